@@ -0,0 +1,76 @@
+#include "benchmark.h"
+#include "framearena.h"
+
+#include <cstdio>
+
+#include <QElapsedTimer>
+
+double Benchmark::run(const QString& name, const std::function<void()>& body, double items, double bytes)
+{
+  // прогрев: кэши, пулы потоков, ленивые выделения памяти
+  body();
+  double best = 0.0;
+  for ( int repeat = 0; repeat < kRepeats; repeat++ ) {
+    QElapsedTimer timer;
+    timer.start();
+    qint64 iterations = 0;
+    do {
+      body();
+      iterations++;
+    } while ( timer.elapsed() < kMinTimeMs );
+    double ns = double(timer.nsecsElapsed()) / double(iterations);
+    if ( repeat == 0 || ns < best ) {
+      best = ns;
+    }
+  }
+  qint64 allocations = FrameArena::heapAllocations();
+  if ( allocations >= 0 ) {
+    body();
+    allocations = FrameArena::heapAllocations() - allocations;
+  }
+  double perItem = best / items;
+  std::printf("  %-52s %12.1f ns/call %10.2f ns/item", qPrintable(name), best, perItem);
+  if ( bytes > 0.0 ) {
+    std::printf(" %9.1f MB/s", bytes * 1.0e3 / best);
+  }
+  if ( allocations >= 0 ) {
+    std::printf(" %9lld allocs", static_cast<long long>(allocations));
+  }
+  std::printf("\n");
+  return best;
+}
+
+void Benchmark::section(const QString& title)
+{
+  std::printf("\n%s\n", qPrintable(title));
+}
+
+void Benchmark::note(const QString& text)
+{
+  std::printf("  %s\n", qPrintable(text));
+}
+
+BenchmarkGroup::BenchmarkGroup(const QString& name, void (*function)())
+{
+  groups().append(Entry{name, function});
+}
+
+int BenchmarkGroup::runAll(const QString& filter)
+{
+  int count = 0;
+  for ( const auto& entry : groups() ) {
+    if ( !filter.isEmpty() && !entry.name.contains(filter) ) {
+      continue;
+    }
+    Benchmark::section(QString("== %1 ==").arg(entry.name));
+    entry.function();
+    count++;
+  }
+  return count;
+}
+
+QVector<BenchmarkGroup::Entry>& BenchmarkGroup::groups()
+{
+  static QVector<Entry> entries;
+  return entries;
+}
@@ -0,0 +1,42 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <functional>
+
+#include <QString>
+#include <QVector>
+
+// Замер: тело повторяется, пока суммарное время не превысит kMinTimeMs,
+// в отчёт идёт лучшее время одного повтора из kRepeats таких серий.
+// Обращения к куче считаются по отдельному вызову после замеров.
+class Benchmark
+{
+public:
+  static const int kRepeats = 5;
+  static const int kMinTimeMs = 100;
+
+  // items - сколько единиц работы в одном вызове body (задач, элементов, треугольников),
+  // bytes - сколько входных данных он разбирает (для MB/s). Обращения к куче за вызов
+  // из потока замера печатаются, если собран счётчик FrameArena::heapAllocations()
+  static double run(const QString& name, const std::function<void()>& body, double items = 1.0, double bytes = 0.0);
+  static void section(const QString& title);
+  static void note(const QString& text);
+};
+
+// группа замеров регистрируется статическим объектом в своём .cpp
+class BenchmarkGroup
+{
+public:
+  BenchmarkGroup(const QString& name, void (*function)());
+
+  static int runAll(const QString& filter);
+
+private:
+  struct Entry {
+    QString name;
+    void (*function)();
+  };
+  static QVector<Entry>& groups();
+};
+
+#endif // BENCHMARK_H
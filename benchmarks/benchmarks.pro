@@ -0,0 +1,85 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = benchmarks
+TEMPLATE = app
+DESTDIR = ~/build_dir/opengl
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+# Benchmark::run печатает обращения к куче за вызов (счётчик подменяет malloc, только glibc)
+DEFINES += HEAP_ALLOCATION_COUNTER
+
+# код движка берётся из основного проекта как есть
+INCLUDEPATH += ../opengl1
+# шейдеры для сравнения программного растеризатора с GL
+DEFINES += BENCHMARK_SHADER_DIR=\\\"$$PWD/../opengl1/shaders\\\"
+# модели для замеров сжатия геометрии
+DEFINES += BENCHMARK_MODEL_DIR=\\\"$$PWD/../opengl1/models\\\"
+
+SOURCES += \
+        main.cpp \
+        benchmark.cpp \
+    jobsystembenchmark.cpp \
+    simdmathbenchmark.cpp \
+    transformbenchmark.cpp \
+    scenebenchmark.cpp \
+    rasterizerbenchmark.cpp \
+    framegraphbenchmark.cpp \
+    geometrycodecbenchmark.cpp \
+    loaderbenchmark.cpp \
+    rendersetupbenchmark.cpp \
+    ../opengl1/jobsystem.cpp \
+    ../opengl1/simdmath.cpp \
+    ../opengl1/camera.cpp \
+    ../opengl1/transformhierarchy.cpp \
+    ../opengl1/structs.cpp \
+    ../opengl1/scene.cpp \
+    ../opengl1/rasterizer.cpp \
+    ../opengl1/cpuscene.cpp \
+    ../opengl1/tonemap.cpp \
+    ../opengl1/assetarchive.cpp \
+    ../opengl1/oglobject.cpp \
+    ../opengl1/outofcoremodel.cpp \
+    ../opengl1/occlusionculler.cpp \
+    ../opengl1/mesh.cpp \
+    ../opengl1/material.cpp \
+    ../opengl1/texturestreamer.cpp \
+    ../opengl1/gpumemory.cpp \
+    ../opengl1/meshsimplifier.cpp \
+    ../opengl1/meshlet.cpp \
+    ../opengl1/indexoptimizer.cpp \
+    ../opengl1/framearena.cpp \
+    ../opengl1/framegraph.cpp \
+    ../opengl1/framesetup.cpp \
+    ../opengl1/geometrycodec.cpp
+
+HEADERS += \
+        benchmark.h \
+    ../opengl1/jobsystem.h \
+    ../opengl1/simdmath.h \
+    ../opengl1/camera.h \
+    ../opengl1/transformhierarchy.h \
+    ../opengl1/structs.h \
+    ../opengl1/scene.h \
+    ../opengl1/simd4.h \
+    ../opengl1/rasterizer.h \
+    ../opengl1/cpuscene.h \
+    ../opengl1/tonemap.h \
+    ../opengl1/assetarchive.h \
+    ../opengl1/oglobject.h \
+    ../opengl1/outofcoremodel.h \
+    ../opengl1/occlusionculler.h \
+    ../opengl1/mesh.h \
+    ../opengl1/material.h \
+    ../opengl1/texturestreamer.h \
+    ../opengl1/gpumemory.h \
+    ../opengl1/meshsimplifier.h \
+    ../opengl1/meshlet.h \
+    ../opengl1/indexoptimizer.h \
+    ../opengl1/framearena.h \
+    ../opengl1/framegraph.h \
+    ../opengl1/framesetup.h \
+    ../opengl1/geometrycodec.h
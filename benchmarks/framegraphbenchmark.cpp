@@ -0,0 +1,167 @@
+#include "benchmark.h"
+#include "framegraph.h"
+#include "framesetup.h"
+
+static const int kWidth = 3840;
+static const int kHeight = 2160;
+static const int kShadowResolution = 2048;
+static const int kBloomLevels = 5;
+static const char* kBloomDown[kBloomLevels]{"bloom down 1/2", "bloom down 1/4", "bloom down 1/8",
+                                            "bloom down 1/16", "bloom down 1/32"};
+static const char* kBloomUp[kBloomLevels]{"bloom up 1/2", "bloom up 1/4", "bloom up 1/8",
+                                          "bloom up 1/16", "bloom up 1/32"};
+
+// отложенное освещение в 4K, какое получится, когда проходы появятся в paintGL;
+// отладочный вывод нормалей и вектора движения без TAA никто не читает
+static void describeFrame(FrameGraph& graph)
+{
+  typedef FrameGraph::TextureDesc Desc;
+  graph.reset();
+  int backbuffer = graph.importFramebuffer("backbuffer", 0, Desc{kWidth, kHeight, FrameGraph::Rgba8});
+  int shadowMap = graph.importTexture("shadow map", 0, Desc{kShadowResolution, kShadowResolution, FrameGraph::Depth24});
+  int depth = graph.createTexture("depth", Desc{kWidth, kHeight, FrameGraph::Depth24Stencil8});
+  int albedo = graph.createTexture("albedo", Desc{kWidth, kHeight, FrameGraph::Rgba8});
+  int normal = graph.createTexture("normal", Desc{kWidth, kHeight, FrameGraph::Rg16F});
+  int material = graph.createTexture("material", Desc{kWidth, kHeight, FrameGraph::Rgba8});
+  int velocity = graph.createTexture("velocity", Desc{kWidth, kHeight, FrameGraph::Rg16F});
+  int ao = graph.createTexture("ao", Desc{kWidth, kHeight, FrameGraph::R8});
+  int aoBlurX = graph.createTexture("ao blur x", Desc{kWidth, kHeight, FrameGraph::R8});
+  int aoBlurred = graph.createTexture("ao blurred", Desc{kWidth, kHeight, FrameGraph::R8});
+  int hdr = graph.createTexture("hdr", Desc{kWidth, kHeight, FrameGraph::Rgba16F});
+  int ldr = graph.createTexture("ldr", Desc{kWidth, kHeight, FrameGraph::Rgba8});
+  int debug = graph.createTexture("debug normals", Desc{kWidth, kHeight, FrameGraph::Rgba8});
+
+  int pass = graph.addPass("shadows", nullptr);
+  graph.write(pass, shadowMap);
+  pass = graph.addPass("depth prepass", nullptr);
+  graph.write(pass, depth);
+  pass = graph.addPass("g-buffer", nullptr);
+  graph.read(pass, depth);
+  graph.write(pass, depth);
+  graph.write(pass, albedo);
+  graph.write(pass, normal);
+  graph.write(pass, material);
+  pass = graph.addPass("motion vectors", nullptr);
+  graph.read(pass, depth);
+  graph.write(pass, velocity);
+  pass = graph.addPass("ssao", nullptr);
+  graph.read(pass, depth);
+  graph.read(pass, normal);
+  graph.write(pass, ao);
+  pass = graph.addPass("ssao blur x", nullptr);
+  graph.read(pass, ao);
+  graph.write(pass, aoBlurX);
+  pass = graph.addPass("ssao blur y", nullptr);
+  graph.read(pass, aoBlurX);
+  graph.write(pass, aoBlurred);
+  pass = graph.addPass("lighting", nullptr);
+  for ( int input : { depth, albedo, normal, material, aoBlurred, shadowMap } ) {
+    graph.read(pass, input);
+  }
+  graph.write(pass, hdr);
+  pass = graph.addPass("sky", nullptr);
+  graph.read(pass, depth);
+  graph.read(pass, hdr);
+  graph.write(pass, hdr);
+  pass = graph.addPass("debug normals", nullptr);
+  graph.read(pass, normal);
+  graph.write(pass, debug);
+
+  int source = hdr;
+  int down[kBloomLevels];
+  for ( int i = 0; i < kBloomLevels; i++ ) {
+    Desc level{kWidth >> (i + 1), kHeight >> (i + 1), FrameGraph::R11G11B10F};
+    down[i] = graph.createTexture(kBloomDown[i], level);
+    pass = graph.addPass(kBloomDown[i], nullptr);
+    graph.read(pass, source);
+    graph.write(pass, down[i]);
+    source = down[i];
+  }
+  for ( int i = kBloomLevels - 2; i >= 0; i-- ) {
+    Desc level{kWidth >> (i + 1), kHeight >> (i + 1), FrameGraph::R11G11B10F};
+    int up = graph.createTexture(kBloomUp[i], level);
+    pass = graph.addPass(kBloomUp[i], nullptr);
+    graph.read(pass, source);
+    graph.read(pass, down[i]);
+    graph.write(pass, up);
+    source = up;
+  }
+  pass = graph.addPass("tonemap", nullptr);
+  graph.read(pass, hdr);
+  graph.read(pass, source);
+  graph.write(pass, ldr);
+  pass = graph.addPass("fxaa", nullptr);
+  graph.read(pass, ldr);
+  graph.write(pass, backbuffer);
+}
+
+// граф, который каждый кадр собирает OpenglWidget, без контекста GL: все сочетания
+// настроек должны компилироваться без цикла и выполнять все проходы, у которых есть результат
+static void widgetFrameBenchmarks()
+{
+  static const int kSizes[][2] = { {1920, 1080}, {3840, 2160}, {64, 48} };
+  static const float kScales[] = { 1.0f, 0.5f };
+  FrameGraph graph;
+  FrameSetup::Settings settings;
+  Benchmark::section("OpenglWidget frame (FrameSetup)");
+  int failed = 0;
+  int checked = 0;
+  for ( const auto& size : kSizes ) {
+    for ( float scale : kScales ) {
+      for ( int flags = 0; flags < 8; flags++ ) {
+        settings.targetWidth = size[0];
+        settings.targetHeight = size[1];
+        settings.sceneWidth = qMax(1, int(size[0] * scale + 0.5f));
+        settings.sceneHeight = qMax(1, int(size[1] * scale + 0.5f));
+        settings.bloom = flags & 1;
+        settings.debugDraw = flags & 2;
+        settings.shadowMap = flags & 4;
+        settings.shadowResolution = kShadowResolution;
+        FrameSetup::declare(graph, settings, nullptr);
+        // без карты теней проход "shadows" ничего не пишет и отбрасывается
+        int culled = settings.shadowMap ? 0 : 1;
+        bool ok = graph.compile() && graph.culledPasses() == culled && graph.executedCount() == graph.passCount() - culled;
+        if ( !ok ) {
+          failed++;
+          Benchmark::note(QString("FAILED %1x%2 scale %3 bloom %4 debug %5 shadows %6").arg(size[0]).arg(size[1])
+                          .arg(double(scale)).arg(settings.bloom).arg(settings.debugDraw).arg(settings.shadowMap));
+        }
+        checked++;
+      }
+    }
+  }
+  Benchmark::note(QString("%1 of %2 configurations compiled").arg(checked - failed).arg(checked));
+  settings.targetWidth = 1920;
+  settings.targetHeight = 1080;
+  settings.sceneWidth = 1920;
+  settings.sceneHeight = 1080;
+  settings.bloom = true;
+  settings.debugDraw = true;
+  settings.shadowMap = true;
+  FrameSetup::declare(graph, settings, nullptr);
+  graph.compile();
+  Benchmark::run("FrameSetup::declare + compile, 1920x1080", [&] {
+    FrameSetup::declare(graph, settings, nullptr);
+    graph.compile();
+  }, graph.passCount());
+  Benchmark::note(graph.report());
+}
+
+static void frameGraphBenchmarks()
+{
+  FrameGraph graph;
+  describeFrame(graph);
+  graph.compile();
+  Benchmark::section(QString("%1x%2 deferred frame, %3 passes").arg(kWidth).arg(kHeight).arg(graph.passCount()));
+  Benchmark::run("FrameGraph: describe + compile", [&] {
+    describeFrame(graph);
+    graph.compile();
+  }, graph.passCount());
+  Benchmark::note(graph.report());
+  Benchmark::note(QString("aliasing saves %1% of transient memory")
+                  .arg(100.0 * double(graph.transientBytes() - graph.aliasedBytes()) / double(graph.transientBytes()),
+                       0, 'f', 1));
+  widgetFrameBenchmarks();
+}
+
+static BenchmarkGroup frameGraphGroup("framegraph", frameGraphBenchmarks);
@@ -0,0 +1,142 @@
+#include "benchmark.h"
+#include "geometrycodec.h"
+#include "oglobject.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+static const int kGridSizes[] = { 64, 256, 512 };
+
+// сетка-рельеф как её отдал бы разбор obj: по три вершины на треугольник, без общих
+static void buildGrid(int size, QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  auto vertex = [size]( int x, int z ) {
+    float u = float(x) / size;
+    float v = float(z) / size;
+    float height = 0.1f * std::sin(u * 17.0f) * std::cos(v * 13.0f);
+    QVector3D normal{-1.7f * std::cos(u * 17.0f) * std::cos(v * 13.0f), 1.0f,
+                     1.3f * std::sin(u * 17.0f) * std::sin(v * 13.0f)};
+    return Vertex(QVector3D{u * 10.0f, height, v * 10.0f}, QVector2D{u, v}, normal.normalized());
+  };
+  vertexes.clear();
+  indexes.clear();
+  for ( int z = 0; z < size; z++ ) {
+    for ( int x = 0; x < size; x++ ) {
+      for ( const auto& corner : { vertex(x, z), vertex(x, z + 1), vertex(x + 1, z),
+                                   vertex(x + 1, z), vertex(x, z + 1), vertex(x + 1, z + 1) } ) {
+        indexes.append(GLuint(vertexes.size()));
+        vertexes.append(corner);
+      }
+    }
+  }
+}
+
+// сборка как в OGLObject::bake: склейка, порядок под кэш и обход, LOD, касательные
+static void measure(const QString& title, std::vector< std::shared_ptr<Mesh> >& meshes)
+{
+  QVector<Vertex> vertexes;
+  QVector<GLuint> indexes;
+  for ( const auto& mesh : meshes ) {
+    int base = vertexes.size();
+    vertexes += mesh->builtVertexes();
+    for ( GLuint index : mesh->builtIndexes() ) {
+      indexes.append(GLuint(base) + index);
+    }
+  }
+  double vertexBytes = double(vertexes.size()) * sizeof(Vertex);
+  double indexBytes = double(indexes.size()) * sizeof(GLuint);
+  Benchmark::section(QString("%1: %2 vertexes, %3 indexes, %4 KB raw").arg(title).arg(vertexes.size())
+                     .arg(indexes.size()).arg(qint64(vertexBytes + indexBytes) / 1024));
+
+  QByteArray encodedVertexes = GeometryCodec::encodeVertexes(vertexes.constData(), vertexes.size(), int(sizeof(Vertex)));
+  QByteArray encodedIndexes = GeometryCodec::encodeIndexes(indexes.constData(), indexes.size());
+  GeometryCodec::Compression compression = GeometryCodec::Deflate;
+  QByteArray deflatedVertexes = GeometryCodec::compress(encodedVertexes, compression);
+  GeometryCodec::Compression vertexCompression = compression;
+  compression = GeometryCodec::Deflate;
+  QByteArray deflatedIndexes = GeometryCodec::compress(encodedIndexes, compression);
+  GeometryCodec::Compression indexCompression = compression;
+  QByteArray rawDeflated = qCompress(QByteArray::fromRawData(reinterpret_cast<const char*>(vertexes.constData()),
+                                                             int(vertexBytes)));
+  Benchmark::note(QString("vertexes: codec x%1, codec + deflate x%2, deflate only x%3")
+                  .arg(vertexBytes / encodedVertexes.size(), 0, 'f', 2)
+                  .arg(vertexBytes / deflatedVertexes.size(), 0, 'f', 2)
+                  .arg(vertexBytes / rawDeflated.size(), 0, 'f', 2));
+  Benchmark::note(QString("indexes: codec x%1 (%2 bytes/index), codec + deflate x%3")
+                  .arg(indexBytes / encodedIndexes.size(), 0, 'f', 2)
+                  .arg(double(encodedIndexes.size()) / indexes.size(), 0, 'f', 2)
+                  .arg(indexBytes / deflatedIndexes.size(), 0, 'f', 2));
+
+  QVector<Vertex> decodedVertexes(vertexes.size());
+  QVector<GLuint> decodedIndexes(indexes.size());
+  bool ok = true;
+  auto gbps = []( double bytes, double ns ) { return QString::number(bytes / ns, 'f', 2); };
+  double ns = Benchmark::run("copy raw vertexes (memcpy)", [&] {
+    std::memcpy(decodedVertexes.data(), vertexes.constData(), size_t(vertexBytes));
+  }, vertexes.size());
+  Benchmark::note(QString("-> %1 GB/s").arg(gbps(vertexBytes, ns)));
+  ns = Benchmark::run(QString("decode vertexes (%1)").arg(GeometryCodec::backend()), [&] {
+    ok = GeometryCodec::decodeVertexes(reinterpret_cast<const uchar*>(encodedVertexes.constData()), encodedVertexes.size(),
+                                       decodedVertexes.data(), vertexes.size(), int(sizeof(Vertex))) && ok;
+  }, vertexes.size());
+  Benchmark::note(QString("-> %1 GB/s of vertexes").arg(gbps(vertexBytes, ns)));
+  ns = Benchmark::run("decode indexes", [&] {
+    ok = GeometryCodec::decodeIndexes(reinterpret_cast<const uchar*>(encodedIndexes.constData()), encodedIndexes.size(),
+                                      decodedIndexes.data(), indexes.size(), vertexes.size()) && ok;
+  }, indexes.size());
+  Benchmark::note(QString("-> %1 GB/s of indexes").arg(gbps(indexBytes, ns)));
+  ns = Benchmark::run("inflate + decode vertexes and indexes", [&] {
+    QByteArray stream;
+    ok = GeometryCodec::uncompress(reinterpret_cast<const uchar*>(deflatedVertexes.constData()), deflatedVertexes.size(),
+                                   vertexCompression, stream)
+         && GeometryCodec::decodeVertexes(reinterpret_cast<const uchar*>(stream.constData()), stream.size(),
+                                          decodedVertexes.data(), vertexes.size(), int(sizeof(Vertex)))
+         && GeometryCodec::uncompress(reinterpret_cast<const uchar*>(deflatedIndexes.constData()), deflatedIndexes.size(),
+                                      indexCompression, stream)
+         && GeometryCodec::decodeIndexes(reinterpret_cast<const uchar*>(stream.constData()), stream.size(),
+                                         decodedIndexes.data(), indexes.size(), vertexes.size()) && ok;
+  }, vertexes.size());
+  Benchmark::note(QString("-> %1 GB/s of geometry").arg(gbps(vertexBytes + indexBytes, ns)));
+  Benchmark::run("encode vertexes and indexes", [&] {
+    encodedVertexes = GeometryCodec::encodeVertexes(vertexes.constData(), vertexes.size(), int(sizeof(Vertex)));
+    encodedIndexes = GeometryCodec::encodeIndexes(indexes.constData(), indexes.size());
+  }, vertexes.size());
+
+  ok = ok && std::memcmp(decodedVertexes.constData(), vertexes.constData(), size_t(vertexBytes)) == 0
+       && decodedIndexes == indexes;
+  Benchmark::note(ok ? "round trip: exact" : "round trip: MISMATCH");
+}
+
+static void geometryCodecBenchmarks()
+{
+  for ( int size : kGridSizes ) {
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+    buildGrid(size, vertexes, indexes);
+    std::vector< std::shared_ptr<Mesh> > meshes{std::make_shared<Mesh>()};
+    meshes.front()->setMaterial(std::make_shared<Material>(QString("grid")));
+    meshes.front()->build(vertexes, indexes);
+    measure(QString("grid %1x%1").arg(size), meshes);
+  }
+
+  QString path = QString(BENCHMARK_MODEL_DIR) + "/sphere/misha.obj";
+  QStringList mtlLibraries;
+  QVector<OGLObject::ObjMesh> objMeshes;
+  if ( !OGLObject::parse(path, mtlLibraries, objMeshes) ) {
+    Benchmark::note(QString("%1 not loaded").arg(path));
+    return;
+  }
+  std::vector< std::shared_ptr<Mesh> > meshes;
+  for ( auto& objMesh : objMeshes ) {
+    auto mesh = std::make_shared<Mesh>();
+    if ( !objMesh.material.isEmpty() ) {
+      mesh->setMaterial(std::make_shared<Material>(objMesh.material));
+    }
+    mesh->build(objMesh.vertexes, objMesh.indexes);
+    meshes.push_back(mesh);
+  }
+  measure("models/sphere/misha.obj", meshes);
+}
+
+static BenchmarkGroup geometryCodecGroup("geometry codec", geometryCodecBenchmarks);
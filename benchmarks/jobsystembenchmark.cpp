@@ -0,0 +1,107 @@
+#include "benchmark.h"
+#include "jobsystem.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include <QThread>
+
+static const int kChildJobs = 4000;
+static const int kScalingElements = 1 << 20;
+static const int kNestedOuter = 64;
+static const int kNestedInner = 4096;
+
+// немного арифметики на элемент, чтобы замер не упирался в память
+static void scalingBody(std::vector<float>& data, int begin, int end)
+{
+  for ( int i = begin; i < end; i++ ) {
+    float x = float(i) * 0.001f;
+    data[size_t(i)] = std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+  }
+}
+
+static QVector<int> workerCounts()
+{
+  QVector<int> counts;
+  int maxWorkers = qMax(1, QThread::idealThreadCount() - 1);
+  for ( int workers = 1; workers < maxWorkers; workers *= 2 ) {
+    counts.append(workers);
+  }
+  counts.append(maxWorkers);
+  return counts;
+}
+
+static void overheadBenchmarks()
+{
+  JobSystem jobs;
+  Benchmark::note(QString("%1 threads").arg(jobs.threadCount()));
+
+  Benchmark::run("empty job: create + run + wait", [&jobs] {
+    Job* job = jobs.create([] {});
+    jobs.run(job);
+    jobs.wait(job);
+  });
+
+  std::atomic<int> counter{0};
+  Benchmark::run(QString("%1 child jobs of one root").arg(kChildJobs), [&jobs, &counter] {
+    Job* root = jobs.create([] {});
+    for ( int i = 0; i < kChildJobs; i++ ) {
+      jobs.run(jobs.create([&counter] { counter.fetch_add(1, std::memory_order_relaxed); }, root));
+    }
+    jobs.run(root);
+    jobs.wait(root);
+  }, kChildJobs);
+
+  Benchmark::run(QString("parallelFor %1 empty items, grain 1").arg(kChildJobs), [&jobs] {
+    jobs.parallelFor(kChildJobs, 1, []( int, int ) {});
+  }, kChildJobs);
+
+  std::atomic<qint64> sum{0};
+  Benchmark::run(QString("nested parallelFor %1 x %2").arg(kNestedOuter).arg(kNestedInner), [&jobs, &sum] {
+    jobs.parallelFor(kNestedOuter, 1, [&jobs, &sum]( int begin, int end ) {
+      for ( int i = begin; i < end; i++ ) {
+        jobs.parallelFor(kNestedInner, [&sum]( int innerBegin, int innerEnd ) {
+          sum.fetch_add(innerEnd - innerBegin, std::memory_order_relaxed);
+        });
+      }
+    });
+  }, double(kNestedOuter) * kNestedInner);
+
+  Benchmark::run("main thread queue: post + drain", [&jobs] {
+    Job* job = jobs.create([&jobs] { jobs.runOnMainThread([] {}); });
+    jobs.run(job);
+    jobs.wait(job);
+    jobs.processMainThreadJobs();
+  });
+  Benchmark::note(QString("executed %1 jobs, stolen %2").arg(jobs.jobsExecuted()).arg(jobs.jobsStolen()));
+}
+
+static void scalingBenchmarks()
+{
+  std::vector<float> data(kScalingElements);
+  double serial = Benchmark::run("serial loop", [&data] {
+    scalingBody(data, 0, kScalingElements);
+  }, kScalingElements);
+
+  for ( int workers : workerCounts() ) {
+    JobSystem jobs(workers);
+    double time = Benchmark::run(QString("parallelFor, %1 threads, auto grain").arg(jobs.threadCount()), [&jobs, &data] {
+      jobs.parallelFor(kScalingElements, [&data]( int begin, int end ) {
+        scalingBody(data, begin, end);
+      });
+    }, kScalingElements);
+    Benchmark::note(QString("speedup %1x, stolen %2 of %3 jobs")
+                    .arg(serial / time, 0, 'f', 2).arg(jobs.jobsStolen()).arg(jobs.jobsExecuted()));
+  }
+}
+
+static void jobSystemBenchmarks()
+{
+  Benchmark::section("task overhead");
+  overheadBenchmarks();
+  Benchmark::section("scaling");
+  scalingBenchmarks();
+}
+
+static BenchmarkGroup jobSystemGroup("jobsystem", jobSystemBenchmarks);
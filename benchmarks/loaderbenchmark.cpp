@@ -0,0 +1,133 @@
+#include "benchmark.h"
+#include "mesh.h"
+#include "oglobject.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+#include <QDir>
+#include <QFile>
+
+// стороны сетки obj: от пары сотен треугольников до полумиллиона
+static const int kObjGridSizes[] = { 16, 128, 512 };
+static const int kMtlMaterialCounts[] = { 4, 256, 8192 };
+static const int kTbnTriangleCounts[] = { 1000, 64000, 512000 };
+
+static void appendLine(QByteArray& text, const char* format, ...)
+{
+  char line[128];
+  va_list arguments;
+  va_start(arguments, format);
+  int size = std::vsnprintf(line, sizeof(line), format, arguments);
+  va_end(arguments);
+  text.append(line, size);
+}
+
+// сетка-рельеф в формате, который пишут экспортёры: v/vt/vn на узел, грани v/vt/vn
+static QByteArray objText(int size)
+{
+  QByteArray text("# benchmark grid\nmtllib grid.mtl\no grid\n");
+  int row = size + 1;
+  for ( int z = 0; z <= size; z++ ) {
+    for ( int x = 0; x <= size; x++ ) {
+      float u = float(x) / size;
+      float v = float(z) / size;
+      appendLine(text, "v %.6f %.6f %.6f\n", u * 10.0, 0.3 * std::sin(u * 17.0) * std::cos(v * 13.0), v * 10.0);
+      appendLine(text, "vt %.6f %.6f\n", double(u), double(v));
+      appendLine(text, "vn %.6f %.6f %.6f\n", -0.3 * std::cos(u * 17.0), 0.9, 0.3 * std::sin(v * 13.0));
+    }
+  }
+  text.append("usemtl grid\n");
+  for ( int z = 0; z < size; z++ ) {
+    for ( int x = 0; x < size; x++ ) {
+      int a = z * row + x + 1;
+      int b = a + row;
+      appendLine(text, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, a + 1, a + 1, a + 1);
+      appendLine(text, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a + 1, a + 1, a + 1, b, b, b, b + 1, b + 1, b + 1);
+    }
+  }
+  return text;
+}
+
+static QByteArray mtlText(int count)
+{
+  QByteArray text("# benchmark materials\n");
+  for ( int i = 0; i < count; i++ ) {
+    text.append(QString("newmtl material%1\n").arg(i).toLatin1());
+    appendLine(text, "Ns %.6f\n", 32.0 + i % 64);
+    appendLine(text, "Ka %.6f %.6f %.6f\n", 1.0, 1.0, 1.0);
+    appendLine(text, "Kd %.6f %.6f %.6f\n", 0.8, 0.5 + (i % 7) * 0.05, 0.2);
+    appendLine(text, "Ks %.6f %.6f %.6f\n", 0.5, 0.5, 0.5);
+    appendLine(text, "Ke %.6f %.6f %.6f\n", 0.0, 0.0, 0.0);
+    text.append("Ni 1.450000\nd 1.000000\nillum 2\n");
+    text.append(QString("map_Kd textures/albedo %1.png\nmap_Bump textures/normal %1.png\n").arg(i).toLatin1());
+  }
+  return text;
+}
+
+// треугольники без индексов, как их отдаёт разбор obj до склейки
+static QVector<Vertex> triangleSoup(int triangles)
+{
+  QVector<Vertex> vertexes;
+  vertexes.reserve(triangles * 3);
+  int side = int(std::sqrt(float(triangles / 2))) + 1;
+  for ( int i = 0; i < triangles; i++ ) {
+    float x = float(i / 2 % side);
+    float z = float(i / 2 / side);
+    float flip = float(i % 2);
+    QVector3D normal{0.0f, 1.0f, 0.0f};
+    vertexes.append(Vertex(QVector3D{x + flip, 0.0f, z}, QVector2D{(x + flip) / side, z / side}, normal));
+    vertexes.append(Vertex(QVector3D{x, 0.1f * flip, z + 1.0f}, QVector2D{x / side, (z + 1.0f) / side}, normal));
+    vertexes.append(Vertex(QVector3D{x + 1.0f, 0.0f, z + flip}, QVector2D{(x + 1.0f) / side, (z + flip) / side}, normal));
+  }
+  return vertexes;
+}
+
+static void loaderBenchmarks()
+{
+  QString directory = QDir::tempPath();
+  for ( int size : kObjGridSizes ) {
+    QByteArray text = objText(size);
+    int faces = size * size * 2;
+    QString path = QDir(directory).filePath(QString("opengl1-benchmark-%1.obj").arg(size));
+    QFile file{path};
+    if ( !file.open(QFile::WriteOnly) || file.write(text) != text.size() ) {
+      Benchmark::note(QString("%1 not written").arg(path));
+      return;
+    }
+    file.close();
+    Benchmark::section(QString("obj %1x%1 grid: %2 faces, %3 KB").arg(size).arg(faces).arg(text.size() / 1024));
+    QVector<OGLObject::ObjMesh> meshes;
+    Benchmark::run("OGLObject::parse (read + tokenize + assemble)", [&] {
+      QStringList mtlLibraries;
+      meshes.clear();
+      OGLObject::parse(path, mtlLibraries, meshes);
+    }, faces, text.size());
+    int vertexes = meshes.isEmpty() ? 0 : meshes.first().vertexes.size();
+    Benchmark::note(QString("%1 meshes, %2 vertexes").arg(meshes.size()).arg(vertexes));
+    QFile::remove(path);
+  }
+
+  for ( int count : kMtlMaterialCounts ) {
+    QByteArray text = mtlText(count);
+    Benchmark::section(QString("mtl: %1 materials, %2 KB").arg(count).arg(text.size() / 1024));
+    int parsed = 0;
+    Benchmark::run("OGLObject::parseMtl", [&] {
+      parsed = OGLObject::parseMtl(text, directory).size();
+    }, count, text.size());
+    Benchmark::note(QString("%1 materials parsed").arg(parsed));
+  }
+
+  for ( int triangles : kTbnTriangleCounts ) {
+    QVector<Vertex> vertexes = triangleSoup(triangles);
+    Benchmark::section(QString("tangents: %1 triangles").arg(triangles));
+    Benchmark::run("Mesh::calculateTBN", [&] {
+      Mesh::calculateTBN(vertexes);
+    }, triangles, double(vertexes.size()) * sizeof(Vertex));
+    Benchmark::note(QString("first tangent (%1, %2, %3)").arg(double(vertexes.first().tangent.x()))
+                    .arg(double(vertexes.first().tangent.y())).arg(double(vertexes.first().tangent.z())));
+  }
+}
+
+static BenchmarkGroup loaderGroup("loader", loaderBenchmarks);
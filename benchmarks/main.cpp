@@ -0,0 +1,27 @@
+#include "benchmark.h"
+
+#include <cstdio>
+#include <memory>
+
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QStringList>
+
+// Использование: benchmarks [--gl] [часть имени группы]
+// --gl - замеры, которым нужен контекст GL (QGuiApplication; без экрана - QT_QPA_PLATFORM=offscreen)
+int main(int argc, char *argv[])
+{
+  bool gl = false;
+  for ( int i = 1; i < argc; i++ ) {
+    gl = gl || QString(argv[i]) == "--gl";
+  }
+  std::unique_ptr<QCoreApplication> application(gl ? new QGuiApplication(argc, argv) : new QCoreApplication(argc, argv));
+  QStringList arguments = application->arguments();
+  arguments.removeAll(QString("--gl"));
+  QString filter = arguments.size() > 1 ? arguments.at(1) : QString();
+  if ( BenchmarkGroup::runAll(filter) == 0 ) {
+    std::printf("no benchmark group matches \"%s\"\n", qPrintable(filter));
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+#include "benchmark.h"
+#include "rasterizer.h"
+#include "jobsystem.h"
+#include "tonemap.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QSurfaceFormat>
+#include <QtMath>
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+// сетка шаров на полу: kGrid x kGrid, у каждого свои metallic и roughness
+static const int kGrid = 8;
+static const int kSphereRings = 32;
+static const int kSphereSegments = 64;
+static const float kSphereRadius = 0.8f;
+static const float kSpacing = 2.0f;
+static const float kFloorSize = 40.0f;
+static const float kFieldOfView = 45.0f;
+static const QVector3D kEye{0.0f, 6.0f, 16.0f};
+static const QVector3D kLightDirection{0.55f, -1.0f, 1.0f};
+static const QVector3D kLightColor{0.4f, 0.4f, 0.4f};
+
+// меш рисуется одним вызовом со своим материалом; вершины уже в мировых координатах
+struct Draw {
+  int firstIndex;
+  int indexCount;
+  CpuScene::Surface surface;
+};
+
+static void appendSphere(QVector<Vertex>& vertexes, QVector<GLuint>& indexes, const QVector3D& center)
+{
+  GLuint first = GLuint(vertexes.size());
+  for ( int ring = 0; ring <= kSphereRings; ring++ ) {
+    float theta = float(M_PI) * float(ring) / float(kSphereRings);
+    for ( int segment = 0; segment <= kSphereSegments; segment++ ) {
+      float phi = 2.0f * float(M_PI) * float(segment) / float(kSphereSegments);
+      QVector3D normal{std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+      Vertex vertex(center + normal * kSphereRadius,
+                    QVector2D{float(segment) / float(kSphereSegments), float(ring) / float(kSphereRings)}, normal);
+      vertex.tangent = QVector3D{-std::sin(phi), 0.0f, std::cos(phi)};
+      vertex.bitangent = QVector3D::crossProduct(normal, vertex.tangent);
+      vertexes.append(vertex);
+    }
+  }
+  int row = kSphereSegments + 1;
+  for ( int ring = 0; ring < kSphereRings; ring++ ) {
+    for ( int segment = 0; segment < kSphereSegments; segment++ ) {
+      GLuint a = first + GLuint(ring * row + segment);
+      GLuint b = a + GLuint(row);
+      indexes << a << b << a + 1 << a + 1 << b << b + 1;
+    }
+  }
+}
+
+static void appendFloor(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  GLuint first = GLuint(vertexes.size());
+  float half = kFloorSize * 0.5f;
+  float y = -kSphereRadius;
+  for ( int corner = 0; corner < 4; corner++ ) {
+    float u = float(corner & 1);
+    float v = float(corner >> 1);
+    Vertex vertex(QVector3D{(u - 0.5f) * kFloorSize, y, (v - 0.5f) * kFloorSize},
+                  QVector2D{u * half, v * half}, QVector3D{0.0f, 1.0f, 0.0f});
+    vertex.tangent = QVector3D{1.0f, 0.0f, 0.0f};
+    vertex.bitangent = QVector3D{0.0f, 0.0f, 1.0f};
+    vertexes.append(vertex);
+  }
+  indexes << first << first + 2 << first + 1 << first + 1 << first + 2 << first + 3;
+}
+
+static QVector<CpuScene::PointLight> pointLights()
+{
+  QVector<CpuScene::PointLight> lights;
+  const QVector3D positions[] = { {-6.0f, 3.0f, -4.0f}, {6.0f, 3.0f, -4.0f}, {-6.0f, 3.0f, 6.0f}, {6.0f, 3.0f, 6.0f} };
+  const QVector3D colors[] = { {1.0f, 0.8f, 0.6f}, {0.6f, 0.8f, 1.0f}, {1.0f, 1.0f, 1.0f}, {0.8f, 1.0f, 0.8f} };
+  for ( int i = 0; i < 4; i++ ) {
+    CpuScene::PointLight light;
+    light.position = positions[i];
+    light.color = colors[i];
+    lights.append(light);
+  }
+  return lights;
+}
+
+// та же сцена через fPBRShader.frag в контексте GL без окна; с LIBGL_ALWAYS_SOFTWARE=1
+// это llvmpipe. Возвращает кадр, пустое изображение - если контекст не создался
+static QImage glBenchmark(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes, const QVector<Draw>& draws,
+                          const QMatrix4x4& view, const QMatrix4x4& projection)
+{
+  QSurfaceFormat format;
+  format.setVersion(3, 3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  QOffscreenSurface surface;
+  surface.setFormat(format);
+  surface.create();
+  QOpenGLContext context;
+  context.setFormat(format);
+  if ( !surface.isValid() || !context.create() || !context.makeCurrent(&surface) ) {
+    Benchmark::note("gl: no context");
+    return QImage();
+  }
+  QOpenGLFunctions* f = context.functions();
+  Benchmark::note(QString("gl: %1").arg(reinterpret_cast<const char*>(f->glGetString(GL_RENDERER))));
+
+  QImage image;
+  {
+    QOpenGLShaderProgram shader;
+    QString directory = QString(BENCHMARK_SHADER_DIR);
+    if ( !shader.addShaderFromSourceFile(QOpenGLShader::Vertex, directory + "/vPBRShader.vert")
+         || !shader.addShaderFromSourceFile(QOpenGLShader::Fragment, directory + "/fPBRShader.frag")
+         || !shader.link() ) {
+      Benchmark::note(QString("gl: shader not built: %1").arg(shader.log()));
+      return QImage();
+    }
+    // шейдер пишет линейный HDR, тонмаппинг - на CPU тем же оператором, что у растеризатора
+    QOpenGLFramebufferObject target(kWidth, kHeight, QOpenGLFramebufferObject::Depth, GL_TEXTURE_2D, GL_RGBA16F);
+    QOpenGLVertexArrayObject vao;
+    vao.create();
+    vao.bind();
+    QOpenGLBuffer vbo{QOpenGLBuffer::VertexBuffer};
+    vbo.create();
+    vbo.bind();
+    vbo.allocate(vertexes.constData(), vertexes.size() * int(sizeof(Vertex)));
+    QOpenGLBuffer ebo{QOpenGLBuffer::IndexBuffer};
+    ebo.create();
+    ebo.bind();
+    ebo.allocate(indexes.constData(), indexes.size() * int(sizeof(GLuint)));
+
+    // раскладка Vertex, как в Mesh::bind()
+    shader.bind();
+    const char* attributes[] = { "inPos", "inTexCoord", "inNormal", "inTangent", "inBitangent" };
+    const int sizes[] = { 3, 2, 3, 3, 3 };
+    int offset = 0;
+    for ( int i = 0; i < 5; i++ ) {
+      int location = shader.attributeLocation(attributes[i]);
+      if ( location >= 0 ) {
+        shader.enableAttributeArray(location);
+        shader.setAttributeBuffer(location, GL_FLOAT, offset, sizes[i], int(sizeof(Vertex)));
+      }
+      offset += sizes[i] * int(sizeof(float));
+    }
+
+    // освещение как в OpenglWidget::setLightShader(), фонарь выключен, теней нет
+    QMatrix4x4 model;
+    shader.setUniformValue("mvp", projection * view);
+    shader.setUniformValue("model", model);
+    shader.setUniformValue("normalMatrix", model.normalMatrix());
+    shader.setUniformValue("view", view);
+    shader.setUniformValue("viewPos", kEye);
+    shader.setUniformValue("useShadows", false);
+    shader.setUniformValue("lightDir.direction", kLightDirection);
+    shader.setUniformValue("lightDir.diffuse", kLightColor);
+    QVector<CpuScene::PointLight> lights = pointLights();
+    for ( int i = 0; i < lights.size(); i++ ) {
+      QString name = QString("pointLights[%1].").arg(i);
+      shader.setUniformValue(qPrintable(name + "position"), lights.at(i).position);
+      shader.setUniformValue(qPrintable(name + "diffuse"), lights.at(i).color);
+      shader.setUniformValue(qPrintable(name + "constant"), lights.at(i).constant);
+      shader.setUniformValue(qPrintable(name + "linear"), lights.at(i).linear);
+      shader.setUniformValue(qPrintable(name + "quadratic"), lights.at(i).quadratic);
+    }
+    shader.setUniformValue("lamp.diffuse", QVector3D{0.0f, 0.0f, 0.0f});
+    shader.setUniformValue("lamp.constant", 1.0f);
+    for ( const char* flag : { "useAlbedoMap", "useNormalMap", "useMetallicMap", "useRoughnessMap", "useAOMap" } ) {
+      shader.setUniformValue(flag, false);
+    }
+
+    target.bind();
+    f->glViewport(0, 0, kWidth, kHeight);
+    f->glEnable(GL_DEPTH_TEST);
+    f->glClearColor(SoftwareRasterizer::kClearColor, SoftwareRasterizer::kClearColor, SoftwareRasterizer::kClearColor, 1.0f);
+    Benchmark::run(QString("gl: %1x%2 frame").arg(kWidth).arg(kHeight), [&] {
+      f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      for ( const Draw& draw : draws ) {
+        shader.setUniformValue("material.ambientColor", draw.surface.albedo);
+        shader.setUniformValue("material.metallic", draw.surface.metallic);
+        shader.setUniformValue("material.roughness", draw.surface.roughness);
+        shader.setUniformValue("material.ao", draw.surface.ao);
+        f->glDrawElements(GL_TRIANGLES, draw.indexCount, GL_UNSIGNED_INT,
+                          reinterpret_cast<const void*>(size_t(draw.firstIndex) * sizeof(GLuint)));
+      }
+      // время кадра - до конца растеризации, а не до постановки команд в очередь
+      f->glFinish();
+    }, double(kWidth) * kHeight);
+    std::vector<float> hdr(size_t(kWidth) * kHeight * 4);
+    f->glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_FLOAT, hdr.data());
+    image = QImage(kWidth, kHeight, QImage::Format_RGB32);
+    for ( int y = 0; y < kHeight; y++ ) {
+      // строки GL идут снизу вверх
+      const float* source = hdr.data() + size_t(kHeight - 1 - y) * kWidth * 4;
+      QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+      for ( int x = 0; x < kWidth; x++ ) {
+        QVector3D color = Tonemap::apply(QVector3D{source[x * 4], source[x * 4 + 1], source[x * 4 + 2]}, Tonemap::Reinhard);
+        line[x] = qRgb(qBound(0, int(color.x() * 255.0f + 0.5f), 255), qBound(0, int(color.y() * 255.0f + 0.5f), 255),
+                       qBound(0, int(color.z() * 255.0f + 0.5f), 255));
+      }
+    }
+    target.release();
+    vao.release();
+  }
+  context.doneCurrent();
+  return image;
+}
+
+static void rasterizerBenchmarks()
+{
+  QVector<Vertex> vertexes;
+  QVector<GLuint> indexes;
+  QVector<Draw> draws;
+  auto scene = std::make_shared<CpuScene>();
+  {
+    Draw floor;
+    floor.firstIndex = indexes.size();
+    appendFloor(vertexes, indexes);
+    floor.indexCount = indexes.size() - floor.firstIndex;
+    floor.surface.albedo = QVector3D{0.6f, 0.6f, 0.6f};
+    floor.surface.roughness = 0.8f;
+    draws.append(floor);
+  }
+  for ( int row = 0; row < kGrid; row++ ) {
+    for ( int column = 0; column < kGrid; column++ ) {
+      Draw sphere;
+      sphere.firstIndex = indexes.size();
+      float offset = (kGrid - 1) * kSpacing * 0.5f;
+      appendSphere(vertexes, indexes, QVector3D{column * kSpacing - offset, 0.0f, row * kSpacing - offset});
+      sphere.indexCount = indexes.size() - sphere.firstIndex;
+      sphere.surface.albedo = QVector3D{0.9f, 0.3f + 0.5f * row / kGrid, 0.2f};
+      sphere.surface.metallic = float(column) / float(kGrid - 1);
+      sphere.surface.roughness = 0.05f + 0.95f * float(row) / float(kGrid - 1);
+      draws.append(sphere);
+    }
+  }
+  for ( const Draw& draw : draws ) {
+    scene->addMesh(vertexes, indexes.mid(draw.firstIndex, draw.indexCount), QMatrix4x4(), draw.surface);
+  }
+  scene->setDirectionalLight(kLightDirection, kLightColor);
+  for ( const auto& light : pointLights() ) {
+    scene->addPointLight(light);
+  }
+
+  QMatrix4x4 view;
+  view.lookAt(kEye, QVector3D{0.0f, 0.0f, 0.0f}, QVector3D{0.0f, 1.0f, 0.0f});
+  QMatrix4x4 projection;
+  projection.perspective(kFieldOfView, float(kWidth) / float(kHeight), 0.1f, 100.0f);
+
+  Benchmark::section(QString("%1 triangles, %2 draws, %3 point lights").arg(int(scene->triangles().size()))
+                     .arg(draws.size()).arg(scene->pointLights().size()));
+  SoftwareRasterizer rasterizer;
+  rasterizer.setScene(scene);
+  rasterizer.setView(view, projection);
+  rasterizer.setTonemap(Tonemap::Reinhard, 1.0f);
+  rasterizer.resize(kWidth, kHeight);
+  Benchmark::run(QString("software: %1x%2 frame").arg(kWidth).arg(kHeight), [&] {
+    rasterizer.render();
+  }, double(kWidth) * kHeight);
+  Benchmark::note(QString("software: %1, %2 threads, %3 tris binned, %4 pixels shaded")
+                  .arg(SoftwareRasterizer::backend()).arg(JobSystem::instance().threadCount() + 1)
+                  .arg(rasterizer.trianglesBinned()).arg(rasterizer.pixelsShaded()));
+
+  // контекст GL без окна есть только у QGuiApplication (benchmarks --gl)
+  if ( !qobject_cast<QGuiApplication*>(QCoreApplication::instance()) ) {
+    Benchmark::note("gl: skipped, run with --gl (LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe)");
+    return;
+  }
+  QImage gl = glBenchmark(vertexes, indexes, draws, view, projection);
+  if ( gl.isNull() ) {
+    return;
+  }
+  // расхождение с GL: средняя разница каналов и доля пикселей, отличающихся больше чем на 8 из 255
+  const QImage& software = rasterizer.image();
+  double difference = 0.0;
+  int different = 0;
+  for ( int y = 0; y < kHeight; y++ ) {
+    const QRgb* a = reinterpret_cast<const QRgb*>(software.constScanLine(y));
+    const QRgb* b = reinterpret_cast<const QRgb*>(gl.constScanLine(y));
+    for ( int x = 0; x < kWidth; x++ ) {
+      int channels[3] = { std::abs(qRed(a[x]) - qRed(b[x])), std::abs(qGreen(a[x]) - qGreen(b[x])),
+                          std::abs(qBlue(a[x]) - qBlue(b[x])) };
+      difference += channels[0] + channels[1] + channels[2];
+      different += qMax(channels[0], qMax(channels[1], channels[2])) > 8 ? 1 : 0;
+    }
+  }
+  Benchmark::note(QString("software vs gl: mean channel difference %1, %2% pixels differ by more than 8")
+                  .arg(difference / (3.0 * kWidth * kHeight), 0, 'f', 2)
+                  .arg(100.0 * different / (double(kWidth) * kHeight), 0, 'f', 2));
+}
+
+static BenchmarkGroup rasterizerGroup("rasterizer", rasterizerBenchmarks);
@@ -0,0 +1,132 @@
+#include "benchmark.h"
+#include "camera.h"
+#include "simdmath.h"
+#include "structs.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <QPoint>
+
+static const int kCameraCalls = 1000;
+static const int kDrawCounts[] = { 16, 1024, 65536 };
+static const int kLightCounts[] = { 4, 64, 1024 };
+
+static float random(float from, float to)
+{
+  return from + (to - from) * float(std::rand()) / float(RAND_MAX);
+}
+
+static void cameraBenchmarks()
+{
+  Benchmark::section(QString("camera: %1 calls").arg(kCameraCalls));
+  Camera camera;
+  float sum = 0.0f;
+  Benchmark::run("Camera::getView, camera still", [&] {
+    for ( int i = 0; i < kCameraCalls; i++ ) {
+      sum += camera.getView()(0, 3);
+    }
+  }, kCameraCalls);
+  Benchmark::run("Camera::goForward + getView", [&] {
+    for ( int i = 0; i < kCameraCalls; i++ ) {
+      camera.goForward();
+      sum += camera.getView()(0, 3);
+    }
+    camera.setCameraPosition(QVector3D{0.0f, 0.0f, 3.0f});
+  }, kCameraCalls);
+  // движение мыши как в mouseMoveEvent: смещение в несколько пикселей за событие
+  std::vector<QPoint> moves;
+  for ( int i = 0; i < kCameraCalls; i++ ) {
+    moves.push_back(QPoint{std::rand() % 9 - 4, std::rand() % 9 - 4});
+  }
+  Benchmark::run("Camera::rotateCamera", [&] {
+    for ( const auto& move : moves ) {
+      camera.rotateCamera(move);
+    }
+  }, kCameraCalls);
+  Benchmark::run("Camera::rotateCamera + getView", [&] {
+    for ( const auto& move : moves ) {
+      camera.rotateCamera(move);
+      sum += camera.getView()(0, 3);
+    }
+  }, kCameraCalls);
+  Benchmark::note(QString("checksum %1").arg(double(sum), 0, 'g', 3));
+}
+
+// матрицы draw-вызова: viewProjection считается раз за кадр в paintGL,
+// mvp и матрица нормалей - на каждый объект в setTransformUniforms
+static void matrixBenchmarks()
+{
+  QMatrix4x4 projection;
+  projection.perspective(45.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+  Camera camera;
+  for ( int draws : kDrawCounts ) {
+    std::vector<QMatrix4x4> models(static_cast<size_t>(draws));
+    std::vector<Mat4> simdModels(static_cast<size_t>(draws));
+    for ( int i = 0; i < draws; i++ ) {
+      models[size_t(i)].translate(random(-50.0f, 50.0f), random(0.0f, 5.0f), random(-50.0f, 50.0f));
+      models[size_t(i)].rotate(random(0.0f, 360.0f), QVector3D{0.0f, 1.0f, 0.0f});
+      models[size_t(i)].scale(random(0.5f, 2.0f));
+      simdModels[size_t(i)] = SimdMath::fromQt(models[size_t(i)]);
+    }
+    std::vector<ObjectTransform> transforms(static_cast<size_t>(draws));
+    Benchmark::section(QString("matrices: %1 draws").arg(draws));
+    float sum = 0.0f;
+    Benchmark::run("QMatrix4x4: viewProjection * model + normalMatrix", [&] {
+      QMatrix4x4 viewProjection = projection * camera.getView();
+      for ( const auto& model : models ) {
+        QMatrix4x4 mvp = viewProjection * model;
+        QMatrix3x3 normal = model.normalMatrix();
+        sum += mvp(0, 0) + normal(0, 0);
+      }
+    }, draws);
+    Benchmark::run("SimdMath::objectTransforms, one per draw", [&] {
+      Mat4 viewProjection = SimdMath::fromQt(projection * camera.getView());
+      for ( int i = 0; i < draws; i++ ) {
+        Mat4 model = SimdMath::fromQt(models[size_t(i)]);
+        SimdMath::objectTransforms(viewProjection, &model, &transforms[size_t(i)], 1);
+      }
+    }, draws);
+    Benchmark::run("SimdMath::objectTransforms, batched", [&] {
+      Mat4 viewProjection = SimdMath::fromQt(projection * camera.getView());
+      SimdMath::objectTransforms(viewProjection, simdModels.data(), transforms.data(), draws);
+    }, draws);
+    Benchmark::note(QString("checksum %1").arg(double(sum + transforms.back().mvp[0]), 0, 'g', 3));
+  }
+}
+
+// имена uniform-переменных источников в setLightShader: сборка через QString::arg
+// против таблицы, собранной один раз (так делает OpenglWidget)
+static void uniformNameBenchmarks()
+{
+  for ( int lights : kLightCounts ) {
+    Benchmark::section(QString("point light uniforms: %1 lights").arg(lights));
+    int length = 0;
+    Benchmark::run("PointLightUniforms::forLight per light", [&] {
+      for ( int i = 0; i < lights; i++ ) {
+        length += PointLightUniforms::forLight(i).quadratic.size();
+      }
+    }, lights);
+    QVector<PointLightUniforms> table;
+    for ( int i = 0; i < lights; i++ ) {
+      table.append(PointLightUniforms::forLight(i));
+    }
+    Benchmark::run("cached table lookup", [&] {
+      for ( int i = 0; i < lights; i++ ) {
+        const PointLightUniforms& names = table.at(i);
+        length += int(names.position.constData()[0]) + int(names.quadratic.constData()[0]);
+      }
+    }, lights);
+    Benchmark::note(QString("checksum %1").arg(length));
+  }
+}
+
+static void renderSetupBenchmarks()
+{
+  std::srand(1);
+  cameraBenchmarks();
+  matrixBenchmarks();
+  uniformNameBenchmarks();
+}
+
+static BenchmarkGroup renderSetupGroup("render setup", renderSetupBenchmarks);
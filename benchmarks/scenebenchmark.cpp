@@ -0,0 +1,72 @@
+#include "benchmark.h"
+#include "scene.h"
+
+#include <cstdlib>
+
+static const int kSpinning = 1000;
+static const int kChildren = 299;
+static const int kEntities = kSpinning * (kChildren + 1);
+
+static float random(float from, float to)
+{
+  return from + (to - from) * float(std::rand()) / float(RAND_MAX);
+}
+
+static void sceneBenchmarks()
+{
+  // kSpinning вращающихся объектов, под каждым kChildren неподвижных копий
+  std::srand(1);
+  Scene scene;
+  scene.reserve(kEntities);
+  BoundingBox box;
+  box.extend(QVector3D{-0.5f, -0.5f, -0.5f});
+  box.extend(QVector3D{0.5f, 0.5f, 0.5f});
+  for ( int s = 0; s < kSpinning; s++ ) {
+    SpinComponent spin;
+    spin.position = QVector3D{random(-200.0f, 200.0f), 0.0f, random(-200.0f, 200.0f)};
+    spin.angle = random(0.0f, 360.0f);
+    int root = scene.createEntity(QMatrix4x4());
+    scene.spins().add(root, spin);
+    scene.meshRenderers().add(root);
+    scene.setBounds(root, box);
+    for ( int c = 0; c < kChildren; c++ ) {
+      QMatrix4x4 local;
+      local.translate(random(-5.0f, 5.0f), random(0.0f, 2.0f), random(-5.0f, 5.0f));
+      int entity = scene.createEntity(local, root);
+      scene.meshRenderers().add(entity);
+      scene.setBounds(entity, box);
+    }
+  }
+  scene.update();
+
+  Benchmark::section(QString("%1 entities, %2 spinning").arg(kEntities).arg(kSpinning));
+  Benchmark::run("animate + update: everything moves", [&] {
+    scene.animate();
+    scene.update();
+  }, kEntities);
+  Benchmark::run("update: nothing moved", [&] {
+    scene.update();
+  }, kEntities);
+
+  // проход отсечения как в DrawListBuilder: по массиву рендереров, сфера из BoundsComponent
+  QMatrix4x4 projection;
+  projection.perspective(45.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+  QMatrix4x4 view;
+  view.lookAt(QVector3D{0.0f, 50.0f, 250.0f}, QVector3D{0.0f, 0.0f, 0.0f}, QVector3D{0.0f, 1.0f, 0.0f});
+  Frustum frustum(projection * view);
+  int visible = 0;
+  Benchmark::run("cull: renderers against frustum", [&] {
+    visible = 0;
+    const ComponentArray<MeshRendererComponent>& renderers = scene.meshRenderers();
+    const ComponentArray<BoundsComponent>& bounds = scene.bounds();
+    for ( int i = 0; i < renderers.size(); i++ ) {
+      const BoundsComponent* sphere = bounds.find(renderers.entity(i));
+      if ( sphere && frustum.intersects(sphere->center, sphere->radius) ) {
+        visible++;
+      }
+    }
+  }, kEntities);
+  Benchmark::note(QString("%1 of %2 visible").arg(visible).arg(kEntities));
+}
+
+static BenchmarkGroup sceneGroup("scene", sceneBenchmarks);
@@ -0,0 +1,104 @@
+#include "benchmark.h"
+#include "simdmath.h"
+#include "camera.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <QGenericMatrix>
+
+static const int kObjects = 4096;
+
+// сцена из kObjects объектов: сдвиг, поворот и неравномерный масштаб
+static std::vector<QMatrix4x4> sceneModels()
+{
+  std::srand(1);
+  auto random = []( float from, float to ) {
+    return from + (to - from) * float(std::rand()) / float(RAND_MAX);
+  };
+  std::vector<QMatrix4x4> models(kObjects);
+  for ( auto& model : models ) {
+    model.translate(random(-100.0f, 100.0f), random(-10.0f, 10.0f), random(-100.0f, 100.0f));
+    model.rotate(random(0.0f, 360.0f), QVector3D{random(-1.0f, 1.0f), 1.0f, random(-1.0f, 1.0f)}.normalized());
+    model.scale(random(0.5f, 2.0f), random(0.5f, 2.0f), random(0.5f, 2.0f));
+  }
+  return models;
+}
+
+static void simdMathBenchmarks()
+{
+  std::vector<QMatrix4x4> models = sceneModels();
+  QMatrix4x4 projection;
+  projection.perspective(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+  QMatrix4x4 view;
+  view.lookAt(QVector3D{0.0f, 5.0f, 30.0f}, QVector3D{0.0f, 0.0f, 0.0f}, QVector3D{0.0f, 1.0f, 0.0f});
+
+  Benchmark::section(QString("%1 objects: MVP and normal matrix").arg(kObjects));
+  std::vector<QMatrix4x4> mvps(kObjects);
+  std::vector<QMatrix3x3> normals(kObjects);
+  double qtTime = Benchmark::run("QMatrix4x4: projection * view * model, normalMatrix()", [&] {
+    for ( int i = 0; i < kObjects; i++ ) {
+      mvps[size_t(i)] = projection * view * models[size_t(i)];
+      normals[size_t(i)] = models[size_t(i)].normalMatrix();
+    }
+  }, kObjects);
+  QMatrix4x4 viewProjection = projection * view;
+  Benchmark::run("QMatrix4x4: viewProjection * model, normalMatrix()", [&] {
+    for ( int i = 0; i < kObjects; i++ ) {
+      mvps[size_t(i)] = viewProjection * models[size_t(i)];
+      normals[size_t(i)] = models[size_t(i)].normalMatrix();
+    }
+  }, kObjects);
+
+  std::vector<Mat4> batch(kObjects);
+  for ( int i = 0; i < kObjects; i++ ) {
+    batch[size_t(i)] = SimdMath::fromQt(models[size_t(i)]);
+  }
+  Mat4 batchViewProjection = SimdMath::fromQt(viewProjection);
+  std::vector<ObjectTransform> transforms(kObjects);
+  double simdTime = Benchmark::run(QString("SimdMath::objectTransforms, %1 x%2").arg(SimdMath::backend()).arg(SimdMath::kLanes), [&] {
+    SimdMath::objectTransforms(batchViewProjection, batch.data(), transforms.data(), kObjects);
+  }, kObjects);
+  Benchmark::note(QString("speedup %1x").arg(qtTime / simdTime, 0, 'f', 2));
+
+  // сверка с Qt: пакетный путь не должен расходиться с QMatrix4x4
+  float maxError = 0.0f;
+  for ( int i = 0; i < kObjects; i++ ) {
+    const float* expected = mvps[size_t(i)].constData();
+    for ( int k = 0; k < 16; k++ ) {
+      maxError = qMax(maxError, qAbs(expected[k] - transforms[size_t(i)].mvp[k]) / qMax(1.0f, qAbs(expected[k])));
+    }
+    const float* normal = normals[size_t(i)].constData();
+    for ( int k = 0; k < 9; k++ ) {
+      // QMatrix3x3 хранит элементы по столбцам, как и ObjectTransform::normal
+      maxError = qMax(maxError, qAbs(normal[k] - transforms[size_t(i)].normal[k]) / qMax(1.0f, qAbs(normal[k])));
+    }
+  }
+  Benchmark::note(QString("max relative difference from QMatrix4x4 %1").arg(double(maxError), 0, 'g', 3));
+
+  Benchmark::section(QString("%1 objects: matrix product").arg(kObjects));
+  std::vector<QMatrix4x4> products(kObjects);
+  Benchmark::run("QMatrix4x4: root * local", [&] {
+    for ( int i = 0; i < kObjects; i++ ) {
+      products[size_t(i)] = viewProjection * models[size_t(i)];
+    }
+  }, kObjects);
+  std::vector<Mat4> batchProducts(kObjects);
+  Benchmark::run(QString("SimdMath::multiply, %1 x%2").arg(SimdMath::backend()).arg(SimdMath::kLanes), [&] {
+    SimdMath::multiply(batchViewProjection, batch.data(), batchProducts.data(), kObjects);
+  }, kObjects);
+
+  Benchmark::section("view matrix");
+  Camera camera;
+  volatile float sink = 0.0f;
+  Benchmark::run("QMatrix4x4::lookAt on every call", [&] {
+    QMatrix4x4 lookAt;
+    lookAt.lookAt(camera.position(), camera.position() + camera.front(), QVector3D{0.0f, 1.0f, 0.0f});
+    sink = sink + lookAt(0, 0);
+  });
+  Benchmark::run("Camera::getView, cached until the camera moves", [&] {
+    sink = sink + camera.getView()(0, 0);
+  });
+}
+
+static BenchmarkGroup simdMathGroup("simdmath", simdMathBenchmarks);
@@ -0,0 +1,93 @@
+#include "benchmark.h"
+#include "transformhierarchy.h"
+
+#include <cstdlib>
+#include <vector>
+
+static const int kRoots = 1000;
+static const int kChildren = 99;
+static const int kNodes = kRoots * (kChildren + 1);
+
+static float random(float from, float to)
+{
+  return from + (to - from) * float(std::rand()) / float(RAND_MAX);
+}
+
+static QMatrix4x4 randomLocal()
+{
+  QMatrix4x4 local;
+  local.translate(random(-10.0f, 10.0f), random(-1.0f, 1.0f), random(-10.0f, 10.0f));
+  local.rotate(random(0.0f, 360.0f), QVector3D{0.0f, 1.0f, 0.0f});
+  local.scale(random(0.5f, 2.0f));
+  return local;
+}
+
+static void transformBenchmarks()
+{
+  // kRoots объектов по kChildren детей - как сетка копий под вращающимся объектом
+  std::srand(1);
+  TransformHierarchy hierarchy;
+  hierarchy.reserve(kNodes);
+  std::vector<int> nodes;
+  std::vector<int> parents;
+  std::vector<QMatrix4x4> locals;
+  for ( int r = 0; r < kRoots; r++ ) {
+    int root = hierarchy.create();
+    int rootIndex = int(nodes.size());
+    nodes.push_back(root);
+    parents.push_back(-1);
+    locals.push_back(randomLocal());
+    hierarchy.setLocal(root, locals.back());
+    for ( int c = 0; c < kChildren; c++ ) {
+      nodes.push_back(hierarchy.create(root));
+      parents.push_back(rootIndex);
+      locals.push_back(randomLocal());
+      hierarchy.setLocal(nodes.back(), locals.back());
+    }
+  }
+  hierarchy.update();
+
+  Benchmark::section(QString("%1 nodes, %2 roots").arg(kNodes).arg(kRoots));
+  std::vector<QMatrix4x4> worlds(kNodes);
+  double qtTime = Benchmark::run("QMatrix4x4: parent * local for every node", [&] {
+    for ( int i = 0; i < kNodes; i++ ) {
+      int parent = parents[size_t(i)];
+      worlds[size_t(i)] = parent < 0 ? locals[size_t(i)] : worlds[size_t(parent)] * locals[size_t(i)];
+    }
+  }, kNodes);
+  double allTime = Benchmark::run("TransformHierarchy: every root moved", [&] {
+    for ( int r = 0; r < kRoots; r++ ) {
+      int i = r * (kChildren + 1);
+      hierarchy.setLocal(nodes[size_t(i)], locals[size_t(i)]);
+    }
+    hierarchy.update();
+  }, kNodes);
+  Benchmark::note(QString("speedup %1x, %2 ms per update")
+                  .arg(qtTime / allTime, 0, 'f', 2).arg(allTime / 1.0e6, 0, 'f', 3));
+  double fewTime = Benchmark::run("TransformHierarchy: 1% of roots moved", [&] {
+    for ( int r = 0; r < kRoots; r += 100 ) {
+      int i = r * (kChildren + 1);
+      hierarchy.setLocal(nodes[size_t(i)], locals[size_t(i)]);
+    }
+    hierarchy.update();
+  }, kNodes);
+  Benchmark::note(QString("%1 nodes recomputed, %2 ms per update")
+                  .arg(hierarchy.changed().size()).arg(fewTime / 1.0e6, 0, 'f', 3));
+  double noneTime = Benchmark::run("TransformHierarchy: nothing moved", [&] {
+    hierarchy.update();
+  }, kNodes);
+  Benchmark::note(QString("%1 ms per update").arg(noneTime / 1.0e6, 0, 'f', 6));
+
+  // сверка с Qt: пакетный пересчёт не должен расходиться с QMatrix4x4
+  float maxError = 0.0f;
+  for ( int i = 0; i < kNodes; i++ ) {
+    const float* expected = worlds[size_t(i)].constData();
+    Mat4 world = hierarchy.world(nodes[size_t(i)]);
+    for ( int k = 0; k < 16; k++ ) {
+      maxError = qMax(maxError, qAbs(expected[k] - world.m[k]) / qMax(1.0f, qAbs(expected[k])));
+    }
+  }
+  Benchmark::note(QString("max relative difference from QMatrix4x4 %1").arg(double(maxError), 0, 'g', 3));
+}
+
+static BenchmarkGroup transformGroup("transform", transformBenchmarks);
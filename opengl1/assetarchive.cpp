@@ -0,0 +1,446 @@
+#include "assetarchive.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDir>
+#include <QDebug>
+#include <QFileInfo>
+#include <QOpenGLContext>
+
+static const char kMagic[8] = { 'O', 'G', 'L', 'A', 'S', 'S', 'E', 'T' };
+static const int kBC1BlockBytes = 8;
+static const int kBC3BlockBytes = 16;
+
+namespace {
+
+// имя в оглавлении: путь ресурса Qt без ":/", путь на диске - относительно каталога архива;
+// пустая строка - путь вне каталога архива, такого ресурса в архиве нет
+QString normalizedPath(const QString& path, const QDir& root)
+{
+  QString key = QDir::cleanPath(QDir::fromNativeSeparators(path));
+  if ( key.startsWith(QString(":/")) ) {
+    return key.mid(2);
+  }
+  if ( QDir::isAbsolutePath(key) ) {
+    key = QDir::cleanPath(root.relativeFilePath(key));
+    if ( key == QString("..") || key.startsWith(QString("../")) || QDir::isAbsolutePath(key) ) {
+      return QString();
+    }
+  }
+  return key;
+}
+
+int blockBytes(AssetArchive::Format format)
+{
+  return format == AssetArchive::BC1 ? kBC1BlockBytes : kBC3BlockBytes;
+}
+
+// в блоке 4x4 строки пикселей переставляются в обратном порядке: у BC1 - байты индексов
+// цвета, у BC3 ещё и 12-битные строки индексов альфы. rows < 4 у мипов ниже блока
+void flipBlock(uchar* block, AssetArchive::Format format, int rows)
+{
+  if ( format == AssetArchive::BC3 ) {
+    quint64 bits = 0;
+    for ( int i = 0; i < 6; i++ ) {
+      bits |= quint64(block[2 + i]) << (8 * i);
+    }
+    quint64 flipped = bits;
+    for ( int row = 0; row < rows; row++ ) {
+      quint64 line = (bits >> (12 * row)) & 0xfffull;
+      int target = 12 * (rows - 1 - row);
+      flipped = (flipped & ~(0xfffull << target)) | (line << target);
+    }
+    for ( int i = 0; i < 6; i++ ) {
+      block[2 + i] = uchar(flipped >> (8 * i));
+    }
+    block += kBC1BlockBytes;
+  }
+  std::reverse(block + 4, block + 4 + rows);
+}
+
+// переворот без распаковки: строки блоков в обратном порядке и строки внутри блоков;
+// точен для высоты, кратной 4, и для мипов ниже одного блока
+QByteArray flipMip(const uchar* data, AssetArchive::Format format, int width, int height)
+{
+  QByteArray result(int(AssetArchive::mipBytes(format, width, height)), Qt::Uninitialized);
+  uchar* target = reinterpret_cast<uchar*>(result.data());
+  if ( format == AssetArchive::RGBA8 ) {
+    int line = width * 4;
+    for ( int y = 0; y < height; y++ ) {
+      std::memcpy(target + (height - 1 - y) * line, data + y * line, size_t(line));
+    }
+    return result;
+  }
+  int line = (width + 3) / 4 * blockBytes(format);
+  int blockRows = (height + 3) / 4;
+  for ( int y = 0; y < blockRows; y++ ) {
+    uchar* row = target + (blockRows - 1 - y) * line;
+    std::memcpy(row, data + y * line, size_t(line));
+    for ( int x = 0; x < line; x += blockBytes(format) ) {
+      flipBlock(row + x, format, qMin(height, 4));
+    }
+  }
+  return result;
+}
+
+QOpenGLTexture::TextureFormat textureFormat(AssetArchive::Format format)
+{
+  switch ( format ) {
+    case ( AssetArchive::BC1 ): {
+      return QOpenGLTexture::RGB_DXT1;
+    }
+    case ( AssetArchive::BC3 ): {
+      return QOpenGLTexture::RGBA_DXT5;
+    }
+    default: {
+      return QOpenGLTexture::RGBA8_UNorm;
+    }
+  }
+}
+
+}
+
+AssetArchive& AssetArchive::instance()
+{
+  static AssetArchive archive;
+  return archive;
+}
+
+AssetArchive::~AssetArchive()
+{
+  close();
+}
+
+bool AssetArchive::open(const QString& path)
+{
+  close();
+  file_.setFileName(path);
+  if ( !file_.open(QFile::ReadOnly) ) {
+    return false;
+  }
+  size_ = file_.size();
+  data_ = size_ >= qint64(sizeof(Header)) ? file_.map(0, size_) : nullptr;
+  if ( !data_ ) {
+    qDebug() << QString("asset archive %1 not mapped").arg(path);
+    close();
+    return false;
+  }
+  const Header* header = reinterpret_cast<const Header*>(data_);
+  // число записей сравнивается с местом после начала оглавления: сумма смещения и размера
+  // оглавления из повреждённого заголовка могла бы переполниться
+  quint64 size = quint64(size_);
+  if ( std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion
+       || header->tocOffset % alignof(Entry) != 0 || header->tocOffset > size
+       || quint64(header->entryCount) > (size - header->tocOffset) / sizeof(Entry) || header->namesOffset > size ) {
+    qDebug() << QString("asset archive %1 has wrong format").arg(path);
+    close();
+    return false;
+  }
+  entries_ = reinterpret_cast<const Entry*>(data_ + header->tocOffset);
+  entryCount_ = int(header->entryCount);
+  names_ = reinterpret_cast<const char*>(data_ + header->namesOffset);
+  if ( !isValid() ) {
+    qDebug() << QString("asset archive %1 has entries outside the file").arg(path);
+    close();
+    return false;
+  }
+  root_ = QDir(QFileInfo(path).absolutePath());
+  qDebug() << QString("asset archive %1: %2 entries, %3 MB").arg(path).arg(entryCount_)
+              .arg(double(size_) / (1024 * 1024), 0, 'f', 1);
+  return true;
+}
+
+void AssetArchive::close()
+{
+  if ( data_ ) {
+    file_.unmap(data_);
+  }
+  file_.close();
+  data_ = nullptr;
+  size_ = 0;
+  entries_ = nullptr;
+  entryCount_ = 0;
+  names_ = nullptr;
+  root_ = QDir();
+}
+
+bool AssetArchive::isValid() const
+{
+  quint64 size = quint64(size_);
+  quint64 namesSize = size - quint64(names_ - reinterpret_cast<const char*>(data_));
+  for ( int i = 0; i < entryCount_; i++ ) {
+    const Entry& entry = entries_[i];
+    if ( entry.offset > size || entry.size > size - entry.offset
+         || entry.nameOffset > namesSize || entry.nameSize > namesSize - entry.nameOffset ) {
+      return false;
+    }
+    if ( entry.type != Texture ) {
+      continue;
+    }
+    // мипы текстуры целиком внутри ресурса
+    if ( entry.format > BC3 || entry.width == 0 || entry.height == 0 || entry.width > 65536 || entry.height > 65536
+         || entry.mipCount == 0 || entry.mipCount > 17 ) {
+      return false;
+    }
+    Format format = Format(entry.format);
+    int width = int(entry.width);
+    int height = int(entry.height);
+    int last = int(entry.mipCount) - 1;
+    quint64 end = mipOffset(format, width, height, last)
+                  + mipBytes(format, qMax(1, width >> last), qMax(1, height >> last));
+    if ( end > entry.size ) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const AssetArchive::Entry* AssetArchive::find(const QString& path, Type type) const
+{
+  if ( !data_ ) {
+    return nullptr;
+  }
+  QString key = normalizedPath(path, root_);
+  if ( key.isEmpty() ) {
+    return nullptr;
+  }
+  const Entry* end = entries_ + entryCount_;
+  const Entry* entry = std::lower_bound(entries_, end, key, [this]( const Entry& item, const QString& value ) {
+    return name(item) < value;
+  });
+  if ( entry != end && entry->type == quint32(type) && name(*entry) == key ) {
+    return entry;
+  }
+  return nullptr;
+}
+
+QString AssetArchive::name(const Entry& entry) const
+{
+  return QString::fromUtf8(names_ + entry.nameOffset, int(entry.nameSize));
+}
+
+QByteArray AssetArchive::text(const QString& path) const
+{
+  const Entry* entry = find(path, Text);
+  if ( !entry ) {
+    return QByteArray();
+  }
+  return QByteArray::fromRawData(reinterpret_cast<const char*>(data(*entry)), int(entry->size));
+}
+
+quint64 AssetArchive::mipBytes(Format format, int width, int height)
+{
+  if ( format == RGBA8 ) {
+    return quint64(width) * quint64(height) * 4;
+  }
+  return quint64((width + 3) / 4) * quint64((height + 3) / 4) * quint64(blockBytes(format));
+}
+
+quint64 AssetArchive::mipOffset(Format format, int width, int height, int mip)
+{
+  quint64 offset = 0;
+  for ( int i = 0; i < mip; i++ ) {
+    offset = align(offset + mipBytes(format, width, height));
+    width = qMax(1, width / 2);
+    height = qMax(1, height / 2);
+  }
+  return offset;
+}
+
+QVector<QImage> AssetArchive::mipChain(const Entry& entry) const
+{
+  QVector<QImage> mips;
+  if ( entry.type != Texture || entry.format != RGBA8 ) {
+    return mips;
+  }
+  int width = int(entry.width);
+  int height = int(entry.height);
+  for ( int mip = 0; mip < int(entry.mipCount); mip++ ) {
+    // QImage над константными данными не копирует их, пока его не меняют
+    const uchar* bits = data(entry) + mipOffset(RGBA8, int(entry.width), int(entry.height), mip);
+    mips.append(QImage(bits, width, height, width * 4, QImage::Format_RGBA8888));
+    width = qMax(1, width / 2);
+    height = qMax(1, height / 2);
+  }
+  return mips;
+}
+
+bool AssetArchive::isCompressedSupported(const Entry& entry) const
+{
+  if ( entry.format == RGBA8 ) {
+    return true;
+  }
+  QOpenGLContext* context = QOpenGLContext::currentContext();
+  return context && context->hasExtension(QByteArrayLiteral("GL_EXT_texture_compression_s3tc"));
+}
+
+QOpenGLTexture* AssetArchive::createTexture(const Entry& entry, bool mirrored) const
+{
+  if ( entry.type != Texture || !isCompressedSupported(entry) ) {
+    return nullptr;
+  }
+  Format format = Format(entry.format);
+  QOpenGLTexture* texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+  texture->create();
+  texture->setFormat(textureFormat(format));
+  texture->setSize(int(entry.width), int(entry.height));
+  texture->setMipLevels(int(entry.mipCount));
+  texture->allocateStorage();
+  int width = int(entry.width);
+  int height = int(entry.height);
+  for ( int mip = 0; mip < int(entry.mipCount); mip++ ) {
+    const uchar* bits = data(entry) + mipOffset(format, int(entry.width), int(entry.height), mip);
+    QByteArray flipped;
+    if ( mirrored ) {
+      flipped = flipMip(bits, format, width, height);
+      bits = reinterpret_cast<const uchar*>(flipped.constData());
+    }
+    if ( format == RGBA8 ) {
+      texture->setData(mip, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, bits);
+    }
+    else {
+      texture->setCompressedData(mip, int(mipBytes(format, width, height)), bits);
+    }
+    width = qMax(1, width / 2);
+    height = qMax(1, height / 2);
+  }
+  return texture;
+}
+
+QOpenGLTexture* AssetArchive::createCubeMap(const QVector<const Entry*>& faces) const
+{
+  if ( faces.size() != 6 ) {
+    return nullptr;
+  }
+  for ( const Entry* face : faces ) {
+    if ( !face || face->type != Texture || face->format != faces.first()->format
+         || face->width != faces.first()->width || face->height != faces.first()->height
+         || face->mipCount != faces.first()->mipCount || !isCompressedSupported(*face) ) {
+      return nullptr;
+    }
+  }
+  const Entry& first = *faces.first();
+  Format format = Format(first.format);
+  QOpenGLTexture* texture = new QOpenGLTexture(QOpenGLTexture::TargetCubeMap);
+  texture->create();
+  texture->setFormat(textureFormat(format));
+  texture->setSize(int(first.width), int(first.height));
+  texture->setMipLevels(int(first.mipCount));
+  texture->allocateStorage();
+  for ( int i = 0; i < faces.size(); i++ ) {
+    QOpenGLTexture::CubeMapFace face = QOpenGLTexture::CubeMapFace(QOpenGLTexture::CubeMapPositiveX + i);
+    int width = int(first.width);
+    int height = int(first.height);
+    for ( int mip = 0; mip < int(first.mipCount); mip++ ) {
+      const uchar* bits = data(*faces.at(i)) + mipOffset(format, int(first.width), int(first.height), mip);
+      if ( format == RGBA8 ) {
+        texture->setData(mip, 0, face, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, bits);
+      }
+      else {
+        texture->setCompressedData(mip, 0, face, int(mipBytes(format, width, height)), bits);
+      }
+      width = qMax(1, width / 2);
+      height = qMax(1, height / 2);
+    }
+  }
+  return texture;
+}
+
+bool AssetArchiveWriter::open(const QString& path)
+{
+  entries_.clear();
+  names_.clear();
+  file_.setFileName(path);
+  if ( !file_.open(QFile::WriteOnly | QFile::Truncate) ) {
+    qDebug() << QString(" file %1 not open ").arg(path);
+    return false;
+  }
+  AssetArchive::Header header{};
+  return file_.write(reinterpret_cast<const char*>(&header), sizeof(header)) == qint64(sizeof(header));
+}
+
+bool AssetArchiveWriter::addText(const QString& name, const QByteArray& text)
+{
+  AssetArchive::Entry entry{};
+  entry.type = AssetArchive::Text;
+  return add(name, entry, { text });
+}
+
+bool AssetArchiveWriter::addTexture(const QString& name, AssetArchive::Format format, int width, int height,
+                                    const QVector<QByteArray>& mips)
+{
+  AssetArchive::Entry entry{};
+  entry.type = AssetArchive::Texture;
+  entry.format = format;
+  entry.width = quint32(width);
+  entry.height = quint32(height);
+  entry.mipCount = quint32(mips.size());
+  return add(name, entry, mips);
+}
+
+bool AssetArchiveWriter::addModel(const QString& name, const QByteArray& data)
+{
+  AssetArchive::Entry entry{};
+  entry.type = AssetArchive::Model;
+  return add(name, entry, { data });
+}
+
+bool AssetArchiveWriter::add(const QString& name, AssetArchive::Entry entry, const QVector<QByteArray>& parts)
+{
+  if ( !pad() ) {
+    return false;
+  }
+  entry.offset = quint64(file_.pos());
+  for ( int i = 0; i < parts.size(); i++ ) {
+    if ( (i > 0 && !pad()) || file_.write(parts.at(i)) != parts.at(i).size() ) {
+      return false;
+    }
+  }
+  entry.size = quint64(file_.pos()) - entry.offset;
+  entries_.append(entry);
+  names_.append(QDir::cleanPath(QDir::fromNativeSeparators(name)));
+  return true;
+}
+
+bool AssetArchiveWriter::pad()
+{
+  qint64 position = file_.pos();
+  qint64 padding = qint64(AssetArchive::align(quint64(position))) - position;
+  return padding == 0 || file_.write(QByteArray(int(padding), '\0')) == padding;
+}
+
+bool AssetArchiveWriter::finish()
+{
+  QVector<int> order(entries_.size());
+  for ( int i = 0; i < order.size(); i++ ) {
+    order[i] = i;
+  }
+  // оглавление по имени - для двоичного поиска при чтении
+  std::sort(order.begin(), order.end(), [this]( int a, int b ) { return names_.at(a) < names_.at(b); });
+  QByteArray names;
+  QVector<AssetArchive::Entry> toc;
+  for ( int index : order ) {
+    AssetArchive::Entry entry = entries_.at(index);
+    QByteArray name = names_.at(index).toUtf8();
+    entry.nameOffset = quint32(names.size());
+    entry.nameSize = quint32(name.size());
+    names += name;
+    toc.append(entry);
+  }
+
+  AssetArchive::Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = AssetArchive::kVersion;
+  header.entryCount = quint32(toc.size());
+  bool ok = pad();
+  header.tocOffset = quint64(file_.pos());
+  qint64 tocBytes = qint64(toc.size()) * qint64(sizeof(AssetArchive::Entry));
+  ok = ok && file_.write(reinterpret_cast<const char*>(toc.constData()), tocBytes) == tocBytes;
+  header.namesOffset = quint64(file_.pos());
+  ok = ok && file_.write(names) == names.size();
+  ok = ok && file_.seek(0);
+  ok = ok && file_.write(reinterpret_cast<const char*>(&header), sizeof(header)) == qint64(sizeof(header));
+  file_.close();
+  return ok;
+}
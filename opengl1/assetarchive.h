@@ -0,0 +1,124 @@
+#ifndef ASSETARCHIVE_H
+#define ASSETARCHIVE_H
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QOpenGLTexture>
+
+// Архив ресурсов, который собирает rescompiler: заголовок, данные ресурсов и в конце
+// оглавление, отсортированное по имени. Начало каждого ресурса и каждого мипа выровнено,
+// поэтому файл отображается в память целиком и указатели на данные сразу уходят в GL -
+// без открытия файлов и декодирования при запуске. Числа в файле - little-endian.
+class AssetArchive
+{
+public:
+  static const quint32 kVersion = 1;
+  static const int kAlignment = 64;
+
+  enum Type { Text, Texture, Model };
+  // RGBA8 - цепочка для стриминга текстур материалов, BC1/BC3 (S3TC) - сжатые текстуры сцены
+  enum Format { RGBA8, BC1, BC3 };
+
+  struct Header {
+    char magic[8];
+    quint32 version;
+    quint32 entryCount;
+    quint64 tocOffset;
+    quint64 namesOffset;
+  };
+
+  struct Entry {
+    quint64 offset;
+    quint64 size;
+    quint32 nameOffset;
+    quint32 nameSize;
+    quint32 type;
+    quint32 format;
+    quint32 width;
+    quint32 height;
+    quint32 mipCount;
+    quint32 reserved;
+  };
+
+  static AssetArchive& instance();
+
+  AssetArchive() = default;
+  AssetArchive(const AssetArchive&) = delete;
+  ~AssetArchive();
+
+  AssetArchive& operator=(const AssetArchive&) = delete;
+
+  bool open(const QString& path);
+  void close();
+  bool isOpen() const { return data_ != nullptr; }
+  int entryCount() const { return entryCount_; }
+
+  // только точное совпадение пути: ":/shaders/..." ищется без префикса ресурсов,
+  // путь на диске - относительно каталога, где лежит архив (так rescompiler и называет
+  // ресурсы, если ему дан этот каталог); относительный путь - как есть
+  const Entry* find(const QString& path, Type type) const;
+  QString name(const Entry& entry) const;
+  const uchar* data(const Entry& entry) const { return data_ + entry.offset; }
+  // данные без копирования; пустой массив, если ресурса нет
+  QByteArray text(const QString& path) const;
+
+  static quint64 align(quint64 offset) { return (offset + kAlignment - 1) / kAlignment * kAlignment; }
+  static quint64 mipBytes(Format format, int width, int height);
+  // смещение мипа от начала ресурса
+  static quint64 mipOffset(Format format, int width, int height, int mip);
+
+  // цепочка мипов RGBA8 поверх отображённого файла, для StreamedTexture
+  QVector<QImage> mipChain(const Entry& entry) const;
+  // сжатая текстура со всеми мипами, nullptr - формат не поддерживается контекстом;
+  // mirrored переворачивает строки, как QImage::mirrored() у текстур из файлов
+  QOpenGLTexture* createTexture(const Entry& entry, bool mirrored) const;
+  // кубическая карта из шести сжатых текстур одного размера и формата
+  QOpenGLTexture* createCubeMap(const QVector<const Entry*>& faces) const;
+
+private:
+  // смещения и размеры всех ресурсов и имён внутри файла
+  bool isValid() const;
+  bool isCompressedSupported(const Entry& entry) const;
+
+private:
+  QFile file_;
+  uchar* data_ = nullptr;
+  qint64 size_ = 0;
+  const Entry* entries_ = nullptr;
+  int entryCount_ = 0;
+  const char* names_ = nullptr;
+  QDir root_;
+};
+
+// Запись архива: данные ресурсов пишутся в файл сразу при добавлении,
+// оглавление и имена - в finish()
+class AssetArchiveWriter
+{
+public:
+  AssetArchiveWriter() = default;
+  AssetArchiveWriter(const AssetArchiveWriter&) = delete;
+
+  AssetArchiveWriter& operator=(const AssetArchiveWriter&) = delete;
+
+  bool open(const QString& path);
+  bool addText(const QString& name, const QByteArray& text);
+  // mips - от полного размера до 1x1, каждый уже в формате format
+  bool addTexture(const QString& name, AssetArchive::Format format, int width, int height, const QVector<QByteArray>& mips);
+  bool addModel(const QString& name, const QByteArray& data);
+  bool finish();
+  qint64 size() const { return file_.size(); }
+
+private:
+  bool add(const QString& name, AssetArchive::Entry entry, const QVector<QByteArray>& parts);
+  bool pad();
+
+private:
+  QFile file_;
+  QVector<AssetArchive::Entry> entries_;
+  QStringList names_;
+};
+
+#endif // ASSETARCHIVE_H
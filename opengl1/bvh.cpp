@@ -0,0 +1,546 @@
+#include "bvh.h"
+#include "simd4.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const int Bvh::kEmpty = std::numeric_limits<int>::min();
+
+// глубже разбиение идёт пополам по числу треугольников, чтобы стек обхода был ограничен
+static const int kMaxDepth = 64;
+static const int kStackSize = kMaxDepth * (Bvh::kWidth - 1) + 1;
+static const float kMinDirection = 1.0e-9f;
+static const float kMinDeterminant = 1.0e-12f;
+
+namespace {
+
+typedef Simd4::V V;
+
+inline V madd(V a, V b, V c) { return Simd4::add(Simd4::mul(a, b), c); }
+inline V dot(V ax, V ay, V az, V bx, V by, V bz) { return madd(ax, bx, madd(ay, by, Simd4::mul(az, bz))); }
+
+// луч в дорожках: в пакете у каждой дорожки свой, у одиночного луча - один во всех
+struct RayLanes
+{
+  V originX, originY, originZ;
+  V directionX, directionY, directionZ;
+  V inverseX, inverseY, inverseZ;
+  V tMin;
+};
+
+float safeDirection(float d)
+{
+  return std::fabs(d) < kMinDirection ? std::copysign(kMinDirection, d) : d;
+}
+
+RayLanes splat(const BvhRay& ray)
+{
+  RayLanes r;
+  r.originX = Simd4::set(ray.origin.x());
+  r.originY = Simd4::set(ray.origin.y());
+  r.originZ = Simd4::set(ray.origin.z());
+  r.directionX = Simd4::set(ray.direction.x());
+  r.directionY = Simd4::set(ray.direction.y());
+  r.directionZ = Simd4::set(ray.direction.z());
+  r.inverseX = Simd4::set(1.0f / safeDirection(ray.direction.x()));
+  r.inverseY = Simd4::set(1.0f / safeDirection(ray.direction.y()));
+  r.inverseZ = Simd4::set(1.0f / safeDirection(ray.direction.z()));
+  r.tMin = Simd4::set(ray.tMin);
+  return r;
+}
+
+RayLanes splat(const BvhRayPacket& packet)
+{
+  alignas(16) float inverse[3][4];
+  for ( int i = 0; i < 4; i++ ) {
+    inverse[0][i] = 1.0f / safeDirection(packet.directionX[i]);
+    inverse[1][i] = 1.0f / safeDirection(packet.directionY[i]);
+    inverse[2][i] = 1.0f / safeDirection(packet.directionZ[i]);
+  }
+  RayLanes r;
+  r.originX = Simd4::load(packet.originX);
+  r.originY = Simd4::load(packet.originY);
+  r.originZ = Simd4::load(packet.originZ);
+  r.directionX = Simd4::load(packet.directionX);
+  r.directionY = Simd4::load(packet.directionY);
+  r.directionZ = Simd4::load(packet.directionZ);
+  r.inverseX = Simd4::load(inverse[0]);
+  r.inverseY = Simd4::load(inverse[1]);
+  r.inverseZ = Simd4::load(inverse[2]);
+  r.tMin = Simd4::load(packet.tMin);
+  return r;
+}
+
+// пересечение лучей с коробками (метод пластин): маска попаданий, в near - расстояние входа
+V slabs(const RayLanes& r, V tMax, V minX, V minY, V minZ, V maxX, V maxY, V maxZ, V& near)
+{
+  V x0 = Simd4::mul(Simd4::sub(minX, r.originX), r.inverseX);
+  V x1 = Simd4::mul(Simd4::sub(maxX, r.originX), r.inverseX);
+  V y0 = Simd4::mul(Simd4::sub(minY, r.originY), r.inverseY);
+  V y1 = Simd4::mul(Simd4::sub(maxY, r.originY), r.inverseY);
+  V z0 = Simd4::mul(Simd4::sub(minZ, r.originZ), r.inverseZ);
+  V z1 = Simd4::mul(Simd4::sub(maxZ, r.originZ), r.inverseZ);
+  near = Simd4::max(Simd4::max(Simd4::min(x0, x1), Simd4::min(y0, y1)), Simd4::max(Simd4::min(z0, z1), r.tMin));
+  V far = Simd4::min(Simd4::min(Simd4::max(x0, x1), Simd4::max(y0, y1)), Simd4::min(Simd4::max(z0, z1), tMax));
+  return Simd4::lessEqual(near, far);
+}
+
+// Мёллер-Трумбор для лучей в дорожках и одного треугольника в каждой дорожке
+// (или одного треугольника во всех); маска попаданий, t, u, v - в дорожках
+V triangles(const RayLanes& r, V tMax, V v0X, V v0Y, V v0Z, V e1X, V e1Y, V e1Z, V e2X, V e2Y, V e2Z,
+            V& t, V& u, V& v)
+{
+  V px = Simd4::sub(Simd4::mul(r.directionY, e2Z), Simd4::mul(r.directionZ, e2Y));
+  V py = Simd4::sub(Simd4::mul(r.directionZ, e2X), Simd4::mul(r.directionX, e2Z));
+  V pz = Simd4::sub(Simd4::mul(r.directionX, e2Y), Simd4::mul(r.directionY, e2X));
+  V determinant = dot(e1X, e1Y, e1Z, px, py, pz);
+  V inverse = Simd4::div(Simd4::set(1.0f), determinant);
+  V sx = Simd4::sub(r.originX, v0X);
+  V sy = Simd4::sub(r.originY, v0Y);
+  V sz = Simd4::sub(r.originZ, v0Z);
+  u = Simd4::mul(dot(sx, sy, sz, px, py, pz), inverse);
+  V qx = Simd4::sub(Simd4::mul(sy, e1Z), Simd4::mul(sz, e1Y));
+  V qy = Simd4::sub(Simd4::mul(sz, e1X), Simd4::mul(sx, e1Z));
+  V qz = Simd4::sub(Simd4::mul(sx, e1Y), Simd4::mul(sy, e1X));
+  v = Simd4::mul(dot(r.directionX, r.directionY, r.directionZ, qx, qy, qz), inverse);
+  t = Simd4::mul(dot(e2X, e2Y, e2Z, qx, qy, qz), inverse);
+  V zero = Simd4::set(0.0f);
+  V mask = Simd4::less(Simd4::set(kMinDeterminant), Simd4::abs(determinant));
+  mask = Simd4::both(mask, Simd4::lessEqual(zero, u));
+  mask = Simd4::both(mask, Simd4::lessEqual(zero, v));
+  mask = Simd4::both(mask, Simd4::lessEqual(Simd4::add(u, v), Simd4::set(1.0f)));
+  mask = Simd4::both(mask, Simd4::less(r.tMin, t));
+  return Simd4::both(mask, Simd4::less(t, tMax));
+}
+
+float surfaceArea(const BoundingBox& box)
+{
+  if ( box.isEmpty() ) {
+    return 0.0f;
+  }
+  QVector3D size = box.size();
+  return 2.0f * (size.x() * size.y() + size.y() * size.z() + size.z() * size.x());
+}
+
+} // namespace
+
+const char* Bvh::backend()
+{
+  return Simd4::backend();
+}
+
+void Bvh::visitBoxes(int maxDepth, const std::function<void(const BoundingBox& box, int depth)>& visitor) const
+{
+  if ( nodes_.empty() ) {
+    return;
+  }
+  visitor(bounds_, 0);
+  struct Entry {
+    int node;
+    int depth;
+  };
+  std::vector<Entry> stack{Entry{0, 1}};
+  while ( !stack.empty() ) {
+    Entry entry = stack.back();
+    stack.pop_back();
+    if ( entry.depth > maxDepth ) {
+      continue;
+    }
+    const Node& node = nodes_[size_t(entry.node)];
+    for ( int i = 0; i < kWidth; i++ ) {
+      if ( node.child[i] == kEmpty ) {
+        continue;
+      }
+      BoundingBox box;
+      box.min = QVector3D{node.minX[i], node.minY[i], node.minZ[i]};
+      box.max = QVector3D{node.maxX[i], node.maxY[i], node.maxZ[i]};
+      visitor(box, entry.depth);
+      if ( node.child[i] >= 0 ) {
+        stack.push_back(Entry{node.child[i], entry.depth + 1});
+      }
+    }
+  }
+}
+
+void Bvh::clear()
+{
+  nodes_.clear();
+  triangles_.clear();
+  bounds_ = BoundingBox{};
+  triangleCount_ = 0;
+}
+
+void Bvh::build(const QVector<QVector3D>& positions)
+{
+  clear();
+  triangleCount_ = positions.size() / 3;
+  if ( triangleCount_ == 0 ) {
+    return;
+  }
+  references_.resize(size_t(triangleCount_));
+  for ( int i = 0; i < triangleCount_; i++ ) {
+    Reference& reference = references_[size_t(i)];
+    reference.box = BoundingBox{};
+    for ( int k = 0; k < 3; k++ ) {
+      reference.box.extend(positions.at(i * 3 + k));
+    }
+    reference.centroid = reference.box.center();
+    reference.triangle = i;
+    bounds_.extend(reference.box);
+  }
+  nodes_.reserve(size_t(triangleCount_ / kLeafSize + 1));
+  triangles_.reserve(size_t(triangleCount_ / kLeafSize * 2 + 1));
+  buildNode(positions, 0, triangleCount_, 0);
+  std::vector<Reference>().swap(references_);
+}
+
+int Bvh::buildNode(const QVector<QVector3D>& positions, int begin, int end, int depth)
+{
+  int index = int(nodes_.size());
+  nodes_.emplace_back();
+  // бинарное разбиение сразу сворачивается: делим самый большой по площади диапазон,
+  // пока детей меньше kWidth
+  int ranges[kWidth][2];
+  BoundingBox boxes[kWidth];
+  int count = 1;
+  ranges[0][0] = begin;
+  ranges[0][1] = end;
+  boxes[0] = rangeBounds(begin, end);
+  while ( count < kWidth ) {
+    int best = -1;
+    float bestArea = -1.0f;
+    for ( int i = 0; i < count; i++ ) {
+      float area = surfaceArea(boxes[i]);
+      if ( ranges[i][1] - ranges[i][0] > kLeafSize && area > bestArea ) {
+        best = i;
+        bestArea = area;
+      }
+    }
+    if ( best < 0 ) {
+      break;
+    }
+    int middle = split(ranges[best][0], ranges[best][1], depth >= kMaxDepth);
+    ranges[count][0] = middle;
+    ranges[count][1] = ranges[best][1];
+    ranges[best][1] = middle;
+    boxes[best] = rangeBounds(ranges[best][0], middle);
+    boxes[count] = rangeBounds(middle, ranges[count][1]);
+    count++;
+  }
+  for ( int i = 0; i < kWidth; i++ ) {
+    int child = kEmpty;
+    // у пустого слота вывернутая коробка, но обход пропускает его и по kEmpty
+    BoundingBox box;
+    if ( i < count ) {
+      box = boxes[i];
+      child = ranges[i][1] - ranges[i][0] <= kLeafSize ? buildLeaf(positions, ranges[i][0], ranges[i][1])
+                                                       : buildNode(positions, ranges[i][0], ranges[i][1], depth + 1);
+    }
+    // nodes_ мог переехать при построении детей
+    Node& node = nodes_[size_t(index)];
+    node.minX[i] = box.min.x();
+    node.minY[i] = box.min.y();
+    node.minZ[i] = box.min.z();
+    node.maxX[i] = box.max.x();
+    node.maxY[i] = box.max.y();
+    node.maxZ[i] = box.max.z();
+    node.child[i] = child;
+  }
+  return index;
+}
+
+int Bvh::buildLeaf(const QVector<QVector3D>& positions, int begin, int end)
+{
+  Triangles pack;
+  std::memset(&pack, 0, sizeof(pack));
+  for ( int k = 0; k < kLeafSize; k++ ) {
+    pack.ids[k] = -1;
+    if ( begin + k >= end ) {
+      continue;
+    }
+    int triangle = references_[size_t(begin + k)].triangle;
+    QVector3D v0 = positions.at(triangle * 3);
+    QVector3D e1 = positions.at(triangle * 3 + 1) - v0;
+    QVector3D e2 = positions.at(triangle * 3 + 2) - v0;
+    pack.v0X[k] = v0.x();
+    pack.v0Y[k] = v0.y();
+    pack.v0Z[k] = v0.z();
+    pack.e1X[k] = e1.x();
+    pack.e1Y[k] = e1.y();
+    pack.e1Z[k] = e1.z();
+    pack.e2X[k] = e2.x();
+    pack.e2Y[k] = e2.y();
+    pack.e2Z[k] = e2.z();
+    pack.ids[k] = triangle;
+  }
+  triangles_.push_back(pack);
+  return ~int(triangles_.size() - 1);
+}
+
+int Bvh::split(int begin, int end, bool median)
+{
+  BoundingBox centroids;
+  for ( int i = begin; i < end; i++ ) {
+    centroids.extend(references_[size_t(i)].centroid);
+  }
+  QVector3D extent = centroids.size();
+  int bestAxis = -1;
+  int bestBin = 0;
+  float bestCost = std::numeric_limits<float>::max();
+  for ( int axis = 0; axis < 3 && !median; axis++ ) {
+    if ( extent[axis] <= 0.0f ) {
+      continue;
+    }
+    float origin = centroids.min[axis];
+    float scale = float(kBins) / extent[axis];
+    BoundingBox bins[kBins];
+    int counts[kBins] = {};
+    for ( int i = begin; i < end; i++ ) {
+      const Reference& reference = references_[size_t(i)];
+      int bin = qMin(int((reference.centroid[axis] - origin) * scale), kBins - 1);
+      bins[bin].extend(reference.box);
+      counts[bin]++;
+    }
+    // площади и числа справа от каждой границы, затем проход слева
+    float rightArea[kBins];
+    int rightCount[kBins];
+    BoundingBox accumulated;
+    int accumulatedCount = 0;
+    for ( int b = kBins - 1; b > 0; b-- ) {
+      accumulated.extend(bins[b]);
+      accumulatedCount += counts[b];
+      rightArea[b] = surfaceArea(accumulated);
+      rightCount[b] = accumulatedCount;
+    }
+    accumulated = BoundingBox{};
+    accumulatedCount = 0;
+    for ( int b = 0; b < kBins - 1; b++ ) {
+      accumulated.extend(bins[b]);
+      accumulatedCount += counts[b];
+      if ( accumulatedCount == 0 || rightCount[b + 1] == 0 ) {
+        continue;
+      }
+      float cost = float(accumulatedCount) * surfaceArea(accumulated) + float(rightCount[b + 1]) * rightArea[b + 1];
+      if ( cost < bestCost ) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = b + 1;
+      }
+    }
+  }
+  if ( bestAxis >= 0 ) {
+    float origin = centroids.min[bestAxis];
+    float scale = float(kBins) / extent[bestAxis];
+    auto middle = std::partition(references_.begin() + begin, references_.begin() + end, [=]( const Reference& reference ) {
+      return qMin(int((reference.centroid[bestAxis] - origin) * scale), kBins - 1) < bestBin;
+    });
+    int m = int(middle - references_.begin());
+    if ( m > begin && m < end ) {
+      return m;
+    }
+  }
+  // центры совпадают или дерево слишком глубокое: пополам по самой длинной оси
+  int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : (extent.y() >= extent.z() ? 1 : 2);
+  int middle = begin + (end - begin) / 2;
+  std::nth_element(references_.begin() + begin, references_.begin() + middle, references_.begin() + end,
+                   [axis]( const Reference& a, const Reference& b ) {
+    return a.centroid[axis] < b.centroid[axis];
+  });
+  return middle;
+}
+
+BoundingBox Bvh::rangeBounds(int begin, int end) const
+{
+  BoundingBox box;
+  for ( int i = begin; i < end; i++ ) {
+    box.extend(references_[size_t(i)].box);
+  }
+  return box;
+}
+
+bool Bvh::intersect(const BvhRay& ray, BvhHit& hit) const
+{
+  if ( nodes_.empty() ) {
+    return false;
+  }
+  struct Entry {
+    int node;
+    float near;
+  };
+  RayLanes r = splat(ray);
+  float tMax = ray.tMax;
+  bool found = false;
+  Entry stack[kStackSize];
+  int top = 0;
+  stack[top++] = Entry{0, ray.tMin};
+  while ( top > 0 ) {
+    Entry entry = stack[--top];
+    if ( entry.near > tMax ) {
+      continue;
+    }
+    if ( entry.node < 0 ) {
+      const Triangles& pack = triangles_[size_t(~entry.node)];
+      V t, u, v;
+      int mask = Simd4::mask(triangles(r, Simd4::set(tMax),
+                                       Simd4::load(pack.v0X), Simd4::load(pack.v0Y), Simd4::load(pack.v0Z),
+                                       Simd4::load(pack.e1X), Simd4::load(pack.e1Y), Simd4::load(pack.e1Z),
+                                       Simd4::load(pack.e2X), Simd4::load(pack.e2Y), Simd4::load(pack.e2Z), t, u, v));
+      if ( mask == 0 ) {
+        continue;
+      }
+      alignas(16) float lanes[3][4];
+      Simd4::store(lanes[0], t);
+      Simd4::store(lanes[1], u);
+      Simd4::store(lanes[2], v);
+      for ( int k = 0; k < kLeafSize; k++ ) {
+        if ( (mask >> k & 1) && lanes[0][k] < tMax ) {
+          tMax = lanes[0][k];
+          hit.t = tMax;
+          hit.u = lanes[1][k];
+          hit.v = lanes[2][k];
+          hit.triangle = pack.ids[k];
+          found = true;
+        }
+      }
+      continue;
+    }
+    const Node& node = nodes_[size_t(entry.node)];
+    V near;
+    int mask = Simd4::mask(slabs(r, Simd4::set(tMax), Simd4::load(node.minX), Simd4::load(node.minY), Simd4::load(node.minZ),
+                                 Simd4::load(node.maxX), Simd4::load(node.maxY), Simd4::load(node.maxZ), near));
+    alignas(16) float distances[4];
+    Simd4::store(distances, near);
+    // дальние дети в стек первыми, ближний достаётся следующим
+    Entry children[kWidth];
+    int count = 0;
+    for ( int i = 0; i < kWidth; i++ ) {
+      if ( (mask >> i & 1) && node.child[i] != kEmpty ) {
+        Entry child{node.child[i], distances[i]};
+        int j = count++;
+        for ( ; j > 0 && children[j - 1].near < child.near; j-- ) {
+          children[j] = children[j - 1];
+        }
+        children[j] = child;
+      }
+    }
+    for ( int i = 0; i < count; i++ ) {
+      stack[top++] = children[i];
+    }
+  }
+  return found;
+}
+
+bool Bvh::occluded(const BvhRay& ray) const
+{
+  if ( nodes_.empty() ) {
+    return false;
+  }
+  RayLanes r = splat(ray);
+  V tMax = Simd4::set(ray.tMax);
+  int stack[kStackSize];
+  int top = 0;
+  stack[top++] = 0;
+  while ( top > 0 ) {
+    int index = stack[--top];
+    if ( index < 0 ) {
+      const Triangles& pack = triangles_[size_t(~index)];
+      V t, u, v;
+      if ( Simd4::mask(triangles(r, tMax, Simd4::load(pack.v0X), Simd4::load(pack.v0Y), Simd4::load(pack.v0Z),
+                                 Simd4::load(pack.e1X), Simd4::load(pack.e1Y), Simd4::load(pack.e1Z),
+                                 Simd4::load(pack.e2X), Simd4::load(pack.e2Y), Simd4::load(pack.e2Z), t, u, v)) != 0 ) {
+        return true;
+      }
+      continue;
+    }
+    const Node& node = nodes_[size_t(index)];
+    V near;
+    int mask = Simd4::mask(slabs(r, tMax, Simd4::load(node.minX), Simd4::load(node.minY), Simd4::load(node.minZ),
+                                 Simd4::load(node.maxX), Simd4::load(node.maxY), Simd4::load(node.maxZ), near));
+    for ( int i = 0; i < kWidth; i++ ) {
+      if ( (mask >> i & 1) && node.child[i] != kEmpty ) {
+        stack[top++] = node.child[i];
+      }
+    }
+  }
+  return false;
+}
+
+void Bvh::intersect(const BvhRayPacket& packet, BvhHit hits[4]) const
+{
+  if ( nodes_.empty() ) {
+    return;
+  }
+  // в дорожках - лучи пакета; узел и треугольник размножаются на все дорожки
+  RayLanes r = splat(packet);
+  alignas(16) float tMaxLanes[4];
+  std::memcpy(tMaxLanes, packet.tMax, sizeof(tMaxLanes));
+  V tMax = Simd4::load(tMaxLanes);
+  int stack[kStackSize];
+  int top = 0;
+  stack[top++] = 0;
+  while ( top > 0 ) {
+    int index = stack[--top];
+    if ( index < 0 ) {
+      const Triangles& pack = triangles_[size_t(~index)];
+      for ( int k = 0; k < kLeafSize && pack.ids[k] >= 0; k++ ) {
+        V t, u, v;
+        int mask = Simd4::mask(triangles(r, tMax, Simd4::set(pack.v0X[k]), Simd4::set(pack.v0Y[k]), Simd4::set(pack.v0Z[k]),
+                                         Simd4::set(pack.e1X[k]), Simd4::set(pack.e1Y[k]), Simd4::set(pack.e1Z[k]),
+                                         Simd4::set(pack.e2X[k]), Simd4::set(pack.e2Y[k]), Simd4::set(pack.e2Z[k]), t, u, v));
+        if ( mask == 0 ) {
+          continue;
+        }
+        alignas(16) float lanes[3][4];
+        Simd4::store(lanes[0], t);
+        Simd4::store(lanes[1], u);
+        Simd4::store(lanes[2], v);
+        for ( int i = 0; i < 4; i++ ) {
+          if ( mask >> i & 1 ) {
+            tMaxLanes[i] = lanes[0][i];
+            hits[i].t = lanes[0][i];
+            hits[i].u = lanes[1][i];
+            hits[i].v = lanes[2][i];
+            hits[i].triangle = pack.ids[k];
+          }
+        }
+        tMax = Simd4::load(tMaxLanes);
+      }
+      continue;
+    }
+    const Node& node = nodes_[size_t(index)];
+    int children[kWidth];
+    float nearest[kWidth];
+    int count = 0;
+    for ( int c = 0; c < kWidth; c++ ) {
+      if ( node.child[c] == kEmpty ) {
+        continue;
+      }
+      V near;
+      int mask = Simd4::mask(slabs(r, tMax, Simd4::set(node.minX[c]), Simd4::set(node.minY[c]), Simd4::set(node.minZ[c]),
+                                   Simd4::set(node.maxX[c]), Simd4::set(node.maxY[c]), Simd4::set(node.maxZ[c]), near));
+      if ( mask == 0 ) {
+        continue;
+      }
+      // порядок обхода - по ближайшему из попавших лучей
+      alignas(16) float distances[4];
+      Simd4::store(distances, near);
+      float distance = std::numeric_limits<float>::max();
+      for ( int i = 0; i < 4; i++ ) {
+        if ( mask >> i & 1 ) {
+          distance = qMin(distance, distances[i]);
+        }
+      }
+      int j = count++;
+      for ( ; j > 0 && nearest[j - 1] < distance; j-- ) {
+        children[j] = children[j - 1];
+        nearest[j] = nearest[j - 1];
+      }
+      children[j] = node.child[c];
+      nearest[j] = distance;
+    }
+    for ( int i = 0; i < count; i++ ) {
+      stack[top++] = children[i];
+    }
+  }
+}
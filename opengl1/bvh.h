@@ -0,0 +1,120 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include <QVector>
+#include <QVector3D>
+
+#include "structs.h"
+
+struct BvhRay {
+  QVector3D origin;
+  QVector3D direction;
+  float tMin = 0.0f;
+  float tMax = std::numeric_limits<float>::max();
+};
+
+// u, v - барицентрические координаты относительно вершин 1 и 2 треугольника
+struct BvhHit {
+  float t = std::numeric_limits<float>::max();
+  float u = 0.0f;
+  float v = 0.0f;
+  int triangle = -1;
+};
+
+// четыре луча по компонентам (SoA); у неактивной дорожки tMax < 0
+struct alignas(16) BvhRayPacket {
+  float originX[4];
+  float originY[4];
+  float originZ[4];
+  float directionX[4];
+  float directionY[4];
+  float directionZ[4];
+  float tMin[4];
+  float tMax[4];
+};
+
+// Иерархия ограничивающих объёмов по треугольникам для трассировки на CPU. Строится
+// бинарным разбиением по SAH (kBins корзин по каждой оси), которое сразу сворачивается
+// в дерево ширины 4: в узле границы четырёх детей лежат по компонентам, и луч проверяется
+// со всеми четырьмя одной SIMD-операцией. Лист - пачка до kLeafSize треугольников в том же
+// виде (вершина и два ребра по компонентам), пересечение Мёллера-Трумбора тоже идёт
+// по четыре. SSE2 на x86-64, NEON на ARM, без них - скалярный вариант того же кода.
+class Bvh
+{
+public:
+  static const int kWidth = 4;
+  static const int kLeafSize = 4;
+  static const int kBins = 16;
+
+  // positions - по три вершины на треугольник, номер треугольника в BvhHit - по этому массиву
+  void build(const QVector<QVector3D>& positions);
+  void clear();
+
+  // ближайшее пересечение в (tMin, tMax)
+  bool intersect(const BvhRay& ray, BvhHit& hit) const;
+  // любое пересечение - для теневых лучей
+  bool occluded(const BvhRay& ray) const;
+  // четыре луча одним обходом: узел проверяется сразу для всех лучей пакета
+  void intersect(const BvhRayPacket& packet, BvhHit hits[4]) const;
+
+  bool isEmpty() const { return nodes_.empty(); }
+  int nodeCount() const { return int(nodes_.size()); }
+  int triangleCount() const { return triangleCount_; }
+  const BoundingBox& bounds() const { return bounds_; }
+  static const char* backend();
+  // границы дерева (глубина 0) и коробки детей узлов до глубины maxDepth - для отладочного вывода
+  void visitBoxes(int maxDepth, const std::function<void(const BoundingBox& box, int depth)>& visitor) const;
+
+private:
+  // ребёнок >= 0 - узел, < 0 - лист ~(номер пачки), kEmpty - пустой слот
+  static const int kEmpty;
+
+  struct alignas(16) Node {
+    float minX[kWidth];
+    float minY[kWidth];
+    float minZ[kWidth];
+    float maxX[kWidth];
+    float maxY[kWidth];
+    float maxZ[kWidth];
+    int child[kWidth];
+  };
+
+  // пустые места пачки - вырожденные треугольники, они никогда не пересекаются
+  struct alignas(16) Triangles {
+    float v0X[kLeafSize];
+    float v0Y[kLeafSize];
+    float v0Z[kLeafSize];
+    float e1X[kLeafSize];
+    float e1Y[kLeafSize];
+    float e1Z[kLeafSize];
+    float e2X[kLeafSize];
+    float e2Y[kLeafSize];
+    float e2Z[kLeafSize];
+    int ids[kLeafSize];
+  };
+
+  struct Reference {
+    BoundingBox box;
+    QVector3D centroid;
+    int triangle;
+  };
+
+  int buildNode(const QVector<QVector3D>& positions, int begin, int end, int depth);
+  int buildLeaf(const QVector<QVector3D>& positions, int begin, int end);
+  // SAH по корзинам, возвращает границу разбиения внутри (begin, end); median - пополам
+  int split(int begin, int end, bool median);
+  BoundingBox rangeBounds(int begin, int end) const;
+
+private:
+  std::vector<Node> nodes_;
+  std::vector<Triangles> triangles_;
+  std::vector<Reference> references_;
+  BoundingBox bounds_;
+  int triangleCount_ = 0;
+};
+
+#endif // BVH_H
@@ -17,21 +17,26 @@ Camera::Camera(QVector3D cameraPos, QVector3D cameraFront) :
 
 }
 
-QMatrix4x4 Camera::getView()
+const QMatrix4x4& Camera::getView()
 {
-  QMatrix4x4 view;
-  view.lookAt(cameraPos_, cameraPos_ + cameraFront_, up_);
-  return view;
+  if ( viewDirty_ ) {
+    view_.setToIdentity();
+    view_.lookAt(cameraPos_, cameraPos_ + cameraFront_, up_);
+    viewDirty_ = false;
+  }
+  return view_;
 }
 
 void Camera::goForward()
 {
   cameraPos_ += cameraFront_ * kCameraSpeed;
+  viewDirty_ = true;
 }
 
 void Camera::goBack()
 {
   cameraPos_ -= cameraFront_ * kCameraSpeed;
+  viewDirty_ = true;
 }
 
 void Camera::goLeft()
@@ -39,6 +44,7 @@ void Camera::goLeft()
   auto right = QVector3D::crossProduct(cameraFront_, up_);
   right.normalize();
   cameraPos_ -= right * kCameraSpeed;
+  viewDirty_ = true;
 }
 
 void Camera::goRight()
@@ -46,6 +52,7 @@ void Camera::goRight()
   auto right = QVector3D::crossProduct(cameraFront_, up_);
   right.normalize();
   cameraPos_ += right * kCameraSpeed;
+  viewDirty_ = true;
 }
 
 void Camera::rotateCamera(QPoint diff )
@@ -63,4 +70,5 @@ void Camera::rotateCamera(QPoint diff )
   cameraFront_.setY( sin(qDegreesToRadians(pitch_)) );
   cameraFront_.setZ( sin(qDegreesToRadians(yaw_)) * cos(qDegreesToRadians(pitch_)) );
   cameraFront_.normalize();
+  viewDirty_ = true;
 }
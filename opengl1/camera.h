@@ -9,9 +9,10 @@ class Camera
 public:
   Camera();
   Camera(QVector3D cameraPos, QVector3D cameraFront);
-  void setCameraPosition(QVector3D pos) { cameraPos_ = pos; }
-  void setCameraFront(QVector3D front) { cameraFront_ = front; }
-  QMatrix4x4 getView();
+  void setCameraPosition(QVector3D pos) { cameraPos_ = pos; viewDirty_ = true; }
+  void setCameraFront(QVector3D front) { cameraFront_ = front; viewDirty_ = true; }
+  // lookAt пересчитывается только после движения камеры
+  const QMatrix4x4& getView();
   void goForward();
   void goBack();
   void goLeft();
@@ -27,6 +28,8 @@ private:
   QVector3D up_{0.0f, 1.0f, 0.0f};
   float yaw_ = -90.0f;
   float pitch_ = 0.0f;
+  QMatrix4x4 view_;
+  bool viewDirty_ = true;
 };
 
 #endif // CAMERA_H
@@ -0,0 +1,206 @@
+#include "cpuscene.h"
+#include "oglobject.h"
+#include "material.h"
+#include "tonemap.h"
+
+#include <cmath>
+
+static QImage toRgba(const QImage& image)
+{
+  return image.isNull() ? image : image.convertToFormat(QImage::Format_RGBA8888);
+}
+
+void CpuScene::clear()
+{
+  positions_.clear();
+  triangles_.clear();
+  surfaces_.clear();
+  pointLights_.clear();
+  lightColor_ = QVector3D{0.0f, 0.0f, 0.0f};
+  environment_.clear();
+}
+
+void CpuScene::addMesh(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes, const QMatrix4x4& model,
+                       const Surface& surface)
+{
+  int surfaceIndex = surfaces_.size();
+  Surface converted = surface;
+  converted.albedoMap = toRgba(surface.albedoMap);
+  converted.normalMap = toRgba(surface.normalMap);
+  converted.metallicMap = toRgba(surface.metallicMap);
+  converted.roughnessMap = toRgba(surface.roughnessMap);
+  converted.aoMap = toRgba(surface.aoMap);
+  surfaces_.append(converted);
+
+  QMatrix4x4 normalMatrix = model.inverted().transposed();
+  for ( int i = 0; i + 2 < indexes.size(); i += 3 ) {
+    if ( int(qMax(indexes.at(i), qMax(indexes.at(i + 1), indexes.at(i + 2)))) >= vertexes.size() ) {
+      continue;
+    }
+    Triangle triangle;
+    for ( int k = 0; k < 3; k++ ) {
+      const Vertex& vertex = vertexes.at(int(indexes.at(i + k)));
+      triangle.positions[k] = model.map(vertex.position);
+      triangle.normals[k] = normalMatrix.mapVector(vertex.normal).normalized();
+      triangle.uvs[k] = vertex.texturePosition;
+      positions_.append(triangle.positions[k]);
+    }
+    QVector3D e1 = triangle.positions[1] - triangle.positions[0];
+    QVector3D e2 = triangle.positions[2] - triangle.positions[0];
+    triangle.geometric = QVector3D::crossProduct(e1, e2).normalized();
+    QVector2D d1 = triangle.uvs[1] - triangle.uvs[0];
+    QVector2D d2 = triangle.uvs[2] - triangle.uvs[0];
+    float determinant = d1.x() * d2.y() - d2.x() * d1.y();
+    if ( std::fabs(determinant) > 1.0e-12f ) {
+      float r = 1.0f / determinant;
+      triangle.tangent = (e1 * d2.y() - e2 * d1.y()) * r;
+      triangle.bitangent = (e2 * d1.x() - e1 * d2.x()) * r;
+    }
+    else {
+      basis(triangle.geometric, triangle.tangent, triangle.bitangent);
+    }
+    triangle.surface = surfaceIndex;
+    triangles_.push_back(triangle);
+  }
+}
+
+bool CpuScene::addObject(OGLObject& object, const QMatrix4x4& model)
+{
+  bool added = false;
+  for ( const auto& mesh : object.meshes() ) {
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+    if ( !mesh->readGeometry(vertexes, indexes) ) {
+      continue;
+    }
+    addMesh(vertexes, indexes, model, surface(mesh->material()));
+    added = true;
+  }
+  return added;
+}
+
+CpuScene::Surface CpuScene::surface(const Material* material)
+{
+  Surface surface;
+  if ( material == nullptr ) {
+    return surface;
+  }
+  auto image = []( const StreamedTexture* texture ) {
+    return texture != nullptr && texture->mipCount() > 0 ? texture->image() : QImage();
+  };
+  surface.albedo = material->ambientColor();
+  surface.metallic = material->metallic();
+  surface.roughness = material->roughness();
+  surface.ao = material->ao();
+  surface.albedoMap = image(material->textureAlbedo());
+  surface.normalMap = image(material->textureNormal());
+  surface.metallicMap = image(material->textureMetallic());
+  surface.roughnessMap = image(material->textureRoughness());
+  surface.aoMap = image(material->textureAmbientOcclusion());
+  return surface;
+}
+
+void CpuScene::setDirectionalLight(const QVector3D& direction, const QVector3D& color)
+{
+  lightDirection_ = direction.normalized();
+  lightColor_ = color;
+}
+
+void CpuScene::addPointLight(const PointLight& light)
+{
+  pointLights_.append(light);
+}
+
+void CpuScene::setEnvironment(const QVector<QImage>& faces, float intensity)
+{
+  environment_.clear();
+  if ( faces.size() != 6 ) {
+    return;
+  }
+  for ( const auto& face : faces ) {
+    if ( face.isNull() ) {
+      environment_.clear();
+      return;
+    }
+    environment_.append(toRgba(face));
+  }
+  environmentIntensity_ = intensity;
+}
+
+QVector3D CpuScene::environment(const QVector3D& direction) const
+{
+  if ( environment_.isEmpty() ) {
+    return QVector3D{0.0f, 0.0f, 0.0f};
+  }
+  // выбор грани и координат как у samplerCube (таблица из спецификации GL)
+  float x = direction.x();
+  float y = direction.y();
+  float z = direction.z();
+  float ax = std::fabs(x);
+  float ay = std::fabs(y);
+  float az = std::fabs(z);
+  int face;
+  float s, t, major;
+  if ( ax >= ay && ax >= az ) {
+    face = x > 0.0f ? 0 : 1;
+    s = x > 0.0f ? -z : z;
+    t = -y;
+    major = ax;
+  }
+  else if ( ay >= az ) {
+    face = y > 0.0f ? 2 : 3;
+    s = x;
+    t = y > 0.0f ? z : -z;
+    major = ay;
+  }
+  else {
+    face = z > 0.0f ? 4 : 5;
+    s = z > 0.0f ? x : -x;
+    t = -y;
+    major = az;
+  }
+  QVector2D uv{(s / major + 1.0f) * 0.5f, (t / major + 1.0f) * 0.5f};
+  // грани неба в sRGB, как у skybox в fSkyBoxShader.frag
+  return Tonemap::toLinear(sample(environment_.at(face), uv, false).toVector3D()) * environmentIntensity_;
+}
+
+QVector4D CpuScene::sample(const QImage& map, const QVector2D& uv, bool repeat)
+{
+  int width = map.width();
+  int height = map.height();
+  float x = uv.x() * float(width) - 0.5f;
+  float y = uv.y() * float(height) - 0.5f;
+  if ( !std::isfinite(x) || !std::isfinite(y) ) {
+    x = 0.0f;
+    y = 0.0f;
+  }
+  float fx = x - std::floor(x);
+  float fy = y - std::floor(y);
+  int x0 = int(std::floor(x));
+  int y0 = int(std::floor(y));
+  auto texel = [&]( int tx, int ty ) {
+    if ( repeat ) {
+      tx = (tx % width + width) % width;
+      ty = (ty % height + height) % height;
+    }
+    else {
+      tx = qBound(0, tx, width - 1);
+      ty = qBound(0, ty, height - 1);
+    }
+    const uchar* p = map.constScanLine(ty) + tx * 4;
+    return QVector4D{float(p[0]), float(p[1]), float(p[2]), float(p[3])};
+  };
+  QVector4D top = texel(x0, y0) * (1.0f - fx) + texel(x0 + 1, y0) * fx;
+  QVector4D bottom = texel(x0, y0 + 1) * (1.0f - fx) + texel(x0 + 1, y0 + 1) * fx;
+  return (top * (1.0f - fy) + bottom * fy) / 255.0f;
+}
+
+void CpuScene::basis(const QVector3D& n, QVector3D& t, QVector3D& b)
+{
+  // Duff и др., 2017
+  float sign = std::copysign(1.0f, n.z());
+  float a = -1.0f / (sign + n.z());
+  float c = n.x() * n.y() * a;
+  t = QVector3D{1.0f + sign * n.x() * n.x() * a, sign * c, -sign * n.x()};
+  b = QVector3D{c, sign + n.y() * n.y() * a, -n.y()};
+}
@@ -0,0 +1,103 @@
+#ifndef CPUSCENE_H
+#define CPUSCENE_H
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector>
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector4D>
+#include <qopengl.h>
+
+#include <vector>
+
+#include "structs.h"
+
+class OGLObject;
+class Material;
+
+// Снимок сцены для рендеров на CPU (PathTracer, SoftwareRasterizer): треугольники в мировых
+// координатах, параметры материалов как их получает fPBRShader.frag, источники света и небо.
+// Собирается в потоке контекста GL (addObject() читает буферы мешей), после этого не меняется
+// и читается из любых потоков без синхронизации.
+class CpuScene
+{
+public:
+  // материал поверхности; карты - RGBA8888, строка изображения = v * высоту, как у текстур в GL
+  struct Surface {
+    QVector3D albedo{1.0f, 1.0f, 1.0f};
+    float metallic = 0.0f;
+    float roughness = 0.5f;
+    float ao = 1.0f;
+    QImage albedoMap;
+    QImage normalMap;
+    QImage metallicMap;
+    QImage roughnessMap;
+    QImage aoMap;
+  };
+
+  // затухание как в шейдере: 1 / (constant + linear * d + quadratic * d^2)
+  struct PointLight {
+    QVector3D position;
+    QVector3D color;
+    float constant = 1.0f;
+    float linear = 0.09f;
+    float quadratic = 0.032f;
+  };
+
+  struct Triangle {
+    QVector3D positions[3];
+    QVector3D normals[3];
+    QVector2D uvs[3];
+    // касательные по развёртке - для карты нормалей
+    QVector3D tangent;
+    QVector3D bitangent;
+    QVector3D geometric;
+    int surface;
+  };
+
+  CpuScene() = default;
+  CpuScene(const CpuScene&) = delete;
+
+  CpuScene& operator=(const CpuScene&) = delete;
+
+  void clear();
+  void addMesh(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes, const QMatrix4x4& model,
+               const Surface& surface);
+  // меши объекта (LOD 0) с их материалами; в потоке контекста GL
+  bool addObject(OGLObject& object, const QMatrix4x4& model);
+  // параметры как их берёт fPBRShader.frag: без карты цвет - ambientColor
+  static Surface surface(const Material* material);
+  void setDirectionalLight(const QVector3D& direction, const QVector3D& color);
+  void addPointLight(const PointLight& light);
+  // грани кубической карты в порядке GL: +X, -X, +Y, -Y, +Z, -Z
+  void setEnvironment(const QVector<QImage>& faces, float intensity = 1.0f);
+
+  const std::vector<Triangle>& triangles() const { return triangles_; }
+  const QVector<Surface>& surfaces() const { return surfaces_; }
+  // вершины треугольников подряд, по три, - вход Bvh::build()
+  const QVector<QVector3D>& positions() const { return positions_; }
+  const QVector<PointLight>& pointLights() const { return pointLights_; }
+  QVector3D lightDirection() const { return lightDirection_; }
+  QVector3D lightColor() const { return lightColor_; }
+  bool hasEnvironment() const { return !environment_.isEmpty(); }
+  // цвет неба по направлению, как samplerCube; без неба - чёрный
+  QVector3D environment(const QVector3D& direction) const;
+
+  // билинейная выборка, repeat - повтор текстуры, иначе край растягивается
+  static QVector4D sample(const QImage& map, const QVector2D& uv, bool repeat = true);
+  // ортонормированный базис вокруг n
+  static void basis(const QVector3D& n, QVector3D& t, QVector3D& b);
+
+private:
+  QVector<QVector3D> positions_;
+  std::vector<Triangle> triangles_;
+  QVector<Surface> surfaces_;
+  QVector<PointLight> pointLights_;
+  QVector3D lightDirection_{0.0f, -1.0f, 0.0f};
+  QVector3D lightColor_{0.0f, 0.0f, 0.0f};
+  QVector<QImage> environment_;
+  float environmentIntensity_ = 1.0f;
+};
+
+#endif // CPUSCENE_H
@@ -0,0 +1,348 @@
+#include "debugdraw.h"
+#include "bvh.h"
+#include "gpuringbuffer.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QtMath>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+
+// подписи: ширина знака и шаг строки в долях высоты
+static const float kGlyphWidth = 0.55f;
+static const float kGlyphAdvance = 0.8f;
+// наконечник стрелки в долях её длины
+static const float kArrowHead = 0.15f;
+// нормали резервируются пачками: у большой модели рисуется часть, что влезла в лимит кадра
+static const int kNormalBatch = 4096;
+
+namespace {
+
+// 14 сегментов и две точки; у сегмента концы (x0, y0, x1, y1) в долях ширины и высоты знака
+enum Segment : quint16 {
+  A = 1 << 0, B = 1 << 1, C = 1 << 2, D = 1 << 3, E = 1 << 4, F = 1 << 5,
+  G1 = 1 << 6, G2 = 1 << 7, H = 1 << 8, I = 1 << 9, J = 1 << 10, K = 1 << 11, L = 1 << 12, M = 1 << 13,
+  DotLow = 1 << 14, DotHigh = 1 << 15
+};
+
+const int kSegmentCount = 16;
+const float kSegments[kSegmentCount][4]{
+  {0.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 0.5f}, {1.0f, 0.5f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, 0.0f, 0.5f}, {0.0f, 0.5f, 0.0f, 1.0f}, {0.0f, 0.5f, 0.5f, 0.5f}, {0.5f, 0.5f, 1.0f, 0.5f},
+  {0.0f, 1.0f, 0.5f, 0.5f}, {0.5f, 1.0f, 0.5f, 0.5f}, {1.0f, 1.0f, 0.5f, 0.5f}, {0.0f, 0.0f, 0.5f, 0.5f},
+  {0.5f, 0.5f, 0.5f, 0.0f}, {1.0f, 0.0f, 0.5f, 0.5f}, {0.5f, 0.0f, 0.5f, 0.1f}, {0.5f, 0.6f, 0.5f, 0.7f}
+};
+
+const quint16 kDigits[10]{
+  A | B | C | D | E | F | J | K, B | C | J, A | B | G1 | G2 | E | D, A | B | C | D | G2, F | G1 | G2 | B | C,
+  A | F | G1 | G2 | C | D, A | F | G1 | G2 | E | C | D, A | B | C, A | B | C | D | E | F | G1 | G2,
+  A | B | C | D | F | G1 | G2
+};
+
+const quint16 kLetters[26]{
+  A | B | C | E | F | G1 | G2, A | B | C | D | I | L | G2, A | D | E | F, A | B | C | D | I | L,
+  A | D | E | F | G1, A | E | F | G1, A | C | D | E | F | G2, B | C | E | F | G1 | G2, A | D | I | L,
+  B | C | D | E, E | F | G1 | J | M, D | E | F, B | C | E | F | H | J, B | C | E | F | H | M,
+  A | B | C | D | E | F, A | B | E | F | G1 | G2, A | B | C | D | E | F | M, A | B | E | F | G1 | G2 | M,
+  A | F | G1 | G2 | C | D, A | I | L, B | C | D | E | F, E | F | K | J, B | C | E | F | K | M,
+  H | J | K | M, H | J | L, A | J | K | D
+};
+
+quint16 glyph(char c)
+{
+  if ( c >= '0' && c <= '9' ) {
+    return kDigits[c - '0'];
+  }
+  c = char(std::toupper(static_cast<unsigned char>(c)));
+  if ( c >= 'A' && c <= 'Z' ) {
+    return kLetters[c - 'A'];
+  }
+  switch ( c ) {
+    case ( '-' ): { return G1 | G2; }
+    case ( '+' ): { return G1 | G2 | I | L; }
+    case ( '.' ): { return DotLow; }
+    case ( ':' ): { return DotLow | DotHigh; }
+    case ( '/' ): { return J | K; }
+    case ( '_' ): { return D; }
+    default: { return 0; }
+  }
+}
+
+int bitCount(quint16 mask)
+{
+  int count = 0;
+  for ( ; mask != 0; mask &= quint16(mask - 1) ) {
+    count++;
+  }
+  return count;
+}
+
+// любой единичный вектор, перпендикулярный direction
+QVector3D perpendicular(const QVector3D& direction)
+{
+  QVector3D axis = std::fabs(direction.x()) < 0.9f ? QVector3D{1.0f, 0.0f, 0.0f} : QVector3D{0.0f, 1.0f, 0.0f};
+  return QVector3D::crossProduct(direction, axis).normalized();
+}
+
+} // namespace
+
+quint32 DebugDraw::pack(const QVector3D& color)
+{
+  auto channel = [](float value) {
+    return quint32(qBound(0.0f, value, 1.0f) * 255.0f + 0.5f);
+  };
+  return channel(color.x()) | channel(color.y()) << 8 | channel(color.z()) << 16 | 0xFFu << 24;
+}
+
+void DebugDraw::begin(const QMatrix4x4& view)
+{
+  clear();
+  dropped_ = 0;
+  overlay_ = false;
+  right_ = view.row(0).toVector3D().normalized();
+  up_ = view.row(1).toVector3D().normalized();
+}
+
+void DebugDraw::clear()
+{
+  depthTested_.clear();
+  overlaid_.clear();
+}
+
+DebugDraw::LineVertex* DebugDraw::reserve(int count)
+{
+  if ( vertexCount() + count > kMaxVertices ) {
+    dropped_ += count;
+    return nullptr;
+  }
+  std::vector<LineVertex>& vertexes = overlay_ ? overlaid_ : depthTested_;
+  size_t first = vertexes.size();
+  vertexes.resize(first + size_t(count));
+  return vertexes.data() + first;
+}
+
+void DebugDraw::setVertex(LineVertex& vertex, const QVector3D& position, quint32 color)
+{
+  vertex.position[0] = position.x();
+  vertex.position[1] = position.y();
+  vertex.position[2] = position.z();
+  vertex.color = color;
+}
+
+void DebugDraw::line(const QVector3D& from, const QVector3D& to, const QVector3D& color)
+{
+  LineVertex* out = reserve(2);
+  if ( !out ) { return; }
+  quint32 packed = pack(color);
+  setVertex(out[0], from, packed);
+  setVertex(out[1], to, packed);
+}
+
+void DebugDraw::cross(const QVector3D& center, float size, const QVector3D& color)
+{
+  LineVertex* out = reserve(6);
+  if ( !out ) { return; }
+  quint32 packed = pack(color);
+  float half = size * 0.5f;
+  for ( int axis = 0; axis < 3; axis++ ) {
+    QVector3D offset;
+    offset[axis] = half;
+    setVertex(out[axis * 2], center - offset, packed);
+    setVertex(out[axis * 2 + 1], center + offset, packed);
+  }
+}
+
+void DebugDraw::box(const BoundingBox& box, const QVector3D& color)
+{
+  this->box(QMatrix4x4(), box, color);
+}
+
+void DebugDraw::box(const QMatrix4x4& model, const BoundingBox& box, const QVector3D& color)
+{
+  if ( box.isEmpty() ) { return; }
+  // углы: бит 0 - x, бит 1 - y, бит 2 - z (0 - min, 1 - max)
+  static const int kEdges[12][2]{{0, 1}, {2, 3}, {4, 5}, {6, 7}, {0, 2}, {1, 3},
+                                 {4, 6}, {5, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+  LineVertex* out = reserve(24);
+  if ( !out ) { return; }
+  QVector3D corners[8];
+  for ( int i = 0; i < 8; i++ ) {
+    QVector3D corner{(i & 1) ? box.max.x() : box.min.x(), (i & 2) ? box.max.y() : box.min.y(),
+                     (i & 4) ? box.max.z() : box.min.z()};
+    corners[i] = model.map(corner);
+  }
+  quint32 packed = pack(color);
+  for ( int i = 0; i < 12; i++ ) {
+    setVertex(out[i * 2], corners[kEdges[i][0]], packed);
+    setVertex(out[i * 2 + 1], corners[kEdges[i][1]], packed);
+  }
+}
+
+void DebugDraw::circle(const QVector3D& center, const QVector3D& normal, float radius, const QVector3D& color)
+{
+  LineVertex* out = reserve(kCircleSegments * 2);
+  if ( !out ) { return; }
+  QVector3D u = perpendicular(normal.normalized());
+  QVector3D v = QVector3D::crossProduct(normal.normalized(), u);
+  quint32 packed = pack(color);
+  QVector3D previous = center + u * radius;
+  for ( int i = 1; i <= kCircleSegments; i++ ) {
+    float angle = 2.0f * float(M_PI) * float(i) / float(kCircleSegments);
+    QVector3D point = center + (u * std::cos(angle) + v * std::sin(angle)) * radius;
+    setVertex(*out++, previous, packed);
+    setVertex(*out++, point, packed);
+    previous = point;
+  }
+}
+
+void DebugDraw::sphere(const QVector3D& center, float radius, const QVector3D& color)
+{
+  circle(center, QVector3D{1.0f, 0.0f, 0.0f}, radius, color);
+  circle(center, QVector3D{0.0f, 1.0f, 0.0f}, radius, color);
+  circle(center, QVector3D{0.0f, 0.0f, 1.0f}, radius, color);
+}
+
+void DebugDraw::arrow(const QVector3D& from, const QVector3D& to, const QVector3D& color)
+{
+  QVector3D direction = to - from;
+  float length = direction.length();
+  if ( length <= 0.0f ) { return; }
+  LineVertex* out = reserve(10);
+  if ( !out ) { return; }
+  direction /= length;
+  QVector3D u = perpendicular(direction) * (length * kArrowHead * 0.5f);
+  QVector3D v = QVector3D::crossProduct(direction, u);
+  QVector3D base = to - direction * (length * kArrowHead);
+  quint32 packed = pack(color);
+  setVertex(*out++, from, packed);
+  setVertex(*out++, to, packed);
+  for ( const QVector3D& side : { u, -u, v, -v } ) {
+    setVertex(*out++, to, packed);
+    setVertex(*out++, base + side, packed);
+  }
+}
+
+void DebugDraw::frustum(const QMatrix4x4& viewProjection, const QVector3D& color)
+{
+  bool invertible = false;
+  QMatrix4x4 inverse = viewProjection.inverted(&invertible);
+  if ( !invertible ) { return; }
+  // углы куба NDC в том же порядке, что у коробки
+  BoundingBox ndc;
+  ndc.min = QVector3D{-1.0f, -1.0f, -1.0f};
+  ndc.max = QVector3D{1.0f, 1.0f, 1.0f};
+  box(inverse, ndc, color);
+}
+
+void DebugDraw::text(const QVector3D& position, const char* text, float height, const QVector3D& color)
+{
+  int count = 0;
+  for ( const char* c = text; *c; c++ ) {
+    count += bitCount(glyph(*c));
+  }
+  LineVertex* out = reserve(count * 2);
+  if ( !out ) { return; }
+  quint32 packed = pack(color);
+  QVector3D right = right_ * (height * kGlyphWidth);
+  QVector3D up = up_ * height;
+  QVector3D origin = position;
+  for ( const char* c = text; *c; c++ ) {
+    quint16 mask = glyph(*c);
+    for ( int s = 0; s < kSegmentCount; s++ ) {
+      if ( mask >> s & 1 ) {
+        const float* segment = kSegments[s];
+        setVertex(*out++, origin + right * segment[0] + up * segment[1], packed);
+        setVertex(*out++, origin + right * segment[2] + up * segment[3], packed);
+      }
+    }
+    origin += right_ * (height * kGlyphAdvance);
+  }
+}
+
+void DebugDraw::normals(const QVector<Vertex>& vertexes, const QMatrix4x4& model, float length, const QVector3D& color)
+{
+  quint32 packed = pack(color);
+  // матрицы по столбцам; нормаль - через обратную транспонированную
+  const float* m = model.constData();
+  QMatrix3x3 normalMatrix = model.normalMatrix();
+  const float* n = normalMatrix.constData();
+  for ( int begin = 0; begin < vertexes.size(); begin += kNormalBatch ) {
+    int count = std::min(kNormalBatch, vertexes.size() - begin);
+    LineVertex* out = reserve(count * 2);
+    if ( !out ) {
+      continue;
+    }
+    for ( int i = begin; i < begin + count; i++ ) {
+      const Vertex& vertex = vertexes.at(i);
+      float px = vertex.position.x(), py = vertex.position.y(), pz = vertex.position.z();
+      float nx = vertex.normal.x(), ny = vertex.normal.y(), nz = vertex.normal.z();
+      float x = m[0] * px + m[4] * py + m[8] * pz + m[12];
+      float y = m[1] * px + m[5] * py + m[9] * pz + m[13];
+      float z = m[2] * px + m[6] * py + m[10] * pz + m[14];
+      float dx = n[0] * nx + n[3] * ny + n[6] * nz;
+      float dy = n[1] * nx + n[4] * ny + n[7] * nz;
+      float dz = n[2] * nx + n[5] * ny + n[8] * nz;
+      float scale = length / std::max(std::sqrt(dx * dx + dy * dy + dz * dz), 1.0e-12f);
+      LineVertex& from = *out++;
+      LineVertex& to = *out++;
+      from.position[0] = x;
+      from.position[1] = y;
+      from.position[2] = z;
+      from.color = packed;
+      to.position[0] = x + dx * scale;
+      to.position[1] = y + dy * scale;
+      to.position[2] = z + dz * scale;
+      to.color = packed;
+    }
+  }
+}
+
+void DebugDraw::bvh(const Bvh& bvh, int maxDepth, const QVector3D& from, const QVector3D& to)
+{
+  bvh.visitBoxes(maxDepth, [&]( const BoundingBox& box, int depth ) {
+    float t = maxDepth > 0 ? float(depth) / float(maxDepth) : 0.0f;
+    this->box(box, from + (to - from) * t);
+  });
+}
+
+void DebugDraw::flush(QOpenGLShaderProgram& shader, GpuRingBuffer& ring, const QMatrix4x4& viewProjection)
+{
+  if ( isEmpty() || !shader.isLinked() ) {
+    clear();
+    return;
+  }
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  shader.bind();
+  shader.setUniformValue("viewProjection", viewProjection);
+  // линии проверяют глубину сцены, но не пишут её
+  f->glDepthMask(GL_FALSE);
+  drawLines(shader, ring, depthTested_);
+  f->glDisable(GL_DEPTH_TEST);
+  drawLines(shader, ring, overlaid_);
+  f->glEnable(GL_DEPTH_TEST);
+  f->glDepthMask(GL_TRUE);
+  clear();
+}
+
+void DebugDraw::drawLines(QOpenGLShaderProgram& shader, GpuRingBuffer& ring, const std::vector<LineVertex>& vertexes)
+{
+  if ( vertexes.empty() ) { return; }
+  GLintptr offset = ring.write(vertexes.data(), GLsizeiptr(vertexes.size() * sizeof(LineVertex)));
+  if ( offset < 0 ) { return; }
+
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glBindBuffer(GL_ARRAY_BUFFER, ring.buffer());
+  shader.enableAttributeArray(kPositionLocation);
+  shader.setAttributeBuffer(kPositionLocation, GL_FLOAT, int(offset), 3, sizeof(LineVertex));
+  // цвет - байты, нормируются в [0, 1]
+  shader.enableAttributeArray(kColorLocation);
+  f->glVertexAttribPointer(kColorLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(LineVertex),
+                           reinterpret_cast<const void*>(offset + GLintptr(offsetof(LineVertex, color))));
+  f->glDrawArrays(GL_LINES, 0, GLsizei(vertexes.size()));
+  shader.disableAttributeArray(kPositionLocation);
+  shader.disableAttributeArray(kColorLocation);
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
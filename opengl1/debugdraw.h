@@ -0,0 +1,92 @@
+#ifndef DEBUGDRAW_H
+#define DEBUGDRAW_H
+
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QOpenGLShaderProgram>
+
+#include "structs.h"
+
+class Bvh;
+class GpuRingBuffer;
+
+// Отладочная геометрия в немедленном режиме: линии, коробки, сферы, стрелки, пирамиды
+// видимости и подписи можно добавлять откуда угодно в потоке кадра, за кадр они копятся
+// в двух массивах вершин GL_LINES - с тестом глубины и поверх сцены. flush() пишет оба
+// массива в кольцевой буфер и рисует их двумя draw-вызовами, после чего массивы пустеют.
+// Сверх kMaxVertices вершин за кадр примитивы отбрасываются целиком.
+class DebugDraw
+{
+public:
+  static const int kMaxVertices = 1 << 17;
+  static const int kCircleSegments = 24;
+  // атрибуты vDebugShader.vert
+  static const int kPositionLocation = 0;
+  static const int kColorLocation = 1;
+
+  // позиция в мире и цвет sRGB RGBA8
+  struct LineVertex {
+    float position[3];
+    quint32 color;
+  };
+
+  DebugDraw() = default;
+  DebugDraw(const DebugDraw&) = delete;
+
+  DebugDraw& operator=(const DebugDraw&) = delete;
+
+  // начало кадра: из вида берутся оси, в которых подписи повёрнуты к камере
+  void begin(const QMatrix4x4& view);
+  // примитивы после setOverlay(true) рисуются поверх сцены без теста глубины
+  void setOverlay(bool overlay) { overlay_ = overlay; }
+  bool isOverlay() const { return overlay_; }
+
+  void line(const QVector3D& from, const QVector3D& to, const QVector3D& color);
+  void cross(const QVector3D& center, float size, const QVector3D& color);
+  void box(const BoundingBox& box, const QVector3D& color);
+  // коробка в пространстве модели
+  void box(const QMatrix4x4& model, const BoundingBox& box, const QVector3D& color);
+  void circle(const QVector3D& center, const QVector3D& normal, float radius, const QVector3D& color);
+  // три окружности в плоскостях осей
+  void sphere(const QVector3D& center, float radius, const QVector3D& color);
+  void arrow(const QVector3D& from, const QVector3D& to, const QVector3D& color);
+  // рёбра пирамиды видимости матрицы проекции*вида (у теневого каскада - коробка)
+  void frustum(const QMatrix4x4& viewProjection, const QVector3D& color);
+  // подпись сегментным шрифтом (цифры, латиница, - . : / _ +), height - высота строки в мире;
+  // строка начинается в position и повёрнута к камере
+  void text(const QVector3D& position, const char* text, float height, const QVector3D& color);
+  // нормали вершин меша отрезками длины length; сверх лимита кадра отбрасываются
+  // пачками, а не все сразу
+  void normals(const QVector<Vertex>& vertexes, const QMatrix4x4& model, float length, const QVector3D& color);
+  // коробки узлов Bvh до глубины maxDepth, цвет от from у корня к to на maxDepth
+  void bvh(const Bvh& bvh, int maxDepth, const QVector3D& from, const QVector3D& to);
+
+  // shader - vDebugShader.vert / fDebugShader.frag, привязанные цели и viewport - кадра
+  void flush(QOpenGLShaderProgram& shader, GpuRingBuffer& ring, const QMatrix4x4& viewProjection);
+  void clear();
+
+  bool isEmpty() const { return depthTested_.empty() && overlaid_.empty(); }
+  int vertexCount() const { return int(depthTested_.size() + overlaid_.size()); }
+  // вершин отброшено за кадр из-за kMaxVertices
+  int droppedVertices() const { return dropped_; }
+
+  static quint32 pack(const QVector3D& color);
+
+private:
+  // место под count вершин в текущем массиве или nullptr, если лимит кадра исчерпан
+  LineVertex* reserve(int count);
+  static void setVertex(LineVertex& vertex, const QVector3D& position, quint32 color);
+  void drawLines(QOpenGLShaderProgram& shader, GpuRingBuffer& ring, const std::vector<LineVertex>& vertexes);
+
+private:
+  std::vector<LineVertex> depthTested_;
+  std::vector<LineVertex> overlaid_;
+  bool overlay_ = false;
+  int dropped_ = 0;
+  QVector3D right_{1.0f, 0.0f, 0.0f};
+  QVector3D up_{0.0f, 1.0f, 0.0f};
+};
+
+#endif // DEBUGDRAW_H
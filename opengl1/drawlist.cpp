@@ -0,0 +1,265 @@
+#include "drawlist.h"
+#include "oglobject.h"
+#include "mesh.h"
+#include "occlusionculler.h"
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+// меньше экземпляров на задачу - накладные расходы пула съедают выигрыш
+static const int kMinInstancesPerTask = 512;
+static const int kTasksPerThread = 4;
+
+// материал и меш в старших битах (состояние меняется реже), глубина - спереди назад
+static quint64 sortKey(const Mesh* mesh, float depth)
+{
+  auto hash16 = []( const void* pointer ) {
+    return (quint64(quintptr(pointer)) * 0x9E3779B97F4A7C15ull) >> 48;
+  };
+  // неотрицательные float при сравнении как целые сохраняют порядок
+  quint32 depthBits = 0;
+  float clamped = qMax(depth, 0.0f);
+  std::memcpy(&depthBits, &clamped, sizeof(depthBits));
+  return (hash16(mesh->material()) << 48) | (hash16(mesh) << 32) | depthBits;
+}
+
+DrawListBuilder::DrawList::DrawList() :
+  items{ArenaAllocator<DrawItem>(&arena)},
+  models{ArenaAllocator<Mat4>(&arena)},
+  transforms{ArenaAllocator<ObjectTransform>(&arena)},
+  counts{ArenaAllocator<GLsizei>(&arena)},
+  offsets{ArenaAllocator<const void*>(&arena)}
+{
+
+}
+
+void DrawListBuilder::DrawList::begin(int firstInstance, int lastInstance)
+{
+  // резерв по прошлому кадру: в установившемся режиме списки не растут
+  size_t itemCapacity = items.size();
+  size_t modelCapacity = models.size();
+  size_t rangeCapacity = counts.size();
+  arena.beginFrame();
+  items = ArenaVector<DrawItem>(ArenaAllocator<DrawItem>(&arena));
+  models = ArenaVector<Mat4>(ArenaAllocator<Mat4>(&arena));
+  transforms = ArenaVector<ObjectTransform>(ArenaAllocator<ObjectTransform>(&arena));
+  counts = ArenaVector<GLsizei>(ArenaAllocator<GLsizei>(&arena));
+  offsets = ArenaVector<const void*>(ArenaAllocator<const void*>(&arena));
+  items.reserve(itemCapacity);
+  models.reserve(modelCapacity);
+  transforms.reserve(modelCapacity);
+  counts.reserve(rangeCapacity);
+  offsets.reserve(rangeCapacity);
+  first = firstInstance;
+  last = lastInstance;
+  instances = 0;
+  culled = 0;
+  trianglesDrawn = 0;
+  trianglesSaved = 0;
+  meshletTriangles = 0;
+  meshletTrianglesVisible = 0;
+}
+
+void DrawListBuilder::build(Scene& scene, const OcclusionCuller* culler, const DrawView& view)
+{
+  QElapsedTimer timer;
+  timer.start();
+  ComponentArray<MeshRendererComponent>& renderers = scene.meshRenderers();
+  int count = renderers.size();
+  JobSystem& jobs = JobSystem::instance();
+  int taskLimit = jobs.threadCount() * kTasksPerThread;
+  tasks_ = qBound(1, count / kMinInstancesPerTask, taskLimit);
+  while ( lists_.size() < tasks_ ) {
+    lists_.append(std::make_shared<DrawList>());
+  }
+  for ( int i = 0; i < tasks_; i++ ) {
+    lists_[i]->begin(count * i / tasks_, count * (i + 1) / tasks_);
+  }
+
+  // data() отделяет общий буфер QVector заранее, в потоках запись идёт только в свои элементы
+  Traversal traversal{renderers.data(), &scene, culler, view, Frustum{view.viewProjection}};
+  if ( tasks_ == 1 ) {
+    traverse(*lists_.first(), traversal);
+  }
+  else {
+    jobs.parallelFor(tasks_, 1, [this, &traversal]( int begin, int end ) {
+      for ( int i = begin; i < end; i++ ) {
+        traverse(*lists_.at(i), traversal);
+      }
+    });
+  }
+
+  instances_ = 0;
+  instancesCulled_ = 0;
+  drawItems_ = 0;
+  trianglesDrawn_ = 0;
+  trianglesSaved_ = 0;
+  meshletTriangles_ = 0;
+  meshletTrianglesVisible_ = 0;
+  for ( int i = 0; i < tasks_; i++ ) {
+    const DrawList& list = *lists_.at(i);
+    instances_ += list.instances;
+    instancesCulled_ += list.culled;
+    drawItems_ += int(list.items.size());
+    trianglesDrawn_ += list.trianglesDrawn;
+    trianglesSaved_ += list.trianglesSaved;
+    meshletTriangles_ += list.meshletTriangles;
+    meshletTrianglesVisible_ += list.meshletTrianglesVisible;
+  }
+  buildMs_ = float(timer.nsecsElapsed()) / 1.0e6f;
+}
+
+void DrawListBuilder::traverse(DrawList& list, const Traversal& traversal)
+{
+  const DrawView& view = traversal.view;
+  bool meshletCulling = view.meshletCulling;
+  const Scene& scene = *traversal.scene;
+  for ( int i = list.first; i < list.last; i++ ) {
+    MeshRendererComponent& renderer = traversal.renderers[i];
+    if ( !renderer.object ) {
+      continue;
+    }
+    int entity = scene.meshRenderers().entity(i);
+    const BoundsComponent* bounds = scene.bounds().find(entity);
+    if ( !bounds || bounds->local.isEmpty() ) {
+      continue;
+    }
+    list.instances++;
+    // мировая сфера уже посчитана системой границ, матрица нужна только видимым
+    if ( !traversal.frustum.intersects(bounds->center, bounds->radius) ) {
+      list.culled++;
+      continue;
+    }
+    Mat4 world = scene.worldMat4(entity);
+    QMatrix4x4 model = SimdMath::toQt(world);
+    const QVector3D& center = bounds->center;
+    float depth = (center - view.position).length();
+
+    // кластеры проверяем в пространстве модели, обратную матрицу считаем только когда нужна
+    Frustum localFrustum;
+    QVector3D localCamera;
+    bool localReady = false;
+    // матрица экземпляра попадает в пакет, только если рисуется хотя бы один его меш
+    int transform = -1;
+
+    const auto& meshes = renderer.object->meshes();
+    if ( renderer.lods.size() != meshes.size() ) {
+      renderer.lods.fill(0, meshes.size());
+    }
+    for ( int m = 0; m < meshes.size(); m++ ) {
+      Mesh* mesh = meshes.at(m).get();
+      if ( traversal.culler && !traversal.culler->isVisible(mesh->bounds(), model) ) {
+        continue;
+      }
+      int lod = mesh->selectLod(model, view, renderer.lods.at(m));
+      renderer.lods[m] = lod;
+      mesh->requestTextures(model, view);
+
+      DrawItem item;
+      item.sortKey = sortKey(mesh, depth);
+      item.mesh = mesh;
+      item.lod = lod;
+      if ( lod == 0 && meshletCulling && mesh->meshletCount() > 0 ) {
+        if ( !localReady ) {
+          localFrustum = Frustum{view.viewProjection * model};
+          localCamera = model.inverted().map(view.position);
+          localReady = true;
+        }
+        item.firstRange = int(list.counts.size());
+        int visible = mesh->cullMeshlets(localFrustum, localCamera, list.counts, list.offsets);
+        item.rangeCount = int(list.counts.size()) - item.firstRange;
+        list.meshletTriangles += mesh->lodTriangleCount(0);
+        list.meshletTrianglesVisible += visible;
+        list.trianglesDrawn += visible;
+        if ( item.rangeCount == 0 ) {
+          continue;
+        }
+      }
+      else {
+        list.trianglesDrawn += mesh->lodTriangleCount(lod);
+        list.trianglesSaved += mesh->lodTriangleCount(0) - mesh->lodTriangleCount(lod);
+      }
+      if ( transform < 0 ) {
+        transform = int(list.models.size());
+        list.models.push_back(world);
+      }
+      item.transform = transform;
+      list.items.push_back(item);
+    }
+  }
+  std::sort(list.items.begin(), list.items.end(), []( const DrawItem& a, const DrawItem& b ) {
+    return a.sortKey < b.sortKey;
+  });
+  list.transforms.resize(list.models.size());
+  SimdMath::objectTransforms(SimdMath::fromQt(view.viewProjection), list.models.data(), list.transforms.data(),
+                             int(list.models.size()));
+}
+
+void DrawListBuilder::submit(QOpenGLShaderProgram& shader)
+{
+  QElapsedTimer timer;
+  timer.start();
+  meshBinds_ = 0;
+  if ( !shader.isLinked() ) {
+    return;
+  }
+  // слияние отсортированных списков: куча по текущему элементу каждого списка
+  auto greater = []( const Cursor& a, const Cursor& b ) {
+    return a.list->items[a.next].sortKey > b.list->items[b.next].sortKey;
+  };
+  cursors_.resize(0);
+  for ( int i = 0; i < tasks_; i++ ) {
+    if ( !lists_.at(i)->items.empty() ) {
+      cursors_.append(Cursor{lists_.at(i).get(), 0});
+    }
+  }
+  Cursor* heap = cursors_.data();
+  int cursorCount = cursors_.size();
+  std::make_heap(heap, heap + cursorCount, greater);
+
+  int modelLocation = shader.uniformLocation("model");
+  int mvpLocation = shader.uniformLocation("mvp");
+  int normalLocation = shader.uniformLocation("normalMatrix");
+  QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+  Mesh* bound = nullptr;
+  while ( cursorCount > 0 ) {
+    std::pop_heap(heap, heap + cursorCount, greater);
+    Cursor& cursor = heap[cursorCount - 1];
+    const DrawList& list = *cursor.list;
+    const DrawItem& item = list.items[cursor.next];
+    if ( item.mesh != bound ) {
+      if ( bound ) {
+        bound->release(shader);
+      }
+      bound = item.mesh->bind(shader) ? item.mesh : nullptr;
+      meshBinds_++;
+    }
+    if ( bound ) {
+      const ObjectTransform& transform = list.transforms[size_t(item.transform)];
+      f->glUniformMatrix4fv(modelLocation, 1, GL_FALSE, list.models[size_t(item.transform)].m);
+      f->glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, transform.mvp);
+      f->glUniformMatrix3fv(normalLocation, 1, GL_FALSE, transform.normal);
+      if ( item.rangeCount > 0 ) {
+        bound->drawRangesBound(list.counts.data() + item.firstRange, list.offsets.data() + item.firstRange, item.rangeCount);
+      }
+      else {
+        bound->drawBound(item.lod);
+      }
+    }
+    if ( ++cursor.next < list.items.size() ) {
+      std::push_heap(heap, heap + cursorCount, greater);
+    }
+    else {
+      cursorCount--;
+    }
+  }
+  if ( bound ) {
+    bound->release(shader);
+  }
+  submitMs_ = float(timer.nsecsElapsed()) / 1.0e6f;
+}
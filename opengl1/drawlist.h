@@ -0,0 +1,113 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <memory>
+
+#include <QVector>
+#include <QMatrix4x4>
+#include <QOpenGLShaderProgram>
+
+#include "structs.h"
+#include "framearena.h"
+#include "simdmath.h"
+#include "scene.h"
+
+class Mesh;
+class OGLObject;
+class OcclusionCuller;
+
+// один draw-вызов: либо уровень LOD целиком, либо диапазоны видимых кластеров
+struct DrawItem {
+  quint64 sortKey = 0;
+  Mesh* mesh = nullptr;
+  // индекс матриц экземпляра в списке (models, transforms)
+  int transform = 0;
+  int lod = 0;
+  int firstRange = 0;
+  int rangeCount = 0;
+};
+
+// Обход рендереров сцены по частям в рабочих потоках: отсечение пирамидой видимости
+// и буфером окклюзии, выбор LOD, кластеры и ключи сортировки. MVP и матрицы нормалей
+// видимых экземпляров считаются пакетом на SIMD (SimdMath). Каждая часть пишет свой
+// список в собственную FrameArena, списки сортируются там же, а поток GL сливает их
+// по ключу (материал, меш, глубина) и отправляет, переключая состояние только на границах серий.
+class DrawListBuilder
+{
+public:
+  DrawListBuilder() = default;
+  DrawListBuilder(const DrawListBuilder&) = delete;
+
+  DrawListBuilder& operator=(const DrawListBuilder&) = delete;
+
+  // обходятся MeshRendererComponent с моделями; в сцене меняются только LOD рендереров,
+  // мировые матрицы и границы берутся уже пересчитанными (Scene::update); culler может быть nullptr
+  void build(Scene& scene, const OcclusionCuller* culler, const DrawView& view);
+  // uniform "model", "mvp" и "normalMatrix" выставляются на каждый элемент, остальное состояние шейдера - снаружи
+  void submit(QOpenGLShaderProgram& shader);
+
+  int instances() const { return instances_; }
+  int instancesCulled() const { return instancesCulled_; }
+  int drawItems() const { return drawItems_; }
+  int meshBinds() const { return meshBinds_; }
+  int tasks() const { return tasks_; }
+  int trianglesDrawn() const { return trianglesDrawn_; }
+  int trianglesSaved() const { return trianglesSaved_; }
+  int meshletTriangles() const { return meshletTriangles_; }
+  int meshletTrianglesVisible() const { return meshletTrianglesVisible_; }
+  float buildMs() const { return buildMs_; }
+  float submitMs() const { return submitMs_; }
+
+private:
+  struct DrawList {
+    DrawList();
+
+    void begin(int firstInstance, int lastInstance);
+
+    FrameArena arena;
+    ArenaVector<DrawItem> items;
+    ArenaVector<Mat4> models;
+    ArenaVector<ObjectTransform> transforms;
+    ArenaVector<GLsizei> counts;
+    ArenaVector<const void*> offsets;
+    int first = 0;
+    int last = 0;
+    int instances = 0;
+    int culled = 0;
+    int trianglesDrawn = 0;
+    int trianglesSaved = 0;
+    int meshletTriangles = 0;
+    int meshletTrianglesVisible = 0;
+  };
+
+  struct Cursor {
+    const DrawList* list;
+    size_t next;
+  };
+  struct Traversal {
+    MeshRendererComponent* renderers;
+    const Scene* scene;
+    const OcclusionCuller* culler;
+    DrawView view;
+    Frustum frustum;
+  };
+
+  static void traverse(DrawList& list, const Traversal& traversal);
+
+private:
+  QVector< std::shared_ptr<DrawList> > lists_;
+  QVector<Cursor> cursors_;
+  int instances_ = 0;
+  int instancesCulled_ = 0;
+  int drawItems_ = 0;
+  int meshBinds_ = 0;
+  int tasks_ = 0;
+  int trianglesDrawn_ = 0;
+  int trianglesSaved_ = 0;
+  int meshletTriangles_ = 0;
+  int meshletTrianglesVisible_ = 0;
+  float buildMs_ = 0.0f;
+  float submitMs_ = 0.0f;
+};
+
+#endif // DRAWLIST_H
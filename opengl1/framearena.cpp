@@ -0,0 +1,110 @@
+#include "framearena.h"
+
+#include <cstdlib>
+
+#include <QDebug>
+
+#if defined(HEAP_ALLOCATION_COUNTER) && defined(__GLIBC__)
+// Подменяем malloc/calloc/realloc для всего процесса (включая Qt и libstdc++),
+// чтобы считать обращения к куче. Только для отладочной сборки с glibc.
+// Счётчик у каждого потока свой: задачи JobSystem не попадают в статистику кадра
+// потока рендера. thread_local без конструктора не обращается к malloc.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+}
+
+static thread_local qint64 heapAllocationCount = 0;
+
+extern "C" void* malloc(size_t size)
+{
+  heapAllocationCount++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+  heapAllocationCount++;
+  return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+  heapAllocationCount++;
+  return __libc_realloc(pointer, size);
+}
+
+qint64 FrameArena::heapAllocations()
+{
+  return heapAllocationCount;
+}
+#else
+qint64 FrameArena::heapAllocations()
+{
+  return -1;
+}
+#endif
+
+static size_t alignedOffset(const char* data, size_t offset, size_t alignment)
+{
+  quintptr address = reinterpret_cast<quintptr>(data) + offset;
+  quintptr aligned = (address + alignment - 1) & ~quintptr(alignment - 1);
+  return size_t(aligned - reinterpret_cast<quintptr>(data));
+}
+
+FrameArena::FrameArena(size_t blockSize) :
+  blockSize_(blockSize)
+{
+
+}
+
+FrameArena::~FrameArena()
+{
+  for ( auto& frame : frames_ ) {
+    for ( auto& block : frame.blocks ) {
+      std::free(block.data);
+    }
+  }
+}
+
+void FrameArena::beginFrame()
+{
+  current_ = (current_ + 1) % kFrameCount;
+  Frame& frame = frames_[current_];
+  frame.block = 0;
+  frame.offset = 0;
+  frame.used = 0;
+  frame.allocations = 0;
+  frame.blockAllocations = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment)
+{
+  Frame& frame = frames_[current_];
+  frame.allocations++;
+  frame.used += size;
+  while ( frame.block < frame.blocks.size() ) {
+    Block& block = frame.blocks[frame.block];
+    size_t offset = alignedOffset(block.data, frame.offset, alignment);
+    if ( offset + size <= block.size ) {
+      frame.offset = offset + size;
+      return block.data + offset;
+    }
+    frame.block++;
+    frame.offset = 0;
+  }
+  // свободных блоков нет: растём, выделенный блок останется и для следующих кадров
+  size_t blockSize = qMax(blockSize_, size + alignment);
+  char* data = static_cast<char*>(std::malloc(blockSize));
+  if ( !data ) {
+    qDebug() << QString("frame arena: can't allocate %1 bytes").arg(blockSize);
+    return nullptr;
+  }
+  frame.blocks.append(Block{data, blockSize});
+  frame.blockAllocations++;
+  frame.block = frame.blocks.size() - 1;
+  size_t offset = alignedOffset(data, 0, alignment);
+  frame.offset = offset + size;
+  return data + offset;
+}
@@ -0,0 +1,85 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <vector>
+
+#include <QVector>
+#include <QtGlobal>
+
+// Линейный аллокатор временных данных кадра: память выделяется сдвигом указателя
+// и вся разом освобождается в beginFrame(). Буферов два, поэтому данные кадра N
+// живут и в кадре N + 1 (на случай, если их обработка отстаёт на кадр).
+// Блоки не возвращаются в кучу, так что в установившемся режиме кадр не трогает malloc.
+// Не потокобезопасен: один аллокатор - один поток.
+class FrameArena
+{
+public:
+  static const int kFrameCount = 2;
+  static const size_t kDefaultBlockSize = 256 * 1024;
+
+  explicit FrameArena(size_t blockSize = kDefaultBlockSize);
+  FrameArena(const FrameArena&) = delete;
+  ~FrameArena();
+
+  FrameArena& operator=(const FrameArena&) = delete;
+
+  void beginFrame();
+  void* allocate(size_t size, size_t alignment);
+
+  int allocations() const { return frames_[current_].allocations; }
+  size_t bytesUsed() const { return frames_[current_].used; }
+  int blockAllocations() const { return frames_[current_].blockAllocations; }
+
+  // число обращений к куче из вызывающего потока за всё время его работы,
+  // -1 если счётчик не собран (см. HEAP_ALLOCATION_COUNTER в opengl1.pro)
+  static qint64 heapAllocations();
+
+private:
+  struct Block {
+    char* data;
+    size_t size;
+  };
+  struct Frame {
+    QVector<Block> blocks;
+    int block = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    int allocations = 0;
+    int blockAllocations = 0;
+  };
+
+private:
+  Frame frames_[kFrameCount];
+  int current_ = 0;
+  size_t blockSize_;
+};
+
+// Адаптер для контейнеров STL: deallocate ничего не делает, память вернётся при сбросе кадра
+template<class T>
+class ArenaAllocator
+{
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(FrameArena* arena) noexcept : arena_(arena) {}
+  template<class U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t count) { return static_cast<T*>(arena_->allocate(count * sizeof(T), alignof(T))); }
+  void deallocate(T*, size_t) noexcept {}
+  FrameArena* arena() const noexcept { return arena_; }
+
+private:
+  FrameArena* arena_;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
+
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+#endif // FRAMEARENA_H
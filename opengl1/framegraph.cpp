@@ -0,0 +1,519 @@
+#include "framegraph.h"
+#include "gpumemory.h"
+
+#include <algorithm>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+struct TextureFormat {
+  const char* name;
+  GLenum internalFormat;
+  GLenum format;
+  GLenum type;
+  int bytes;
+};
+
+static const TextureFormat kFormats[FrameGraph::FormatCount]{
+  {"rgba8", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4},
+  {"rgba16f", GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8},
+  {"r11g11b10f", GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, 4},
+  {"rg16f", GL_RG16F, GL_RG, GL_HALF_FLOAT, 4},
+  {"r8", GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1},
+  {"depth24", GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT, 4},
+  {"depth24stencil8", GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4},
+  {"depth32f", GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4},
+};
+
+static double megabytes(qint64 bytes)
+{
+  return double(bytes) / (1024.0 * 1024.0);
+}
+
+FrameGraph::~FrameGraph()
+{
+  destroy();
+}
+
+int FrameGraph::bytesPerTexel(Format format)
+{
+  return kFormats[format].bytes;
+}
+
+bool FrameGraph::isDepth(Format format)
+{
+  return format == Depth24 || format == Depth24Stencil8 || format == Depth32F;
+}
+
+qint64 FrameGraph::textureBytes(const TextureDesc& desc)
+{
+  return GpuMemory::textureBytes(desc.width, desc.height, 1, bytesPerTexel(desc.format), false);
+}
+
+void FrameGraph::reset()
+{
+  resources_.clear();
+  passCount_ = 0;
+  compiled_ = false;
+}
+
+int FrameGraph::createTexture(const char* name, const TextureDesc& desc)
+{
+  return addResource(name, desc, false);
+}
+
+int FrameGraph::importTexture(const char* name, GLuint texture, const TextureDesc& desc)
+{
+  int index = addResource(name, desc, true);
+  resources_[size_t(index)].texture = texture;
+  return index;
+}
+
+int FrameGraph::importFramebuffer(const char* name, GLuint framebuffer, const TextureDesc& desc)
+{
+  int index = addResource(name, desc, true);
+  resources_[size_t(index)].framebuffer = framebuffer;
+  resources_[size_t(index)].isFramebuffer = true;
+  return index;
+}
+
+int FrameGraph::addPass(const char* name, Execute execute)
+{
+  if ( passCount_ == int(passes_.size()) ) {
+    passes_.emplace_back();
+  }
+  Pass& pass = passes_[size_t(passCount_)];
+  pass.name = name;
+  pass.execute = std::move(execute);
+  pass.reads.clear();
+  pass.writes.clear();
+  pass.dependencies.clear();
+  pass.sideEffects = false;
+  pass.live = false;
+  return passCount_++;
+}
+
+void FrameGraph::read(int pass, int resource)
+{
+  // чтение привязано к версии ресурса на момент объявления, а не к последней записи кадра
+  int writer = resources_[size_t(resource)].lastWriter;
+  if ( writer >= 0 && writer != pass ) {
+    addDependency(pass, writer);
+  }
+  passes_[size_t(pass)].reads.push_back(resource);
+}
+
+void FrameGraph::write(int pass, int resource)
+{
+  Resource& target = resources_[size_t(resource)];
+  if ( target.lastWriter >= 0 && target.lastWriter != pass ) {
+    addDependency(pass, target.lastWriter);
+  }
+  // новая версия пишется после всех, кто читал предыдущую
+  for ( int p = target.lastWriter + 1; p < pass; p++ ) {
+    const std::vector<int>& reads = passes_[size_t(p)].reads;
+    if ( std::find(reads.begin(), reads.end(), resource) != reads.end() ) {
+      addDependency(pass, p);
+    }
+  }
+  target.lastWriter = pass;
+  passes_[size_t(pass)].writes.push_back(resource);
+}
+
+void FrameGraph::setSideEffects(int pass)
+{
+  passes_[size_t(pass)].sideEffects = true;
+}
+
+bool FrameGraph::compile()
+{
+  compiled_ = false;
+  order_.clear();
+  physical_.clear();
+  culledPasses_ = 0;
+  transientCount_ = 0;
+  transientBytes_ = 0;
+  aliasedBytes_ = 0;
+  livePeakBytes_ = 0;
+  for ( auto& resource : resources_ ) {
+    resource.first = -1;
+    resource.last = -1;
+    resource.physical = -1;
+  }
+
+  // живы проходы с побочными эффектами, записью во внешние ресурсы и те, от кого они зависят
+  pending_.clear();
+  for ( int p = 0; p < passCount_; p++ ) {
+    Pass& pass = passes_[size_t(p)];
+    pass.live = false;
+    bool root = pass.sideEffects;
+    for ( int resource : pass.writes ) {
+      root = root || resources_[size_t(resource)].imported;
+    }
+    if ( root ) {
+      pass.live = true;
+      pending_.push_back(p);
+    }
+  }
+  while ( !pending_.empty() ) {
+    int p = pending_.back();
+    pending_.pop_back();
+    for ( int dependency : passes_[size_t(p)].dependencies ) {
+      if ( !passes_[size_t(dependency)].live ) {
+        passes_[size_t(dependency)].live = true;
+        pending_.push_back(dependency);
+      }
+    }
+  }
+
+  // устойчивая топологическая сортировка: из готовых проходов первым идёт объявленный раньше;
+  // pending_ - позиция прохода в порядке выполнения
+  pending_.assign(size_t(passCount_), -1);
+  int liveCount = 0;
+  for ( int p = 0; p < passCount_; p++ ) {
+    if ( passes_[size_t(p)].live ) {
+      liveCount++;
+    }
+    else {
+      culledPasses_++;
+    }
+  }
+  bool acyclic = true;
+  while ( acyclic && int(order_.size()) < liveCount ) {
+    int next = -1;
+    for ( int p = 0; p < passCount_ && next < 0; p++ ) {
+      const Pass& pass = passes_[size_t(p)];
+      if ( !pass.live || pending_[size_t(p)] >= 0 ) {
+        continue;
+      }
+      bool ready = true;
+      for ( int dependency : pass.dependencies ) {
+        ready = ready && pending_[size_t(dependency)] >= 0;
+      }
+      if ( ready ) {
+        next = p;
+      }
+    }
+    if ( next < 0 ) {
+      acyclic = false;
+      break;
+    }
+    pending_[size_t(next)] = int(order_.size());
+    order_.push_back(next);
+  }
+  if ( !acyclic ) {
+    // зависимости указывают только на объявленные раньше проходы, так что цикл - ошибка в графе;
+    // кадр всё равно рисуется - в порядке объявления
+    if ( !cycleReported_ ) {
+      qWarning() << "Frame graph has a dependency cycle, passes run in declaration order";
+      cycleReported_ = true;
+    }
+    order_.clear();
+    for ( int p = 0; p < passCount_; p++ ) {
+      if ( passes_[size_t(p)].live ) {
+        order_.push_back(p);
+      }
+    }
+  }
+
+  // время жизни временных текстур - от первого до последнего живого прохода, который их трогает
+  for ( int t = 0; t < int(order_.size()); t++ ) {
+    const Pass& pass = passes_[size_t(order_[size_t(t)])];
+    for ( const std::vector<int>* accesses : { &pass.reads, &pass.writes } ) {
+      for ( int resource : *accesses ) {
+        Resource& target = resources_[size_t(resource)];
+        if ( target.first < 0 ) {
+          target.first = t;
+        }
+        target.last = t;
+      }
+    }
+  }
+
+  // жадное назначение по началу жизни оптимально для каждого размера и формата отдельно
+  pending_.clear();
+  for ( int r = 0; r < int(resources_.size()); r++ ) {
+    const Resource& resource = resources_[size_t(r)];
+    if ( !resource.imported && resource.first >= 0 ) {
+      pending_.push_back(r);
+      transientBytes_ += textureBytes(resource.desc);
+    }
+  }
+  transientCount_ = int(pending_.size());
+  std::sort(pending_.begin(), pending_.end(), [this]( int a, int b ) {
+    int firstA = resources_[size_t(a)].first;
+    int firstB = resources_[size_t(b)].first;
+    return firstA != firstB ? firstA < firstB : a < b;
+  });
+  for ( int r : pending_ ) {
+    Resource& resource = resources_[size_t(r)];
+    int physical = -1;
+    for ( int k = 0; k < int(physical_.size()) && physical < 0; k++ ) {
+      if ( physical_[size_t(k)].desc == resource.desc && physical_[size_t(k)].lastUse < resource.first ) {
+        physical = k;
+      }
+    }
+    if ( physical < 0 ) {
+      physical = int(physical_.size());
+      physical_.emplace_back();
+      physical_.back().desc = resource.desc;
+      aliasedBytes_ += textureBytes(resource.desc);
+    }
+    physical_[size_t(physical)].lastUse = resource.last;
+    resource.physical = physical;
+  }
+  for ( int t = 0; t < int(order_.size()); t++ ) {
+    qint64 live = 0;
+    for ( int r : pending_ ) {
+      const Resource& resource = resources_[size_t(r)];
+      if ( resource.first <= t && t <= resource.last ) {
+        live += textureBytes(resource.desc);
+      }
+    }
+    livePeakBytes_ = qMax(livePeakBytes_, live);
+  }
+  compiled_ = true;
+  return acyclic;
+}
+
+void FrameGraph::execute()
+{
+  if ( !compiled_ ) {
+    return;
+  }
+  frame_++;
+  for ( int i = int(pool_.size()) - 1; i >= 0; i-- ) {
+    if ( pool_[size_t(i)].lastFrame + kRetainFrames < frame_ ) {
+      releasePooled(i);
+    }
+  }
+  acquirePooled();
+  for ( int p : order_ ) {
+    executePass(passes_[size_t(p)]);
+  }
+}
+
+void FrameGraph::destroy()
+{
+  for ( int i = int(pool_.size()) - 1; i >= 0; i-- ) {
+    releasePooled(i);
+  }
+  for ( auto& pass : passes_ ) {
+    pass.gpuStart.reset();
+    pass.gpuEnd.reset();
+    pass.timerPending = false;
+  }
+  if ( framebuffer_ != 0 ) {
+    QOpenGLContext::currentContext()->extraFunctions()->glDeleteFramebuffers(1, &framebuffer_);
+    framebuffer_ = 0;
+    attachedColors_ = 0;
+    attachedDepth_ = 0;
+  }
+  reset();
+}
+
+GLuint FrameGraph::texture(int resource) const
+{
+  const Resource& target = resources_[size_t(resource)];
+  if ( target.imported ) {
+    return target.texture;
+  }
+  if ( target.physical < 0 || physical_[size_t(target.physical)].pooled < 0 ) {
+    return 0;
+  }
+  return pool_[size_t(physical_[size_t(target.physical)].pooled)].texture;
+}
+
+qint64 FrameGraph::pooledBytes() const
+{
+  qint64 bytes = 0;
+  for ( const auto& pooled : pool_ ) {
+    bytes += textureBytes(pooled.desc);
+  }
+  return bytes;
+}
+
+QString FrameGraph::report() const
+{
+  QString text = QString("frame graph: %1 passes, %2 culled").arg(passCount_).arg(culledPasses_);
+  for ( int t = 0; t < int(order_.size()); t++ ) {
+    text += QString("\n  %1. %2").arg(t).arg(passes_[size_t(order_[size_t(t)])].name);
+  }
+  for ( int p = 0; p < passCount_; p++ ) {
+    if ( !passes_[size_t(p)].live ) {
+      text += QString("\n  culled: %1").arg(passes_[size_t(p)].name);
+    }
+  }
+  for ( const auto& resource : resources_ ) {
+    if ( resource.imported || resource.first < 0 ) {
+      continue;
+    }
+    text += QString("\n  %1 %2x%3 %4: passes %5-%6, texture %7")
+        .arg(resource.name).arg(resource.desc.width).arg(resource.desc.height)
+        .arg(kFormats[resource.desc.format].name).arg(resource.first).arg(resource.last).arg(resource.physical);
+  }
+  text += QString("\n  transient %1 MB in %2 textures, aliased %3 MB in %4, live peak %5 MB")
+      .arg(megabytes(transientBytes_), 0, 'f', 1).arg(transientCount_)
+      .arg(megabytes(aliasedBytes_), 0, 'f', 1).arg(physical_.size())
+      .arg(megabytes(livePeakBytes_), 0, 'f', 1);
+  return text;
+}
+
+int FrameGraph::addResource(const char* name, const TextureDesc& desc, bool imported)
+{
+  resources_.emplace_back();
+  Resource& resource = resources_.back();
+  resource.name = name;
+  resource.desc = desc;
+  resource.imported = imported;
+  return int(resources_.size()) - 1;
+}
+
+void FrameGraph::addDependency(int pass, int dependency)
+{
+  std::vector<int>& dependencies = passes_[size_t(pass)].dependencies;
+  if ( std::find(dependencies.begin(), dependencies.end(), dependency) == dependencies.end() ) {
+    dependencies.push_back(dependency);
+  }
+}
+
+void FrameGraph::acquirePooled()
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  for ( auto& physical : physical_ ) {
+    physical.pooled = -1;
+    for ( int i = 0; i < int(pool_.size()) && physical.pooled < 0; i++ ) {
+      if ( pool_[size_t(i)].desc == physical.desc && pool_[size_t(i)].lastFrame != frame_ ) {
+        physical.pooled = i;
+      }
+    }
+    if ( physical.pooled < 0 ) {
+      const TextureFormat& format = kFormats[physical.desc.format];
+      PooledTexture pooled;
+      pooled.desc = physical.desc;
+      f->glGenTextures(1, &pooled.texture);
+      f->glBindTexture(GL_TEXTURE_2D, pooled.texture);
+      f->glTexImage2D(GL_TEXTURE_2D, 0, GLint(format.internalFormat), physical.desc.width, physical.desc.height, 0,
+                      format.format, format.type, nullptr);
+      f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      f->glBindTexture(GL_TEXTURE_2D, 0);
+      pooled.memory = GpuMemory::instance().add(GpuMemory::RenderTarget, QString("frame graph"),
+                                                textureBytes(physical.desc));
+      physical.pooled = int(pool_.size());
+      pool_.push_back(pooled);
+    }
+    PooledTexture& pooled = pool_[size_t(physical.pooled)];
+    pooled.lastFrame = frame_;
+    GpuMemory::instance().touch(pooled.memory);
+  }
+}
+
+void FrameGraph::bindTargets(const Pass& pass)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  const Resource* target = nullptr;
+  bool transient = false;
+  for ( int resource : pass.writes ) {
+    transient = transient || !resources_[size_t(resource)].imported;
+  }
+  if ( transient ) {
+    if ( framebuffer_ == 0 ) {
+      f->glGenFramebuffers(1, &framebuffer_);
+    }
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    GLenum drawBuffers[kMaxColorAttachments];
+    int colors = 0;
+    GLenum depth = 0;
+    for ( int resource : pass.writes ) {
+      const Resource& written = resources_[size_t(resource)];
+      if ( written.imported ) {
+        continue;
+      }
+      GLenum attachment;
+      if ( isDepth(written.desc.format) ) {
+        attachment = written.desc.format == Depth24Stencil8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        depth = attachment;
+      }
+      else if ( colors < kMaxColorAttachments ) {
+        attachment = GLenum(GL_COLOR_ATTACHMENT0 + colors);
+        drawBuffers[colors++] = attachment;
+      }
+      else {
+        continue;
+      }
+      f->glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture(resource), 0);
+      target = target != nullptr ? target : &written;
+    }
+    // вложения предыдущего прохода, которых у этого нет
+    for ( int i = colors; i < attachedColors_; i++ ) {
+      f->glFramebufferTexture2D(GL_FRAMEBUFFER, GLenum(GL_COLOR_ATTACHMENT0 + i), GL_TEXTURE_2D, 0, 0);
+    }
+    if ( attachedDepth_ != 0 && attachedDepth_ != depth ) {
+      f->glFramebufferTexture2D(GL_FRAMEBUFFER, attachedDepth_, GL_TEXTURE_2D, 0, 0);
+    }
+    attachedColors_ = colors;
+    attachedDepth_ = depth;
+    if ( colors > 0 ) {
+      f->glDrawBuffers(colors, drawBuffers);
+    }
+    else {
+      GLenum none = GL_NONE;
+      f->glDrawBuffers(1, &none);
+    }
+  }
+  else {
+    for ( int resource : pass.writes ) {
+      const Resource& written = resources_[size_t(resource)];
+      if ( written.isFramebuffer && target == nullptr ) {
+        f->glBindFramebuffer(GL_FRAMEBUFFER, written.framebuffer);
+        target = &written;
+      }
+    }
+  }
+  if ( target != nullptr ) {
+    f->glViewport(0, 0, target->desc.width, target->desc.height);
+  }
+}
+
+void FrameGraph::executePass(Pass& pass)
+{
+  if ( !pass.gpuStart ) {
+    pass.gpuStart.reset(new QOpenGLTimerQuery);
+    pass.gpuEnd.reset(new QOpenGLTimerQuery);
+    pass.gpuStart->create();
+    pass.gpuEnd->create();
+  }
+  // пока результат прошлого замера не пришёл, новый не начинаем
+  if ( pass.timerPending && pass.gpuEnd->isResultAvailable() ) {
+    pass.gpuMs = float(pass.gpuEnd->waitForResult() - pass.gpuStart->waitForResult()) / 1.0e6f;
+    pass.timerPending = false;
+  }
+  bool timed = !pass.timerPending && pass.gpuStart->isCreated();
+  if ( timed ) {
+    pass.gpuStart->recordTimestamp();
+  }
+  QElapsedTimer timer;
+  timer.start();
+  bindTargets(pass);
+  if ( pass.execute ) {
+    pass.execute(*this);
+  }
+  pass.cpuMs = float(timer.nsecsElapsed()) / 1.0e6f;
+  if ( timed ) {
+    pass.gpuEnd->recordTimestamp();
+    pass.timerPending = true;
+  }
+}
+
+void FrameGraph::releasePooled(int index)
+{
+  PooledTexture& pooled = pool_[size_t(index)];
+  QOpenGLContext::currentContext()->extraFunctions()->glDeleteTextures(1, &pooled.texture);
+  GpuMemory::instance().remove(pooled.memory);
+  pool_.erase(pool_.begin() + index);
+}
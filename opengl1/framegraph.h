@@ -0,0 +1,174 @@
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <QString>
+#include <QOpenGLTimerQuery>
+#include <qopengl.h>
+
+// Граф кадра: проходы объявляют, какие цели рендера читают и пишут, а compile() по этим
+// объявлениям отбрасывает проходы, чьи результаты никто не использует, упорядочивает
+// оставшиеся и считает время жизни временных (transient) текстур. Временные текстуры с
+// непересекающимся временем жизни делят одну физическую текстуру: в GL нет размещения
+// ресурсов в общей памяти, как в Vulkan/D3D12, поэтому делить можно только текстуру с тем же
+// размером и форматом. Физические текстуры живут в пуле между кадрами, граф описывается
+// заново каждый кадр. Внешние (imported) ресурсы - карта теней, экран - графу не принадлежат,
+// запись в них считается результатом кадра.
+class FrameGraph
+{
+public:
+  enum Format { Rgba8, Rgba16F, R11G11B10F, Rg16F, R8, Depth24, Depth24Stencil8, Depth32F, FormatCount };
+
+  struct TextureDesc {
+    int width = 0;
+    int height = 0;
+    Format format = Rgba8;
+
+    bool operator==(const TextureDesc& other) const
+    {
+      return width == other.width && height == other.height && format == other.format;
+    }
+  };
+
+  typedef std::function<void(const FrameGraph&)> Execute;
+
+  // сколько кадров неиспользуемая текстура пула ждёт, прежде чем удалиться
+  static const int kRetainFrames = 60;
+  static const int kMaxColorAttachments = 8;
+
+  FrameGraph() = default;
+  FrameGraph(const FrameGraph&) = delete;
+  ~FrameGraph();
+
+  FrameGraph& operator=(const FrameGraph&) = delete;
+
+  static int bytesPerTexel(Format format);
+  static bool isDepth(Format format);
+  static qint64 textureBytes(const TextureDesc& desc);
+
+  // начало описания кадра; имена - строковые литералы, граф их не копирует
+  void reset();
+  // содержимое временной текстуры до первой записи в кадре не определено
+  int createTexture(const char* name, const TextureDesc& desc);
+  int importTexture(const char* name, GLuint texture, const TextureDesc& desc);
+  // проходы, которые пишут в такой ресурс, рисуют в framebuffer (например, экран)
+  int importFramebuffer(const char* name, GLuint framebuffer, const TextureDesc& desc);
+  int addPass(const char* name, Execute execute);
+  // проход, который пишет ресурс, выполняется после предыдущего по объявлению прохода,
+  // пишущего тот же ресурс, и после всех, кто читал его предыдущую версию; проход, который
+  // читает, - после последнего записавшего до этого объявления (версия ресурса на момент read)
+  void read(int pass, int resource);
+  void write(int pass, int resource);
+  // проход нельзя отбросить, даже если его результаты никто не читает
+  void setSideEffects(int pass);
+
+  // false - в зависимостях есть цикл: о нём пишется один раз, проходы выполняются
+  // в порядке объявления
+  bool compile();
+  // временные текстуры берутся из пула; проходу, который пишет временные текстуры,
+  // привязывается framebuffer графа с ними, проходу, который пишет внешний framebuffer, -
+  // этот framebuffer; viewport - по размеру первой цели. Время каждого прохода меряется
+  // на CPU (запись команд) и на GPU (метки времени, результат приходит через несколько кадров)
+  void execute();
+  void destroy();
+
+  GLuint texture(int resource) const;
+  const TextureDesc& desc(int resource) const { return resources_[size_t(resource)].desc; }
+
+  int passCount() const { return passCount_; }
+  int culledPasses() const { return culledPasses_; }
+  int transientCount() const { return transientCount_; }
+  int physicalCount() const { return int(physical_.size()); }
+  // пик временной памяти: каждая текстура отдельно, после алиасинга и нижняя граница -
+  // наибольшая сумма одновременно живых текстур (её дал бы алиасинг памяти без учёта формата)
+  qint64 transientBytes() const { return transientBytes_; }
+  qint64 aliasedBytes() const { return aliasedBytes_; }
+  qint64 livePeakBytes() const { return livePeakBytes_; }
+  qint64 pooledBytes() const;
+  // выполненные проходы в порядке выполнения; время GPU привязано к номеру прохода
+  // в описании, поэтому при смене набора проходов первые кадры оно неточно
+  int executedCount() const { return int(order_.size()); }
+  const char* executedName(int index) const { return passes_[size_t(order_[size_t(index)])].name; }
+  float executedCpuMs(int index) const { return passes_[size_t(order_[size_t(index)])].cpuMs; }
+  float executedGpuMs(int index) const { return passes_[size_t(order_[size_t(index)])].gpuMs; }
+  // порядок проходов, времена жизни и физические текстуры последнего compile()
+  QString report() const;
+
+private:
+  struct Resource {
+    const char* name = nullptr;
+    TextureDesc desc;
+    bool imported = false;
+    GLuint texture = 0;
+    GLuint framebuffer = 0;
+    bool isFramebuffer = false;
+    // последний по объявлению проход, который пишет ресурс
+    int lastWriter = -1;
+    // позиции в порядке выполнения, -1 - живые проходы ресурс не трогают
+    int first = -1;
+    int last = -1;
+    int physical = -1;
+  };
+
+  struct Pass {
+    const char* name = nullptr;
+    Execute execute;
+    std::vector<int> reads;
+    std::vector<int> writes;
+    // проходы, после которых выполняется этот
+    std::vector<int> dependencies;
+    bool sideEffects = false;
+    bool live = false;
+    std::unique_ptr<QOpenGLTimerQuery> gpuStart;
+    std::unique_ptr<QOpenGLTimerQuery> gpuEnd;
+    bool timerPending = false;
+    float cpuMs = 0.0f;
+    float gpuMs = 0.0f;
+  };
+
+  struct Physical {
+    TextureDesc desc;
+    int lastUse = -1;
+    int pooled = -1;
+  };
+
+  struct PooledTexture {
+    TextureDesc desc;
+    GLuint texture = 0;
+    int memory = -1;
+    quint64 lastFrame = 0;
+  };
+
+  int addResource(const char* name, const TextureDesc& desc, bool imported);
+  void addDependency(int pass, int dependency);
+  void acquirePooled();
+  void bindTargets(const Pass& pass);
+  void executePass(Pass& pass);
+  void releasePooled(int index);
+
+private:
+  std::vector<Resource> resources_;
+  // проходы не удаляются между кадрами, чтобы не освобождать их массивы
+  std::vector<Pass> passes_;
+  int passCount_ = 0;
+  std::vector<int> order_;
+  std::vector<int> pending_;
+  std::vector<Physical> physical_;
+  std::vector<PooledTexture> pool_;
+  GLuint framebuffer_ = 0;
+  int attachedColors_ = 0;
+  GLenum attachedDepth_ = 0;
+  quint64 frame_ = 0;
+  bool compiled_ = false;
+  bool cycleReported_ = false;
+  int culledPasses_ = 0;
+  int transientCount_ = 0;
+  qint64 transientBytes_ = 0;
+  qint64 aliasedBytes_ = 0;
+  qint64 livePeakBytes_ = 0;
+};
+
+#endif // FRAMEGRAPH_H
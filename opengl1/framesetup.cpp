@@ -0,0 +1,106 @@
+#include "framesetup.h"
+
+static const char* kBloomTextureNames[FrameSetup::kBloomLevels]{"bloom 1/2", "bloom 1/4", "bloom 1/8",
+                                                                "bloom 1/16", "bloom 1/32", "bloom 1/64"};
+static const char* kBloomDownNames[FrameSetup::kBloomLevels]{"bloom down 1/2", "bloom down 1/4", "bloom down 1/8",
+                                                             "bloom down 1/16", "bloom down 1/32", "bloom down 1/64"};
+static const char* kBloomUpNames[FrameSetup::kBloomLevels]{"bloom up 1/2", "bloom up 1/4", "bloom up 1/8",
+                                                           "bloom up 1/16", "bloom up 1/32", "bloom up 1/64"};
+static const char* kBloomUpTextureNames[FrameSetup::kBloomLevels]{"bloom sum 1/2", "bloom sum 1/4", "bloom sum 1/8",
+                                                                  "bloom sum 1/16", "bloom sum 1/32", "bloom sum 1/64"};
+
+void FrameSetup::declare(FrameGraph& graph, const Settings& settings, FramePainter* painter)
+{
+  graph.reset();
+  int backbuffer = graph.importFramebuffer("backbuffer", settings.backbuffer,
+                                           FrameGraph::TextureDesc{settings.targetWidth, settings.targetHeight, FrameGraph::Rgba8});
+  // освещение копится линейно в half float, на экран попадает только после тонмаппинга
+  int hdr = graph.createTexture("hdr", FrameGraph::TextureDesc{settings.sceneWidth, settings.sceneHeight, FrameGraph::Rgba16F});
+  int depth = graph.createTexture("depth", FrameGraph::TextureDesc{settings.sceneWidth, settings.sceneHeight, FrameGraph::Depth24});
+  FrameGraph::Execute shadowPass;
+  FrameGraph::Execute scenePass;
+  if ( painter ) {
+    shadowPass = [painter]( const FrameGraph& ) { painter->paintShadowPass(); };
+    scenePass = [painter]( const FrameGraph& ) { painter->paintScenePass(); };
+  }
+  int shadows = graph.addPass("shadows", std::move(shadowPass));
+  int scene = graph.addPass("scene", std::move(scenePass));
+  if ( settings.shadowMap ) {
+    // карта теней живёт между кадрами: каскады обновляются не каждый кадр
+    FrameGraph::TextureDesc cascades{settings.shadowResolution, settings.shadowResolution, FrameGraph::Depth24};
+    int shadowMap = graph.importTexture("shadow map", settings.shadowTexture, cascades);
+    graph.write(shadows, shadowMap);
+    graph.read(scene, shadowMap);
+  }
+  graph.write(scene, hdr);
+  graph.write(scene, depth);
+  if ( settings.debugDraw ) {
+    // линии проверяют глубину сцены и попадают в HDR до bloom и тонмаппинга
+    FrameGraph::Execute debugPass;
+    if ( painter ) {
+      debugPass = [painter]( const FrameGraph& ) { painter->paintDebugPass(); };
+    }
+    int debug = graph.addPass("debug draw", std::move(debugPass));
+    graph.read(debug, depth);
+    graph.write(debug, hdr);
+    graph.write(debug, depth);
+  }
+
+  // bloom: HDR уменьшается вдвое уровень за уровнем, затем каждый уровень размывается
+  // и складывается с вдвое более крупным в отдельную текстуру (читать и писать один уровень
+  // в проходе нельзя); результат - на уровне 1/2
+  int bloom = -1;
+  if ( settings.bloom ) {
+    int levels[kBloomLevels];
+    int levelCount = 0;
+    int source = hdr;
+    for ( int i = 0; i < kBloomLevels; i++ ) {
+      FrameGraph::TextureDesc level{settings.sceneWidth >> (i + 1), settings.sceneHeight >> (i + 1), FrameGraph::R11G11B10F};
+      if ( qMin(level.width, level.height) < kBloomMinSize ) {
+        break;
+      }
+      levels[i] = graph.createTexture(kBloomTextureNames[i], level);
+      bool firstLevel = i == 0;
+      FrameGraph::Execute downPass;
+      if ( painter ) {
+        downPass = [painter, source, firstLevel]( const FrameGraph& frameGraph ) {
+          painter->paintBloomDown(frameGraph, source, firstLevel);
+        };
+      }
+      int pass = graph.addPass(kBloomDownNames[i], std::move(downPass));
+      graph.read(pass, source);
+      graph.write(pass, levels[i]);
+      source = levels[i];
+      levelCount++;
+    }
+    for ( int i = levelCount - 2; i >= 0; i-- ) {
+      int sum = graph.createTexture(kBloomUpTextureNames[i], graph.desc(levels[i]));
+      int base = levels[i];
+      FrameGraph::Execute upPass;
+      if ( painter ) {
+        upPass = [painter, source, base]( const FrameGraph& frameGraph ) {
+          painter->paintBloomUp(frameGraph, source, base);
+        };
+      }
+      int pass = graph.addPass(kBloomUpNames[i], std::move(upPass));
+      graph.read(pass, source);
+      graph.read(pass, base);
+      graph.write(pass, sum);
+      source = sum;
+    }
+    bloom = levelCount > 0 ? source : -1;
+  }
+
+  FrameGraph::Execute tonemapPass;
+  if ( painter ) {
+    tonemapPass = [painter, hdr, bloom]( const FrameGraph& frameGraph ) {
+      painter->paintTonemap(frameGraph, hdr, bloom);
+    };
+  }
+  int tonemap = graph.addPass("tonemap", std::move(tonemapPass));
+  graph.read(tonemap, hdr);
+  if ( bloom >= 0 ) {
+    graph.read(tonemap, bloom);
+  }
+  graph.write(tonemap, backbuffer);
+}
@@ -0,0 +1,50 @@
+#ifndef FRAMESETUP_H
+#define FRAMESETUP_H
+
+#include <qopengl.h>
+
+#include "framegraph.h"
+
+// Рисование проходов кадра; цели и viewport привязывает граф кадра
+class FramePainter
+{
+public:
+  virtual ~FramePainter() = default;
+
+  virtual void paintShadowPass() = 0;
+  virtual void paintScenePass() = 0;
+  virtual void paintDebugPass() = 0;
+  virtual void paintBloomDown(const FrameGraph& graph, int source, bool firstLevel) = 0;
+  // base - уровень того же размера, что и цель; к нему прибавляется размытый source
+  virtual void paintBloomUp(const FrameGraph& graph, int source, int base) = 0;
+  virtual void paintTonemap(const FrameGraph& graph, int hdr, int bloom) = 0;
+};
+
+// Проходы кадра OpenglWidget и ресурсы, которые они читают и пишут. Описание отделено от
+// рисования: без FramePainter проходы получают пустое Execute, и граф собирается и
+// проверяется compile() без контекста GL (так его проверяет benchmarks)
+class FrameSetup
+{
+public:
+  // уровни bloom: 1/2 ... 1/64 сцены, пока сторона не меньше kBloomMinSize
+  static const int kBloomLevels = 6;
+  static const int kBloomMinSize = 8;
+
+  struct Settings {
+    int targetWidth = 1;
+    int targetHeight = 1;
+    GLuint backbuffer = 0;
+    // сцена и bloom - в разрешении динамического масштаба, экран - в полном
+    int sceneWidth = 1;
+    int sceneHeight = 1;
+    bool shadowMap = false;
+    GLuint shadowTexture = 0;
+    int shadowResolution = 0;
+    bool debugDraw = false;
+    bool bloom = false;
+  };
+
+  static void declare(FrameGraph& graph, const Settings& settings, FramePainter* painter);
+};
+
+#endif // FRAMESETUP_H
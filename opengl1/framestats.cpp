@@ -0,0 +1,155 @@
+#include "framestats.h"
+
+void FrameStats::reset()
+{
+  frameMs = 0.0f;
+  heapAllocations = -1;
+  arenaAllocations = 0;
+  arenaBytes = 0;
+  arenaBlockAllocations = 0;
+  sceneEntities = 0;
+  transformNodes = 0;
+  transformsUpdated = 0;
+  transformMs = 0.0f;
+  shadowCascadesUpdated = 0;
+  shadowStaticRedraws = 0;
+  occluderTriangles = 0;
+  occlusionTested = 0;
+  occlusionCulled = 0;
+  occlusionOutside = 0;
+  occlusionMs = 0.0f;
+  lodTrianglesDrawn = 0;
+  lodTrianglesSaved = 0;
+  meshletTriangles = 0;
+  meshletTrianglesVisible = 0;
+  sceneInstances = 0;
+  sceneInstancesCulled = 0;
+  drawItems = 0;
+  drawMeshBinds = 0;
+  drawTasks = 0;
+  drawBuildMs = 0.0f;
+  drawSubmitMs = 0.0f;
+  ringBytes = 0;
+  ringFenceWaits = 0;
+  ringOrphans = 0;
+  graphPasses = 0;
+  graphCulledPasses = 0;
+  graphTextures = 0;
+  graphPhysicalTextures = 0;
+  graphTransientBytes = 0;
+  graphAliasedBytes = 0;
+  graphLivePeakBytes = 0;
+  graphPassCount = 0;
+  debugVertices = 0;
+  debugDropped = 0;
+  sceneWidth = 0;
+  sceneHeight = 0;
+  gpuFrameMs = 0.0f;
+  tonemap = nullptr;
+  textureUploads = 0;
+  textureEvictions = 0;
+  gpuEvictions = 0;
+  gpuEvictedBytes = 0;
+  softwareMs = 0.0f;
+  softwareTriangles = 0;
+  softwarePixels = 0;
+  streamImportProgress = -1.0f;
+  // времена каскадов не сбрасываем: результаты таймеров приходят с задержкой
+}
+
+QString FrameStats::summary() const
+{
+  QString text = QString("frame %1 ms").arg(double(frameMs), 0, 'f', 2);
+  text += QString("\nalloc: render thread heap %1, arena %2 (%3 KB, new blocks %4)")
+      .arg(heapAllocations < 0 ? QString("n/a") : QString::number(heapAllocations))
+      .arg(arenaAllocations).arg(arenaBytes / 1024).arg(arenaBlockAllocations);
+  if ( transformNodes > 0 ) {
+    text += QString("\nscene: %1 entities, transforms: %2 of %3 nodes updated, %4 ms")
+        .arg(sceneEntities).arg(transformsUpdated).arg(transformNodes).arg(double(transformMs), 0, 'f', 3);
+  }
+  if ( shadowCascadeCount > 0 ) {
+    QString cascades;
+    for ( int i = 0; i < shadowCascadeCount; i++ ) {
+      cascades += QString(" %1").arg(double(shadowCascadeMs[i]), 0, 'f', 2);
+    }
+    text += QString("\nshadow cascades ms:%1 (updated %2, static %3)")
+        .arg(cascades).arg(shadowCascadesUpdated).arg(shadowStaticRedraws);
+  }
+  if ( occlusionTested > 0 || occluderTriangles > 0 ) {
+    text += QString("\nocclusion %1 ms: %2 occluder tris, culled %3 of %4 (%5 off screen)")
+        .arg(double(occlusionMs), 0, 'f', 2).arg(occluderTriangles).arg(occlusionCulled).arg(occlusionTested)
+        .arg(occlusionOutside);
+  }
+  if ( lodTrianglesDrawn > 0 ) {
+    text += QString("\nlod: %1 tris drawn, %2 saved").arg(lodTrianglesDrawn).arg(lodTrianglesSaved);
+  }
+  if ( meshletTriangles > 0 ) {
+    text += QString("\nmeshlets: %1 of %2 tris submitted").arg(meshletTrianglesVisible).arg(meshletTriangles);
+  }
+  if ( sceneInstances > 0 ) {
+    text += QString("\ndraw lists: %1 instances (%2 culled), %3 draws, %4 binds, %5 tasks, build %6 ms, submit %7 ms")
+        .arg(sceneInstances).arg(sceneInstancesCulled).arg(drawItems).arg(drawMeshBinds).arg(drawTasks)
+        .arg(double(drawBuildMs), 0, 'f', 2).arg(double(drawSubmitMs), 0, 'f', 2);
+  }
+  if ( graphPasses > 0 ) {
+    text += QString("\nframe graph: %1 passes (%2 culled), %3 transient targets %4 MB, aliased into %5: %6 MB, live peak %7 MB")
+        .arg(graphPasses).arg(graphCulledPasses).arg(graphTextures)
+        .arg(double(graphTransientBytes) / 1048576.0, 0, 'f', 1).arg(graphPhysicalTextures)
+        .arg(double(graphAliasedBytes) / 1048576.0, 0, 'f', 1).arg(double(graphLivePeakBytes) / 1048576.0, 0, 'f', 1);
+  }
+  if ( graphPassCount > 0 ) {
+    QString passes;
+    for ( int i = 0; i < graphPassCount; i++ ) {
+      passes += QString("%1 %2 %3/%4").arg(i > 0 ? "," : "").arg(graphPassNames[i])
+          .arg(double(graphPassCpuMs[i]), 0, 'f', 2).arg(double(graphPassGpuMs[i]), 0, 'f', 2);
+    }
+    text += QString("\npasses ms cpu/gpu:%1").arg(passes);
+  }
+  if ( sceneWidth > 0 ) {
+    text += QString("\nresolution: %1x%2 (%3%), gpu %4 ms%5").arg(sceneWidth).arg(sceneHeight)
+        .arg(int(resolutionScale * 100.0f + 0.5f)).arg(double(gpuFrameMs), 0, 'f', 2)
+        .arg(dynamicResolution ? QString(" of %1 ms budget").arg(double(frameTargetMs), 0, 'f', 1) : QString());
+  }
+  if ( debugVertices > 0 || debugDropped > 0 ) {
+    text += QString("\ndebug draw: %1 lines, %2 vertices dropped").arg(debugVertices / 2).arg(debugDropped);
+  }
+  if ( tonemap != nullptr ) {
+    text += QString("\ntonemap: %1, exposure %2").arg(tonemap).arg(double(exposure), 0, 'f', 2);
+  }
+  if ( ringBytes > 0 ) {
+    text += QString("\nring buffer (%1): %2 KB/frame, %3% used, fence waits %4, orphans %5")
+        .arg(ringPersistent ? "persistent" : "orphaning").arg(double(ringBytes) / 1024.0, 0, 'f', 1)
+        .arg(int(ringOccupancy * 100.0f)).arg(ringFenceWaits).arg(ringOrphans);
+  }
+  if ( textureCount > 0 ) {
+    text += QString("\ntextures: %1, resident %2 MB of %3 MB requested, budget %4 MB, uploads %5, evictions %6")
+        .arg(textureCount).arg(double(textureResidentBytes) / 1048576.0, 0, 'f', 1)
+        .arg(double(textureRequestedBytes) / 1048576.0, 0, 'f', 1).arg(textureBudget / 1048576)
+        .arg(textureUploads).arg(textureEvictions);
+  }
+  if ( gpuResources > 0 ) {
+    QString types;
+    for ( int type = 0; type < GpuMemory::TypeCount; type++ ) {
+      types += QString(", %1 %2").arg(GpuMemory::typeName(GpuMemory::Type(type)))
+          .arg(double(gpuTypeBytes[type]) / 1048576.0, 0, 'f', 1);
+    }
+    text += QString("\ngpu memory: %1 of %2 MB in %3 resources%4; evicted %5 (%6 MB)")
+        .arg(double(gpuBytes) / 1048576.0, 0, 'f', 1).arg(gpuBudget / 1048576).arg(gpuResources).arg(types)
+        .arg(gpuEvictions).arg(double(gpuEvictedBytes) / 1048576.0, 0, 'f', 1);
+  }
+  if ( softwareMs > 0.0f ) {
+    text += QString("\nsoftware renderer: %1 ms, %2 tris binned, %3 pixels shaded")
+        .arg(double(softwareMs), 0, 'f', 2).arg(softwareTriangles).arg(softwarePixels);
+  }
+  if ( streamImportProgress >= 0.0f ) {
+    if ( streamImportProgress < 1.0f || streamChunks == 0 ) {
+      text += QString("\nout of core: import %1%").arg(int(streamImportProgress * 100.0f));
+    }
+    else {
+      text += QString("\nout of core: %1 of %2 chunks resident, %3 loading, %4 of %5 MB")
+          .arg(streamResidentChunks).arg(streamChunks).arg(streamLoadingChunks)
+          .arg(double(streamResidentBytes) / 1048576.0, 0, 'f', 1).arg(streamBudget / 1048576);
+    }
+  }
+  return text;
+}
@@ -0,0 +1,113 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QString>
+
+#include "gpumemory.h"
+
+struct FrameStats
+{
+  static const int kMaxShadowCascades = 4;
+  static const int kMaxGraphPasses = 16;
+
+  void reset();
+  QString summary() const;
+
+  float frameMs = 0.0f;
+  // -1: счётчик обращений к куче не собран
+  int heapAllocations = -1;
+  int arenaAllocations = 0;
+  int arenaBytes = 0;
+  int arenaBlockAllocations = 0;
+
+  int sceneEntities = 0;
+  int transformNodes = 0;
+  int transformsUpdated = 0;
+  float transformMs = 0.0f;
+
+  int shadowCascadeCount = 0;
+  int shadowCascadesUpdated = 0;
+  int shadowStaticRedraws = 0;
+  float shadowCascadeMs[kMaxShadowCascades]{};
+
+  int occluderTriangles = 0;
+  int occlusionTested = 0;
+  int occlusionCulled = 0;
+  int occlusionOutside = 0;
+  float occlusionMs = 0.0f;
+
+  int lodTrianglesDrawn = 0;
+  int lodTrianglesSaved = 0;
+
+  int meshletTriangles = 0;
+  int meshletTrianglesVisible = 0;
+
+  int sceneInstances = 0;
+  int sceneInstancesCulled = 0;
+  int drawItems = 0;
+  int drawMeshBinds = 0;
+  int drawTasks = 0;
+  float drawBuildMs = 0.0f;
+  float drawSubmitMs = 0.0f;
+
+  int ringBytes = 0;
+  float ringOccupancy = 0.0f;
+  int ringFenceWaits = 0;
+  int ringOrphans = 0;
+  bool ringPersistent = false;
+
+  int textureCount = 0;
+  qint64 textureResidentBytes = 0;
+  qint64 textureRequestedBytes = 0;
+  qint64 textureBudget = 0;
+  int textureUploads = 0;
+  int textureEvictions = 0;
+
+  int graphPasses = 0;
+  int graphCulledPasses = 0;
+  int graphTextures = 0;
+  int graphPhysicalTextures = 0;
+  // пик временных целей рендера без алиасинга, с ним и сумма одновременно живых
+  qint64 graphTransientBytes = 0;
+  qint64 graphAliasedBytes = 0;
+  qint64 graphLivePeakBytes = 0;
+  // выполненные проходы графа; время GPU - последнее пришедшее
+  int graphPassCount = 0;
+  const char* graphPassNames[kMaxGraphPasses]{};
+  float graphPassCpuMs[kMaxGraphPasses]{};
+  float graphPassGpuMs[kMaxGraphPasses]{};
+  int debugVertices = 0;
+  int debugDropped = 0;
+  // сцена рисуется в sceneWidth x sceneHeight, resolutionScale - доля стороны экрана
+  int sceneWidth = 0;
+  int sceneHeight = 0;
+  float resolutionScale = 1.0f;
+  bool dynamicResolution = false;
+  float gpuFrameMs = 0.0f;
+  float frameTargetMs = 0.0f;
+  // оператор тонмаппинга кадра (GL или программного рендера)
+  const char* tonemap = nullptr;
+  float exposure = 1.0f;
+
+  qint64 gpuBytes = 0;
+  qint64 gpuBudget = 0;
+  qint64 gpuTypeBytes[GpuMemory::TypeCount]{};
+  int gpuResources = 0;
+  int gpuEvictions = 0;
+  qint64 gpuEvictedBytes = 0;
+
+  // программный рендер, 0 - кадр рисует GL
+  float softwareMs = 0.0f;
+  int softwareTriangles = 0;
+  int softwarePixels = 0;
+
+  // -1: модель не подгружается кусками
+  float streamImportProgress = -1.0f;
+  int streamChunks = 0;
+  int streamResidentChunks = 0;
+  int streamLoadingChunks = 0;
+  qint64 streamResidentBytes = 0;
+  qint64 streamBudget = 0;
+};
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,359 @@
+#include "geometrycodec.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GEOMETRY_SSE
+#endif
+
+const int GeometryCodec::kBlockVertexes;
+const int GeometryCodec::kMaxChannels;
+const float GeometryCodec::kMinDeflateGain = 0.05f;
+
+// режимы плоскости в заголовке поля: по 2 бита на плоскость, младшие - у младшего байта
+static const int kEmptyPlane = 0;
+static const int kNibblePlane = 1;
+static const int kBytePlane = 2;
+static const int kPlaneBytes[4] = { 0, GeometryCodec::kBlockVertexes / 2, GeometryCodec::kBlockVertexes, -1 };
+// varint 32-битного числа - не длиннее 5 байт
+static const int kMaxVarintBytes = 5;
+
+namespace {
+
+inline quint32 zigzag(quint32 delta)
+{
+  return (delta << 1) ^ quint32(-qint32(delta >> 31));
+}
+
+inline quint32 unzigzag(quint32 value)
+{
+  return (value >> 1) ^ quint32(-qint32(value & 1));
+}
+
+inline quint32 loadChannel(const uchar* vertex, int channel)
+{
+  quint32 value;
+  std::memcpy(&value, vertex + channel * 4, sizeof(value));
+  return value;
+}
+
+inline void storeChannel(uchar* vertex, int channel, quint32 value)
+{
+  std::memcpy(vertex + channel * 4, &value, sizeof(value));
+}
+
+// байты плоскости блока: полубайты - по два значения в байте, первое в младших битах
+void appendPlane(QByteArray& data, const uchar* plane, int mode)
+{
+  if ( mode == kNibblePlane ) {
+    for ( int i = 0; i < GeometryCodec::kBlockVertexes; i += 2 ) {
+      data.append(char(plane[i] | (plane[i + 1] << 4)));
+    }
+  }
+  else if ( mode == kBytePlane ) {
+    data.append(reinterpret_cast<const char*>(plane), GeometryCodec::kBlockVertexes);
+  }
+}
+
+// сколько байт занимают плоскости поля с этим заголовком, -1 - неизвестный режим
+inline int planeBytes(uchar header)
+{
+  int bytes = 0;
+  for ( int plane = 0; plane < 4; plane++ ) {
+    int size = kPlaneBytes[(header >> (plane * 2)) & 3];
+    if ( size < 0 ) {
+      return -1;
+    }
+    bytes += size;
+  }
+  return bytes;
+}
+
+#if defined(GEOMETRY_SSE)
+inline __m128i loadPlane(const uchar*& data, int mode)
+{
+  if ( mode == kNibblePlane ) {
+    __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+    __m128i mask = _mm_set1_epi8(0x0F);
+    __m128i low = _mm_and_si128(packed, mask);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+    data += GeometryCodec::kBlockVertexes / 2;
+    return _mm_unpacklo_epi8(low, high);
+  }
+  if ( mode == kBytePlane ) {
+    __m128i plane = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    data += GeometryCodec::kBlockVertexes;
+    return plane;
+  }
+  return _mm_setzero_si128();
+}
+
+inline __m128i unzigzag(__m128i value)
+{
+  __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi32(1)));
+  return _mm_xor_si128(_mm_srli_epi32(value, 1), sign);
+}
+
+// префиксная сумма четырёх разностей плюс последнее значение предыдущей четвёрки
+inline __m128i prefixSum(__m128i delta, __m128i& previous)
+{
+  delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+  delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+  delta = _mm_add_epi32(delta, previous);
+  previous = _mm_shuffle_epi32(delta, _MM_SHUFFLE(3, 3, 3, 3));
+  return delta;
+}
+
+// одно поле блока: 16 значений в values
+void decodeChannel(const uchar*& data, uchar header, quint32& previous, quint32* values)
+{
+  __m128i p0 = loadPlane(data, header & 3);
+  __m128i p1 = loadPlane(data, (header >> 2) & 3);
+  __m128i p2 = loadPlane(data, (header >> 4) & 3);
+  __m128i p3 = loadPlane(data, (header >> 6) & 3);
+  // транспонирование 4x16 байт в 16 слов
+  __m128i low01 = _mm_unpacklo_epi8(p0, p1);
+  __m128i high01 = _mm_unpackhi_epi8(p0, p1);
+  __m128i low23 = _mm_unpacklo_epi8(p2, p3);
+  __m128i high23 = _mm_unpackhi_epi8(p2, p3);
+  __m128i last = _mm_set1_epi32(int(previous));
+  __m128i v0 = prefixSum(unzigzag(_mm_unpacklo_epi16(low01, low23)), last);
+  __m128i v1 = prefixSum(unzigzag(_mm_unpackhi_epi16(low01, low23)), last);
+  __m128i v2 = prefixSum(unzigzag(_mm_unpacklo_epi16(high01, high23)), last);
+  __m128i v3 = prefixSum(unzigzag(_mm_unpackhi_epi16(high01, high23)), last);
+  _mm_store_si128(reinterpret_cast<__m128i*>(values), v0);
+  _mm_store_si128(reinterpret_cast<__m128i*>(values + 4), v1);
+  _mm_store_si128(reinterpret_cast<__m128i*>(values + 8), v2);
+  _mm_store_si128(reinterpret_cast<__m128i*>(values + 12), v3);
+  previous = quint32(_mm_cvtsi128_si32(last));
+}
+
+// values[channel * kBlockVertexes + i] в вершины блока: четвёрки полей четырёх вершин
+// транспонируются в регистрах и пишутся по 16 байт
+void storeBlock(const quint32* values, int channels, uchar* block, int stride, int count)
+{
+  int channel = 0;
+  if ( count == GeometryCodec::kBlockVertexes ) {
+    for ( ; channel + 4 <= channels; channel += 4 ) {
+      const quint32* group = values + channel * GeometryCodec::kBlockVertexes;
+      for ( int i = 0; i < GeometryCodec::kBlockVertexes; i += 4 ) {
+        __m128i c0 = _mm_load_si128(reinterpret_cast<const __m128i*>(group + i));
+        __m128i c1 = _mm_load_si128(reinterpret_cast<const __m128i*>(group + GeometryCodec::kBlockVertexes + i));
+        __m128i c2 = _mm_load_si128(reinterpret_cast<const __m128i*>(group + 2 * GeometryCodec::kBlockVertexes + i));
+        __m128i c3 = _mm_load_si128(reinterpret_cast<const __m128i*>(group + 3 * GeometryCodec::kBlockVertexes + i));
+        __m128i low01 = _mm_unpacklo_epi32(c0, c1);
+        __m128i high01 = _mm_unpackhi_epi32(c0, c1);
+        __m128i low23 = _mm_unpacklo_epi32(c2, c3);
+        __m128i high23 = _mm_unpackhi_epi32(c2, c3);
+        uchar* vertex = block + i * stride + channel * 4;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vertex), _mm_unpacklo_epi64(low01, low23));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vertex + stride), _mm_unpackhi_epi64(low01, low23));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vertex + 2 * stride), _mm_unpacklo_epi64(high01, high23));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vertex + 3 * stride), _mm_unpackhi_epi64(high01, high23));
+      }
+    }
+  }
+  for ( ; channel < channels; channel++ ) {
+    for ( int i = 0; i < count; i++ ) {
+      storeChannel(block + i * stride, channel, values[channel * GeometryCodec::kBlockVertexes + i]);
+    }
+  }
+}
+#else
+void decodeChannel(const uchar*& data, uchar header, quint32& previous, quint32* values)
+{
+  for ( int i = 0; i < GeometryCodec::kBlockVertexes; i++ ) {
+    values[i] = 0;
+  }
+  for ( int plane = 0; plane < 4; plane++ ) {
+    int mode = (header >> (plane * 2)) & 3;
+    if ( mode == kNibblePlane ) {
+      for ( int i = 0; i < GeometryCodec::kBlockVertexes; i += 2 ) {
+        values[i] |= quint32(data[i / 2] & 0x0F) << (plane * 8);
+        values[i + 1] |= quint32(data[i / 2] >> 4) << (plane * 8);
+      }
+    }
+    else if ( mode == kBytePlane ) {
+      for ( int i = 0; i < GeometryCodec::kBlockVertexes; i++ ) {
+        values[i] |= quint32(data[i]) << (plane * 8);
+      }
+    }
+    data += kPlaneBytes[mode];
+  }
+  for ( int i = 0; i < GeometryCodec::kBlockVertexes; i++ ) {
+    previous += unzigzag(values[i]);
+    values[i] = previous;
+  }
+}
+
+void storeBlock(const quint32* values, int channels, uchar* block, int stride, int count)
+{
+  for ( int i = 0; i < count; i++ ) {
+    for ( int channel = 0; channel < channels; channel++ ) {
+      storeChannel(block + i * stride, channel, values[channel * GeometryCodec::kBlockVertexes + i]);
+    }
+  }
+}
+#endif
+
+}
+
+void GeometryCodec::Stats::add(const Stats& stats)
+{
+  rawBytes += stats.rawBytes;
+  encodedBytes += stats.encodedBytes;
+}
+
+QByteArray GeometryCodec::encodeVertexes(const void* vertexes, int count, int stride)
+{
+  int channels = stride / 4;
+  if ( count < 0 || stride <= 0 || stride % 4 != 0 || channels > kMaxChannels ) {
+    return QByteArray();
+  }
+  const uchar* source = static_cast<const uchar*>(vertexes);
+  QByteArray data;
+  data.reserve(count * stride / 2);
+  quint32 previous[kMaxChannels] = {};
+  uchar planes[4][kBlockVertexes];
+  for ( int begin = 0; begin < count; begin += kBlockVertexes ) {
+    int size = qMin(kBlockVertexes, count - begin);
+    for ( int channel = 0; channel < channels; channel++ ) {
+      uchar maximum[4] = {};
+      for ( int i = 0; i < kBlockVertexes; i++ ) {
+        // хвост блока дополняется нулевыми разностями
+        quint32 delta = 0;
+        if ( i < size ) {
+          quint32 value = loadChannel(source + (begin + i) * stride, channel);
+          delta = zigzag(value - previous[channel]);
+          previous[channel] = value;
+        }
+        for ( int plane = 0; plane < 4; plane++ ) {
+          planes[plane][i] = uchar(delta >> (plane * 8));
+          maximum[plane] = qMax(maximum[plane], planes[plane][i]);
+        }
+      }
+      uchar header = 0;
+      for ( int plane = 0; plane < 4; plane++ ) {
+        int mode = maximum[plane] == 0 ? kEmptyPlane : maximum[plane] < 16 ? kNibblePlane : kBytePlane;
+        header |= uchar(mode << (plane * 2));
+      }
+      data.append(char(header));
+      for ( int plane = 0; plane < 4; plane++ ) {
+        appendPlane(data, planes[plane], (header >> (plane * 2)) & 3);
+      }
+    }
+  }
+  return data;
+}
+
+bool GeometryCodec::decodeVertexes(const uchar* data, int size, void* vertexes, int count, int stride)
+{
+  int channels = stride / 4;
+  if ( count < 0 || stride <= 0 || stride % 4 != 0 || channels > kMaxChannels ) {
+    return false;
+  }
+  const uchar* end = data + size;
+  uchar* target = static_cast<uchar*>(vertexes);
+  quint32 previous[kMaxChannels] = {};
+  alignas(16) quint32 values[kMaxChannels * kBlockVertexes];
+  for ( int begin = 0; begin < count; begin += kBlockVertexes ) {
+    int blockSize = qMin(kBlockVertexes, count - begin);
+    uchar* block = target + begin * stride;
+    for ( int channel = 0; channel < channels; channel++ ) {
+      if ( data >= end ) {
+        return false;
+      }
+      uchar header = *data++;
+      int bytes = planeBytes(header);
+      if ( bytes < 0 || bytes > end - data ) {
+        return false;
+      }
+      decodeChannel(data, header, previous[channel], values + channel * kBlockVertexes);
+    }
+    storeBlock(values, channels, block, stride, blockSize);
+  }
+  return data == end;
+}
+
+QByteArray GeometryCodec::encodeIndexes(const GLuint* indexes, int count)
+{
+  QByteArray data;
+  data.reserve(count * 2);
+  quint32 next = 0;
+  for ( int i = 0; i < count; i++ ) {
+    quint32 value = zigzag(next - indexes[i]);
+    while ( value >= 0x80 ) {
+      data.append(char((value & 0x7F) | 0x80));
+      value >>= 7;
+    }
+    data.append(char(value));
+    next = qMax(next, quint32(indexes[i]) + 1);
+  }
+  return data;
+}
+
+bool GeometryCodec::decodeIndexes(const uchar* data, int size, GLuint* indexes, int count, int vertexCount)
+{
+  const uchar* end = data + size;
+  quint32 next = 0;
+  for ( int i = 0; i < count; i++ ) {
+    if ( data >= end ) {
+      return false;
+    }
+    quint32 value = *data++;
+    // почти все индексы укладываются в байт, длинный varint - редкость
+    if ( value >= 0x80 ) {
+      value &= 0x7F;
+      for ( int shift = 7; ; shift += 7 ) {
+        if ( data >= end || shift >= kMaxVarintBytes * 7 ) {
+          return false;
+        }
+        quint32 byte = *data++;
+        value |= (byte & 0x7F) << shift;
+        if ( byte < 0x80 ) {
+          break;
+        }
+      }
+    }
+    quint32 index = next - unzigzag(value);
+    indexes[i] = index;
+    next = qMax(next, index + 1);
+  }
+  // next - наибольший индекс + 1: одна проверка после цикла вместо проверки каждого индекса
+  return data == end && next <= quint32(qMax(vertexCount, 0));
+}
+
+QByteArray GeometryCodec::compress(const QByteArray& encoded, Compression& compression)
+{
+  if ( compression == Deflate ) {
+    QByteArray packed = qCompress(encoded);
+    if ( packed.size() <= encoded.size() * (1.0f - kMinDeflateGain) ) {
+      return packed;
+    }
+  }
+  compression = NoCompression;
+  return encoded;
+}
+
+bool GeometryCodec::uncompress(const uchar* data, int size, Compression compression, QByteArray& encoded)
+{
+  if ( compression == NoCompression ) {
+    encoded = QByteArray::fromRawData(reinterpret_cast<const char*>(data), size);
+    return true;
+  }
+  if ( compression == Deflate ) {
+    encoded = qUncompress(data, size);
+    return !encoded.isEmpty();
+  }
+  return false;
+}
+
+const char* GeometryCodec::backend()
+{
+#if defined(GEOMETRY_SSE)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef GEOMETRYCODEC_H
+#define GEOMETRYCODEC_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <qopengl.h>
+
+// Сжатие геометрии для архива ресурсов без потерь.
+// Вершины: каждое 32-битное поле (float как целое) заменяется разностью с тем же полем
+// предыдущей вершины в zigzag, блоки по kBlockVertexes значений одного поля раскладываются
+// на 4 байтовые плоскости, плоскость пишется пустой (одни нули), полубайтами или целиком -
+// режимы плоскостей в байте-заголовке перед полем блока. Вершины после
+// IndexOptimizer::optimizeVertexFetch идут в порядке обхода, соседние близки, и старшие
+// плоскости обычно нулевые. Декодер на SSE2 (иначе скалярный) разбирает 16 значений за раз:
+// сборка плоскостей, обратный zigzag и префиксная сумма в регистрах, в вершины поля
+// пишутся транспонированными четвёрками.
+// Индексы: разность со следующей новой вершиной (после optimizeVertexFetch новая вершина
+// даёт 0, недавняя - небольшое число) в zigzag, записанная varint.
+// Поверх обоих потоков можно положить zlib (deflate), если время чтения дороже распаковки.
+class GeometryCodec
+{
+public:
+  static const int kBlockVertexes = 16;
+  // шаг вершины - не больше kMaxChannels 32-битных полей
+  static const int kMaxChannels = 32;
+
+  enum Compression { NoCompression = 0, Deflate = 1 };
+
+  // сколько занимала геометрия без кодека и сколько с ним
+  struct Stats
+  {
+    double ratio() const { return encodedBytes > 0 ? double(rawBytes) / double(encodedBytes) : 0.0; }
+    void add( const Stats& stats );
+
+    qint64 rawBytes = 0;
+    qint64 encodedBytes = 0;
+  };
+
+  // stride кратен 4; пустой массив - неподходящий шаг
+  static QByteArray encodeVertexes(const void* vertexes, int count, int stride);
+  // false - поток повреждён или не соответствует count/stride
+  static bool decodeVertexes(const uchar* data, int size, void* vertexes, int count, int stride);
+  static QByteArray encodeIndexes(const GLuint* indexes, int count);
+  // false - ещё и если какой-то индекс не меньше vertexCount
+  static bool decodeIndexes(const uchar* data, int size, GLuint* indexes, int count, int vertexCount);
+
+  // deflate остаётся, только если экономит хотя бы kMinDeflateGain потока
+  static QByteArray compress(const QByteArray& encoded, Compression& compression);
+  // encoded - распакованный поток (для NoCompression - те же данные без копии)
+  static bool uncompress(const uchar* data, int size, Compression compression, QByteArray& encoded);
+
+  static const char* backend();
+
+private:
+  static const float kMinDeflateGain;
+};
+
+#endif // GEOMETRYCODEC_H
@@ -0,0 +1,171 @@
+#include "gpumemory.h"
+
+#include <algorithm>
+
+#include <QDebug>
+
+GpuMemory& GpuMemory::instance()
+{
+  static GpuMemory memory;
+  return memory;
+}
+
+QString GpuMemory::typeName(Type type)
+{
+  switch ( type ) {
+    case ( VertexBuffer ): {
+      return QString("vertices");
+    }
+    case ( IndexBuffer ): {
+      return QString("indexes");
+    }
+    case ( Texture ): {
+      return QString("textures");
+    }
+    case ( RenderTarget ): {
+      return QString("render targets");
+    }
+    case ( StreamingBuffer ): {
+      return QString("streaming");
+    }
+    case ( TypeCount ): {
+      break;
+    }
+  }
+  return QString("unknown");
+}
+
+qint64 GpuMemory::textureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmaps)
+{
+  qint64 bytes = qint64(width) * height * layers * bytesPerTexel;
+  return mipmaps ? bytes * 4 / 3 : bytes;
+}
+
+int GpuMemory::add(Type type, const QString& owner, qint64 bytes, std::function<bool()> evict)
+{
+  int id;
+  if ( free_.isEmpty() ) {
+    id = entries_.size();
+    entries_.append(Entry{});
+  }
+  else {
+    id = free_.takeLast();
+  }
+  Entry& entry = entries_[id];
+  entry.type = type;
+  entry.owner = owner;
+  entry.bytes = bytes;
+  entry.lastUsedFrame = frame_;
+  entry.evict = std::move(evict);
+  entry.used = true;
+  typeBytes_[type] += bytes;
+  totalBytes_ += bytes;
+  count_++;
+  return id;
+}
+
+void GpuMemory::resize(int id, qint64 bytes)
+{
+  Entry& entry = entries_[id];
+  typeBytes_[entry.type] += bytes - entry.bytes;
+  totalBytes_ += bytes - entry.bytes;
+  entry.bytes = bytes;
+}
+
+void GpuMemory::remove(int id)
+{
+  Entry& entry = entries_[id];
+  if ( !entry.used ) {
+    return;
+  }
+  typeBytes_[entry.type] -= entry.bytes;
+  totalBytes_ -= entry.bytes;
+  entry = Entry{};
+  free_.append(id);
+  count_--;
+}
+
+void GpuMemory::endFrame()
+{
+  evictions_ = 0;
+  evictedBytes_ = 0;
+  if ( totalBytes_ > budget_ ) {
+    victims_.clear();
+    for ( int i = 0; i < entries_.size(); i++ ) {
+      const Entry& entry = entries_.at(i);
+      if ( entry.used && entry.evict && entry.lastUsedFrame < frame_ ) {
+        victims_.append(i);
+      }
+    }
+    std::sort(victims_.begin(), victims_.end(), [this]( int a, int b ) {
+      return entries_.at(a).lastUsedFrame < entries_.at(b).lastUsedFrame;
+    });
+    for ( int id : victims_ ) {
+      if ( totalBytes_ <= budget_ ) {
+        break;
+      }
+      // выгрузка одного ресурса может снять и соседние (буферы одного меша)
+      if ( !entries_.at(id).used || !entries_.at(id).evict ) {
+        continue;
+      }
+      qint64 before = totalBytes_;
+      std::function<bool()> evict = entries_.at(id).evict;
+      if ( evict() ) {
+        evictions_++;
+        evictedBytes_ += before - totalBytes_;
+      }
+    }
+    if ( evictions_ > 0 ) {
+      qDebug() << QString("gpu memory over budget: evicted %1 resources, %2 MB")
+                  .arg(evictions_).arg(double(evictedBytes_) / 1048576.0, 0, 'f', 1);
+    }
+  }
+  frame_++;
+}
+
+QMap<QString, qint64> GpuMemory::ownerBytes() const
+{
+  QMap<QString, qint64> owners;
+  for ( const auto& entry : entries_ ) {
+    if ( entry.used ) {
+      owners[entry.owner] += entry.bytes;
+    }
+  }
+  return owners;
+}
+
+QString GpuMemory::report() const
+{
+  QString text = QString("gpu memory: %1 MB of %2 MB in %3 resources")
+      .arg(double(totalBytes_) / 1048576.0, 0, 'f', 1).arg(budget_ / 1048576).arg(count_);
+  for ( int type = 0; type < TypeCount; type++ ) {
+    text += QString("\n  %1: %2 MB").arg(typeName(Type(type)))
+        .arg(double(typeBytes_[type]) / 1048576.0, 0, 'f', 2);
+  }
+  QMap<QString, qint64> owners = ownerBytes();
+  for ( const auto& owner : owners.keys() ) {
+    text += QString("\n  [%1] %2 MB").arg(owner).arg(double(owners.value(owner)) / 1048576.0, 0, 'f', 2);
+  }
+  return text;
+}
+
+void GpuAllocation::allocate(GpuMemory::Type type, const QString& owner, qint64 bytes, std::function<bool()> evict)
+{
+  release();
+  id_ = GpuMemory::instance().add(type, owner, bytes, std::move(evict));
+}
+
+void GpuAllocation::resize(qint64 bytes)
+{
+  if ( id_ >= 0 ) {
+    GpuMemory::instance().resize(id_, bytes);
+  }
+}
+
+void GpuAllocation::release()
+{
+  if ( id_ >= 0 ) {
+    GpuMemory::instance().remove(id_);
+    id_ = -1;
+  }
+}
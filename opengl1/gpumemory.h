@@ -0,0 +1,90 @@
+#ifndef GPUMEMORY_H
+#define GPUMEMORY_H
+
+#include <functional>
+
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+// Учёт видеопамяти: сколько байт занимают буферы, текстуры и цели рендера по типам
+// и по владельцам. Ресурсы с функцией выгрузки, которые давно не использовались,
+// освобождаются в endFrame(), если сумма превышает бюджет; владелец загружает их
+// обратно из памяти CPU при следующем обращении. Работает только в потоке контекста GL.
+class GpuMemory
+{
+public:
+  enum Type { VertexBuffer, IndexBuffer, Texture, RenderTarget, StreamingBuffer, TypeCount };
+
+  static const qint64 kDefaultBudget = 1024ll * 1024 * 1024;
+
+  static GpuMemory& instance();
+  static QString typeName(Type type);
+  // размер текстуры с цепочкой мипов (треть сверху) или без неё
+  static qint64 textureBytes(int width, int height, int layers, int bytesPerTexel, bool mipmaps);
+
+  // evict возвращает false, если освободить ресурс нельзя; после выгрузки
+  // владелец сам вызывает remove() или resize()
+  int add(Type type, const QString& owner, qint64 bytes, std::function<bool()> evict = nullptr);
+  void resize(int id, qint64 bytes);
+  void remove(int id);
+  void touch(int id) { entries_[id].lastUsedFrame = frame_; }
+  // выгрузка по LRU до бюджета; использованное в этом кадре не трогаем
+  void endFrame();
+
+  void setBudget(qint64 bytes) { budget_ = bytes; }
+  qint64 budget() const { return budget_; }
+  qint64 totalBytes() const { return totalBytes_; }
+  qint64 bytes(Type type) const { return typeBytes_[type]; }
+  int resourceCount() const { return count_; }
+  int evictions() const { return evictions_; }
+  qint64 evictedBytes() const { return evictedBytes_; }
+  QMap<QString, qint64> ownerBytes() const;
+  QString report() const;
+
+private:
+  struct Entry {
+    Type type = VertexBuffer;
+    QString owner;
+    qint64 bytes = 0;
+    quint64 lastUsedFrame = 0;
+    std::function<bool()> evict;
+    bool used = false;
+  };
+
+  GpuMemory() = default;
+
+private:
+  QVector<Entry> entries_;
+  QVector<int> free_;
+  QVector<int> victims_;
+  qint64 typeBytes_[TypeCount]{};
+  qint64 totalBytes_ = 0;
+  qint64 budget_ = kDefaultBudget;
+  quint64 frame_ = 0;
+  int count_ = 0;
+  int evictions_ = 0;
+  qint64 evictedBytes_ = 0;
+};
+
+// Запись в GpuMemory, которая снимается вместе с владельцем
+class GpuAllocation
+{
+public:
+  GpuAllocation() = default;
+  GpuAllocation(const GpuAllocation&) = delete;
+  ~GpuAllocation() { release(); }
+
+  GpuAllocation& operator=(const GpuAllocation&) = delete;
+
+  void allocate(GpuMemory::Type type, const QString& owner, qint64 bytes, std::function<bool()> evict = nullptr);
+  void resize(qint64 bytes);
+  void release();
+  void touch() { if ( id_ >= 0 ) { GpuMemory::instance().touch(id_); } }
+  bool isAllocated() const { return id_ >= 0; }
+
+private:
+  int id_ = -1;
+};
+
+#endif // GPUMEMORY_H
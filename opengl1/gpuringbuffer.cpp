@@ -0,0 +1,170 @@
+#include "gpuringbuffer.h"
+
+#include <cstring>
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (QOPENGLF_APIENTRYP BufferStorageFunction)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// сколько ждать fence, если кольцо переполнено: дольше - значит GPU завис
+static const GLuint64 kFenceTimeout = 1000000000;
+
+GpuRingBuffer::~GpuRingBuffer()
+{
+  destroy();
+}
+
+void GpuRingBuffer::create(GLsizeiptr size)
+{
+  destroy();
+  auto context = QOpenGLContext::currentContext();
+  auto f = context->extraFunctions();
+  size_ = size;
+  f->glGenBuffers(1, &buffer_);
+  f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+
+  auto bufferStorage = reinterpret_cast<BufferStorageFunction>(context->getProcAddress("glBufferStorage"));
+  if ( bufferStorage && !context->isOpenGLES() && context->hasExtension("GL_ARB_buffer_storage") ) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    bufferStorage(GL_COPY_WRITE_BUFFER, size_, nullptr, flags);
+    mapped_ = f->glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size_, flags);
+  }
+  if ( !mapped_ ) {
+    f->glBufferData(GL_COPY_WRITE_BUFFER, size_, nullptr, GL_STREAM_DRAW);
+  }
+  f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  memory_.allocate(GpuMemory::StreamingBuffer, QString("ring buffer"), size_);
+  qDebug() << QString("ring buffer %1 KB, %2").arg(size_ / 1024)
+              .arg(mapped_ ? "persistent mapping" : "unsynchronized map + orphaning");
+}
+
+void GpuRingBuffer::destroy()
+{
+  // без контекста объекты GL уже удалены вместе с ним
+  if ( buffer_ == 0 || !QOpenGLContext::currentContext() ) { return; }
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  for ( auto& fence : fences_ ) {
+    f->glDeleteSync(fence.sync);
+  }
+  fences_.clear();
+  if ( mapped_ ) {
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    f->glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    mapped_ = nullptr;
+  }
+  f->glDeleteBuffers(1, &buffer_);
+  memory_.release();
+  buffer_ = 0;
+  size_ = 0;
+  head_ = 0;
+  used_ = 0;
+  frameBytes_ = 0;
+}
+
+GLintptr GpuRingBuffer::write(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+{
+  if ( buffer_ == 0 || size <= 0 || size > size_ ) {
+    return -1;
+  }
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  retireFences(false);
+
+  GLintptr offset = (head_ + alignment - 1) / alignment * alignment;
+  if ( offset + size > size_ ) {
+    offset = 0; // остаток до конца буфера пропускаем
+  }
+  GLsizeiptr padding = offset >= head_ ? offset - head_ : size_ - head_ + offset;
+  if ( mapped_ ) {
+    // участки, которые GPU ещё читает, освобождаются по fence от старых кадров к новым
+    while ( used_ + padding + size > size_ ) {
+      if ( fences_.isEmpty() ) {
+        qDebug() << QString("ring buffer overflow: %1 bytes in one frame").arg(frameBytes_ + size);
+        return -1;
+      }
+      retireFences(true);
+    }
+    std::memcpy(static_cast<char*>(mapped_) + offset, data, size_t(size));
+  }
+  else {
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    if ( used_ + padding + size > size_ ) {
+      // старое хранилище драйвер держит, пока GPU его читает, нам выдаёт новое
+      f->glBufferData(GL_COPY_WRITE_BUFFER, size_, nullptr, GL_STREAM_DRAW);
+      orphans_++;
+      offset = 0;
+      padding = 0;
+      used_ = 0;
+    }
+    void* target = f->glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if ( target ) {
+      std::memcpy(target, data, size_t(size));
+      f->glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if ( !target ) {
+      return -1;
+    }
+  }
+  used_ += padding + size;
+  frameBytes_ += padding + size;
+  head_ = offset + size;
+  return offset;
+}
+
+void GpuRingBuffer::endFrame()
+{
+  lastFrameBytes_ = frameBytes_;
+  if ( !mapped_ ) {
+    // без fence место в текущем хранилище освобождается только при orphaning
+    frameBytes_ = 0;
+    return;
+  }
+  if ( frameBytes_ > 0 ) {
+    auto f = QOpenGLContext::currentContext()->extraFunctions();
+    fences_.append(Fence{f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), frameBytes_});
+    frameBytes_ = 0;
+  }
+}
+
+void GpuRingBuffer::resetCounters()
+{
+  fenceWaits_ = 0;
+  orphans_ = 0;
+}
+
+void GpuRingBuffer::retireFences(bool wait)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  while ( !fences_.isEmpty() ) {
+    Fence& fence = fences_.first();
+    GLenum status = f->glClientWaitSync(fence.sync, 0, 0);
+    if ( status == GL_TIMEOUT_EXPIRED ) {
+      if ( !wait ) {
+        return;
+      }
+      fenceWaits_++;
+      status = f->glClientWaitSync(fence.sync, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+      if ( status == GL_TIMEOUT_EXPIRED ) {
+        qDebug() << "ring buffer fence timeout";
+      }
+      wait = false; // ждём только один кадр, дальше снова без блокировки
+    }
+    f->glDeleteSync(fence.sync);
+    used_ -= fence.bytes;
+    fences_.removeFirst();
+  }
+  if ( fences_.isEmpty() && frameBytes_ == 0 ) {
+    used_ = 0;
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef GPURINGBUFFER_H
+#define GPURINGBUFFER_H
+
+#include <QVector>
+#include <qopengl.h>
+
+#include "gpumemory.h"
+
+// Кольцевой буфер для данных, которые пишутся каждый кадр (константы, матрицы экземпляров,
+// отладочная геометрия). С GL_ARB_buffer_storage буфер отображён в память постоянно,
+// а занятые кадром участки защищаются fence: CPU ждёт GPU только если кольцо переполнено.
+// На чистом GL 3.3 запись идёт через glMapBufferRange без синхронизации в ещё не
+// использованную часть буфера, а при переходе через конец хранилище "сиротеет" (orphaning).
+class GpuRingBuffer
+{
+public:
+  GpuRingBuffer() = default;
+  GpuRingBuffer(const GpuRingBuffer&) = delete;
+  ~GpuRingBuffer();
+
+  GpuRingBuffer& operator=(const GpuRingBuffer&) = delete;
+
+  void create(GLsizeiptr size);
+  void destroy();
+  bool isCreated() const { return buffer_ != 0; }
+  bool isPersistent() const { return mapped_ != nullptr; }
+  GLuint buffer() const { return buffer_; }
+
+  // копирует данные в кольцо, возвращает смещение от начала буфера или -1
+  GLintptr write(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16);
+  // закрывает кадр: всё записанное с прошлого вызова защищается fence
+  void endFrame();
+
+  float occupancy() const { return size_ > 0 ? float(used_) / float(size_) : 0.0f; }
+  int fenceWaits() const { return fenceWaits_; }
+  int orphans() const { return orphans_; }
+  // байт записано за последний закрытый кадр (с учётом выравнивания)
+  GLsizeiptr frameBytes() const { return lastFrameBytes_; }
+  void resetCounters();
+
+private:
+  struct Fence {
+    GLsync sync;
+    GLsizeiptr bytes;
+  };
+
+  void retireFences(bool wait);
+
+private:
+  GLuint buffer_ = 0;
+  GLsizeiptr size_ = 0;
+  void* mapped_ = nullptr;
+  GLintptr head_ = 0;
+  GLsizeiptr used_ = 0;
+  GLsizeiptr frameBytes_ = 0;
+  GLsizeiptr lastFrameBytes_ = 0;
+  QVector<Fence> fences_;
+  int fenceWaits_ = 0;
+  int orphans_ = 0;
+  GpuAllocation memory_;
+};
+
+#endif // GPURINGBUFFER_H
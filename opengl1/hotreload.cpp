@@ -0,0 +1,212 @@
+#include "hotreload.h"
+#include "oglobject.h"
+
+#include <QDebug>
+#include <QFileInfo>
+
+HotReload::HotReload(QObject* parent) :
+  QObject(parent)
+{
+  QObject::connect(&watcher_, SIGNAL(fileChanged(QString)), this, SLOT(fileChangedSlot(QString)));
+}
+
+void HotReload::watchModel(OGLObject* object)
+{
+  QStringList released = removeDependents(object);
+  addDependent(object->path(), Dependent{Model, object, nullptr});
+  for ( const auto& library : object->materialLibraries() ) {
+    addDependent(library, Dependent{MaterialLibrary, object, nullptr});
+  }
+  for ( const auto& texture : object->texturePaths() ) {
+    addDependent(texture, Dependent{Texture, object, nullptr});
+  }
+  // файлы, которые модель перестала использовать
+  QStringList unused;
+  for ( const auto& path : released ) {
+    if ( !dependents_.contains(path) ) {
+      unused.append(path);
+    }
+  }
+  unwatch(unused);
+}
+
+void HotReload::unwatchModel(OGLObject* object)
+{
+  for ( int i = reloaded_.size() - 1; i >= 0; i-- ) {
+    if ( reloaded_.at(i).object == object ) {
+      reloaded_.remove(i);
+    }
+  }
+  unwatch(removeDependents(object));
+}
+
+void HotReload::watchShader(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const QString& path)
+{
+  QVector<ShaderFile>& files = programs_[&program];
+  for ( const auto& file : files ) {
+    if ( file.path == path ) {
+      return;
+    }
+  }
+  files.append(ShaderFile{type, path});
+  addDependent(path, Dependent{Shader, nullptr, &program});
+}
+
+HotReload::Result HotReload::process()
+{
+  Result result;
+  QVector<ReloadedModel> reloaded;
+  reloaded.swap(reloaded_);
+  for ( const auto& model : reloaded ) {
+    bool ok = model.object->applyReloadedGeometry();
+    if ( ok ) {
+      watchModel(model.object);
+      if ( !result.models.contains(model.object) ) {
+        result.models.append(model.object);
+      }
+    }
+    logLatency(model.path, model.changed, ok);
+  }
+  QStringList ready;
+  for ( auto it = changes_.constBegin(); it != changes_.constEnd(); ++it ) {
+    if ( it.value().last.elapsed() >= kSettleMs ) {
+      ready.append(it.key());
+    }
+  }
+  for ( const auto& path : ready ) {
+    Change change = changes_.take(path);
+    // при сохранении через переименование наблюдение за путём снимается - ставим заново
+    if ( !watcher_.files().contains(path) && QFileInfo::exists(path) ) {
+      watcher_.addPath(path);
+    }
+    // копия: перезагрузка модели перестраивает её зависимости
+    QVector<Dependent> dependents = dependents_.value(path);
+    for ( const auto& dependent : dependents ) {
+      switch ( dependent.kind ) {
+        case ( Model ): {
+          // меши собираются в рабочих потоках, подменяются в начале одного из следующих кадров
+          OGLObject* object = dependent.object;
+          QElapsedTimer first = change.first;
+          object->reloadGeometry([this, object, path, first]( bool ok ) {
+            if ( !ok ) {
+              logLatency(path, first, false);
+              return;
+            }
+            for ( const auto& reloaded : reloaded_ ) {
+              if ( reloaded.object == object ) {
+                return;
+              }
+            }
+            reloaded_.append(ReloadedModel{object, path, first});
+          });
+          break;
+        }
+        case ( MaterialLibrary ): {
+          dependent.object->reloadMaterials(path);
+          watchModel(dependent.object);
+          if ( !result.models.contains(dependent.object) ) {
+            result.models.append(dependent.object);
+          }
+          logLatency(path, change.first, true);
+          break;
+        }
+        case ( Texture ): {
+          QElapsedTimer first = change.first;
+          dependent.object->reloadTexture(path, [path, first]( bool ok ) {
+            logLatency(path, first, ok);
+          });
+          break;
+        }
+        case ( Shader ): {
+          // программа с несколькими изменившимися файлами собирается один раз
+          if ( result.programs.contains(dependent.program) ) {
+            break;
+          }
+          bool ok = reloadProgram(*dependent.program);
+          if ( ok ) {
+            result.programs.append(dependent.program);
+          }
+          logLatency(path, change.first, ok);
+          break;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+void HotReload::fileChangedSlot(const QString& path)
+{
+  Change& change = changes_[path];
+  if ( !change.first.isValid() ) {
+    change.first.start();
+  }
+  change.last.start();
+}
+
+void HotReload::addDependent(const QString& path, const Dependent& dependent)
+{
+  QVector<Dependent>& list = dependents_[path];
+  if ( list.isEmpty() && QFileInfo::exists(path) ) {
+    watcher_.addPath(path);
+  }
+  list.append(dependent);
+}
+
+QStringList HotReload::removeDependents(OGLObject* object)
+{
+  QStringList released;
+  for ( auto it = dependents_.begin(); it != dependents_.end(); ) {
+    QVector<Dependent>& list = it.value();
+    for ( int i = list.size() - 1; i >= 0; i-- ) {
+      if ( list.at(i).object == object ) {
+        list.remove(i);
+      }
+    }
+    if ( list.isEmpty() ) {
+      released.append(it.key());
+      it = dependents_.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  return released;
+}
+
+void HotReload::unwatch(const QStringList& paths)
+{
+  for ( const auto& path : paths ) {
+    watcher_.removePath(path);
+    changes_.remove(path);
+  }
+}
+
+bool HotReload::reloadProgram(QOpenGLShaderProgram& program)
+{
+  QVector<ShaderFile> files = programs_.value(&program);
+  // сначала пробная сборка: с ошибкой в шейдере рисуем дальше старой программой.
+  // Программы живут в виджете по значению, поэтому удачная сборка повторяется на месте
+  QOpenGLShaderProgram candidate;
+  for ( const auto& file : files ) {
+    if ( !candidate.addShaderFromSourceFile(file.type, file.path) ) {
+      qDebug().noquote() << QString("shader %1:\n%2").arg(file.path, candidate.log());
+      return false;
+    }
+  }
+  if ( !candidate.link() ) {
+    qDebug().noquote() << QString("shader program link:\n%1").arg(candidate.log());
+    return false;
+  }
+  program.removeAllShaders();
+  for ( const auto& file : files ) {
+    program.addShaderFromSourceFile(file.type, file.path);
+  }
+  return program.link();
+}
+
+void HotReload::logLatency(const QString& path, const QElapsedTimer& changed, bool ok)
+{
+  qDebug() << QString("hot reload %1: %2, %3 ms after change").arg(QFileInfo(path).fileName())
+              .arg(ok ? "replaced" : "failed, previous version kept").arg(changed.elapsed());
+}
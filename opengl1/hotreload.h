@@ -0,0 +1,95 @@
+#ifndef HOTRELOAD_H
+#define HOTRELOAD_H
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+#include <QOpenGLShader>
+#include <QOpenGLShaderProgram>
+
+class OGLObject;
+
+// Горячая перезагрузка ресурсов с диска. Хранит граф зависимостей: obj -> модель,
+// mtl -> модели, текстура -> модели, файл шейдера -> программы, и по сигналу
+// QFileSystemWatcher перерабатывает только изменившиеся файлы. Сами замены делает
+// process() в потоке контекста в начале кадра, поэтому кадр видит либо старый ресурс,
+// либо новый целиком; меши моделей собираются в рабочих потоках и подменяются в начале
+// кадра после сборки, текстуры декодируются в рабочих потоках и подменяются там же,
+// где остальные вызовы GL из JobSystem::runOnMainThread().
+class HotReload : public QObject
+{
+  Q_OBJECT
+
+public:
+  // сохранение файла редактором - это несколько событий подряд, ждём, пока файл затихнет
+  static const int kSettleMs = 100;
+
+  struct Result {
+    QVector<OGLObject*> models;
+    QVector<QOpenGLShaderProgram*> programs;
+  };
+
+  explicit HotReload(QObject* parent = nullptr);
+  HotReload(const HotReload&) = delete;
+
+  HotReload& operator=(const HotReload&) = delete;
+
+  // модель и все её файлы; повторный вызов пересобирает зависимости модели
+  void watchModel(OGLObject* object);
+  void unwatchModel(OGLObject* object);
+  // файл шейдера, из которого собрана программа; программа пересобирается из всех своих файлов
+  void watchShader(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const QString& path);
+  int watchedFiles() const { return dependents_.size(); }
+
+  // в потоке контекста между кадрами; модели и программы, которые уже подменены
+  Result process();
+
+private slots:
+  void fileChangedSlot(const QString& path);
+
+private:
+  enum Kind { Model, MaterialLibrary, Texture, Shader };
+
+  struct Dependent {
+    Kind kind;
+    OGLObject* object;
+    QOpenGLShaderProgram* program;
+  };
+
+  struct ShaderFile {
+    QOpenGLShader::ShaderType type;
+    QString path;
+  };
+
+  // first - от первого события, по нему считается задержка; last - от последнего
+  struct Change {
+    QElapsedTimer first;
+    QElapsedTimer last;
+  };
+
+  // модель, новые меши которой собраны и ждут подмены в process()
+  struct ReloadedModel {
+    OGLObject* object;
+    QString path;
+    QElapsedTimer changed;
+  };
+
+  void addDependent(const QString& path, const Dependent& dependent);
+  // убирает модель из графа, возвращает файлы, от которых больше никто не зависит
+  QStringList removeDependents(OGLObject* object);
+  void unwatch(const QStringList& paths);
+  bool reloadProgram(QOpenGLShaderProgram& program);
+  static void logLatency(const QString& path, const QElapsedTimer& changed, bool ok);
+
+private:
+  QFileSystemWatcher watcher_;
+  // по полному пути файла
+  QHash< QString, QVector<Dependent> > dependents_;
+  QHash< QOpenGLShaderProgram*, QVector<ShaderFile> > programs_;
+  QHash<QString, Change> changes_;
+  QVector<ReloadedModel> reloaded_;
+};
+
+#endif // HOTRELOAD_H
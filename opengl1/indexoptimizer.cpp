@@ -0,0 +1,210 @@
+#include "indexoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// параметры оценки вершин из "Linear-Speed Vertex Cache Optimisation" (T. Forsyth)
+static const int kCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f;
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f;
+
+static float vertexScore(int cachePosition, int liveTriangles)
+{
+  if ( liveTriangles == 0 ) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if ( cachePosition >= 0 ) {
+    // вершины только что выведенного треугольника получают фиксированную оценку,
+    // иначе следующим почти всегда берётся соседний треугольник и получается полоса
+    if ( cachePosition < 3 ) {
+      score = kLastTriangleScore;
+    }
+    else {
+      float scale = 1.0f / (kCacheSize - 3);
+      score = std::pow(1.0f - (cachePosition - 3) * scale, kCacheDecayPower);
+    }
+  }
+  return score + kValenceBoostScale * std::pow(float(liveTriangles), -kValenceBoostPower);
+}
+
+void VertexCacheStats::add(const VertexCacheStats& stats)
+{
+  triangles += stats.triangles;
+  vertexes += stats.vertexes;
+  misses += stats.misses;
+}
+
+void IndexOptimizer::optimizeVertexCache(QVector<GLuint>& indexes, int vertexCount)
+{
+  optimizeVertexCache(indexes, 0, indexes.size(), vertexCount);
+}
+
+void IndexOptimizer::optimizeVertexCache(QVector<GLuint>& indexes, int offset, int count, int vertexCount)
+{
+  count -= count % 3;
+  if ( count < 6 ) {
+    return;
+  }
+  GLuint* range = indexes.data() + offset;
+  if ( count >= vertexCount ) {
+    optimizeRange(range, count, vertexCount);
+    return;
+  }
+  // диапазон (кластер) касается малой доли вершин меша: массивы по вершинам заводятся
+  // на локальную нумерацию, иначе вызов на каждый кластер стоил бы O(вершин меша)
+  QVector<GLuint> used(range, range + count);
+  std::sort(used.begin(), used.end());
+  used.erase(std::unique(used.begin(), used.end()), used.end());
+  for ( int i = 0; i < count; i++ ) {
+    range[i] = GLuint(std::lower_bound(used.constBegin(), used.constEnd(), range[i]) - used.constBegin());
+  }
+  optimizeRange(range, count, used.size());
+  for ( int i = 0; i < count; i++ ) {
+    range[i] = used.at(int(range[i]));
+  }
+}
+
+void IndexOptimizer::optimizeRange(GLuint* indexes, int count, int vertexCount)
+{
+  int triangleCount = count / 3;
+  const GLuint* source = indexes;
+
+  // смежность вершина -> живые (ещё не выведенные) треугольники
+  QVector<int> liveTriangles(vertexCount, 0);
+  for ( int i = 0; i < triangleCount * 3; i++ ) {
+    liveTriangles[int(source[i])]++;
+  }
+  QVector<int> adjacencyOffsets(vertexCount + 1, 0);
+  for ( int v = 0; v < vertexCount; v++ ) {
+    adjacencyOffsets[v + 1] = adjacencyOffsets.at(v) + liveTriangles.at(v);
+  }
+  QVector<int> adjacency(triangleCount * 3);
+  QVector<int> fill = adjacencyOffsets;
+  for ( int i = 0; i < triangleCount * 3; i++ ) {
+    adjacency[fill[int(source[i])]++] = i / 3;
+  }
+
+  QVector<int> cachePosition(vertexCount, -1);
+  QVector<float> scores(vertexCount, 0.0f);
+  for ( int v = 0; v < vertexCount; v++ ) {
+    scores[v] = vertexScore(-1, liveTriangles.at(v));
+  }
+  QVector<float> triangleScores(triangleCount);
+  for ( int t = 0; t < triangleCount; t++ ) {
+    triangleScores[t] = scores.at(int(source[t * 3])) + scores.at(int(source[t * 3 + 1])) + scores.at(int(source[t * 3 + 2]));
+  }
+  QVector<char> emitted(triangleCount, 0);
+
+  QVector<GLuint> result;
+  result.reserve(triangleCount * 3);
+  QVector<int> cache;
+  QVector<int> newCache;
+  int cursor = 0;
+  int best = 0;
+  for ( int t = 1; t < triangleCount; t++ ) {
+    if ( triangleScores.at(t) > triangleScores.at(best) ) {
+      best = t;
+    }
+  }
+
+  while ( best >= 0 ) {
+    emitted[best] = 1;
+    const GLuint* triangle = source + best * 3;
+    newCache.clear();
+    for ( int k = 0; k < 3; k++ ) {
+      int v = int(triangle[k]);
+      result.append(GLuint(v));
+      newCache.append(v);
+      // убираем треугольник из списка живых у вершины
+      int begin = adjacencyOffsets.at(v);
+      int end = begin + liveTriangles.at(v);
+      for ( int a = begin; a < end; a++ ) {
+        if ( adjacency.at(a) == best ) {
+          std::swap(adjacency[a], adjacency[end - 1]);
+          break;
+        }
+      }
+      liveTriangles[v]--;
+    }
+    for ( int v : cache ) {
+      if ( v != int(triangle[0]) && v != int(triangle[1]) && v != int(triangle[2]) ) {
+        newCache.append(v);
+      }
+    }
+    // вытесненные из кэша вершины тоже надо переоценить
+    for ( int i = 0; i < newCache.size(); i++ ) {
+      int v = newCache.at(i);
+      cachePosition[v] = i < kCacheSize ? i : -1;
+      scores[v] = vertexScore(cachePosition.at(v), liveTriangles.at(v));
+    }
+
+    best = -1;
+    float bestScore = -1.0f;
+    for ( int v : newCache ) {
+      for ( int a = adjacencyOffsets.at(v); a < adjacencyOffsets.at(v) + liveTriangles.at(v); a++ ) {
+        int t = adjacency.at(a);
+        const GLuint* other = source + t * 3;
+        float score = scores.at(int(other[0])) + scores.at(int(other[1])) + scores.at(int(other[2]));
+        triangleScores[t] = score;
+        if ( score > bestScore ) {
+          bestScore = score;
+          best = t;
+        }
+      }
+    }
+    if ( newCache.size() > kCacheSize ) {
+      newCache.resize(kCacheSize);
+    }
+    std::swap(cache, newCache);
+
+    if ( best < 0 ) {
+      // тупик: берём следующий невыведенный треугольник по порядку
+      while ( cursor < triangleCount && emitted.at(cursor) ) {
+        cursor++;
+      }
+      best = cursor < triangleCount ? cursor : -1;
+    }
+  }
+
+  std::copy(result.constBegin(), result.constEnd(), indexes);
+}
+
+void IndexOptimizer::optimizeVertexFetch(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  QVector<int> remap(vertexes.size(), -1);
+  QVector<Vertex> ordered;
+  ordered.reserve(vertexes.size());
+  for ( auto& index : indexes ) {
+    int& target = remap[int(index)];
+    if ( target < 0 ) {
+      target = ordered.size();
+      ordered.append(vertexes.at(int(index)));
+    }
+    index = GLuint(target);
+  }
+  vertexes = ordered;
+}
+
+VertexCacheStats IndexOptimizer::analyzeVertexCache(const QVector<GLuint>& indexes, int vertexCount)
+{
+  VertexCacheStats stats;
+  stats.triangles = indexes.size() / 3;
+  // время входа вершины в FIFO: вершина в кэше, пока с тех пор было меньше kFifoCacheSize промахов
+  QVector<int> timestamps(vertexCount, -kFifoCacheSize - 1);
+  QVector<char> referenced(vertexCount, 0);
+  for ( GLuint index : indexes ) {
+    int v = int(index);
+    if ( stats.misses - timestamps.at(v) > kFifoCacheSize ) {
+      timestamps[v] = stats.misses;
+      stats.misses++;
+    }
+    if ( !referenced.at(v) ) {
+      referenced[v] = 1;
+      stats.vertexes++;
+    }
+  }
+  return stats;
+}
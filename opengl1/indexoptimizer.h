@@ -0,0 +1,39 @@
+#ifndef INDEXOPTIMIZER_H
+#define INDEXOPTIMIZER_H
+
+#include <QVector>
+#include <qopengl.h>
+
+#include "structs.h"
+
+// Статистика кэша вершин после трансформации (моделируется FIFO-кэш).
+// ACMR - промахов на треугольник, ATVR - промахов на вершину (1.0 - идеал).
+struct VertexCacheStats
+{
+  float acmr() const { return triangles > 0 ? float(misses) / triangles : 0.0f; }
+  float atvr() const { return vertexes > 0 ? float(misses) / vertexes : 0.0f; }
+  void add( const VertexCacheStats& stats );
+
+  int triangles = 0;
+  int vertexes = 0;
+  int misses = 0;
+};
+
+class IndexOptimizer
+{
+public:
+  static const int kFifoCacheSize = 16;
+
+  // порядок треугольников по Forsyth для диапазона [offset, offset + count) буфера индексов
+  static void optimizeVertexCache(QVector<GLuint>& indexes, int offset, int count, int vertexCount);
+  static void optimizeVertexCache(QVector<GLuint>& indexes, int vertexCount);
+  // перенумеровывает вершины в порядке первого использования
+  static void optimizeVertexFetch(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  static VertexCacheStats analyzeVertexCache(const QVector<GLuint>& indexes, int vertexCount);
+
+private:
+  // индексы count штук в [0, vertexCount), порядок меняется на месте
+  static void optimizeRange(GLuint* indexes, int count, int vertexCount);
+};
+
+#endif // INDEXOPTIMIZER_H
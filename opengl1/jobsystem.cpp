@@ -0,0 +1,325 @@
+#include "jobsystem.h"
+
+#include <chrono>
+
+#include <QDebug>
+#include <QThread>
+
+// сколько раз поток ищет работу перед тем, как уснуть
+static const int kIdleSpins = 64;
+// сон ограничен по времени: пропущенное пробуждение стоит не больше этого
+static const std::chrono::microseconds kIdleSleep{500};
+
+namespace {
+
+thread_local const JobSystem* currentSystem = nullptr;
+thread_local int currentWorker = -1;
+
+}
+
+JobDeque::JobDeque() :
+  jobs_{new std::atomic<Job*>[kCapacity]}
+{
+
+}
+
+bool JobDeque::push(Job* job)
+{
+  qint64 bottom = bottom_.load(std::memory_order_relaxed);
+  qint64 top = top_.load(std::memory_order_acquire);
+  if ( bottom - top >= kCapacity ) {
+    return false;
+  }
+  jobs_[bottom & (kCapacity - 1)].store(job, std::memory_order_relaxed);
+  bottom_.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+Job* JobDeque::pop()
+{
+  qint64 bottom = bottom_.load(std::memory_order_relaxed) - 1;
+  bottom_.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  qint64 top = top_.load(std::memory_order_relaxed);
+  if ( top > bottom ) {
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  Job* job = jobs_[bottom & (kCapacity - 1)].load(std::memory_order_relaxed);
+  if ( top == bottom ) {
+    // последняя задача: соревнуемся с крадущими потоками
+    if ( !top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) ) {
+      job = nullptr;
+    }
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+Job* JobDeque::steal()
+{
+  qint64 top = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  qint64 bottom = bottom_.load(std::memory_order_acquire);
+  if ( top >= bottom ) {
+    return nullptr;
+  }
+  Job* job = jobs_[top & (kCapacity - 1)].load(std::memory_order_relaxed);
+  if ( !top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed) ) {
+    return nullptr;
+  }
+  return job;
+}
+
+JobSystem::JobSystem(int workerCount) :
+  mainThread_{std::this_thread::get_id()}
+{
+  if ( workerCount <= 0 ) {
+    workerCount = qMax(1, QThread::idealThreadCount() - 1);
+  }
+  for ( int i = 0; i <= workerCount; i++ ) {
+    workers_.emplace_back(new Worker);
+    workers_.back()->pool.reset(new Job[kJobPoolSize]);
+    for ( int j = 0; j < kJobPoolSize; j++ ) {
+      workers_.back()->pool[j].unfinished.store(0, std::memory_order_relaxed);
+    }
+    workers_.back()->random = unsigned(i) * 2654435761u + 1;
+  }
+  currentSystem = this;
+  currentWorker = 0;
+  for ( int i = 1; i <= workerCount; i++ ) {
+    threads_.emplace_back([this, i] {
+      currentSystem = this;
+      currentWorker = i;
+      workerLoop(i);
+    });
+  }
+  qDebug() << QString("job system: %1 workers + main thread").arg(workerCount);
+}
+
+JobSystem::~JobSystem()
+{
+  running_.store(false);
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    wake_.notify_all();
+  }
+  for ( auto& thread : threads_ ) {
+    thread.join();
+  }
+  if ( currentSystem == this ) {
+    currentSystem = nullptr;
+    currentWorker = -1;
+  }
+}
+
+JobSystem& JobSystem::instance()
+{
+  static JobSystem system;
+  return system;
+}
+
+int JobSystem::currentIndex() const
+{
+  Q_ASSERT(currentSystem == this);
+  return currentSystem == this ? currentWorker : 0;
+}
+
+bool JobSystem::isMainThread() const
+{
+  return std::this_thread::get_id() == mainThread_;
+}
+
+Job* JobSystem::allocate(Job* parent)
+{
+  int index = currentIndex();
+  Worker& worker = *workers_[size_t(index)];
+  // кольцо обошло круг: задачи, которые ещё в работе (например, ждущий корень
+  // выше по стеку), пропускаем; если заняты все - помогаем остальным, пока не освободится
+  Job* job = nullptr;
+  while ( !job ) {
+    for ( int i = 0; i < kJobPoolSize && !job; i++ ) {
+      Job* candidate = &worker.pool[worker.poolNext % kJobPoolSize];
+      worker.poolNext++;
+      if ( isFinished(candidate) ) {
+        job = candidate;
+      }
+    }
+    if ( !job && !executeOne(index) ) {
+      std::this_thread::yield();
+    }
+  }
+  job->parent = parent;
+  job->unfinished.store(1, std::memory_order_relaxed);
+  if ( parent ) {
+    parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+void JobSystem::run(Job* job)
+{
+  int index = currentIndex();
+  if ( !workers_[size_t(index)]->deque.push(job) ) {
+    // очередь переполнена - выполняем сразу, это лишь теряет параллельность
+    execute(job, index);
+    return;
+  }
+  if ( sleeping_.load(std::memory_order_relaxed) > 0 ) {
+    wake_.notify_one();
+  }
+}
+
+void JobSystem::runBackground(Job* job)
+{
+  {
+    std::lock_guard<std::mutex> lock(backgroundMutex_);
+    background_.push_back(job);
+  }
+  backgroundCount_.fetch_add(1, std::memory_order_release);
+  if ( sleeping_.load(std::memory_order_relaxed) > 0 ) {
+    wake_.notify_one();
+  }
+}
+
+void JobSystem::wait(Job* job)
+{
+  int index = currentIndex();
+  bool main = index == 0 && isMainThread();
+  while ( !isFinished(job) ) {
+    if ( executeOne(index) ) {
+      continue;
+    }
+    // задача может ждать вызова GL, который выполнит только главный поток
+    if ( main && processMainThreadJobs() > 0 ) {
+      continue;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void JobSystem::runOnMainThread(std::function<void()> function)
+{
+  if ( isMainThread() ) {
+    function();
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mainMutex_);
+  mainJobs_.append(std::move(function));
+}
+
+int JobSystem::processMainThreadJobs()
+{
+  Q_ASSERT(isMainThread());
+  QVector< std::function<void()> > jobs;
+  {
+    std::lock_guard<std::mutex> lock(mainMutex_);
+    if ( mainJobs_.isEmpty() ) {
+      return 0;
+    }
+    jobs.swap(mainJobs_);
+  }
+  for ( auto& function : jobs ) {
+    function();
+  }
+  return jobs.size();
+}
+
+qint64 JobSystem::jobsExecuted() const
+{
+  qint64 count = 0;
+  for ( const auto& worker : workers_ ) {
+    count += worker->executed.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+qint64 JobSystem::jobsStolen() const
+{
+  qint64 count = 0;
+  for ( const auto& worker : workers_ ) {
+    count += worker->stolen.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+bool JobSystem::executeOne(int index)
+{
+  Worker& worker = *workers_[size_t(index)];
+  Job* job = worker.deque.pop();
+  if ( !job ) {
+    // своя очередь пуста: крадём у случайного соседа, обходя всех по кругу
+    size_t count = workers_.size();
+    worker.random = worker.random * 1664525u + 1013904223u;
+    size_t start = size_t(worker.random >> 8) % count;
+    for ( size_t i = 0; i < count && !job; i++ ) {
+      size_t victim = (start + i) % count;
+      if ( victim != size_t(index) ) {
+        job = workers_[victim]->deque.steal();
+      }
+    }
+    if ( !job ) {
+      return false;
+    }
+    worker.stolen.fetch_add(1, std::memory_order_relaxed);
+  }
+  execute(job, index);
+  return true;
+}
+
+bool JobSystem::executeBackground(int index)
+{
+  if ( backgroundCount_.load(std::memory_order_acquire) == 0 ) {
+    return false;
+  }
+  Job* job = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(backgroundMutex_);
+    if ( background_.empty() ) {
+      return false;
+    }
+    job = background_.front();
+    background_.pop_front();
+  }
+  backgroundCount_.fetch_sub(1, std::memory_order_relaxed);
+  execute(job, index);
+  return true;
+}
+
+void JobSystem::execute(Job* job, int index)
+{
+  job->function(job);
+  workers_[size_t(index)]->executed.fetch_add(1, std::memory_order_relaxed);
+  finish(job);
+}
+
+void JobSystem::finish(Job* job)
+{
+  while ( job ) {
+    Job* parent = job->parent;
+    if ( job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1 ) {
+      return;
+    }
+    job = parent;
+  }
+}
+
+void JobSystem::workerLoop(int index)
+{
+  int idle = 0;
+  while ( running_.load(std::memory_order_relaxed) ) {
+    if ( executeOne(index) || executeBackground(index) ) {
+      idle = 0;
+      continue;
+    }
+    if ( ++idle < kIdleSpins ) {
+      std::this_thread::yield();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    sleeping_.fetch_add(1, std::memory_order_relaxed);
+    wake_.wait_for(lock, kIdleSleep);
+    sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    idle = 0;
+  }
+}
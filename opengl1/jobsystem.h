@@ -0,0 +1,181 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <QVector>
+#include <QtGlobal>
+
+// Задача планировщика: функция с захваченными данными прямо в теле задачи,
+// без выделения памяти. Задача считается выполненной, когда завершилась она сама
+// и все её дочерние задачи.
+struct alignas(64) Job
+{
+  static const size_t kPayloadSize = 96;
+
+  void (*function)(Job*);
+  Job* parent;
+  std::atomic<int> unfinished;
+  alignas(16) unsigned char payload[kPayloadSize];
+};
+
+// Очередь задач одного потока (Chase-Lev): владелец кладёт и берёт с одного конца
+// без блокировок, остальные потоки крадут с другого.
+class JobDeque
+{
+public:
+  static const qint64 kCapacity = 4096;
+
+  JobDeque();
+
+  bool push(Job* job);
+  Job* pop();
+  Job* steal();
+
+private:
+  std::atomic<qint64> top_{0};
+  std::atomic<qint64> bottom_{0};
+  std::unique_ptr< std::atomic<Job*>[] > jobs_;
+};
+
+// Планировщик с кражей задач. Поток, создавший планировщик, считается главным
+// (поток контекста GL): он тоже выполняет задачи, пока ждёт их, и только он
+// разбирает очередь runOnMainThread(). Создавать и ждать задачи можно только
+// из главного потока и из самих задач.
+class JobSystem
+{
+public:
+  // задач на рабочий поток в parallelFor с автоматическим зерном
+  static const int kChunksPerWorker = 4;
+  static const int kJobPoolSize = 4096;
+
+  // workerCount - число дополнительных потоков; 0 - по числу ядер
+  explicit JobSystem(int workerCount = 0);
+  JobSystem(const JobSystem&) = delete;
+  ~JobSystem();
+
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  static JobSystem& instance();
+
+  // задача не запускается до run(); parent дожидается всех своих дочерних задач
+  template<class F>
+  Job* create(F&& function, Job* parent = nullptr);
+  void run(Job* job);
+  void wait(Job* job);
+  bool isFinished(const Job* job) const { return job->unfinished.load(std::memory_order_acquire) == 0; }
+  // долгие задачи (чтение с диска, подготовка данных впрок): их берут только рабочие
+  // потоки, когда других задач нет; главный поток, ожидая свои задачи, их не выполняет
+  void runBackground(Job* job);
+
+  // body(begin, end) над [0, count); grain <= 0 - подбирается по числу потоков
+  template<class F>
+  void parallelFor(int count, int grain, F&& body);
+  template<class F>
+  void parallelFor(int count, F&& body) { parallelFor(count, 0, std::forward<F>(body)); }
+
+  // очередь для вызовов GL: заполняется из любого потока, выполняется в главном
+  void runOnMainThread(std::function<void()> function);
+  int processMainThreadJobs();
+
+  int threadCount() const { return int(workers_.size()); }
+  bool isMainThread() const;
+  qint64 jobsExecuted() const;
+  qint64 jobsStolen() const;
+
+private:
+  struct Worker {
+    JobDeque deque;
+    std::unique_ptr<Job[]> pool;
+    unsigned poolNext = 0;
+    std::atomic<qint64> executed{0};
+    std::atomic<qint64> stolen{0};
+    unsigned random = 0;
+  };
+
+  Job* allocate(Job* parent);
+  bool executeOne(int index);
+  bool executeBackground(int index);
+  void execute(Job* job, int index);
+  void finish(Job* job);
+  void workerLoop(int index);
+  int currentIndex() const;
+
+  template<class F>
+  static void spawnRange(JobSystem* system, Job* root, int begin, int end, int grain, F* body);
+
+private:
+  std::vector< std::unique_ptr<Worker> > workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> running_{true};
+  std::atomic<int> sleeping_{0};
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  std::mutex backgroundMutex_;
+  std::deque<Job*> background_;
+  std::atomic<int> backgroundCount_{0};
+  std::mutex mainMutex_;
+  QVector< std::function<void()> > mainJobs_;
+  std::thread::id mainThread_;
+};
+
+template<class F>
+Job* JobSystem::create(F&& function, Job* parent)
+{
+  using Function = typename std::decay<F>::type;
+  static_assert(sizeof(Function) <= Job::kPayloadSize, "job capture is too large");
+  static_assert(alignof(Function) <= 16, "job capture is over-aligned");
+  Job* job = allocate(parent);
+  new (job->payload) Function(std::forward<F>(function));
+  job->function = []( Job* self ) {
+    Function& stored = *reinterpret_cast<Function*>(self->payload);
+    stored();
+    stored.~Function();
+  };
+  return job;
+}
+
+template<class F>
+void JobSystem::spawnRange(JobSystem* system, Job* root, int begin, int end, int grain, F* body)
+{
+  // делим пополам, правую половину отдаём в очередь: её и крадут простаивающие потоки
+  while ( end - begin > grain ) {
+    int middle = begin + (end - begin) / 2;
+    system->run(system->create([=] { spawnRange(system, root, middle, end, grain, body); }, root));
+    end = middle;
+  }
+  (*body)(begin, end);
+}
+
+template<class F>
+void JobSystem::parallelFor(int count, int grain, F&& body)
+{
+  if ( count <= 0 ) {
+    return;
+  }
+  if ( grain <= 0 ) {
+    grain = qMax(1, count / (threadCount() * kChunksPerWorker));
+  }
+  if ( count <= grain ) {
+    body(0, count);
+    return;
+  }
+  auto* bodyPointer = &body;
+  Job* root = create([] {});
+  JobSystem* system = this;
+  run(create([=] { spawnRange(system, root, 0, count, grain, bodyPointer); }, root));
+  run(root);
+  wait(root);
+}
+
+#endif // JOBSYSTEM_H
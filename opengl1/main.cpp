@@ -1,10 +1,16 @@
 #include "openglwidget.h"
 #include "mainwidget.h"
+#include "assetarchive.h"
 #include <QApplication>
+#include <QDir>
+
+// архив ресурсов, который собирает rescompiler, ищется рядом с программой
+static const QString kAssetArchive = QString("assets.pak");
 
 int main(int argc, char *argv[])
 {
   QApplication a(argc, argv);
+  AssetArchive::instance().open(QCoreApplication::applicationDirPath() + QDir::separator() + kAssetArchive);
   MainWidget w;
   w.show();
 
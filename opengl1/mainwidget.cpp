@@ -9,6 +9,7 @@
 #include <QFileDialog>
 
 static const double kSensitivity = 0.05;
+static const int kStatsInterval = 500;
 
 MainWidget::MainWidget(QWidget *parent) :
   QWidget(parent),
@@ -32,7 +33,12 @@ MainWidget::MainWidget(QWidget *parent) :
   QObject::connect(ui_->cubeMapCheckBox,SIGNAL(stateChanged(int)), SLOT(setPaintCubeMapSlot(int)));
   QObject::connect(ui_->customObjectCheckBox, SIGNAL(stateChanged(int)), SLOT(setPaintCustomObjectSlot(int)));
   QObject::connect(ui_->fileButton, SIGNAL(clicked()), SLOT(chooseCustomObjectFileSlot()));
+  QObject::connect(ui_->removeButton, SIGNAL(clicked()), SLOT(removeCustomObjectSlot()));
+  QObject::connect(ui_->dynamicResolutionCheckBox, SIGNAL(stateChanged(int)), SLOT(setDynamicResolutionSlot(int)));
+  QObject::connect(ui_->targetFrameTimeSpinBox, SIGNAL(valueChanged(double)), SLOT(setFrameTimeTargetSlot(double)));
+  QObject::connect(ui_->sharpenCheckBox, SIGNAL(stateChanged(int)), SLOT(setSharpenSlot(int)));
   initValue();
+  startTimer(kStatsInterval);
 }
 
 MainWidget::~MainWidget()
@@ -64,6 +70,42 @@ void MainWidget::keyPressEvent(QKeyEvent *event)
       opengl_->switchLamp();
       break;
     }
+    case ( Qt::Key::Key_O ): {
+      opengl_->switchOcclusionCulling();
+      break;
+    }
+    case ( Qt::Key::Key_L ): {
+      opengl_->switchLod();
+      break;
+    }
+    case ( Qt::Key::Key_M ): {
+      opengl_->switchMeshletCulling();
+      break;
+    }
+    case ( Qt::Key::Key_G ): {
+      opengl_->switchInstanceGrid();
+      break;
+    }
+    case ( Qt::Key::Key_R ): {
+      opengl_->renderReference();
+      break;
+    }
+    case ( Qt::Key::Key_B ): {
+      opengl_->switchSoftwareRenderer();
+      break;
+    }
+    case ( Qt::Key::Key_T ): {
+      opengl_->switchTonemap();
+      break;
+    }
+    case ( Qt::Key::Key_Y ): {
+      opengl_->switchBloom();
+      break;
+    }
+    case ( Qt::Key::Key_N ): {
+      opengl_->switchDebugDraw();
+      break;
+    }
     case ( Qt::Key::Key_Escape ): //TODO question for escape
     {
       close();
@@ -110,6 +152,15 @@ void MainWidget::wheelEvent(QWheelEvent* event)
 
 }
 
+void MainWidget::timerEvent(QTimerEvent* event)
+{
+  Q_UNUSED(event);
+  const FrameStats& stats = opengl_->frameStats();
+  ui_->statsLabel->setText(stats.summary());
+  ui_->renderScaleLabel->setText(QString("%1% (%2x%3)").arg(int(stats.resolutionScale * 100.0f + 0.5f))
+                                 .arg(stats.sceneWidth).arg(stats.sceneHeight));
+}
+
 void MainWidget::changeVisibleSettingsSlot()
 {
   ui_->settingsBox->setVisible(!ui_->settingsBox->isVisible());
@@ -185,6 +236,30 @@ void MainWidget::chooseCustomObjectFileSlot()
   }
 }
 
+void MainWidget::removeCustomObjectSlot()
+{
+  // убирается последняя загруженная модель
+  opengl_->removeCustomObject(opengl_->customObjectCount() - 1);
+  if ( opengl_->customObjectCount() == 0 ) {
+    ui_->filePath->setText(tr("select object"));
+  }
+}
+
+void MainWidget::setDynamicResolutionSlot(int flag)
+{
+  opengl_->setDynamicResolution(bool(flag));
+}
+
+void MainWidget::setFrameTimeTargetSlot(double ms)
+{
+  opengl_->setFrameTimeTarget(float(ms));
+}
+
+void MainWidget::setSharpenSlot(int flag)
+{
+  opengl_->setSharpenUpscale(bool(flag));
+}
+
 void MainWidget::setCustomObjectPath(QString path)
 {
   ui_->filePath->setText(path);
@@ -198,4 +273,5 @@ void MainWidget::initValue()
   ui_->farPlaneSpinBox->setValue(100.0);
   ui_->cubeMapCheckBox->setChecked(true);
   ui_->plainSceneCheckBox->setChecked(true);
+  ui_->targetFrameTimeSpinBox->setValue(16.6);
 }
@@ -21,6 +21,7 @@ protected:
   void mousePressEvent(QMouseEvent* event) override;
   void mouseMoveEvent(QMouseEvent* event) override;
   void wheelEvent(QWheelEvent *event) override;
+  void timerEvent(QTimerEvent* event) override;
 
 private slots:
   void changeVisibleSettingsSlot();
@@ -34,6 +35,10 @@ private slots:
   void setPaintCubesSlot(int flag);
   void setPaintCustomObjectSlot(int flag);
   void chooseCustomObjectFileSlot();
+  void removeCustomObjectSlot();
+  void setDynamicResolutionSlot(int flag);
+  void setFrameTimeTargetSlot(double ms);
+  void setSharpenSlot(int flag);
 
 private:
   void initValue();
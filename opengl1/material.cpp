@@ -9,82 +9,116 @@ Material::Material(const QString& name) :
 
 Material::~Material()
 {
-  delete tAlbedo_;
-  delete tNormal_;
-  delete tSpecular_;
-  delete tMetallic_;
-  delete tRoughness_;
-  delete tAO_;
+
 }
 
-bool Material::hasTextureAlbedo()
+bool Material::hasTextureAlbedo() const
 {
-  return ( tAlbedo_ != nullptr);
+  return ( tAlbedo_ && tAlbedo_->isResident() );
 }
 
-bool Material::hasTextureNormal()
+bool Material::hasTextureNormal() const
 {
-  return ( tNormal_ != nullptr);
+  return ( tNormal_ && tNormal_->isResident() );
 }
 
-bool Material::hasTextureSpecular()
+bool Material::hasTextureSpecular() const
 {
-  return ( tSpecular_ != nullptr);
+  return ( tSpecular_ && tSpecular_->isResident() );
 }
 
-bool Material::hasTextureMetallic()
+bool Material::hasTextureMetallic() const
 {
-  return ( tMetallic_ != nullptr);
+  return ( tMetallic_ && tMetallic_->isResident() );
 }
 
-bool Material::hasTextureRoughness()
+bool Material::hasTextureRoughness() const
 {
-  return ( tRoughness_ != nullptr);
+  return ( tRoughness_ && tRoughness_->isResident() );
 }
 
-bool Material::hasTextureAmbientOcclusion()
+bool Material::hasTextureAmbientOcclusion() const
 {
-  return ( tAO_ != nullptr);
+  return ( tAO_ && tAO_->isResident() );
 }
 
 void Material::loadTextureAlbedo(const QString& path)
 {
-  tAlbedo_ = loadTexture(path);
+  setTexture(Albedo, QImage(path));
 }
 
 void Material::loadTextureNormal(const QString& path)
 {
-  tNormal_ = loadTexture(path);
+  setTexture(Normal, QImage(path));
 }
 
 void Material::loadTextureSpecular(const QString& path)
 {
-  tSpecular_ = loadTexture(path);
+  setTexture(Specular, QImage(path));
 }
 
 void Material::loadTextureMetallic(const QString& path)
 {
   qDebug() << "Load metallic";
-  tMetallic_ = loadTexture(path);
+  setTexture(Metallic, QImage(path));
 }
 
 void Material::loadTextureRoughness(const QString& path)
 {
   qDebug() << "Load Roughenss";
-  tRoughness_ = loadTexture(path);
+  setTexture(Roughness, QImage(path));
 }
 
 void Material::loadTextureAmbientOcclusion(const QString& path)
 {
   qDebug() << "Load AO";
-  tAO_ = loadTexture(path);
+  setTexture(AmbientOcclusion, QImage(path));
+}
+
+void Material::setTexture(TextureType type, const QImage& image)
+{
+  setTexture(type, StreamedTexture::buildMipChain(image));
+}
+
+void Material::setTexture(TextureType type, const QVector<QImage>& mips)
+{
+  if ( mips.isEmpty() ) {
+    slot(type).reset();
+    return;
+  }
+  slot(type) = TextureStreamer::instance().create(mips, name_);
+}
+
+void Material::requestDetail(float uvPerPixel)
+{
+  for ( auto texture : { tAlbedo_.get(), tNormal_.get(), tSpecular_.get(), tMetallic_.get(), tRoughness_.get(), tAO_.get() } ) {
+    if ( texture ) {
+      texture->request(uvPerPixel);
+    }
+  }
 }
 
-QOpenGLTexture* Material::loadTexture(const QString& path)
+std::shared_ptr<StreamedTexture>& Material::slot(TextureType type)
 {
-  QOpenGLTexture* texture = new QOpenGLTexture(QImage(path));
-  texture->setMinificationFilter(QOpenGLTexture::Nearest);
-  texture->setMagnificationFilter(QOpenGLTexture::Linear);
-  texture->setWrapMode(QOpenGLTexture::Repeat);
-  return texture;
+  switch ( type ) {
+    case ( Albedo ): {
+      return tAlbedo_;
+    }
+    case ( Normal ): {
+      return tNormal_;
+    }
+    case ( Specular ): {
+      return tSpecular_;
+    }
+    case ( Metallic ): {
+      return tMetallic_;
+    }
+    case ( Roughness ): {
+      return tRoughness_;
+    }
+    case ( AmbientOcclusion ): {
+      break;
+    }
+  }
+  return tAO_;
 }
@@ -1,12 +1,18 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <memory>
+
 #include <QVector3D>
 #include <QOpenGLTexture>
 
+#include "texturestreamer.h"
+
 class Material
 {
 public:
+  enum TextureType { Albedo, Normal, Specular, Metallic, Roughness, AmbientOcclusion };
+
   Material() = default;
   Material(const QString& name);
   Material(const Material& material) = delete;
@@ -14,12 +20,12 @@ public:
 
   Material& operator=(const Material&) = delete;
 
-  bool hasTextureAlbedo();
-  bool hasTextureNormal();
-  bool hasTextureSpecular();
-  bool hasTextureMetallic();
-  bool hasTextureRoughness();
-  bool hasTextureAmbientOcclusion();
+  bool hasTextureAlbedo() const;
+  bool hasTextureNormal() const;
+  bool hasTextureSpecular() const;
+  bool hasTextureMetallic() const;
+  bool hasTextureRoughness() const;
+  bool hasTextureAmbientOcclusion() const;
 
   void setName( const QString& name ) { name_ = name; }
   void setSpecularExponent( float Ns ) { Ns_ = Ns; }
@@ -40,29 +46,35 @@ public:
   void loadTextureMetallic(const QString& path);
   void loadTextureRoughness(const QString& path);
   void loadTextureAmbientOcclusion(const QString& path);
+  // текстура из уже декодированного изображения: декодировать можно в любом потоке,
+  // а этот вызов - только в потоке контекста GL
+  void setTexture(TextureType type, const QImage& image);
+  void setTexture(TextureType type, const QVector<QImage>& mips);
+  // запрос детализации всех текстур материала для потоковой подгрузки мипов
+  void requestDetail(float uvPerPixel);
 
-  QString name() { return name_; }
-  float specularExponent() { return Ns_; }
-  float density() { return Ni_; }
-  float transparent() { return d_; }
-  float illum() { return illum_;}
-  QVector3D ambientColor() { return Ka_; }
-  QVector3D diffuseColor() { return Kd_; }
-  QVector3D specularColor() { return Ks_; }
-  QVector3D emissive() { return Ke_; }
-  QOpenGLTexture* textureAlbedo() { return  tAlbedo_; }
-  QOpenGLTexture* textureNormal() { return tNormal_; }
-  QOpenGLTexture* textureSpecular() { return tSpecular_; }
+  QString name() const { return name_; }
+  float specularExponent() const { return Ns_; }
+  float density() const { return Ni_; }
+  float transparent() const { return d_; }
+  float illum() const { return illum_;}
+  QVector3D ambientColor() const { return Ka_; }
+  QVector3D diffuseColor() const { return Kd_; }
+  QVector3D specularColor() const { return Ks_; }
+  QVector3D emissive() const { return Ke_; }
+  StreamedTexture* textureAlbedo() const { return tAlbedo_.get(); }
+  StreamedTexture* textureNormal() const { return tNormal_.get(); }
+  StreamedTexture* textureSpecular() const { return tSpecular_.get(); }
 
-  QOpenGLTexture* textureMetallic() { return  tMetallic_; }
-  QOpenGLTexture* textureRoughness() { return tRoughness_; }
-  QOpenGLTexture* textureAmbientOcclusion() { return tAO_; }
-  float metallic() { return metallic_; }
-  float roughness() { return roughness_; }
-  float ao() { return ao_; }
+  StreamedTexture* textureMetallic() const { return tMetallic_.get(); }
+  StreamedTexture* textureRoughness() const { return tRoughness_.get(); }
+  StreamedTexture* textureAmbientOcclusion() const { return tAO_.get(); }
+  float metallic() const { return metallic_; }
+  float roughness() const { return roughness_; }
+  float ao() const { return ao_; }
 
 private:
-  QOpenGLTexture* loadTexture(const QString& path);
+  std::shared_ptr<StreamedTexture>& slot(TextureType type);
 
 private:
   QString name_;
@@ -77,12 +89,12 @@ private:
   QVector3D Kd_;
   QVector3D Ks_;
   QVector3D Ke_;
-  QOpenGLTexture* tAlbedo_ = nullptr;
-  QOpenGLTexture* tNormal_ = nullptr;
-  QOpenGLTexture* tSpecular_ = nullptr;
-  QOpenGLTexture* tMetallic_ = nullptr;
-  QOpenGLTexture* tRoughness_ = nullptr;
-  QOpenGLTexture* tAO_ = nullptr;
+  std::shared_ptr<StreamedTexture> tAlbedo_;
+  std::shared_ptr<StreamedTexture> tNormal_;
+  std::shared_ptr<StreamedTexture> tSpecular_;
+  std::shared_ptr<StreamedTexture> tMetallic_;
+  std::shared_ptr<StreamedTexture> tRoughness_;
+  std::shared_ptr<StreamedTexture> tAO_;
 
 
 };
@@ -1,4 +1,50 @@
 #include "mesh.h"
+#include "meshsimplifier.h"
+#include "indexoptimizer.h"
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+// копию геометрии для программного буфера глубины держим только у небольших мешей
+static const int kMaxOccluderTriangles = 4096;
+// цепочка LOD: каждый уровень вдвое меньше предыдущего, пока упрощение даёт выигрыш
+static const int kMaxLodLevels = 6;
+static const int kMinLodTriangles = 64;
+static const float kLodReduction = 0.5f;
+static const float kLodMinGain = 0.85f;
+// допустимая ошибка упрощения относительно диагонали меша
+static const float kLodMaxRelativeError = 0.05f;
+// допустимая ошибка LOD на экране в пикселях и запас при переходе на более грубый уровень
+static const float kLodPixelError = 1.0f;
+static const float kLodHysteresis = 0.25f;
+static const float kMinLodDistance = 1.0e-3f;
+// треугольников на задачу при расчёте TBN
+static const int kTbnGrain = 4096;
+
+// функции 3.3 Core запрашиваются один раз на контекст; nullptr - контекст их не даёт
+static QOpenGLFunctions_3_3_Core* multiDrawFunctions()
+{
+  static QOpenGLContext* resolvedContext = nullptr;
+  static QOpenGLFunctions_3_3_Core* functions = nullptr;
+  QOpenGLContext* context = QOpenGLContext::currentContext();
+  if ( context != resolvedContext ) {
+    resolvedContext = context;
+    functions = context ? context->versionFunctions<QOpenGLFunctions_3_3_Core>() : nullptr;
+    if ( context ) {
+      // новый контекст может получить адрес удалённого
+      QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [] {
+        resolvedContext = nullptr;
+        functions = nullptr;
+      });
+    }
+  }
+  return functions;
+}
 
 Mesh::Mesh()
 {
@@ -10,11 +56,54 @@ Mesh::Mesh(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
   create(vertexes, indexes);
 }
 
-void Mesh::draw(QOpenGLShaderProgram& shader)
+void Mesh::draw(QOpenGLShaderProgram& shader, int lod)
 {
-    if (!shader.isLinked() || !VBO_.isCreated() || !EBO_.isCreated() ) {
-      return;
+  if ( !bind(shader) ) {
+    return;
+  }
+  drawBound(lod);
+  release(shader);
+}
+
+void Mesh::drawRanges(QOpenGLShaderProgram& shader, const ArenaVector<GLsizei>& counts, const ArenaVector<const void*>& offsets)
+{
+  if ( counts.empty() || !bind(shader) ) {
+    return;
+  }
+  drawRangesBound(counts.data(), offsets.data(), int(counts.size()));
+  release(shader);
+}
+
+void Mesh::drawBound(int lod)
+{
+  const LodLevel& level = lods_.at(qBound(0, lod, lods_.size() - 1));
+  glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_INT,
+                 reinterpret_cast<const void*>(quintptr(level.offset) * sizeof(GLuint)));
+}
+
+void Mesh::drawRangesBound(const GLsizei* counts, const void* const* offsets, int rangeCount)
+{
+  if ( rangeCount <= 0 ) {
+    return;
+  }
+  QOpenGLFunctions_3_3_Core* f = multiDrawFunctions();
+  if ( f ) {
+    f->glMultiDrawElements(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, rangeCount);
+    return;
+  }
+  // контекст без функций 3.3 Core (ES, compatibility): диапазоны по одному
+  for ( int i = 0; i < rangeCount; i++ ) {
+    glDrawElements(GL_TRIANGLES, counts[i], GL_UNSIGNED_INT, offsets[i]);
+  }
+}
+
+bool Mesh::bind(QOpenGLShaderProgram& shader)
+{
+    if (!shader.isLinked() || !makeResident() || !EBO_.isCreated() || lods_.isEmpty() ) {
+      return false;
     }
+    vertexMemory_.touch();
+    indexMemory_.touch();
     shader.bind();
     if ( material_->hasTextureAlbedo() ) {
       material_->textureAlbedo()->bind(0);
@@ -102,8 +191,11 @@ void Mesh::draw(QOpenGLShaderProgram& shader)
 
 
     EBO_.bind();
-    glDrawElements(GL_TRIANGLES, EBO_.size(), GL_UNSIGNED_INT, nullptr);
+    return true;
+}
 
+void Mesh::release(QOpenGLShaderProgram& shader)
+{
     EBO_.release();
     VBO_.release();
     if ( material_->hasTextureAlbedo()) {
@@ -127,28 +219,379 @@ void Mesh::draw(QOpenGLShaderProgram& shader)
     shader.release();
 }
 
+void Mesh::drawDepth(QOpenGLShaderProgram& shader)
+{
+  if (!shader.isLinked() || !makeResident() || !EBO_.isCreated() || lods_.isEmpty() ) {
+    return;
+  }
+  vertexMemory_.touch();
+  indexMemory_.touch();
+  VBO_.bind();
+  auto vertLoc = shader.attributeLocation("inPos");
+  shader.enableAttributeArray(vertLoc);
+  shader.setAttributeBuffer(vertLoc, GL_FLOAT, 0, 3, sizeof(Vertex));
+
+  EBO_.bind();
+  glDrawElements(GL_TRIANGLES, lods_.first().count, GL_UNSIGNED_INT, nullptr);
+
+  EBO_.release();
+  VBO_.release();
+}
+
 void Mesh::create(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  build(vertexes, indexes);
+  upload();
+}
+
+void Mesh::build(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
 {
   if (material_) {
     calculateTBN(vertexes);
   }
+  MeshSimplifier::weld(vertexes, indexes);
+  cacheStatsBefore_ = IndexOptimizer::analyzeVertexCache(indexes, vertexes.size());
+
+  // кластеры строятся по полному уровню детализации, его треугольники переупорядочиваются:
+  // внутри кластера - под кэш вершин, сами кластеры - против перерисовки, затем вершины - под выборку
+  meshlets_ = MeshletBuilder::build(vertexes, indexes);
+  for ( const auto& meshlet : meshlets_ ) {
+    IndexOptimizer::optimizeVertexCache(indexes, meshlet.offset, meshlet.count, vertexes.size());
+  }
+  MeshletBuilder::sortForOverdraw(meshlets_, vertexes, indexes);
+  IndexOptimizer::optimizeVertexFetch(vertexes, indexes);
+  cacheStatsAfter_ = IndexOptimizer::analyzeVertexCache(indexes, vertexes.size());
+
+  bounds_ = BoundingBox{};
+  for ( const auto& vertex : vertexes ) {
+    bounds_.extend(vertex.position);
+  }
+  triangleCount_ = indexes.size() / 3;
+  float uvArea = 0.0f;
+  float area = 0.0f;
+  for ( int i = 0; i + 2 < indexes.size(); i += 3 ) {
+    const Vertex& a = vertexes.at(int(indexes.at(i)));
+    const Vertex& b = vertexes.at(int(indexes.at(i + 1)));
+    const Vertex& c = vertexes.at(int(indexes.at(i + 2)));
+    area += QVector3D::crossProduct(b.position - a.position, c.position - a.position).length();
+    QVector2D uvB = b.texturePosition - a.texturePosition;
+    QVector2D uvC = c.texturePosition - a.texturePosition;
+    uvArea += qAbs(uvB.x() * uvC.y() - uvB.y() * uvC.x());
+  }
+  uvDensity_ = area > 0.0f ? std::sqrt(uvArea / area) : 0.0f;
+  // пока только кандидат в окклюдеры: копию для буфера глубины setOccluder(true) снимет
+  // с вершин в памяти, пока upload() их не отдал
+  setOccluder(false);
+  occluder_ = triangleCount_ <= kMaxOccluderTriangles;
+  buildLods(vertexes, indexes);
+  vertexes_ = vertexes;
+}
+
+void Mesh::upload()
+{
+  uploadBuffers(vertexes_.constData(), vertexes_.size(), indexes_.constData(), indexes_.size());
+  vertexes_ = QVector<Vertex>{};
+  indexes_ = QVector<GLuint>{};
+}
+
+void Mesh::uploadBuffers(const Vertex* vertexes, int vertexCount, const GLuint* indexes, int indexCount)
+{
   if (VBO_.isCreated()) { VBO_.destroy(); }
   VBO_.create();
   VBO_.bind();
-  VBO_.allocate(vertexes.constData(), vertexes.size() * sizeof (Vertex));
+  VBO_.allocate(vertexes, vertexCount * int(sizeof (Vertex)));
   VBO_.release();
 
   if (EBO_.isCreated()) { EBO_.destroy();}
   EBO_.create();
   EBO_.bind();
-  EBO_.allocate(indexes.constData(), indexes.size() * sizeof (GLuint));
+  EBO_.allocate(indexes, indexCount * int(sizeof (GLuint)));
   EBO_.release();
+
+  // без источника выгрузить меш можно было бы только чтением буферов обратно - такие не выгружаются
+  std::function<bool()> evictMesh;
+  if ( source_ ) {
+    evictMesh = [this] { return evict(); };
+  }
+  vertexMemory_.allocate(GpuMemory::VertexBuffer, owner_, VBO_.size(), evictMesh);
+  indexMemory_.allocate(GpuMemory::IndexBuffer, owner_, EBO_.size(), evictMesh);
+}
+
+void Mesh::writeMetadata(QDataStream& stream) const
+{
+  stream << bounds_.min << bounds_.max << qint32(triangleCount_) << occluder_ << uvDensity_;
+  for ( const VertexCacheStats* stats : { &cacheStatsBefore_, &cacheStatsAfter_ } ) {
+    stream << qint32(stats->triangles) << qint32(stats->vertexes) << qint32(stats->misses);
+  }
+  stream << qint32(lods_.size());
+  for ( const auto& level : lods_ ) {
+    stream << qint32(level.offset) << qint32(level.count) << level.error;
+  }
+  stream << qint32(meshlets_.size());
+  for ( const auto& meshlet : meshlets_ ) {
+    stream << qint32(meshlet.offset) << qint32(meshlet.count) << meshlet.center << meshlet.radius
+           << meshlet.coneAxis << meshlet.coneCutoff;
+  }
+}
+
+bool Mesh::restore(QDataStream& stream, const Vertex* vertexes, int vertexCount, const GLuint* indexes, int indexCount)
+{
+  qint32 triangles = 0;
+  stream >> bounds_.min >> bounds_.max >> triangles >> occluder_ >> uvDensity_;
+  triangleCount_ = triangles;
+  for ( VertexCacheStats* stats : { &cacheStatsBefore_, &cacheStatsAfter_ } ) {
+    qint32 statsTriangles = 0;
+    qint32 statsVertexes = 0;
+    qint32 misses = 0;
+    stream >> statsTriangles >> statsVertexes >> misses;
+    stats->triangles = statsTriangles;
+    stats->vertexes = statsVertexes;
+    stats->misses = misses;
+  }
+  qint32 lodCount = 0;
+  stream >> lodCount;
+  lods_.clear();
+  currentLod_ = 0;
+  for ( int i = 0; i < lodCount && stream.status() == QDataStream::Ok; i++ ) {
+    qint32 offset = 0;
+    qint32 count = 0;
+    float error = 0.0f;
+    stream >> offset >> count >> error;
+    lods_.append(LodLevel{offset, count, error});
+  }
+  qint32 meshletCount = 0;
+  stream >> meshletCount;
+  meshlets_.clear();
+  for ( int i = 0; i < meshletCount && stream.status() == QDataStream::Ok; i++ ) {
+    Meshlet meshlet;
+    qint32 offset = 0;
+    qint32 count = 0;
+    stream >> offset >> count >> meshlet.center >> meshlet.radius >> meshlet.coneAxis >> meshlet.coneCutoff;
+    meshlet.offset = offset;
+    meshlet.count = count;
+    meshlets_.append(meshlet);
+  }
+  if ( stream.status() != QDataStream::Ok || lods_.isEmpty() ) {
+    return false;
+  }
+  for ( const auto& level : lods_ ) {
+    if ( level.offset < 0 || level.count < 0 || level.offset + level.count > indexCount ) {
+      return false;
+    }
+  }
+  // после restore() вершин в памяти не остаётся, поэтому у кандидата копия для буфера глубины
+  // снимается сразу с отображённого архива; OGLObject::selectOccluders оставит её только выбранным
+  occluderPositions_.clear();
+  occluderIndexes_.clear();
+  if ( occluder_ ) {
+    occluderPositions_.reserve(vertexCount);
+    for ( int i = 0; i < vertexCount; i++ ) {
+      occluderPositions_.append(vertexes[i].position);
+    }
+    const LodLevel& full = lods_.first();
+    occluderIndexes_.resize(full.count);
+    std::copy(indexes + full.offset, indexes + full.offset + full.count, occluderIndexes_.begin());
+  }
+  uploadBuffers(vertexes, vertexCount, indexes, indexCount);
+  return true;
+}
+
+bool Mesh::evict()
+{
+  if ( !VBO_.isCreated() || !EBO_.isCreated() ) {
+    return false;
+  }
+  if ( !source_ ) {
+    return false;
+  }
+  clear();
+  return true;
+}
+
+bool Mesh::makeResident()
+{
+  if ( VBO_.isCreated() ) {
+    return true;
+  }
+  if ( !vertexes_.isEmpty() ) {
+    upload();
+  }
+  else if ( source_ ) {
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+    if ( !source_(vertexes, indexes) ) {
+      qDebug() << QString("mesh of %1 not reloaded").arg(owner_);
+      source_ = nullptr;
+      return false;
+    }
+    uploadBuffers(vertexes.constData(), vertexes.size(), indexes.constData(), indexes.size());
+  }
+  return VBO_.isCreated();
+}
+
+bool Mesh::readGeometry(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  if ( isResident() ) {
+    if ( !readBuffers(vertexes, indexes) ) {
+      return false;
+    }
+  }
+  else if ( !vertexes_.isEmpty() ) {
+    vertexes = vertexes_;
+    indexes = indexes_;
+  }
+  else if ( !source_ || !source_(vertexes, indexes) ) {
+    return false;
+  }
+  if ( !lods_.isEmpty() ) {
+    indexes = indexes.mid(lods_.first().offset, lods_.first().count);
+  }
+  return !indexes.isEmpty();
+}
+
+bool Mesh::readBuffers(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  vertexes.resize(VBO_.size() / int(sizeof (Vertex)));
+  VBO_.bind();
+  bool ok = VBO_.read(0, vertexes.data(), vertexes.size() * int(sizeof (Vertex)));
+  VBO_.release();
+  indexes.resize(EBO_.size() / int(sizeof (GLuint)));
+  EBO_.bind();
+  ok = ok && EBO_.read(0, indexes.data(), indexes.size() * int(sizeof (GLuint)));
+  EBO_.release();
+  if ( !ok ) {
+    vertexes = QVector<Vertex>{};
+    indexes = QVector<GLuint>{};
+  }
+  return ok;
 }
 
 void Mesh::clear()
 {
   VBO_.destroy();
   EBO_.destroy();
+  vertexMemory_.release();
+  indexMemory_.release();
+}
+
+void Mesh::setOccluder(bool flag)
+{
+  if ( flag && occluderPositions_.isEmpty() ) {
+    // копия для программного буфера глубины снимается только у выбранных окклюдеров и только
+    // с вершин в памяти: чтения из видеопамяти при загрузке нет
+    if ( !occluder_ || isResident() || vertexes_.isEmpty() || lods_.isEmpty() ) {
+      occluder_ = false;
+      return;
+    }
+    occluderPositions_.reserve(vertexes_.size());
+    for ( const auto& vertex : vertexes_ ) {
+      occluderPositions_.append(vertex.position);
+    }
+    occluderIndexes_ = indexes_.mid(lods_.first().offset, lods_.first().count);
+  }
+  occluder_ = flag;
+  if ( !occluder_ ) {
+    occluderPositions_.clear();
+    occluderPositions_.squeeze();
+    occluderIndexes_.clear();
+    occluderIndexes_.squeeze();
+  }
+}
+
+int Mesh::selectLod(const QMatrix4x4& model, const DrawView& view)
+{
+  currentLod_ = selectLod(model, view, currentLod_);
+  return currentLod_;
+}
+
+int Mesh::selectLod(const QMatrix4x4& model, const DrawView& view, int currentLod) const
+{
+  if ( lods_.size() < 2 || view.pixelScale <= 0.0f ) {
+    return 0;
+  }
+  float scale = qMax(model.column(0).toVector3D().length(),
+                     qMax(model.column(1).toVector3D().length(), model.column(2).toVector3D().length()));
+  float radius = bounds_.size().length() * 0.5f * scale;
+  float distance = qMax((model.map(bounds_.center()) - view.position).length() - radius, kMinLodDistance);
+  auto pixelError = [&]( int lod ) {
+    return lods_.at(lod).error * scale * view.pixelScale / distance;
+  };
+
+  int lod = 0;
+  while ( lod + 1 < lods_.size() && pixelError(lod + 1) <= kLodPixelError ) {
+    lod++;
+  }
+  // на более грубый уровень переходим с запасом, иначе на границе LOD будет мигать
+  while ( lod > currentLod && pixelError(lod) > kLodPixelError * (1.0f - kLodHysteresis) ) {
+    lod--;
+  }
+  return lod;
+}
+
+void Mesh::requestTextures(const QMatrix4x4& model, const DrawView& view) const
+{
+  if ( !material_ || view.textureScale <= 0.0f || uvDensity_ <= 0.0f ) {
+    return;
+  }
+  float scale = qMax(model.column(0).toVector3D().length(),
+                     qMax(model.column(1).toVector3D().length(), model.column(2).toVector3D().length()));
+  float radius = bounds_.size().length() * 0.5f * scale;
+  float distance = qMax((model.map(bounds_.center()) - view.position).length() - radius, kMinLodDistance);
+  // по ближайшей к камере точке меша: детализации хватает на всей его поверхности
+  material_->requestDetail(uvDensity_ * distance / (scale * view.textureScale));
+}
+
+int Mesh::cullMeshlets(const Frustum& frustum, const QVector3D& cameraPosition,
+                       ArenaVector<GLsizei>& counts, ArenaVector<const void*>& offsets) const
+{
+  int end = -1;
+  int visible = 0;
+  for ( const auto& meshlet : meshlets_ ) {
+    if ( !MeshletBuilder::isVisible(meshlet, frustum, cameraPosition) ) {
+      continue;
+    }
+    visible += meshlet.count;
+    // соседние видимые кластеры склеиваем в один диапазон
+    if ( meshlet.offset == end ) {
+      counts.back() += meshlet.count;
+    }
+    else {
+      counts.push_back(meshlet.count);
+      offsets.push_back(reinterpret_cast<const void*>(quintptr(meshlet.offset) * sizeof(GLuint)));
+    }
+    end = meshlet.offset + meshlet.count;
+  }
+  return visible / 3;
+}
+
+void Mesh::buildLods(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes)
+{
+  lods_.clear();
+  currentLod_ = 0;
+  indexes_ = indexes;
+  lods_.append(LodLevel{0, indexes.size(), 0.0f});
+
+  float maxError = bounds_.size().length() * kLodMaxRelativeError;
+  QVector<GLuint> previous = indexes;
+  while ( lods_.size() < kMaxLodLevels && previous.size() / 3 > kMinLodTriangles ) {
+    int target = int(previous.size() / 3 * kLodReduction) * 3;
+    float error = 0.0f;
+    QVector<GLuint> simplified = MeshSimplifier::simplify(vertexes, previous, target, maxError, &error);
+    if ( simplified.size() > previous.size() * kLodMinGain ) {
+      break;
+    }
+    IndexOptimizer::optimizeVertexCache(simplified, vertexes.size());
+    // каждый уровень строится из предыдущего, поэтому ошибки накапливаются
+    lods_.append(LodLevel{indexes_.size(), simplified.size(), lods_.last().error + error});
+    indexes_ += simplified;
+    previous = simplified;
+  }
+
+  QString chain;
+  for ( const auto& level : lods_ ) {
+    chain += QString(" %1").arg(level.count / 3);
+  }
+  qDebug() << QString("lod triangles:%1").arg(chain);
 }
 
 void Mesh::calculateTBN(QVector<Vertex>& vertexes)
@@ -158,40 +601,44 @@ void Mesh::calculateTBN(QVector<Vertex>& vertexes)
     qDebug() << QString("size vertexes %1").arg(vertexes.size());
     return;
   }
-  for ( int i = 0; i < vertexes.size(); i += 3 ) {
-    QVector3D& v1 = vertexes[i].position;
-    QVector3D& v2 = vertexes[i+1].position;
-    QVector3D& v3 = vertexes[i+2].position;
-
-    QVector2D& uv1 = vertexes[i].texturePosition;
-    QVector2D& uv2 = vertexes[i+1].texturePosition;
-    QVector2D& uv3 = vertexes[i+2].texturePosition;
-
-    QVector3D deltaPos1{v2 - v1};
-    QVector3D deltaPos2{v3 - v1};
-
-    QVector2D deltaUV1{uv2 - uv1};
-    QVector2D deltaUV2{uv3 - uv1};
-
-    float r = 1.0f/( deltaUV1.x() * deltaUV2.y() - deltaUV1.y() * deltaUV2.x() );
-//    QVector3D tangent{ (deltaPos1 * deltaUV2.y() - deltaPos2 * deltaUV1.y()) * r };
-//    QVector3D bitangent{ (deltaPos2 * deltaUV1.x() - deltaPos1 * deltaUV2.x()) * r };
-    QVector3D tangent;
-    tangent.setX((deltaUV2.y() * deltaPos1.x() - deltaUV1.y() * deltaPos2.x()) * r);
-    tangent.setY((deltaUV2.y() * deltaPos1.y() - deltaUV1.y() * deltaPos2.y()) * r);
-    tangent.setZ((deltaUV2.y() * deltaPos1.z() - deltaUV1.y() * deltaPos2.z()) * r);
-    QVector3D bitangent;
-    bitangent.setX((-deltaUV2.y() * deltaPos1.x() + deltaUV1.y() * deltaPos2.x()) * r);
-    bitangent.setY((-deltaUV2.y() * deltaPos1.y() + deltaUV1.y() * deltaPos2.y()) * r);
-    bitangent.setZ((-deltaUV2.y() * deltaPos1.z() + deltaUV1.y() * deltaPos2.z()) * r);
-
-    vertexes[i].tangent = tangent;
-    vertexes[i+1].tangent = tangent;
-    vertexes[i+2].tangent = tangent;
-
-    vertexes[i].bitangent = bitangent;
-    vertexes[i+1].bitangent = bitangent;
-    vertexes[i+2].bitangent = bitangent;
-  }
+  // треугольники независимы: каждый пишет только свои три вершины
+  Vertex* data = vertexes.data();
+  JobSystem::instance().parallelFor(vertexes.size() / 3, kTbnGrain, [data]( int begin, int end ) {
+    for ( int i = begin * 3; i < end * 3; i += 3 ) {
+      QVector3D& v1 = data[i].position;
+      QVector3D& v2 = data[i+1].position;
+      QVector3D& v3 = data[i+2].position;
+
+      QVector2D& uv1 = data[i].texturePosition;
+      QVector2D& uv2 = data[i+1].texturePosition;
+      QVector2D& uv3 = data[i+2].texturePosition;
+
+      QVector3D deltaPos1{v2 - v1};
+      QVector3D deltaPos2{v3 - v1};
+
+      QVector2D deltaUV1{uv2 - uv1};
+      QVector2D deltaUV2{uv3 - uv1};
+
+      float r = 1.0f/( deltaUV1.x() * deltaUV2.y() - deltaUV1.y() * deltaUV2.x() );
+  //    QVector3D tangent{ (deltaPos1 * deltaUV2.y() - deltaPos2 * deltaUV1.y()) * r };
+  //    QVector3D bitangent{ (deltaPos2 * deltaUV1.x() - deltaPos1 * deltaUV2.x()) * r };
+      QVector3D tangent;
+      tangent.setX((deltaUV2.y() * deltaPos1.x() - deltaUV1.y() * deltaPos2.x()) * r);
+      tangent.setY((deltaUV2.y() * deltaPos1.y() - deltaUV1.y() * deltaPos2.y()) * r);
+      tangent.setZ((deltaUV2.y() * deltaPos1.z() - deltaUV1.y() * deltaPos2.z()) * r);
+      QVector3D bitangent;
+      bitangent.setX((-deltaUV2.y() * deltaPos1.x() + deltaUV1.y() * deltaPos2.x()) * r);
+      bitangent.setY((-deltaUV2.y() * deltaPos1.y() + deltaUV1.y() * deltaPos2.y()) * r);
+      bitangent.setZ((-deltaUV2.y() * deltaPos1.z() + deltaUV1.y() * deltaPos2.z()) * r);
+
+      data[i].tangent = tangent;
+      data[i+1].tangent = tangent;
+      data[i+2].tangent = tangent;
+
+      data[i].bitangent = bitangent;
+      data[i+1].bitangent = bitangent;
+      data[i+2].bitangent = bitangent;
+    }
+  });
 }
 
@@ -1,32 +1,131 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <functional>
 #include <memory>
 
+#include <QDataStream>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
+#include <QMatrix4x4>
 
 #include "structs.h"
 #include "material.h"
+#include "meshlet.h"
+#include "indexoptimizer.h"
+#include "framearena.h"
+#include "gpumemory.h"
 
 class Mesh
 {
 public:
+  // заполняет массивы геометрией меша (как в restore()); для загрузки заново после выгрузки
+  using Source = std::function<bool(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)>;
+
   Mesh();
   Mesh(QVector<Vertex>& vertexes, QVector<GLuint>& indexes );
+  Mesh(const Mesh&) = delete;
+
+  Mesh& operator=(const Mesh&) = delete;
 
-  void draw(QOpenGLShaderProgram& shader);
+  void draw(QOpenGLShaderProgram& shader, int lod = 0);
+  void drawRanges(QOpenGLShaderProgram& shader, const ArenaVector<GLsizei>& counts, const ArenaVector<const void*>& offsets);
+  void drawDepth(QOpenGLShaderProgram& shader);
+  // вершины и материал привязываются один раз на серию draw-вызовов этого меша
+  bool bind(QOpenGLShaderProgram& shader);
+  void release(QOpenGLShaderProgram& shader);
+  void drawBound(int lod);
+  void drawRangesBound(const GLsizei* counts, const void* const* offsets, int rangeCount);
   void create(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  // подготовка геометрии и цепочки LOD без обращений к GL - можно вызывать из рабочих потоков
+  void build(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  void upload();
+  // собранный меш для архива ресурсов: метаданные и массивы между build() и upload()
+  void writeMetadata(QDataStream& stream) const;
+  const QVector<Vertex>& builtVertexes() const { return vertexes_; }
+  const QVector<GLuint>& builtIndexes() const { return indexes_; }
+  // касательные и бикасательные треугольников без индексов (по три вершины подряд)
+  static void calculateTBN(QVector<Vertex>& vertexes);
+  // меш из архива: метаданные и готовые массивы, которые без копирования уходят в буферы GL
+  bool restore(QDataStream& stream, const Vertex* vertexes, int vertexCount, const GLuint* indexes, int indexCount);
+  // откуда брать геометрию после выгрузки; без источника меш из видеопамяти не выгружается.
+  // Задаётся до upload()/restore()
+  void setSource(Source source) { source_ = std::move(source); }
+  // буферы удаляются без чтения обратно; при следующей отрисовке меш загрузится из источника
+  bool evict();
+  // треугольники полной детализации (LOD 0) в память CPU; у меша в видеопамяти читаются
+  // из буферов, поэтому нужен текущий контекст
+  bool readGeometry(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  bool isResident() const { return VBO_.isCreated(); }
+  // имя владельца в учёте видеопамяти
+  void setOwner(const QString& owner) { owner_ = owner; }
   void setMaterial( const std::shared_ptr<Material>& material) { material_ = material; }
+  const Material* material() const { return material_.get(); }
   void clear();
 
+  const BoundingBox& bounds() const { return bounds_; }
+  int triangleCount() const { return triangleCount_; }
+  // до setOccluder(true) - только кандидат: небольшой меш
+  bool isOccluder() const { return occluder_; }
+  // true оставляет копию позиций и индексов полного LOD: после build() снимает её с вершин
+  // в памяти, поэтому вызывается до upload(); после restore() копия уже снята с архива
+  void setOccluder( bool flag );
+  const QVector<QVector3D>& occluderPositions() const { return occluderPositions_; }
+  const QVector<GLuint>& occluderIndexes() const { return occluderIndexes_; }
+
+  int lodCount() const { return lods_.size(); }
+  int lodTriangleCount(int lod) const { return lods_.at(lod).count / 3; }
+  int selectLod(const QMatrix4x4& model, const DrawView& view);
+  // то же без состояния в меше: гистерезис по LOD прошлого кадра конкретного экземпляра
+  int selectLod(const QMatrix4x4& model, const DrawView& view, int currentLod) const;
+  // запрос уровня мипов текстур материала по плотности текселей на экране; из потоков обхода
+  void requestTextures(const QMatrix4x4& model, const DrawView& view) const;
+
+  int meshletCount() const { return meshlets_.size(); }
+  const VertexCacheStats& cacheStatsBefore() const { return cacheStatsBefore_; }
+  const VertexCacheStats& cacheStatsAfter() const { return cacheStatsAfter_; }
+  // диапазоны индексов полного LOD, которые не отсечены пирамидой видимости и конусом нормалей;
+  // frustum и cameraPosition - в пространстве модели. Диапазоны добавляются в конец counts/offsets,
+  // возвращает число оставшихся треугольников
+  int cullMeshlets(const Frustum& frustum, const QVector3D& cameraPosition,
+                   ArenaVector<GLsizei>& counts, ArenaVector<const void*>& offsets) const;
+
 private:
-  void calculateTBN(QVector<Vertex>& vertexes);
+  struct LodLevel {
+    int offset = 0;
+    int count = 0;
+    float error = 0.0f;
+  };
+
+  void buildLods(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes);
+  void uploadBuffers(const Vertex* vertexes, int vertexCount, const GLuint* indexes, int indexCount);
+  // загрузка в GPU перед отрисовкой: собранной геометрии или заново из источника после выгрузки
+  bool makeResident();
+  bool readBuffers(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
 
 private:
   QOpenGLBuffer VBO_;
   QOpenGLBuffer EBO_{QOpenGLBuffer::IndexBuffer};
   std::shared_ptr<Material> material_ = nullptr;
+  BoundingBox bounds_;
+  int triangleCount_ = 0;
+  bool occluder_ = false;
+  QVector<QVector3D> occluderPositions_;
+  QVector<GLuint> occluderIndexes_;
+  QVector<LodLevel> lods_;
+  QVector<Meshlet> meshlets_;
+  VertexCacheStats cacheStatsBefore_;
+  VertexCacheStats cacheStatsAfter_;
+  int currentLod_ = 0;
+  // единиц UV на единицу длины в пространстве модели
+  float uvDensity_ = 0.0f;
+  QString owner_;
+  GpuAllocation vertexMemory_;
+  GpuAllocation indexMemory_;
+  // геометрия между build() и upload()
+  QVector<Vertex> vertexes_;
+  QVector<GLuint> indexes_;
+  Source source_;
 };
 
 #endif // MESH_H
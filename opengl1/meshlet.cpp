@@ -0,0 +1,249 @@
+#include "meshlet.h"
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+// при большем разбросе нормалей конус не отсекает ничего, его не используем
+static const float kMinConeDot = 0.1f;
+
+static QVector3D triangleNormal(const QVector<Vertex>& vertexes, const GLuint* triangle)
+{
+  const QVector3D& p0 = vertexes.at(int(triangle[0])).position;
+  const QVector3D& p1 = vertexes.at(int(triangle[1])).position;
+  const QVector3D& p2 = vertexes.at(int(triangle[2])).position;
+  return QVector3D::crossProduct(p1 - p0, p2 - p0).normalized();
+}
+
+static void computeBounds(Meshlet& meshlet, const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes)
+{
+  BoundingBox box;
+  for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i++ ) {
+    box.extend(vertexes.at(int(indexes.at(i))).position);
+  }
+  meshlet.center = box.center();
+  meshlet.radius = 0.0f;
+  for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i++ ) {
+    meshlet.radius = qMax(meshlet.radius, (vertexes.at(int(indexes.at(i))).position - meshlet.center).length());
+  }
+
+  QVector3D axis;
+  for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i += 3 ) {
+    axis += triangleNormal(vertexes, indexes.constData() + i);
+  }
+  meshlet.coneCutoff = 1.0f;
+  if ( axis.length() <= 0.0f ) {
+    return;
+  }
+  axis.normalize();
+  float minDot = 1.0f;
+  for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i += 3 ) {
+    QVector3D normal = triangleNormal(vertexes, indexes.constData() + i);
+    if ( !normal.isNull() ) {
+      minDot = qMin(minDot, QVector3D::dotProduct(normal, axis));
+    }
+  }
+  meshlet.coneAxis = axis;
+  if ( minDot > kMinConeDot ) {
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+  }
+}
+
+QVector<Meshlet> MeshletBuilder::build(const QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  QVector<Meshlet> meshlets;
+  int triangleCount = indexes.size() / 3;
+  int vertexCount = vertexes.size();
+  if ( triangleCount == 0 ) {
+    return meshlets;
+  }
+
+  // смежность позиция -> треугольники: у мешей с жёсткими рёбрами соседние треугольники
+  // часто не делят ни одной вершины, но делят позиции
+  QVector<int> position = MeshSimplifier::positionRemap(vertexes);
+  QVector<int> adjacencyOffsets(vertexCount + 1, 0);
+  for ( int i = 0; i < triangleCount * 3; i++ ) {
+    adjacencyOffsets[position.at(int(indexes.at(i))) + 1]++;
+  }
+  for ( int v = 0; v < vertexCount; v++ ) {
+    adjacencyOffsets[v + 1] += adjacencyOffsets.at(v);
+  }
+  QVector<int> adjacency(triangleCount * 3);
+  QVector<int> fill = adjacencyOffsets;
+  for ( int i = 0; i < triangleCount * 3; i++ ) {
+    adjacency[fill[position.at(int(indexes.at(i)))]++] = i / 3;
+  }
+
+  QVector<char> used(triangleCount, 0);
+  QVector<int> queued(triangleCount, -1);
+  QVector<char> inMeshlet(vertexCount, 0);
+  QVector<GLuint> meshletVertexes;
+  QVector<int> candidates;
+  QVector<GLuint> ordered;
+  ordered.reserve(triangleCount * 3);
+  QVector3D centroidSum;
+
+  auto newVertexes = [&]( int triangle ) {
+    int count = 0;
+    for ( int k = 0; k < 3; k++ ) {
+      count += inMeshlet.at(int(indexes.at(triangle * 3 + k))) ? 0 : 1;
+    }
+    return count;
+  };
+  // лучший кандидат добавляет меньше всего новых вершин, при равенстве - ближе к центру кластера,
+  // иначе кластеры вытягиваются в полосы и их сферы и конусы ничего не отсекают
+  auto bestCandidate = [&]() {
+    QVector3D centroid = centroidSum / float(meshletVertexes.size());
+    int best = -1;
+    int bestNew = 4;
+    float bestDistance = 0.0f;
+    int count = 0;
+    for ( int triangle : candidates ) {
+      if ( used.at(triangle) ) {
+        continue;
+      }
+      candidates[count++] = triangle;
+      int added = newVertexes(triangle);
+      if ( added > bestNew ) {
+        continue;
+      }
+      const GLuint* t = indexes.constData() + triangle * 3;
+      float distance = (vertexes.at(int(t[0])).position + vertexes.at(int(t[1])).position
+          + vertexes.at(int(t[2])).position - centroid * 3.0f).lengthSquared();
+      if ( added < bestNew || distance < bestDistance ) {
+        best = triangle;
+        bestNew = added;
+        bestDistance = distance;
+      }
+    }
+    candidates.resize(count);
+    return best;
+  };
+
+  int seed = 0;
+  while ( ordered.size() < triangleCount * 3 ) {
+    while ( used.at(seed) ) {
+      seed++;
+    }
+    Meshlet meshlet;
+    meshlet.offset = ordered.size();
+    candidates.clear();
+    centroidSum = QVector3D{};
+    int triangle = seed;
+    int triangles = 0;
+    while ( triangle >= 0 ) {
+      used[triangle] = 1;
+      triangles++;
+      for ( int k = 0; k < 3; k++ ) {
+        GLuint v = indexes.at(triangle * 3 + k);
+        ordered.append(v);
+        if ( !inMeshlet.at(int(v)) ) {
+          inMeshlet[int(v)] = 1;
+          meshletVertexes.append(v);
+          centroidSum += vertexes.at(int(v)).position;
+        }
+        int p = position.at(int(v));
+        for ( int a = adjacencyOffsets.at(p); a < adjacencyOffsets.at(p + 1); a++ ) {
+          int neighbour = adjacency.at(a);
+          if ( !used.at(neighbour) && queued.at(neighbour) != meshlets.size() ) {
+            queued[neighbour] = meshlets.size();
+            candidates.append(neighbour);
+          }
+        }
+      }
+      if ( triangles == kMeshletMaxTriangles ) {
+        break;
+      }
+      triangle = bestCandidate();
+      if ( triangle < 0 ) {
+        // связная часть закончилась: продолжаем со следующего по порядку треугольника
+        while ( seed < triangleCount && used.at(seed) ) {
+          seed++;
+        }
+        triangle = seed < triangleCount ? seed : -1;
+      }
+      if ( triangle >= 0 && meshletVertexes.size() + newVertexes(triangle) > kMeshletMaxVertexes ) {
+        triangle = -1;
+      }
+    }
+    meshlet.count = ordered.size() - meshlet.offset;
+    for ( GLuint v : meshletVertexes ) {
+      inMeshlet[int(v)] = 0;
+    }
+    meshletVertexes.clear();
+    meshlets.append(meshlet);
+  }
+
+  indexes = ordered;
+  for ( auto& meshlet : meshlets ) {
+    computeBounds(meshlet, vertexes, indexes);
+  }
+  return meshlets;
+}
+
+void MeshletBuilder::sortForOverdraw(QVector<Meshlet>& meshlets, const QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  if ( meshlets.size() < 2 ) {
+    return;
+  }
+  QVector<QVector3D> centroids(meshlets.size());
+  QVector<QVector3D> normals(meshlets.size());
+  QVector3D meshCentroid;
+  float meshArea = 0.0f;
+  for ( int m = 0; m < meshlets.size(); m++ ) {
+    const Meshlet& meshlet = meshlets.at(m);
+    float area = 0.0f;
+    for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i += 3 ) {
+      const QVector3D& p0 = vertexes.at(int(indexes.at(i))).position;
+      const QVector3D& p1 = vertexes.at(int(indexes.at(i + 1))).position;
+      const QVector3D& p2 = vertexes.at(int(indexes.at(i + 2))).position;
+      QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+      float triangleArea = normal.length();
+      centroids[m] += (p0 + p1 + p2) / 3.0f * triangleArea;
+      normals[m] += normal;
+      area += triangleArea;
+    }
+    meshCentroid += centroids.at(m);
+    meshArea += area;
+    if ( area > 0.0f ) {
+      centroids[m] /= area;
+    }
+    normals[m].normalize();
+  }
+  if ( meshArea > 0.0f ) {
+    meshCentroid /= meshArea;
+  }
+
+  QVector<float> keys(meshlets.size());
+  QVector<int> order(meshlets.size());
+  for ( int m = 0; m < meshlets.size(); m++ ) {
+    keys[m] = QVector3D::dotProduct(centroids.at(m) - meshCentroid, normals.at(m));
+    order[m] = m;
+  }
+  std::stable_sort(order.begin(), order.end(), [&keys]( int a, int b ) { return keys.at(a) > keys.at(b); });
+
+  QVector<GLuint> sorted;
+  sorted.reserve(indexes.size());
+  QVector<Meshlet> sortedMeshlets;
+  sortedMeshlets.reserve(meshlets.size());
+  for ( int m : order ) {
+    Meshlet meshlet = meshlets.at(m);
+    int offset = sorted.size();
+    for ( int i = meshlet.offset; i < meshlet.offset + meshlet.count; i++ ) {
+      sorted.append(indexes.at(i));
+    }
+    meshlet.offset = offset;
+    sortedMeshlets.append(meshlet);
+  }
+  indexes = sorted;
+  meshlets = sortedMeshlets;
+}
+
+bool MeshletBuilder::isVisible(const Meshlet& meshlet, const Frustum& frustum, const QVector3D& cameraPosition)
+{
+  if ( !frustum.intersects(meshlet.center, meshlet.radius) ) {
+    return false;
+  }
+  QVector3D direction = meshlet.center - cameraPosition;
+  return QVector3D::dotProduct(direction, meshlet.coneAxis) < meshlet.coneCutoff * direction.length() + meshlet.radius;
+}
@@ -0,0 +1,37 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <QVector>
+#include <QVector3D>
+#include <qopengl.h>
+
+#include "structs.h"
+
+// Небольшой кластер треугольников меша (до kMeshletMaxVertexes вершин и kMeshletMaxTriangles треугольников).
+// Треугольники кластера лежат в буфере индексов подряд, поэтому видимые кластеры рисуются диапазонами.
+struct Meshlet
+{
+  int offset = 0;
+  int count = 0;
+  QVector3D center;
+  float radius = 0.0f;
+  // конус нормалей: кластер смотрит от камеры, если dot(center - camera, coneAxis) >= coneCutoff * |center - camera| + radius
+  QVector3D coneAxis;
+  float coneCutoff = 1.0f;
+};
+
+class MeshletBuilder
+{
+public:
+  static const int kMeshletMaxVertexes = 64;
+  static const int kMeshletMaxTriangles = 124;
+
+  // переупорядочивает indexes так, чтобы треугольники каждого кластера шли подряд
+  static QVector<Meshlet> build(const QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  // порядок кластеров против перерисовки (Sander et al.): сначала кластеры, которые дальше от центра
+  // меша и смотрят наружу - они чаще перекрывают остальные и отбрасывают их ранним тестом глубины
+  static void sortForOverdraw(QVector<Meshlet>& meshlets, const QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  static bool isVisible(const Meshlet& meshlet, const Frustum& frustum, const QVector3D& cameraPosition);
+};
+
+#endif // MESHLET_H
@@ -0,0 +1,329 @@
+#include "meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
+
+// за проход берём рёбра с ошибкой не больше ошибки "последнего нужного" ребра, умноженной на этот множитель
+static const double kPassErrorFactor = 1.5;
+// схлопывание запрещено, если нормаль соседнего треугольника поворачивается сильнее (cos угла)
+static const float kMinFlipCos = 0.25f;
+
+namespace {
+
+struct Quadric
+{
+  void addPlane(const QVector3D& n, double d, double weight)
+  {
+    double x = double(n.x()), y = double(n.y()), z = double(n.z());
+    a00 += weight * x * x; a01 += weight * x * y; a02 += weight * x * z;
+    a11 += weight * y * y; a12 += weight * y * z; a22 += weight * z * z;
+    b0 += weight * x * d; b1 += weight * y * d; b2 += weight * z * d;
+    c += weight * d * d;
+    w += weight;
+  }
+
+  void add(const Quadric& q)
+  {
+    a00 += q.a00; a01 += q.a01; a02 += q.a02;
+    a11 += q.a11; a12 += q.a12; a22 += q.a22;
+    b0 += q.b0; b1 += q.b1; b2 += q.b2;
+    c += q.c;
+    w += q.w;
+  }
+
+  // средний квадрат расстояния от точки до плоскостей квадрики
+  double error(const QVector3D& p) const
+  {
+    double x = double(p.x()), y = double(p.y()), z = double(p.z());
+    double e = a00 * x * x + a11 * y * y + a22 * z * z
+        + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+        + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return w > 0.0 ? qMax(e, 0.0) / w : 0.0;
+  }
+
+  double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+  double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+  double c = 0.0;
+  double w = 0.0;
+};
+
+struct Collapse
+{
+  int from;
+  int to;
+  double error;
+};
+
+}
+
+static bool lessVector(const QVector3D& a, const QVector3D& b)
+{
+  if ( a.x() != b.x() ) { return a.x() < b.x(); }
+  if ( a.y() != b.y() ) { return a.y() < b.y(); }
+  return a.z() < b.z();
+}
+
+static bool lessVertex(const Vertex& a, const Vertex& b)
+{
+  if ( a.position != b.position ) { return lessVector(a.position, b.position); }
+  if ( a.texturePosition != b.texturePosition ) {
+    if ( a.texturePosition.x() != b.texturePosition.x() ) { return a.texturePosition.x() < b.texturePosition.x(); }
+    return a.texturePosition.y() < b.texturePosition.y();
+  }
+  return lessVector(a.normal, b.normal);
+}
+
+// для каждого элемента - наименьший индекс среди равных ему
+template<class Less>
+static QVector<int> groupEqual(int count, Less less)
+{
+  QVector<int> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), less);
+  QVector<int> canonical(count);
+  for ( int i = 0; i < count; ) {
+    int j = i + 1;
+    while ( j < count && !less(order.at(i), order.at(j)) ) {
+      j++;
+    }
+    for ( int k = i; k < j; k++ ) {
+      canonical[order.at(k)] = order.at(i);
+    }
+    i = j;
+  }
+  return canonical;
+}
+
+void MeshSimplifier::weld(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  QVector<int> canonical = groupEqual(vertexes.size(), [&vertexes]( int a, int b ) {
+    return lessVertex(vertexes.at(a), vertexes.at(b));
+  });
+  QVector<GLuint> remap(vertexes.size());
+  QVector<Vertex> welded;
+  QVector<int> counts;
+  // новые вершины идут в порядке первого появления - так лучше для кэша вершин
+  for ( int i = 0; i < vertexes.size(); i++ ) {
+    if ( canonical.at(i) == i ) {
+      remap[i] = GLuint(welded.size());
+      welded.append(vertexes.at(i));
+      counts.append(1);
+    }
+    else {
+      GLuint target = remap.at(canonical.at(i));
+      welded[int(target)].tangent += vertexes.at(i).tangent;
+      welded[int(target)].bitangent += vertexes.at(i).bitangent;
+      counts[int(target)]++;
+      remap[i] = target;
+    }
+  }
+  for ( int i = 0; i < welded.size(); i++ ) {
+    welded[i].tangent /= float(counts.at(i));
+    welded[i].bitangent /= float(counts.at(i));
+  }
+  for ( auto& index : indexes ) {
+    index = remap.at(int(index));
+  }
+  vertexes = welded;
+}
+
+QVector<int> MeshSimplifier::positionRemap(const QVector<Vertex>& vertexes)
+{
+  return groupEqual(vertexes.size(), [&vertexes]( int a, int b ) {
+    return lessVector(vertexes.at(a).position, vertexes.at(b).position);
+  });
+}
+
+QVector<GLuint> MeshSimplifier::simplify(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes,
+                                         int targetIndexCount, float maxError, float* resultError)
+{
+  QVector<GLuint> result = indexes;
+  if ( resultError ) {
+    *resultError = 0.0f;
+  }
+  int vertexCount = vertexes.size();
+  if ( result.size() <= targetIndexCount || vertexCount == 0 ) {
+    return result;
+  }
+
+  // вершины с одинаковой позицией: всё считаем по "позиции" wedge[v]
+  QVector<int> wedge = positionRemap(vertexes);
+  QVector<char> locked(vertexCount, 0);
+  for ( int v = 0; v < vertexCount; v++ ) {
+    if ( wedge.at(v) != v ) {
+      locked[wedge.at(v)] = 1; // шов UV/нормалей
+    }
+  }
+  auto edgeKey = []( int a, int b ) { return (quint64(quint32(a)) << 32) | quint32(b); };
+  std::unordered_map<quint64, int> edges;
+  edges.reserve(size_t(result.size()));
+  for ( int i = 0; i < result.size(); i += 3 ) {
+    for ( int k = 0; k < 3; k++ ) {
+      edges[edgeKey(wedge.at(int(result.at(i + k))), wedge.at(int(result.at(i + (k + 1) % 3))))]++;
+    }
+  }
+  for ( const auto& edge : edges ) {
+    int a = int(edge.first >> 32);
+    int b = int(edge.first & 0xffffffffu);
+    auto reverse = edges.find(edgeKey(b, a));
+    // граница или неманифолдное ребро
+    if ( edge.second != 1 || reverse == edges.end() || reverse->second != 1 ) {
+      locked[a] = 1;
+      locked[b] = 1;
+    }
+  }
+
+  QVector<Quadric> quadrics(vertexCount);
+  for ( int i = 0; i + 2 < result.size(); i += 3 ) {
+    const QVector3D& p0 = vertexes.at(int(result.at(i))).position;
+    const QVector3D& p1 = vertexes.at(int(result.at(i + 1))).position;
+    const QVector3D& p2 = vertexes.at(int(result.at(i + 2))).position;
+    QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+    float area = normal.length();
+    if ( area <= 0.0f ) {
+      continue;
+    }
+    normal /= area;
+    double d = -double(QVector3D::dotProduct(normal, p0));
+    for ( int k = 0; k < 3; k++ ) {
+      quadrics[wedge.at(int(result.at(i + k)))].addPlane(normal, d, double(area) * 0.5);
+    }
+  }
+
+  auto collapseError = [&]( int from, int to ) {
+    Quadric q = quadrics.at(wedge.at(from));
+    q.add(quadrics.at(wedge.at(to)));
+    return q.error(vertexes.at(to).position);
+  };
+
+  QVector<int> adjacencyOffsets;
+  QVector<int> adjacency;
+  auto flips = [&]( int from, int to ) {
+    const QVector3D& target = vertexes.at(to).position;
+    for ( int a = adjacencyOffsets.at(from); a < adjacencyOffsets.at(from + 1); a++ ) {
+      int triangle = adjacency.at(a) * 3;
+      QVector3D before[3];
+      QVector3D after[3];
+      bool removed = false;
+      for ( int k = 0; k < 3; k++ ) {
+        int v = int(result.at(triangle + k));
+        if ( v == to ) {
+          removed = true;
+        }
+        // другая вершина шва в той же позиции: треугольник выродится, а UV "переедут" через шов
+        else if ( wedge.at(v) == wedge.at(to) ) {
+          return true;
+        }
+        before[k] = vertexes.at(v).position;
+        after[k] = v == from ? target : before[k];
+      }
+      if ( removed ) {
+        continue;
+      }
+      QVector3D n0 = QVector3D::crossProduct(before[1] - before[0], before[2] - before[0]);
+      QVector3D n1 = QVector3D::crossProduct(after[1] - after[0], after[2] - after[0]);
+      float lengths = n0.length() * n1.length();
+      if ( lengths <= 0.0f || QVector3D::dotProduct(n0, n1) < kMinFlipCos * lengths ) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  double maxErrorSq = double(maxError) * double(maxError);
+  double appliedError = 0.0;
+  QVector<int> remap(vertexCount);
+  QVector<char> touched(vertexCount);
+  QVector<Collapse> collapses;
+  while ( result.size() > targetIndexCount ) {
+    adjacencyOffsets.fill(0, vertexCount + 1);
+    for ( GLuint index : result ) {
+      adjacencyOffsets[int(index) + 1]++;
+    }
+    for ( int v = 0; v < vertexCount; v++ ) {
+      adjacencyOffsets[v + 1] += adjacencyOffsets.at(v);
+    }
+    adjacency.resize(result.size());
+    QVector<int> fill = adjacencyOffsets;
+    for ( int i = 0; i < result.size(); i++ ) {
+      adjacency[fill[int(result.at(i))]++] = i / 3;
+    }
+
+    // у манифолдного ребра два треугольника с обходом (a, b) и (b, a): берём только a < b
+    collapses.clear();
+    for ( int i = 0; i < result.size(); i += 3 ) {
+      for ( int k = 0; k < 3; k++ ) {
+        int a = int(result.at(i + k));
+        int b = int(result.at(i + (k + 1) % 3));
+        if ( a >= b ) {
+          continue;
+        }
+        if ( !locked.at(wedge.at(a)) ) {
+          collapses.append(Collapse{a, b, collapseError(a, b)});
+        }
+        if ( !locked.at(wedge.at(b)) ) {
+          collapses.append(Collapse{b, a, collapseError(b, a)});
+        }
+      }
+    }
+    if ( collapses.isEmpty() ) {
+      break;
+    }
+    std::sort(collapses.begin(), collapses.end(), []( const Collapse& a, const Collapse& b ) {
+      return a.error < b.error;
+    });
+
+    // одно схлопывание убирает примерно два треугольника
+    int neededTriangles = (result.size() - targetIndexCount) / 3;
+    int neededCollapses = qMin(collapses.size() - 1, qMax(1, neededTriangles / 2));
+    double passLimit = qMin(maxErrorSq, collapses.at(neededCollapses).error * kPassErrorFactor);
+
+    std::iota(remap.begin(), remap.end(), 0);
+    touched.fill(0);
+    int removed = 0;
+    int applied = 0;
+    for ( const auto& collapse : collapses ) {
+      if ( collapse.error > passLimit || removed >= neededTriangles ) {
+        break;
+      }
+      if ( touched.at(collapse.from) || touched.at(collapse.to) || flips(collapse.from, collapse.to) ) {
+        continue;
+      }
+      remap[collapse.from] = collapse.to;
+      // соседей не трогаем до следующего прохода: проверки выше сделаны для старых позиций
+      for ( int a = adjacencyOffsets.at(collapse.from); a < adjacencyOffsets.at(collapse.from + 1); a++ ) {
+        for ( int k = 0; k < 3; k++ ) {
+          touched[int(result.at(adjacency.at(a) * 3 + k))] = 1;
+        }
+      }
+      quadrics[wedge.at(collapse.to)].add(quadrics.at(wedge.at(collapse.from)));
+      appliedError = qMax(appliedError, collapse.error);
+      removed += 2;
+      applied++;
+    }
+    if ( applied == 0 ) {
+      break;
+    }
+
+    int count = 0;
+    for ( int i = 0; i < result.size(); i += 3 ) {
+      GLuint a = GLuint(remap.at(int(result.at(i))));
+      GLuint b = GLuint(remap.at(int(result.at(i + 1))));
+      GLuint c = GLuint(remap.at(int(result.at(i + 2))));
+      if ( a == b || b == c || a == c ) {
+        continue;
+      }
+      result[count++] = a;
+      result[count++] = b;
+      result[count++] = c;
+    }
+    result.resize(count);
+  }
+
+  if ( resultError ) {
+    *resultError = float(std::sqrt(appliedError));
+  }
+  return result;
+}
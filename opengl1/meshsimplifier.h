@@ -0,0 +1,25 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <QVector>
+#include <qopengl.h>
+
+#include "structs.h"
+
+// Построение индексированной геометрии и её упрощение по квадрикам (Garland-Heckbert).
+// Упрощение только переписывает индексы: буфер вершин общий для всех LOD.
+// Вершины на швах (UV/нормали) и на границах меша не удаляются, поэтому швы сохраняются.
+class MeshSimplifier
+{
+public:
+  // склеивает одинаковые вершины (позиция, UV, нормаль), касательные усредняются
+  static void weld(QVector<Vertex>& vertexes, QVector<GLuint>& indexes);
+  // для каждой вершины - наименьший индекс вершины с той же позицией
+  static QVector<int> positionRemap(const QVector<Vertex>& vertexes);
+  // maxError - допустимое отклонение поверхности в единицах модели,
+  // resultError - фактическое отклонение полученного LOD
+  static QVector<GLuint> simplify(const QVector<Vertex>& vertexes, const QVector<GLuint>& indexes,
+                                  int targetIndexCount, float maxError, float* resultError = nullptr);
+};
+
+#endif // MESHSIMPLIFIER_H
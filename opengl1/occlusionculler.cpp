@@ -0,0 +1,261 @@
+#include "occlusionculler.h"
+#include "jobsystem.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+static const float kMinW = 1.0e-5f;
+// меньше этого числа треугольников накладные расходы потоков больше выигрыша
+static const int kParallelTriangles = 256;
+
+OcclusionCuller::OcclusionCuller() :
+  depth_(kWidth * kHeight, 1.0f)
+{
+  for ( int i = 0; i < kTileCount; i++ ) {
+    tileMaxDepth_[i] = 1.0f;
+  }
+}
+
+void OcclusionCuller::beginFrame(const QMatrix4x4& viewProjection)
+{
+  viewProjection_ = viewProjection;
+  triangles_.clear();
+  for ( auto& bin : bins_ ) {
+    bin.clear();
+  }
+  depth_.fill(1.0f);
+  for ( auto& tileMax : tileMaxDepth_ ) {
+    tileMax = 1.0f;
+  }
+  tested_ = 0;
+  culled_ = 0;
+  outside_ = 0;
+}
+
+void OcclusionCuller::addOccluder(const QVector<QVector3D>& positions, const QVector<GLuint>& indexes, const QMatrix4x4& model)
+{
+  QMatrix4x4 mvp = viewProjection_ * model;
+  for ( int i = 0; i + 2 < indexes.size(); i += 3 ) {
+    addClipTriangle(mvp * QVector4D{positions.at(int(indexes.at(i))), 1.0f},
+                    mvp * QVector4D{positions.at(int(indexes.at(i + 1))), 1.0f},
+                    mvp * QVector4D{positions.at(int(indexes.at(i + 2))), 1.0f});
+  }
+}
+
+void OcclusionCuller::addClipTriangle(const QVector4D& v0, const QVector4D& v1, const QVector4D& v2)
+{
+  // отсечение ближней плоскостью z >= -w, из треугольника получается до 4 вершин
+  const QVector4D in[3]{v0, v1, v2};
+  QVector4D out[4];
+  int count = 0;
+  for ( int i = 0; i < 3; i++ ) {
+    const QVector4D& a = in[i];
+    const QVector4D& b = in[(i + 1) % 3];
+    float da = a.z() + a.w();
+    float db = b.z() + b.w();
+    if ( da >= 0.0f ) {
+      out[count++] = a;
+    }
+    if ( (da >= 0.0f) != (db >= 0.0f) ) {
+      float t = da / (da - db);
+      out[count++] = a + (b - a) * t;
+    }
+  }
+  for ( int i = 1; i + 1 < count; i++ ) {
+    addScreenTriangle(out[0], out[i], out[i + 1]);
+  }
+}
+
+void OcclusionCuller::addScreenTriangle(const QVector4D& v0, const QVector4D& v1, const QVector4D& v2)
+{
+  float x[3], y[3], z[3];
+  const QVector4D* v[3]{&v0, &v1, &v2};
+  for ( int i = 0; i < 3; i++ ) {
+    float w = qMax(v[i]->w(), kMinW);
+    x[i] = (v[i]->x() / w * 0.5f + 0.5f) * kWidth;
+    y[i] = (v[i]->y() / w * 0.5f + 0.5f) * kHeight;
+    z[i] = v[i]->z() / w * 0.5f + 0.5f;
+  }
+  float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if ( qAbs(area) < 1.0e-6f ) {
+    return;
+  }
+  // окклюдеры растеризуем с обеих сторон: приводим обход к CCW
+  if ( area < 0.0f ) {
+    std::swap(x[1], x[2]);
+    std::swap(y[1], y[2]);
+    std::swap(z[1], z[2]);
+    area = -area;
+  }
+
+  ScreenTriangle t;
+  t.minX = qMax(0, int(std::floor(qMin(x[0], qMin(x[1], x[2])))));
+  t.minY = qMax(0, int(std::floor(qMin(y[0], qMin(y[1], y[2])))));
+  t.maxX = qMin(kWidth - 1, int(std::ceil(qMax(x[0], qMax(x[1], x[2])))));
+  t.maxY = qMin(kHeight - 1, int(std::ceil(qMax(y[0], qMax(y[1], y[2])))));
+  if ( t.minX > t.maxX || t.minY > t.maxY || qMin(z[0], qMin(z[1], z[2])) > 1.0f ) {
+    return;
+  }
+  // ребро i лежит напротив вершины (i + 2) % 3: E(x, y) = A*x + B*y + C >= 0 внутри
+  for ( int i = 0; i < 3; i++ ) {
+    int j = (i + 1) % 3;
+    t.edgeA[i] = y[i] - y[j];
+    t.edgeB[i] = x[j] - x[i];
+    t.edgeC[i] = x[i] * y[j] - x[j] * y[i];
+  }
+  // z линейна в экранном пространстве: z = sum(E_i * z_k) / area
+  float inv = 1.0f / area;
+  float zk[3]{z[2], z[0], z[1]};
+  t.depthA = (t.edgeA[0] * zk[0] + t.edgeA[1] * zk[1] + t.edgeA[2] * zk[2]) * inv;
+  t.depthB = (t.edgeB[0] * zk[0] + t.edgeB[1] * zk[1] + t.edgeB[2] * zk[2]) * inv;
+  t.depthC = (t.edgeC[0] * zk[0] + t.edgeC[1] * zk[1] + t.edgeC[2] * zk[2]) * inv;
+
+  int index = triangles_.size();
+  triangles_.append(t);
+  for ( int ty = t.minY / kTileHeight; ty <= t.maxY / kTileHeight; ty++ ) {
+    for ( int tx = t.minX / kTileWidth; tx <= t.maxX / kTileWidth; tx++ ) {
+      bins_[ty * kTilesX + tx].append(index);
+    }
+  }
+}
+
+void OcclusionCuller::rasterize()
+{
+  if ( triangles_.size() < kParallelTriangles ) {
+    for ( int tile = 0; tile < kTileCount; tile++ ) {
+      rasterizeTile(tile);
+    }
+  }
+  else {
+    JobSystem::instance().parallelFor(kTileCount, 1, [this]( int begin, int end ) {
+      for ( int tile = begin; tile < end; tile++ ) {
+        rasterizeTile(tile);
+      }
+    });
+  }
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+  int tileX0 = (tile % kTilesX) * kTileWidth;
+  int tileY0 = (tile / kTilesX) * kTileHeight;
+  int tileX1 = tileX0 + kTileWidth - 1;
+  int tileY1 = tileY0 + kTileHeight - 1;
+
+  for ( int index : bins_[tile] ) {
+    const ScreenTriangle& t = triangles_.at(index);
+    int minX = qMax(t.minX, tileX0);
+    int maxX = qMin(t.maxX, tileX1);
+    int minY = qMax(t.minY, tileY0);
+    int maxY = qMin(t.maxY, tileY1);
+    for ( int y = minY; y <= maxY; y++ ) {
+      float py = float(y) + 0.5f;
+      float* row = depth_.data() + y * kWidth;
+      float rowE0 = t.edgeB[0] * py + t.edgeC[0];
+      float rowE1 = t.edgeB[1] * py + t.edgeC[1];
+      float rowE2 = t.edgeB[2] * py + t.edgeC[2];
+      float rowZ = t.depthB * py + t.depthC;
+#ifdef OCCLUSION_SSE
+      // ширина тайла кратна 4, поэтому выровненная четвёрка не выходит за тайл
+      const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+      const __m128 zero = _mm_setzero_ps();
+      for ( int x = minX & ~3; x <= maxX; x += 4 ) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), laneOffset);
+        __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[0]), px), _mm_set1_ps(rowE0));
+        __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[1]), px), _mm_set1_ps(rowE1));
+        __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edgeA[2]), px), _mm_set1_ps(rowE2));
+        __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+        if ( _mm_movemask_ps(inside) == 0 ) {
+          continue;
+        }
+        __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depthA), px), _mm_set1_ps(rowZ));
+        __m128 current = _mm_loadu_ps(row + x);
+        __m128 nearest = _mm_min_ps(current, z);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+      }
+#else
+      for ( int x = minX; x <= maxX; x++ ) {
+        float px = float(x) + 0.5f;
+        if ( t.edgeA[0] * px + rowE0 < 0.0f || t.edgeA[1] * px + rowE1 < 0.0f || t.edgeA[2] * px + rowE2 < 0.0f ) {
+          continue;
+        }
+        row[x] = qMin(row[x], t.depthA * px + rowZ);
+      }
+#endif
+    }
+  }
+
+  float tileMax = 0.0f;
+  for ( int y = tileY0; y <= tileY1; y++ ) {
+    const float* row = depth_.constData() + y * kWidth;
+    for ( int x = tileX0; x <= tileX1; x++ ) {
+      tileMax = qMax(tileMax, row[x]);
+    }
+  }
+  tileMaxDepth_[tile] = tileMax;
+}
+
+bool OcclusionCuller::isVisible(const BoundingBox& box, const QMatrix4x4& model) const
+{
+  tested_.fetch_add(1, std::memory_order_relaxed);
+  if ( box.isEmpty() ) {
+    return true;
+  }
+  QMatrix4x4 mvp = viewProjection_ * model;
+  float minX = std::numeric_limits<float>::max();
+  float minY = std::numeric_limits<float>::max();
+  float maxX = -std::numeric_limits<float>::max();
+  float maxY = -std::numeric_limits<float>::max();
+  float minZ = std::numeric_limits<float>::max();
+  for ( int i = 0; i < 8; i++ ) {
+    QVector3D corner{ (i & 1) ? box.max.x() : box.min.x(),
+                      (i & 2) ? box.max.y() : box.min.y(),
+                      (i & 4) ? box.max.z() : box.min.z() };
+    QVector4D clip = mvp * QVector4D{corner, 1.0f};
+    // бокс пересекает ближнюю плоскость - считаем видимым
+    if ( clip.w() <= kMinW || clip.z() < -clip.w() ) {
+      return true;
+    }
+    float x = (clip.x() / clip.w() * 0.5f + 0.5f) * kWidth;
+    float y = (clip.y() / clip.w() * 0.5f + 0.5f) * kHeight;
+    minX = qMin(minX, x);
+    maxX = qMax(maxX, x);
+    minY = qMin(minY, y);
+    maxY = qMax(maxY, y);
+    minZ = qMin(minZ, clip.z() / clip.w() * 0.5f + 0.5f);
+  }
+  if ( maxX < 0.0f || maxY < 0.0f || minX > kWidth || minY > kHeight || minZ > 1.0f ) {
+    outside_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  int x0 = qMax(0, int(std::floor(minX)));
+  int y0 = qMax(0, int(std::floor(minY)));
+  int x1 = qMin(kWidth - 1, int(std::ceil(maxX)));
+  int y1 = qMin(kHeight - 1, int(std::ceil(maxY)));
+  for ( int ty = y0 / kTileHeight; ty <= y1 / kTileHeight; ty++ ) {
+    for ( int tx = x0 / kTileWidth; tx <= x1 / kTileWidth; tx++ ) {
+      if ( minZ > tileMaxDepth_[ty * kTilesX + tx] ) {
+        continue;
+      }
+      int rx0 = qMax(x0, tx * kTileWidth);
+      int rx1 = qMin(x1, tx * kTileWidth + kTileWidth - 1);
+      int ry0 = qMax(y0, ty * kTileHeight);
+      int ry1 = qMin(y1, ty * kTileHeight + kTileHeight - 1);
+      for ( int y = ry0; y <= ry1; y++ ) {
+        const float* row = depth_.constData() + y * kWidth;
+        for ( int x = rx0; x <= rx1; x++ ) {
+          if ( minZ <= row[x] ) {
+            return true;
+          }
+        }
+      }
+    }
+  }
+  culled_.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
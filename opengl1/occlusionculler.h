@@ -0,0 +1,73 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <atomic>
+
+#include <QVector>
+#include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
+#include <qopengl.h>
+
+#include "structs.h"
+
+// Программный буфер глубины низкого разрешения для отсечения перекрытых объектов.
+// Работает только на CPU: треугольники окклюдеров раскладываются по тайлам,
+// тайлы растеризуются параллельно (SSE2, 4 пикселя за шаг), затем экранные
+// прямоугольники ограничивающих боксов проверяются по этому буферу.
+class OcclusionCuller
+{
+public:
+  static const int kWidth = 320;
+  static const int kHeight = 192;
+  static const int kTileWidth = 64;
+  static const int kTileHeight = 32;
+  static const int kTilesX = kWidth / kTileWidth;
+  static const int kTilesY = kHeight / kTileHeight;
+  static const int kTileCount = kTilesX * kTilesY;
+
+  OcclusionCuller();
+
+  void beginFrame(const QMatrix4x4& viewProjection);
+  void addOccluder(const QVector<QVector3D>& positions, const QVector<GLuint>& indexes, const QMatrix4x4& model);
+  void rasterize();
+  // после rasterize() можно вызывать из нескольких потоков одновременно
+  bool isVisible(const BoundingBox& box, const QMatrix4x4& model) const;
+
+  const float* depth() const { return depth_.constData(); }
+  int occluderTriangles() const { return triangles_.size(); }
+  int tested() const { return tested_; }
+  // отброшены буфером глубины; боксы вне экрана считаются отдельно в outside()
+  int culled() const { return culled_; }
+  int outside() const { return outside_; }
+
+private:
+  struct ScreenTriangle {
+    float edgeA[3];
+    float edgeB[3];
+    float edgeC[3];
+    float depthA;
+    float depthB;
+    float depthC;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+  };
+
+  void addClipTriangle(const QVector4D& v0, const QVector4D& v1, const QVector4D& v2);
+  void addScreenTriangle(const QVector4D& v0, const QVector4D& v1, const QVector4D& v2);
+  void rasterizeTile(int tile);
+
+private:
+  QMatrix4x4 viewProjection_;
+  QVector<ScreenTriangle> triangles_;
+  QVector<int> bins_[kTileCount];
+  QVector<float> depth_;
+  float tileMaxDepth_[kTileCount];
+  mutable std::atomic<int> tested_{0};
+  mutable std::atomic<int> culled_{0};
+  mutable std::atomic<int> outside_{0};
+};
+
+#endif // OCCLUSIONCULLER_H
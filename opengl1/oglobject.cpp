@@ -1,41 +1,124 @@
 #include "oglobject.h"
 #include "structs.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include <QDataStream>
 #include <QDir>
 #include <QFile>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QVector3D>
 #include <QVector2D>
 
-OGLObject::OGLObject( const QString& path)
+#include "jobsystem.h"
+
+// окклюдером считается меш, сравнимый по размеру со всем объектом
+static const float kOccluderSizeFraction = 0.25f;
+// файл разбирается кусками не меньше этого размера, границы - по концам строк
+static const int kMinParseChunk = 256 * 1024;
+// версия раскладки модели в архиве ресурсов; в первой массивы лежали несжатыми
+static const qint32 kModelVersion = 2;
+static const qint32 kRawModelVersion = 1;
+
+namespace {
+
+// индексы грани как в файле: с 1, позиция/текстура/нормаль
+struct ObjFace
 {
-  load(path);
-}
+  int indexes[3][3];
+};
 
-OGLObject::OGLObject(QVector<Vertex>& vertexes, QVector<GLuint>& indexes )
+// строки, которые зависят от порядка (объекты, материалы, грани), разбираются
+// в своём куске, а применяются потом по порядку в одном потоке
+struct ObjCommand
 {
-  create(vertexes, indexes);
-}
+  enum Type { Object, MtlLib, UseMtl, Face };
+  Type type;
+  int index;
+};
 
-void OGLObject::load(const QString& path)
+struct ObjChunk
 {
-  QFile file{path};
-  if ( !file.exists() ) {
-    qDebug() << QString(" file %1 not exists ").arg(path);
-    return;
-  }
-  if ( !file.open(QFile::ReadOnly) ) {
-    qDebug() << QString(" file %1 not open ").arg(path);
-    return;
-  }
-  QTextStream stream{&file};
+  QByteArray text;
   QVector<QVector3D> coords;
   QVector<QVector2D> texCoords;
   QVector<QVector3D> normals;
+  QVector<ObjFace> faces;
+  QVector<QString> names;
+  QVector<ObjCommand> commands;
+};
+
+// версия kRawModelVersion: массивы лежат как есть и уходят в буферы GL прямо из архива
+bool readRawGeometry(QDataStream& stream, const char* data, quint64 limit, const Vertex*& vertexes, int& vertexCount,
+                     const GLuint*& indexes, int& indexCount)
+{
+  quint64 vertexOffset = 0;
+  qint32 vertexes32 = 0;
+  quint64 indexOffset = 0;
+  qint32 indexes32 = 0;
+  stream >> vertexOffset >> vertexes32 >> indexOffset >> indexes32;
+  if ( stream.status() != QDataStream::Ok || vertexes32 < 0 || indexes32 < 0
+       || vertexOffset + quint64(vertexes32) * sizeof(Vertex) > limit
+       || indexOffset + quint64(indexes32) * sizeof(GLuint) > limit ) {
+    return false;
+  }
+  vertexes = reinterpret_cast<const Vertex*>(data + vertexOffset);
+  vertexCount = vertexes32;
+  indexes = reinterpret_cast<const GLuint*>(data + indexOffset);
+  indexCount = indexes32;
+  // индекс за пределами вершин увёл бы отрисовку и копию окклюдера за конец буфера
+  return indexCount == 0 || *std::max_element(indexes, indexes + indexCount) < GLuint(vertexCount);
+}
 
-  QVector<Vertex> vertexes;
-  QVector<GLuint> indexes;
-  std::shared_ptr<Mesh> mesh;
+// где в модели лежат сжатые потоки меша; по нему меш распаковывается и при загрузке,
+// и заново после выгрузки из видеопамяти
+struct EncodedGeometry
+{
+  qint32 vertexCount = 0;
+  qint32 indexCount = 0;
+  quint64 vertexOffset = 0;
+  qint32 vertexBytes = 0;
+  quint8 vertexCompression = 0;
+  quint64 indexOffset = 0;
+  qint32 indexBytes = 0;
+  quint8 indexCompression = 0;
+};
+
+bool readEncodedGeometry(QDataStream& stream, quint64 limit, EncodedGeometry& geometry)
+{
+  stream >> geometry.vertexCount >> geometry.indexCount >> geometry.vertexOffset >> geometry.vertexBytes
+         >> geometry.vertexCompression >> geometry.indexOffset >> geometry.indexBytes >> geometry.indexCompression;
+  return stream.status() == QDataStream::Ok && geometry.vertexCount >= 0 && geometry.indexCount >= 0
+         && geometry.vertexBytes >= 0 && geometry.indexBytes >= 0
+         && geometry.vertexOffset + quint64(geometry.vertexBytes) <= limit
+         && geometry.indexOffset + quint64(geometry.indexBytes) <= limit;
+}
+
+// потоки GeometryCodec распаковываются в vertexes и indexes
+bool decodeGeometry(const char* data, const EncodedGeometry& geometry, QVector<Vertex>& vertexes,
+                    QVector<GLuint>& indexes)
+{
+  QByteArray vertexStream;
+  QByteArray indexStream;
+  if ( !GeometryCodec::uncompress(reinterpret_cast<const uchar*>(data + geometry.vertexOffset), geometry.vertexBytes,
+                                  GeometryCodec::Compression(geometry.vertexCompression), vertexStream)
+       || !GeometryCodec::uncompress(reinterpret_cast<const uchar*>(data + geometry.indexOffset), geometry.indexBytes,
+                                     GeometryCodec::Compression(geometry.indexCompression), indexStream) ) {
+    return false;
+  }
+  vertexes.resize(geometry.vertexCount);
+  indexes.resize(geometry.indexCount);
+  return GeometryCodec::decodeVertexes(reinterpret_cast<const uchar*>(vertexStream.constData()), vertexStream.size(),
+                                       vertexes.data(), geometry.vertexCount, int(sizeof(Vertex)))
+         && GeometryCodec::decodeIndexes(reinterpret_cast<const uchar*>(indexStream.constData()), indexStream.size(),
+                                         indexes.data(), geometry.indexCount, geometry.vertexCount);
+}
+
+void parseObjChunk(ObjChunk& chunk)
+{
+  QTextStream stream{&chunk.text};
   while( !stream.atEnd()) {
     QString line{stream.readLine()};
     QStringList tokenList{line.split(" ")};
@@ -43,100 +126,237 @@ void OGLObject::load(const QString& path)
 //      qDebug() << QString("Comment string %1").arg(tokenList.first());
     }
     else if ( tokenList.first() == QString("mtllib") ) {
-      QFileInfo fInfo{file};
       QStringList mtlNameList{tokenList};
       mtlNameList.removeFirst();
-      QString fName{mtlNameList.join(" ")}; // если имя файла содержит пробелы
-      fName = fInfo.absolutePath() + QDir::separator() + fName;
-      loadMtl( fName );
+      chunk.names.append(mtlNameList.join(" ")); // если имя файла содержит пробелы
+      chunk.commands.append(ObjCommand{ObjCommand::MtlLib, chunk.names.size() - 1});
     }
     else if (  tokenList.first() == QString("o") ) {
-      if ( !vertexes.isEmpty() && !indexes.isEmpty() && mesh) {
-        mesh->create(vertexes, indexes);
-        meshs_.append(mesh);
-        vertexes.clear();
-        indexes.clear();
-      }
-      mesh = std::make_shared<Mesh>();
+      chunk.commands.append(ObjCommand{ObjCommand::Object, 0});
     }
     else if (tokenList.first() == QString("v")) { //вершинные координаты
-      coords.append( QVector3D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat()} );
+      chunk.coords.append( QVector3D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat()} );
     }
     else if (tokenList.first() == QString("vt")) { // техтурные координаты
-      texCoords.append( QVector2D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat()} );
+      chunk.texCoords.append( QVector2D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat()} );
     }
     else if (tokenList.first() == QString("vn")) { // нормали
-      normals.append( QVector3D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat()} );
+      chunk.normals.append( QVector3D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat()} );
     }
     else if ( tokenList.first() == QString("usemtl")) {
       QStringList matNameList{tokenList};
       matNameList.removeFirst();
-      QString materialName{matNameList.join(" ")}; // если имя материала содерит пробелы
-      if ( materialMap_.contains(materialName) ) {
-       std::shared_ptr<Material> material = materialMap_[materialName];
-       mesh->setMaterial(material);
-      }
-      else {
-        qDebug() << QString("Error material %1 not exists").arg(materialName);
-      }
-
+      chunk.names.append(matNameList.join(" ")); // если имя материала содерит пробелы
+      chunk.commands.append(ObjCommand{ObjCommand::UseMtl, chunk.names.size() - 1});
     }
     else if (tokenList.first() == QString("f")) { //индексы
+      ObjFace face;
       for ( int i = 1; i <= 3; i++ ) {
         auto vertex = tokenList.at(i).split("/");
-        //в obj файле порядок индексов идёт с 1. Переводим индексы.
-        vertexes.append(Vertex{ coords.at(vertex.at(0).toInt() - 1), texCoords.at(vertex.at(1).toInt() - 1), normals.at(vertex.at(2).toInt() - 1),});
-        indexes.append(indexes.size());
+        face.indexes[i - 1][0] = vertex.at(0).toInt();
+        face.indexes[i - 1][1] = vertex.at(1).toInt();
+        face.indexes[i - 1][2] = vertex.at(2).toInt();
       }
+      chunk.faces.append(face);
+      chunk.commands.append(ObjCommand{ObjCommand::Face, chunk.faces.size() - 1});
     }
   }
-  if ( !vertexes.isEmpty() && !indexes.isEmpty() ) {
-    mesh->create(vertexes, indexes);
-    meshs_.append(mesh);
-    vertexes.clear();
-    indexes.clear();
-  }
-  file.close();
+  chunk.text.clear();
 }
 
-void OGLObject::create(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+}
+
+OGLObject::OGLObject( const QString& path)
 {
-  meshs_.clear();
-  auto mesh = std::make_shared<Mesh>();
-  mesh->create(vertexes, indexes);
-  meshs_.append(mesh);
+  load(path);
 }
 
-void OGLObject::draw(QOpenGLShaderProgram& shader)
+OGLObject::OGLObject(QVector<Vertex>& vertexes, QVector<GLuint>& indexes )
 {
-  for( auto& mesh: meshs_ ) {
-    mesh->draw(shader);
-  }
+  create(vertexes, indexes);
 }
 
-void OGLObject::loadMtl(const QString& path)
+void OGLObject::load(const QString& path)
 {
-  qDebug() << "loadMTL" << path;
+  path_ = path;
+  // собранная заранее модель из архива ресурсов: без разбора текста и сборки мешей
+  const AssetArchive::Entry* entry = AssetArchive::instance().find(path, AssetArchive::Model);
+  if ( entry && loadArchived(*entry, path) ) {
+    return;
+  }
   QFile file{path};
   if ( !file.exists() ) {
     qDebug() << QString(" file %1 not exists ").arg(path);
     return;
   }
+  if ( file.size() > OutOfCoreModel::kFileSizeThreshold ) {
+    // целиком такой файл в память не читаем: куски появятся по мере подгрузки
+    outOfCore_.reset(new OutOfCoreModel(path));
+    return;
+  }
+  buildMeshes(path, meshs_);
+}
+
+bool OGLObject::buildMeshes(const QString& path, QVector< std::shared_ptr<Mesh> >& meshes)
+{
+  QStringList mtlLibraries;
+  QVector<ObjMesh> objMeshes;
+  if ( !parse(path, mtlLibraries, objMeshes) ) {
+    return false;
+  }
+  QVector<PendingMesh> pending = prepareMeshes(path, mtlLibraries, objMeshes);
+  QVector< std::shared_ptr<Mesh> > built = buildPending(pending, path);
+  uploadMeshes(path, built);
+  meshes += built;
+  return true;
+}
+
+QVector<OGLObject::PendingMesh> OGLObject::prepareMeshes(const QString& path, const QStringList& mtlLibraries,
+                                                          QVector<ObjMesh>& objMeshes)
+{
+  QString directory = QFileInfo(path).absolutePath();
+  for ( const auto& library : mtlLibraries ) {
+    QString libraryPath = directory + QDir::separator() + library;
+    if ( !libraries_.contains(libraryPath) ) {
+      loadMtl(libraryPath);
+    }
+  }
+  QVector<PendingMesh> pending;
+  for ( auto& objMesh : objMeshes ) {
+    auto mesh = std::make_shared<Mesh>();
+    if ( materialMap_.contains(objMesh.material) ) {
+      mesh->setMaterial(materialMap_.value(objMesh.material));
+    }
+    else if ( !objMesh.material.isEmpty() ) {
+      qDebug() << QString("Error material %1 not exists").arg(objMesh.material);
+    }
+    pending.append(PendingMesh{mesh, objMesh.vertexes, objMesh.indexes});
+  }
+  objMeshes.clear();
+  return pending;
+}
+
+QVector< std::shared_ptr<Mesh> > OGLObject::buildPending(QVector<PendingMesh>& pending, const QString& path)
+{
+  // склейка вершин и цепочки LOD считаются параллельно, загрузка в GPU - в потоке контекста
+  JobSystem::instance().parallelFor(pending.size(), 1, [&pending]( int begin, int end ) {
+    for ( int i = begin; i < end; i++ ) {
+      pending[i].mesh->build(pending[i].vertexes, pending[i].indexes);
+    }
+  });
+  QVector< std::shared_ptr<Mesh> > built;
+  QString owner = QFileInfo(path).fileName();
+  for ( auto& item : pending ) {
+    item.mesh->setOwner(owner);
+    built.append(item.mesh);
+  }
+  pending.clear();
+  // копии для буфера глубины снимаются с вершин в памяти, до того как upload() их освободит
+  selectOccluders(built);
+  return built;
+}
+
+void OGLObject::uploadMeshes(const QString& path, const QVector< std::shared_ptr<Mesh> >& meshes)
+{
+  VertexCacheStats before;
+  VertexCacheStats after;
+  for ( const auto& mesh : meshes ) {
+    mesh->upload();
+    before.add(mesh->cacheStatsBefore());
+    after.add(mesh->cacheStatsAfter());
+  }
+  qDebug() << QString("vertex cache %1: ACMR %2 -> %3, ATVR %4 -> %5").arg(path)
+              .arg(double(before.acmr()), 0, 'f', 3).arg(double(after.acmr()), 0, 'f', 3)
+              .arg(double(before.atvr()), 0, 'f', 3).arg(double(after.atvr()), 0, 'f', 3);
+}
+
+bool OGLObject::parse(const QString& path, QStringList& mtlLibraries, QVector<ObjMesh>& meshes)
+{
+  QFile file{path};
   if ( !file.open(QFile::ReadOnly) ) {
     qDebug() << QString(" file %1 not open ").arg(path);
-    return;
+    return false;
   }
-  QTextStream stream{&file};
-  std::shared_ptr<Material> material;
-  QFileInfo fInfo{file};
-  QString absolutePath{fInfo.absolutePath()} ;
+  QByteArray text = file.readAll();
+  file.close();
+
+  // куски разбираются параллельно, каждый со своими массивами
+  JobSystem& jobs = JobSystem::instance();
+  int chunkSize = qMax(kMinParseChunk, text.size() / (jobs.threadCount() * JobSystem::kChunksPerWorker) + 1);
+  QVector<ObjChunk> chunks;
+  for ( int begin = 0; begin < text.size(); ) {
+    int end = text.indexOf('\n', qMin(begin + chunkSize, text.size() - 1));
+    end = end < 0 ? text.size() : end + 1;
+    ObjChunk chunk;
+    chunk.text = text.mid(begin, end - begin);
+    chunks.append(chunk);
+    begin = end;
+  }
+  text.clear();
+  jobs.parallelFor(chunks.size(), 1, [&chunks]( int begin, int end ) {
+    for ( int i = begin; i < end; i++ ) {
+      parseObjChunk(chunks[i]);
+    }
+  });
 
-  auto filePathFromToken = [ &absolutePath = absolutePath ]( QStringList& fileNameList ) {
+  // индексы в obj сквозные по файлу, поэтому координаты просто склеиваются
+  QVector<QVector3D> coords;
+  QVector<QVector2D> texCoords;
+  QVector<QVector3D> normals;
+  for ( const auto& chunk : chunks ) {
+    coords += chunk.coords;
+    texCoords += chunk.texCoords;
+    normals += chunk.normals;
+  }
+
+  // треугольники до первого объекта достаются ему же
+  ObjMesh current;
+  bool hasObject = false;
+  for ( const auto& chunk : chunks ) {
+    for ( const auto& command : chunk.commands ) {
+      if ( command.type == ObjCommand::MtlLib ) {
+        mtlLibraries.append(chunk.names.at(command.index));
+      }
+      else if ( command.type == ObjCommand::Object ) {
+        if ( !current.vertexes.isEmpty() && !current.indexes.isEmpty() && hasObject ) {
+          meshes.append(current);
+          current = ObjMesh{};
+        }
+        current.material.clear();
+        hasObject = true;
+      }
+      else if ( command.type == ObjCommand::UseMtl ) {
+        current.material = chunk.names.at(command.index);
+      }
+      else {
+        const ObjFace& face = chunk.faces.at(command.index);
+        for ( const auto& vertex : face.indexes ) {
+          //в obj файле порядок индексов идёт с 1. Переводим индексы.
+          current.vertexes.append(Vertex{ coords.at(vertex[0] - 1), texCoords.at(vertex[1] - 1), normals.at(vertex[2] - 1),});
+          current.indexes.append(current.indexes.size());
+        }
+      }
+    }
+  }
+  if ( !current.vertexes.isEmpty() && !current.indexes.isEmpty() && hasObject ) {
+    meshes.append(current);
+  }
+  return true;
+}
+
+QVector<OGLObject::MtlMaterial> OGLObject::parseMtl(const QByteArray& text, const QString& directory)
+{
+  QVector<MtlMaterial> materials;
+  QTextStream stream{text};
+  auto filePathFromToken = [ &directory ]( QStringList& fileNameList ) {
     fileNameList.removeFirst();
     QString fName{fileNameList.join(" ")};
-    fName = absolutePath + QDir::separator() + fName;
+    fName = directory + QDir::separator() + fName;
     return fName;
   };
+  auto color = []( const QStringList& tokenList ) {
+    return QVector3D{tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat()};
+  };
 
   while( !stream.atEnd()) {
     QString line{stream.readLine()};
@@ -147,86 +367,550 @@ void OGLObject::loadMtl(const QString& path)
     else if (  tokenList.first() == QString("newmtl") ) {
       QStringList mNameList{tokenList};
       mNameList.removeFirst();
-      QString mName{mNameList.join(" ")}; //если имя содержит пробелы
-      material = std::make_shared<Material>(mName);
-      materialMap_.insert(mName, material);
+      MtlMaterial material;
+      material.name = mNameList.join(" "); //если имя содержит пробелы
+      materials.append(material);
+    }
+    else if ( materials.isEmpty() ) {
+      // параметры до первого newmtl не относятся ни к какому материалу
     }
     else if (tokenList.first() == QString("Ns")) {
-      if ( material ) {
-        material->setSpecularExponent(tokenList.at(1).toFloat());
-      }
+      materials.last().specularExponent = tokenList.at(1).toFloat();
     }
     else if (tokenList.first() == QString("Ka")) {
-      if ( material ) {
-        material->setAmbientColor(tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat());
-      }
+      materials.last().ambientColor = color(tokenList);
     }
     else if (tokenList.first() == QString("Kd")) {
-      if ( material ) {
-        material->setDiffuseColor(tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat());
-      }
+      materials.last().diffuseColor = color(tokenList);
     }
     else if (tokenList.first() == QString("Ks")) {
-      if ( material ) {
-        material->setSpecularColor(tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat());
-      }
+      materials.last().specularColor = color(tokenList);
     }
     else if (tokenList.first() == QString("Ke")) {
-      if ( material ) {
-        material->setEmissive(tokenList.at(1).toFloat(), tokenList.at(2).toFloat(), tokenList.at(3).toFloat());
-      }
+      materials.last().emissive = color(tokenList);
     }
     else if (tokenList.first() == QString("Ni")) {
-      if ( material ) {
-        material->setDensity(tokenList.at(1).toFloat());
-      }
+      materials.last().density = tokenList.at(1).toFloat();
     }
     else if (tokenList.first() == QString("d")) {
-      if ( material ) {
-        material->setTransparent(tokenList.at(1).toFloat());
-      }
+      materials.last().transparent = tokenList.at(1).toFloat();
     }
     else if (tokenList.first() == QString("illum")) {
-      if ( material ) {
-        material->setIllum(tokenList.at(1).toFloat());
-      }
+      materials.last().illum = tokenList.at(1).toFloat();
     }
     else if (tokenList.first() == QString("map_Kd")) { // albedo
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureAlbedo(tName);
-      }
+      materials.last().maps.append(MtlMap{Material::Albedo, filePathFromToken(tokenList)});
     }
     else if (tokenList.first() == QString("map_Bump")) {  // normal
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureNormal(tName);
-      }
+      materials.last().maps.append(MtlMap{Material::Normal, filePathFromToken(tokenList)});
     }
     else if (tokenList.first() == QString("map_Ks")) { // specular
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureSpecular(tName);
-      }
+      materials.last().maps.append(MtlMap{Material::Specular, filePathFromToken(tokenList)});
     }
     else if (tokenList.first() == QString("map_Pm")) { // metallic
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureMetallic(tName);
-      }
+      materials.last().maps.append(MtlMap{Material::Metallic, filePathFromToken(tokenList)});
     }
     else if (tokenList.first() == QString("map_Pr")) { // roughness
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureRoughness(tName);
-      }
+      materials.last().maps.append(MtlMap{Material::Roughness, filePathFromToken(tokenList)});
     }
     else if (tokenList.first() == QString("map_Ka")) { // AO
-      if ( material ) {
-        auto tName = filePathFromToken(tokenList);
-        material->loadTextureAmbientOcclusion(tName);
+      materials.last().maps.append(MtlMap{Material::AmbientOcclusion, filePathFromToken(tokenList)});
+    }
+  }
+  return materials;
+}
+
+QByteArray OGLObject::bake(const QString& path, GeometryCodec::Compression compression, GeometryCodec::Stats* stats)
+{
+  QStringList mtlLibraries;
+  QVector<ObjMesh> objMeshes;
+  if ( !parse(path, mtlLibraries, objMeshes) ) {
+    return QByteArray();
+  }
+  // материал нужен только как признак: по нему build() считает касательные
+  QVector< std::shared_ptr<Mesh> > meshes;
+  for ( const auto& objMesh : objMeshes ) {
+    auto mesh = std::make_shared<Mesh>();
+    if ( !objMesh.material.isEmpty() ) {
+      mesh->setMaterial(std::make_shared<Material>(objMesh.material));
+    }
+    meshes.append(mesh);
+  }
+  // сжатие - в тех же задачах, что и сборка
+  QVector<QByteArray> vertexStreams(meshes.size());
+  QVector<QByteArray> indexStreams(meshes.size());
+  QVector<GeometryCodec::Compression> vertexCompression(meshes.size(), compression);
+  QVector<GeometryCodec::Compression> indexCompression(meshes.size(), compression);
+  JobSystem::instance().parallelFor(meshes.size(), 1, [&]( int begin, int end ) {
+    for ( int i = begin; i < end; i++ ) {
+      meshes[i]->build(objMeshes[i].vertexes, objMeshes[i].indexes);
+      objMeshes[i].vertexes = QVector<Vertex>{};
+      objMeshes[i].indexes = QVector<GLuint>{};
+      const QVector<Vertex>& vertexes = meshes[i]->builtVertexes();
+      const QVector<GLuint>& indexes = meshes[i]->builtIndexes();
+      vertexStreams[i] = GeometryCodec::compress(
+            GeometryCodec::encodeVertexes(vertexes.constData(), vertexes.size(), int(sizeof(Vertex))),
+            vertexCompression[i]);
+      indexStreams[i] = GeometryCodec::compress(GeometryCodec::encodeIndexes(indexes.constData(), indexes.size()),
+                                                indexCompression[i]);
+    }
+  });
+
+  // в начале смещение метаданных, дальше потоки мешей, в конце метаданные
+  QByteArray data(AssetArchive::kAlignment, '\0');
+  QByteArray metadata;
+  QDataStream stream{&metadata, QIODevice::WriteOnly};
+  stream << kModelVersion << mtlLibraries << qint32(meshes.size());
+  for ( int i = 0; i < meshes.size(); i++ ) {
+    const Mesh& mesh = *meshes.at(i);
+    quint64 vertexOffset = quint64(data.size());
+    data.append(vertexStreams.at(i));
+    quint64 indexOffset = quint64(data.size());
+    data.append(indexStreams.at(i));
+    stream << objMeshes.at(i).material << qint32(mesh.builtVertexes().size()) << qint32(mesh.builtIndexes().size())
+           << vertexOffset << qint32(vertexStreams.at(i).size()) << quint8(vertexCompression.at(i))
+           << indexOffset << qint32(indexStreams.at(i).size()) << quint8(indexCompression.at(i));
+    mesh.writeMetadata(stream);
+    if ( stats ) {
+      stats->rawBytes += qint64(mesh.builtVertexes().size()) * qint64(sizeof(Vertex))
+                         + qint64(mesh.builtIndexes().size()) * qint64(sizeof(GLuint));
+      stats->encodedBytes += vertexStreams.at(i).size() + indexStreams.at(i).size();
+    }
+  }
+  quint64 metadataOffset = quint64(data.size());
+  std::memcpy(data.data(), &metadataOffset, sizeof(metadataOffset));
+  data.append(metadata);
+  return data;
+}
+
+bool OGLObject::loadArchived(const AssetArchive::Entry& entry, const QString& path)
+{
+  AssetArchive& archive = AssetArchive::instance();
+  const char* data = reinterpret_cast<const char*>(archive.data(entry));
+  quint64 metadataOffset = 0;
+  if ( entry.size < sizeof(metadataOffset) ) {
+    return false;
+  }
+  std::memcpy(&metadataOffset, data, sizeof(metadataOffset));
+  if ( metadataOffset >= entry.size ) {
+    return false;
+  }
+  QByteArray metadata = QByteArray::fromRawData(data + metadataOffset, int(entry.size - metadataOffset));
+  QDataStream stream{metadata};
+  qint32 version = 0;
+  QStringList mtlLibraries;
+  qint32 meshCount = 0;
+  stream >> version >> mtlLibraries >> meshCount;
+  if ( stream.status() != QDataStream::Ok || (version != kModelVersion && version != kRawModelVersion) ) {
+    qDebug() << QString("archived model %1 has wrong format").arg(archive.name(entry));
+    return false;
+  }
+  QString directory = QFileInfo(path).absolutePath();
+  for ( const auto& library : mtlLibraries ) {
+    loadMtl(directory + QDir::separator() + library);
+  }
+  QString owner = QFileInfo(path).fileName();
+  VertexCacheStats after;
+  // массивы под распакованные меши, общие для всех мешей модели
+  QVector<Vertex> decodedVertexes;
+  QVector<GLuint> decodedIndexes;
+  GeometryCodec::Stats decoded;
+  QElapsedTimer decodeTimer;
+  qint64 decodeNs = 0;
+  for ( int i = 0; i < meshCount; i++ ) {
+    QString material;
+    stream >> material;
+    const Vertex* vertexes = nullptr;
+    int vertexCount = 0;
+    const GLuint* indexes = nullptr;
+    int indexCount = 0;
+    bool ok = false;
+    // архив отображён до конца работы программы: после выгрузки из видеопамяти меш
+    // загружается снова прямо из него
+    Mesh::Source source;
+    if ( version == kRawModelVersion ) {
+      ok = readRawGeometry(stream, data, metadataOffset, vertexes, vertexCount, indexes, indexCount);
+      source = [vertexes, vertexCount, indexes, indexCount]( QVector<Vertex>& sourceVertexes, QVector<GLuint>& sourceIndexes ) {
+        sourceVertexes.resize(vertexCount);
+        std::copy(vertexes, vertexes + vertexCount, sourceVertexes.begin());
+        sourceIndexes.resize(indexCount);
+        std::copy(indexes, indexes + indexCount, sourceIndexes.begin());
+        return true;
+      };
+    }
+    else {
+      EncodedGeometry geometry;
+      decodeTimer.start();
+      ok = readEncodedGeometry(stream, metadataOffset, geometry)
+           && decodeGeometry(data, geometry, decodedVertexes, decodedIndexes);
+      decodeNs += decodeTimer.nsecsElapsed();
+      if ( ok ) {
+        decoded.rawBytes += qint64(geometry.vertexCount) * qint64(sizeof(Vertex))
+                            + qint64(geometry.indexCount) * qint64(sizeof(GLuint));
+        decoded.encodedBytes += geometry.vertexBytes + geometry.indexBytes;
       }
+      vertexes = decodedVertexes.constData();
+      vertexCount = decodedVertexes.size();
+      indexes = decodedIndexes.constData();
+      indexCount = decodedIndexes.size();
+      source = [data, geometry]( QVector<Vertex>& sourceVertexes, QVector<GLuint>& sourceIndexes ) {
+        return decodeGeometry(data, geometry, sourceVertexes, sourceIndexes);
+      };
     }
+    if ( !ok ) {
+      qDebug() << QString("archived model %1 has wrong format").arg(archive.name(entry));
+      meshs_.clear();
+      return false;
+    }
+    auto mesh = std::make_shared<Mesh>();
+    mesh->setSource(std::move(source));
+    if ( materialMap_.contains(material) ) {
+      mesh->setMaterial(materialMap_.value(material));
+    }
+    else if ( !material.isEmpty() ) {
+      qDebug() << QString("Error material %1 not exists").arg(material);
+    }
+    mesh->setOwner(owner);
+    if ( !mesh->restore(stream, vertexes, vertexCount, indexes, indexCount) ) {
+      qDebug() << QString("archived model %1 has wrong format").arg(archive.name(entry));
+      meshs_.clear();
+      return false;
+    }
+    meshs_.append(mesh);
+    after.add(mesh->cacheStatsAfter());
   }
-  file.close();
+  QString message = QString("archived model %1: %2 meshes, ACMR %3").arg(archive.name(entry)).arg(meshs_.size())
+                    .arg(double(after.acmr()), 0, 'f', 3);
+  if ( decoded.rawBytes > 0 ) {
+    message += QString(", geometry %1 KB -> %2 KB (x%3), decoded in %4 ms (%5 GB/s)")
+               .arg(decoded.encodedBytes / 1024).arg(decoded.rawBytes / 1024).arg(decoded.ratio(), 0, 'f', 2)
+               .arg(double(decodeNs) / 1.0e6, 0, 'f', 2)
+               .arg(decodeNs > 0 ? double(decoded.rawBytes) / double(decodeNs) : 0.0, 0, 'f', 2);
+  }
+  qDebug() << message;
+  selectOccluders(meshs_);
+  return true;
+}
+
+void OGLObject::create(QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  meshs_.clear();
+  auto mesh = std::make_shared<Mesh>();
+  mesh->build(vertexes, indexes);
+  meshs_.append(mesh);
+  selectOccluders(meshs_);
+  mesh->upload();
+}
+
+void OGLObject::draw(QOpenGLShaderProgram& shader)
+{
+  draw(shader, nullptr, QMatrix4x4{}, DrawView{});
+}
+
+void OGLObject::draw(QOpenGLShaderProgram& shader, OcclusionCuller* culler, const QMatrix4x4& model, const DrawView& view)
+{
+  trianglesDrawn_ = 0;
+  trianglesSaved_ = 0;
+  meshletTriangles_ = 0;
+  meshletTrianglesVisible_ = 0;
+  // кластеры проверяем в пространстве модели: так не нужно пересчитывать их сферы и конусы
+  bool meshletCulling = view.meshletCulling && view.arena;
+  Frustum frustum;
+  QVector3D cameraPosition;
+  if ( meshletCulling ) {
+    frustum = Frustum{view.viewProjection * model};
+    cameraPosition = model.inverted().map(view.position);
+  }
+  for( auto& mesh: meshs_ ) {
+    if ( culler && !culler->isVisible(mesh->bounds(), model) ) {
+      continue;
+    }
+    int lod = mesh->selectLod(model, view);
+    if ( lod == 0 && meshletCulling && mesh->meshletCount() > 0 ) {
+      ArenaVector<GLsizei> counts{ArenaAllocator<GLsizei>(view.arena)};
+      ArenaVector<const void*> offsets{ArenaAllocator<const void*>(view.arena)};
+      counts.reserve(size_t(mesh->meshletCount()));
+      offsets.reserve(size_t(mesh->meshletCount()));
+      int visible = mesh->cullMeshlets(frustum, cameraPosition, counts, offsets);
+      mesh->drawRanges(shader, counts, offsets);
+      meshletTriangles_ += mesh->lodTriangleCount(0);
+      meshletTrianglesVisible_ += visible;
+      trianglesDrawn_ += visible;
+      continue;
+    }
+    mesh->draw(shader, lod);
+    trianglesDrawn_ += mesh->lodTriangleCount(lod);
+    trianglesSaved_ += mesh->lodTriangleCount(0) - mesh->lodTriangleCount(lod);
+  }
+}
+
+bool OGLObject::updateStreaming(const QMatrix4x4& model, const DrawView& view)
+{
+  if ( !outOfCore_ ) {
+    return false;
+  }
+  bool wasReady = outOfCore_->isReady();
+  bool changed = outOfCore_->update(model, view);
+  if ( !wasReady && outOfCore_->isReady() ) {
+    QString directory = QFileInfo(path_).absolutePath();
+    for ( const auto& library : outOfCore_->mtlLibraries() ) {
+      loadMtl(directory + QDir::separator() + library);
+    }
+    QVector< std::shared_ptr<Material> > materials;
+    for ( const auto& name : outOfCore_->materialNames() ) {
+      if ( !materialMap_.contains(name) ) {
+        qDebug() << QString("Error material %1 not exists").arg(name);
+      }
+      materials.append(materialMap_.value(name));
+    }
+    outOfCore_->setMaterials(materials);
+  }
+  if ( changed ) {
+    meshs_ = outOfCore_->meshes();
+  }
+  return changed;
+}
+
+void OGLObject::addOccluders(OcclusionCuller& culler, const QMatrix4x4& model)
+{
+  for( auto& mesh: meshs_ ) {
+    if ( mesh->isOccluder() ) {
+      culler.addOccluder(mesh->occluderPositions(), mesh->occluderIndexes(), model);
+    }
+  }
+}
+
+BoundingBox OGLObject::bounds() const
+{
+  if ( outOfCore_ ) {
+    return outOfCore_->bounds();
+  }
+  BoundingBox box;
+  for( auto& mesh: meshs_ ) {
+    box.extend(mesh->bounds());
+  }
+  return box;
+}
+
+void OGLObject::drawDepth(QOpenGLShaderProgram& shader)
+{
+  for( auto& mesh: meshs_ ) {
+    mesh->drawDepth(shader);
+  }
+}
+
+void OGLObject::loadMtl(const QString& path, bool reload)
+{
+  qDebug() << "loadMTL" << path;
+  if ( !libraries_.contains(path) ) {
+    libraries_.append(path);
+  }
+  AssetArchive& archive = AssetArchive::instance();
+  // при перезагрузке копия в архиве уже устарела
+  QByteArray text = reload ? QByteArray() : archive.text(path);
+  if ( text.isNull() ) {
+    QFile file{path};
+    if ( !file.exists() ) {
+      qDebug() << QString(" file %1 not exists ").arg(path);
+      return;
+    }
+    if ( !file.open(QFile::ReadOnly) ) {
+      qDebug() << QString(" file %1 not open ").arg(path);
+      return;
+    }
+    text = file.readAll();
+    file.close();
+  }
+  QVector<TextureBinding> textures;
+  for ( const auto& parsed : parseMtl(text, QFileInfo(path).absolutePath()) ) {
+    // меши держат материал по указателю, поэтому при перезагрузке он меняется на месте
+    std::shared_ptr<Material> material = reload ? materialMap_.value(parsed.name) : nullptr;
+    if ( !material ) {
+      material = std::make_shared<Material>(parsed.name);
+      materialMap_.insert(parsed.name, material);
+    }
+    material->setSpecularExponent(parsed.specularExponent);
+    material->setAmbientColor(parsed.ambientColor);
+    material->setDiffuseColor(parsed.diffuseColor);
+    material->setSpecularColor(parsed.specularColor);
+    material->setEmissive(parsed.emissive);
+    material->setDensity(parsed.density);
+    material->setTransparent(parsed.transparent);
+    material->setIllum(parsed.illum);
+    for ( const auto& map : parsed.maps ) {
+      textures.append(TextureBinding{material, map.type, map.path, path});
+    }
+  }
+  // изображения и цепочки мипов готовятся в рабочих потоках и без ожидания:
+  // модель рисуется сразу, текстуры появляются по мере готовности.
+  // Из архива цепочка мипов уже готова и не копируется - её сразу получает материал
+  auto findBinding = [this]( const TextureBinding& binding ) {
+    for ( int i = 0; i < textures_.size(); i++ ) {
+      if ( textures_.at(i).material == binding.material && textures_.at(i).type == binding.type ) {
+        return i;
+      }
+    }
+    return -1;
+  };
+  QVector<TextureBinding> requests;
+  for ( const auto& binding : textures ) {
+    int index = findBinding(binding);
+    if ( index < 0 ) {
+      textures_.append(binding);
+    }
+    else if ( textures_.at(index).path != binding.path ) {
+      textures_[index] = binding;
+    }
+    else {
+      // та же текстура, что уже загружена
+      continue;
+    }
+    requests.append(binding);
+  }
+  if ( reload ) {
+    // текстуры, которых в файле больше нет, снимаются с материалов
+    for ( int i = textures_.size() - 1; i >= 0; i-- ) {
+      const TextureBinding& binding = textures_.at(i);
+      bool listed = false;
+      for ( const auto& other : textures ) {
+        listed = listed || (other.material == binding.material && other.type == binding.type);
+      }
+      if ( binding.library == path && !listed ) {
+        binding.material->setTexture(binding.type, QVector<QImage>());
+        textures_.remove(i);
+      }
+    }
+  }
+  JobSystem& jobs = JobSystem::instance();
+  for ( const auto& request : requests ) {
+    const AssetArchive::Entry* entry = reload ? nullptr : archive.find(request.path, AssetArchive::Texture);
+    if ( entry && entry->format == AssetArchive::RGBA8 ) {
+      request.material->setTexture(request.type, archive.mipChain(*entry));
+      continue;
+    }
+    jobs.run(jobs.create([&jobs, request] {
+      QVector<QImage> mips = StreamedTexture::buildMipChain(QImage{request.path});
+      jobs.runOnMainThread([request, mips] {
+        request.material->setTexture(request.type, mips);
+      });
+    }));
+  }
+}
+
+QStringList OGLObject::texturePaths() const
+{
+  QStringList paths;
+  for ( const auto& binding : textures_ ) {
+    if ( !paths.contains(binding.path) ) {
+      paths.append(binding.path);
+    }
+  }
+  return paths;
+}
+
+void OGLObject::reloadGeometry(std::function<void(bool)> finished)
+{
+  if ( outOfCore_ ) {
+    qDebug() << QString("streamed model %1 is not reloaded").arg(path_);
+    finished(false);
+    return;
+  }
+  // новая перезагрузка отменяет недоделанную, удаление объекта - любую
+  int generation = ++*reloadGeneration_;
+  std::weak_ptr<int> token = reloadGeneration_;
+  QString path = path_;
+  OGLObject* self = this;
+  JobSystem& jobs = JobSystem::instance();
+  // разбор - фоновая задача; mtl-библиотеки и материалы - в главном потоке, сборка мешей -
+  // снова в фоне. Готовые меши ждут applyReloadedGeometry(), кадр их не видит
+  jobs.runBackground(jobs.create([&jobs, self, token, generation, path, finished] {
+    auto mtlLibraries = std::make_shared<QStringList>();
+    auto objMeshes = std::make_shared< QVector<ObjMesh> >();
+    bool parsed = parse(path, *mtlLibraries, *objMeshes) && !objMeshes->isEmpty();
+    jobs.runOnMainThread([&jobs, self, token, generation, path, finished, parsed, mtlLibraries, objMeshes] {
+      std::shared_ptr<int> current = token.lock();
+      if ( !current || *current != generation ) {
+        return;
+      }
+      if ( !parsed ) {
+        qDebug() << QString("reload of %1 failed, previous meshes are kept").arg(path);
+        finished(false);
+        return;
+      }
+      auto pending = std::make_shared< QVector<PendingMesh> >(self->prepareMeshes(path, *mtlLibraries, *objMeshes));
+      jobs.runBackground(jobs.create([&jobs, self, token, generation, path, finished, pending] {
+        QVector< std::shared_ptr<Mesh> > built = buildPending(*pending, path);
+        jobs.runOnMainThread([self, token, generation, finished, built] {
+          std::shared_ptr<int> current = token.lock();
+          if ( !current || *current != generation ) {
+            return;
+          }
+          self->reloadedMeshs_ = built;
+          finished(true);
+        });
+      }));
+    });
+  }));
+}
+
+bool OGLObject::applyReloadedGeometry()
+{
+  if ( reloadedMeshs_.isEmpty() ) {
+    return false;
+  }
+  uploadMeshes(path_, reloadedMeshs_);
+  // старые меши и их буферы освобождаются здесь же, до следующего кадра
+  meshs_.swap(reloadedMeshs_);
+  reloadedMeshs_.clear();
+  return true;
+}
+
+void OGLObject::reloadMaterials(const QString& library)
+{
+  loadMtl(library, true);
+}
+
+void OGLObject::reloadTexture(const QString& path, std::function<void(bool)> finished)
+{
+  QVector<TextureBinding> bindings;
+  for ( const auto& binding : textures_ ) {
+    if ( binding.path == path ) {
+      bindings.append(binding);
+    }
+  }
+  if ( bindings.isEmpty() ) {
+    finished(false);
+    return;
+  }
+  JobSystem& jobs = JobSystem::instance();
+  jobs.run(jobs.create([&jobs, bindings, path, finished] {
+    QVector<QImage> mips = StreamedTexture::buildMipChain(QImage{path});
+    jobs.runOnMainThread([bindings, mips, finished] {
+      // недописанный или битый файл не декодируется - остаётся прежняя текстура
+      if ( !mips.isEmpty() ) {
+        for ( const auto& binding : bindings ) {
+          binding.material->setTexture(binding.type, mips);
+        }
+      }
+      finished(!mips.isEmpty());
+    });
+  }));
+}
+
+void OGLObject::selectOccluders(QVector< std::shared_ptr<Mesh> >& meshes)
+{
+  BoundingBox box;
+  for( auto& mesh: meshes ) {
+    box.extend(mesh->bounds());
+  }
+  float objectSize = box.size().length();
+  int count = 0;
+  for( auto& mesh: meshes ) {
+    bool large = mesh->bounds().size().length() >= objectSize * kOccluderSizeFraction;
+    mesh->setOccluder(mesh->isOccluder() && large);
+    if ( mesh->isOccluder() ) {
+      count++;
+    }
+  }
+  qDebug() << QString("occluders %1 of %2 meshes").arg(count).arg(meshes.size());
 }
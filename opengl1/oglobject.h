@@ -1,6 +1,7 @@
 #ifndef OGLOBJECT_H
 #define OGLOBJECT_H
 
+#include <functional>
 #include <memory>
 
 #include <QOpenGLBuffer>
@@ -9,25 +10,128 @@
 #include "structs.h"
 #include "material.h"
 #include "mesh.h"
+#include "occlusionculler.h"
+#include "outofcoremodel.h"
+#include "assetarchive.h"
+#include "geometrycodec.h"
 
 class OGLObject
 {
 public:
+  // меш obj-файла до сборки: имя материала и треугольники как в файле
+  struct ObjMesh {
+    QString material;
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+  };
+  // материал mtl-файла до создания текстур; пути карт - полные
+  struct MtlMap {
+    Material::TextureType type;
+    QString path;
+  };
+  struct MtlMaterial {
+    QString name;
+    float specularExponent = 0.0f;
+    float density = 1.0f;
+    float transparent = 1.0f;
+    float illum = 0.0f;
+    QVector3D ambientColor;
+    QVector3D diffuseColor;
+    QVector3D specularColor;
+    QVector3D emissive;
+    QVector<MtlMap> maps;
+  };
+  // текстура материала и mtl-файл, где она задана: по ним перезагрузка находит, что менять
+  struct TextureBinding {
+    std::shared_ptr<Material> material;
+    Material::TextureType type;
+    QString path;
+    QString library;
+  };
+
   OGLObject( const QString& path );
   OGLObject(QVector<Vertex>& vertexes, QVector<GLuint>& indexes );
 
   void load( const QString& path );
   void create(QVector<Vertex>& vertexes, QVector<GLuint>& indexes  );
   void draw( QOpenGLShaderProgram& shader );
+  void draw( QOpenGLShaderProgram& shader, OcclusionCuller* culler, const QMatrix4x4& model, const DrawView& view );
+  void addOccluders( OcclusionCuller& culler, const QMatrix4x4& model );
+  BoundingBox bounds() const;
+  const QVector< std::shared_ptr<Mesh> >& meshes() const { return meshs_; }
+  void drawDepth( QOpenGLShaderProgram& shader );
+  int trianglesDrawn() const { return trianglesDrawn_; }
+  int trianglesSaved() const { return trianglesSaved_; }
+  int meshletTriangles() const { return meshletTriangles_; }
+  int meshletTrianglesVisible() const { return meshletTrianglesVisible_; }
+  // модели из очень больших файлов подгружаются кусками по камере (см. OutOfCoreModel)
+  bool isStreaming() const { return outOfCore_ != nullptr; }
+  const OutOfCoreModel* outOfCore() const { return outOfCore_.get(); }
+  // раз в кадр в потоке контекста; true - сменился набор мешей или границы объекта
+  bool updateStreaming( const QMatrix4x4& model, const DrawView& view );
+
+  // файлы модели для горячей перезагрузки: obj, mtl-библиотеки и текстуры (полные пути)
+  const QString& path() const { return path_; }
+  const QStringList& materialLibraries() const { return libraries_; }
+  QStringList texturePaths() const;
+  // перезагрузка с диска: разбор и сборка мешей - в рабочих потоках, finished(ok) - в главном.
+  // После finished(true) новые меши ждут applyReloadedGeometry(), при ошибке остаются прежние
+  void reloadGeometry( std::function<void(bool)> finished );
+  // в потоке контекста между кадрами: загрузка в GPU и подмена старых мешей одним присваиванием
+  bool applyReloadedGeometry();
+  // параметры материалов обновляются на месте, заново грузятся только текстуры со сменившимся путём
+  void reloadMaterials( const QString& library );
+  // изображение декодируется в рабочем потоке и подменяется в главном, там же finished(ok)
+  void reloadTexture( const QString& path, std::function<void(bool)> finished );
+
+  // разбор obj-файла без обращений к GL
+  static bool parse( const QString& path, QStringList& mtlLibraries, QVector<ObjMesh>& meshes );
+  // то же для mtl; directory - каталог файла, от него считаются пути карт
+  static QVector<MtlMaterial> parseMtl( const QByteArray& text, const QString& directory );
+  // модель для архива ресурсов: меши собраны (склейка, кластеры, LOD), вершины и индексы
+  // сжаты GeometryCodec (с Deflate - ещё и zlib), в stats добавляются размеры до и после
+  static QByteArray bake( const QString& path, GeometryCodec::Compression compression = GeometryCodec::NoCompression,
+                          GeometryCodec::Stats* stats = nullptr );
 
 private:
-  void loadMtl(const QString& path);
+  // меш между разбором и сборкой: материал уже назначен
+  struct PendingMesh
+  {
+    std::shared_ptr<Mesh> mesh;
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+  };
+
+  bool loadArchived( const AssetArchive::Entry& entry, const QString& path );
+  // разбор obj, сборка мешей и загрузка в GPU; ещё не загруженные mtl подгружаются
+  bool buildMeshes( const QString& path, QVector< std::shared_ptr<Mesh> >& meshes );
+  // в главном потоке: подгрузка mtl и материалы мешей
+  QVector<PendingMesh> prepareMeshes( const QString& path, const QStringList& mtlLibraries, QVector<ObjMesh>& objMeshes );
+  // без обращений к GL и к объекту - можно из рабочих потоков
+  static QVector< std::shared_ptr<Mesh> > buildPending( QVector<PendingMesh>& pending, const QString& path );
+  static void uploadMeshes( const QString& path, const QVector< std::shared_ptr<Mesh> >& meshes );
+  // reload - файл перечитывается с диска мимо архива, материалы с теми же именами переиспользуются
+  void loadMtl(const QString& path, bool reload = false);
+  // оставляет кандидатами в окклюдеры только крупные меши; до upload(), пока вершины в памяти
+  static void selectOccluders( QVector< std::shared_ptr<Mesh> >& meshes );
 
 private:
   QOpenGLBuffer VBO_;
   QOpenGLBuffer EBO_{QOpenGLBuffer::IndexBuffer};
   QMap<QString, std::shared_ptr<Material> > materialMap_;
   QVector< std::shared_ptr<Mesh> > meshs_;
+  int trianglesDrawn_ = 0;
+  int trianglesSaved_ = 0;
+  int meshletTriangles_ = 0;
+  int meshletTrianglesVisible_ = 0;
+  QString path_;
+  QStringList libraries_;
+  QVector<TextureBinding> textures_;
+  std::unique_ptr<OutOfCoreModel> outOfCore_;
+  // собранные перезагрузкой меши до applyReloadedGeometry()
+  QVector< std::shared_ptr<Mesh> > reloadedMeshs_;
+  // номер последней перезагрузки; задачи держат weak_ptr и после удаления объекта ничего не делают
+  std::shared_ptr<int> reloadGeneration_ = std::make_shared<int>(0);
 
 
 };
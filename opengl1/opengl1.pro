@@ -9,6 +9,11 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 CONFIG += c++17
 
+# счётчик обращений к куче за кадр (подмена malloc, только glibc)
+CONFIG(debug, debug|release): DEFINES += HEAP_ALLOCATION_COUNTER
+# шейдеры из исходников с горячей перезагрузкой (только отладочная сборка)
+CONFIG(debug, debug|release): DEFINES += HOT_RELOAD_SOURCE_DIR=\\\"$$PWD\\\"
+
 SOURCES += \
         main.cpp \
         openglwidget.cpp \
@@ -17,7 +22,35 @@ SOURCES += \
         structs.cpp \
         oglobject.cpp \
     mesh.cpp \
-    material.cpp
+    material.cpp \
+    framestats.cpp \
+    shadowmap.cpp \
+    occlusionculler.cpp \
+    meshsimplifier.cpp \
+    meshlet.cpp \
+    indexoptimizer.cpp \
+    framearena.cpp \
+    gpuringbuffer.cpp \
+    drawlist.cpp \
+    jobsystem.cpp \
+    texturestreamer.cpp \
+    gpumemory.cpp \
+    outofcoremodel.cpp \
+    assetarchive.cpp \
+    simdmath.cpp \
+    transformhierarchy.cpp \
+    scene.cpp \
+    hotreload.cpp \
+    bvh.cpp \
+    cpuscene.cpp \
+    pathtracer.cpp \
+    rasterizer.cpp \
+    framegraph.cpp \
+    framesetup.cpp \
+    tonemap.cpp \
+    debugdraw.cpp \
+    resolutionscaler.cpp \
+    geometrycodec.cpp
 
 HEADERS += \
         openglwidget.h \
@@ -26,7 +59,36 @@ HEADERS += \
         structs.h \
         oglobject.h \
     mesh.h \
-    material.h
+    material.h \
+    framestats.h \
+    shadowmap.h \
+    occlusionculler.h \
+    meshsimplifier.h \
+    meshlet.h \
+    indexoptimizer.h \
+    framearena.h \
+    gpuringbuffer.h \
+    drawlist.h \
+    jobsystem.h \
+    texturestreamer.h \
+    gpumemory.h \
+    outofcoremodel.h \
+    assetarchive.h \
+    simdmath.h \
+    transformhierarchy.h \
+    scene.h \
+    hotreload.h \
+    bvh.h \
+    simd4.h \
+    cpuscene.h \
+    pathtracer.h \
+    rasterizer.h \
+    framegraph.h \
+    framesetup.h \
+    tonemap.h \
+    debugdraw.h \
+    resolutionscaler.h \
+    geometrycodec.h
 
 FORMS += \
         openglwidget.ui \
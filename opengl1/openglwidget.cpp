@@ -1,10 +1,24 @@
 #include "openglwidget.h"
 #include "ui_openglwidget.h"
+#include "jobsystem.h"
+#include "texturestreamer.h"
+#include "assetarchive.h"
 
+#include <QCoreApplication>
 #include <QDebug>
 #include <QKeyEvent>
 #include <QtMath>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <QPainter>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
 
 static const float kCubeWidth = 1.0f;
 static const float kFloorWidth = 10.0f;
@@ -17,6 +31,48 @@ static const QVector<QString> kSkyBoxPaths{":/textures/cubes/skybox/right.jpg",
                                            ":/textures/cubes/skybox/front.jpg",
                                            ":/textures/cubes/skybox/back.jpg"};
 static const int kPosLightCount = 4;
+static const QVector3D kLightDirection{0.55f, -1.0f, 1.0f};
+static const QVector3D kContainerPos1{1.0f, 0.0f, -3.0f};
+static const QVector3D kContainerPos2{2.0f, 0.0f, -2.0f};
+static const int kShadowMapResolution = 2048;
+static const int kShadowTextureUnit = 5;
+// экземпляры источников и отладочная геометрия (до DebugDraw::kMaxVertices за кадр)
+static const GLsizeiptr kRingBufferSize = 8 * 1024 * 1024;
+// атрибуты экземпляра в vLightShader.vert: mat4 занимает 4 слота
+static const int kLightModelLocation = 5;
+static const int kLightColorLocation = 9;
+// нагрузочная сцена: сетка копий загруженного объекта, шаг - в размерах объекта
+static const int kInstanceGridSize = 224;
+static const float kInstanceGridSpacing = 1.5f;
+// загруженные модели встают в ряд вдоль X
+static const float kModelSpacing = 3.0f;
+// эталонный кадр: проходов накопления, промежуточный результат - каждые kReferenceSaveEvery
+static const int kReferencePasses = 256;
+static const int kReferenceSaveEvery = 32;
+static const float kBloomStrength = 0.04f;
+// сила повышения резкости при растяжении уменьшенного кадра
+static const float kUpscaleSharpness = 0.25f;
+// у контейнеров и пола нет PBR-материала, для эталона - матовое дерево
+static const float kPrimitiveRoughness = 0.6f;
+// отладочный вывод: сфера источника - где его свет ослаб вдвое
+static const float kDebugLightFalloff = 0.5f;
+static const float kDebugLabelHeight = 0.15f;
+static const float kDebugNormalLength = 0.1f;
+static const int kDebugBvhDepth = 6;
+static const QVector3D kDebugBoundsColor{0.2f, 1.0f, 0.2f};
+static const QVector3D kDebugNormalColor{0.3f, 0.6f, 1.0f};
+static const QVector3D kDebugSunColor{1.0f, 0.9f, 0.4f};
+static const QVector3D kDebugBvhRootColor{1.0f, 0.3f, 0.1f};
+static const QVector3D kDebugBvhLeafColor{0.1f, 0.3f, 1.0f};
+static const QVector3D kDebugCascadeColors[]{QVector3D{1.0f, 0.2f, 0.2f}, QVector3D{1.0f, 1.0f, 0.2f},
+                                             QVector3D{0.2f, 1.0f, 1.0f}, QVector3D{1.0f, 0.2f, 1.0f}};
+static const QVector3D kModelSpinAxis{1.0f, 1.0f, 0.0f};
+// каталог исходников проекта: оттуда в отладочной сборке берутся шейдеры для горячей перезагрузки
+#ifdef HOT_RELOAD_SOURCE_DIR
+static const QString kShaderSourceDir = QString(HOT_RELOAD_SOURCE_DIR);
+#else
+static const QString kShaderSourceDir;
+#endif
 
 static QVector<QVector3D> pointLightPositions{
     QVector3D{  1.0f,  0.0f,  1.0f },
@@ -26,6 +82,38 @@ static QVector<QVector3D> pointLightPositions{
 };
 
 
+// имена uniform-переменных точечных источников собираются один раз, а не при каждой установке
+static const QVector<PointLightUniforms>& pointLightUniforms()
+{
+  static const QVector<PointLightUniforms> uniforms = [] {
+    QVector<PointLightUniforms> result;
+    for ( int i = 0; i < kPosLightCount; i++ ) {
+      result.append(PointLightUniforms::forLight(i));
+    }
+    return result;
+  }();
+  return uniforms;
+}
+
+static void copyPositions(const QVector<Vertex>& vertexes, QVector<QVector3D>& positions, QVector<GLuint>& indexes)
+{
+  positions.clear();
+  indexes.clear();
+  for ( const auto& vertex : vertexes ) {
+    indexes.append(GLuint(positions.size()));
+    positions.append(vertex.position);
+  }
+}
+
+// грани неба для рендеров на CPU, в порядке kSkyBoxPaths
+static QVector<QImage> loadSkyBoxFaces()
+{
+  QVector<QImage> faces;
+  for ( const auto& path : kSkyBoxPaths ) {
+    faces.append(QImage(path));
+  }
+  return faces;
+}
 
 OpenglWidget::OpenglWidget(QWidget *parent) :
   QOpenGLWidget(parent),
@@ -45,11 +133,18 @@ OpenglWidget::OpenglWidget(QWidget *parent) :
 OpenglWidget::~OpenglWidget()
 {
   makeCurrent();
+  ringBuffer_.destroy();
+  frameGraph_.destroy();
+  for ( int id : sceneMemory_ ) {
+    GpuMemory::instance().remove(id);
+  }
   delete ui_;
   delete tWoodContainer_;
   delete tFloor_;
   delete tCubeMap_;
-  delete customObject_;
+  for ( OGLObject* model : models_ ) {
+    delete model;
+  }
 }
 
 void OpenglWidget::setFow(float fow)
@@ -73,6 +168,35 @@ void OpenglWidget::setFarPlane(float farPlane)
   updateParametrs();
 }
 
+void OpenglWidget::setTextureBudget(qint64 bytes)
+{
+  if ( bytes <= 0 ) { return; }
+  TextureStreamer::instance().setBudget(bytes);
+}
+
+void OpenglWidget::setDynamicResolution(bool flag)
+{
+  resolutionScaler_.setEnabled(flag);
+  update();
+}
+
+void OpenglWidget::setFrameTimeTarget(float ms)
+{
+  resolutionScaler_.setTargetMs(ms);
+}
+
+void OpenglWidget::setSharpenUpscale(bool flag)
+{
+  sharpen_ = flag;
+  update();
+}
+
+void OpenglWidget::setGpuMemoryBudget(qint64 bytes)
+{
+  if ( bytes <= 0 ) { return; }
+  GpuMemory::instance().setBudget(bytes);
+}
+
 void OpenglWidget::goForward()
 {
   camera_.goForward();
@@ -109,9 +233,185 @@ void OpenglWidget::switchLamp()
   updateParametrs();
 }
 
+void OpenglWidget::switchOcclusionCulling()
+{
+  occlusionCulling_ = !occlusionCulling_;
+  qDebug() << "occlusion culling" << occlusionCulling_;
+  updateParametrs();
+}
+
+void OpenglWidget::switchLod()
+{
+  lod_ = !lod_;
+  qDebug() << "lod" << lod_;
+  updateParametrs();
+}
+
+void OpenglWidget::switchMeshletCulling()
+{
+  meshletCulling_ = !meshletCulling_;
+  qDebug() << "meshlet culling" << meshletCulling_;
+  updateParametrs();
+}
+
+void OpenglWidget::switchInstanceGrid()
+{
+  instanceGrid_ = !instanceGrid_;
+  initInstanceGrid();
+  qDebug() << "instance grid" << instanceGrid_ << gridEntities_.size();
+  updateParametrs();
+}
+
+void OpenglWidget::renderReference()
+{
+  if ( reference_ && reference_.use_count() > 1 ) {
+    qDebug() << "reference: still rendering";
+    return;
+  }
+  QString directory = QCoreApplication::applicationDirPath();
+  grabFramebuffer().save(directory + QString("/opengl.png"));
+
+  // геометрия читается из буферов GL, дальше трассировщику контекст не нужен
+  std::shared_ptr<CpuScene> scene = captureCpuScene();
+  auto tracer = std::make_shared<PathTracer>();
+  tracer->setView(camera_.getView(), projection_);
+  tracer->setTonemap(tonemap_, exposure_);
+  tracer->resize(width(), height());
+  reference_ = tracer;
+
+  bool environment = paintCubeMap_;
+  JobSystem& jobs = JobSystem::instance();
+  jobs.runBackground(jobs.create([tracer, scene, directory, environment] {
+    if ( environment ) {
+      scene->setEnvironment(loadSkyBoxFaces());
+    }
+    tracer->setScene(scene);
+    tracer->build();
+    qDebug() << QString("reference: %1 triangles, BVH %2, %3 threads").arg(tracer->triangleCount())
+                .arg(Bvh::backend()).arg(JobSystem::instance().threadCount() + 1);
+    for ( int pass = 1; pass <= kReferencePasses; pass++ ) {
+      tracer->renderPass();
+      if ( pass % kReferenceSaveEvery == 0 ) {
+        tracer->image().save(directory + QString("/reference.png"));
+        qDebug() << QString("reference: %1 spp, %2 Msamples/s, %3 Mrays/s").arg(tracer->passes())
+                    .arg(tracer->samplesPerSecond() / 1.0e6, 0, 'f', 2).arg(tracer->raysPerSecond() / 1.0e6, 0, 'f', 2);
+      }
+    }
+  }));
+}
+
+void OpenglWidget::switchTonemap()
+{
+  tonemap_ = Tonemap::Operator((tonemap_ + 1) % Tonemap::OperatorCount);
+  qDebug() << "tonemap" << Tonemap::name(tonemap_);
+  updateParametrs();
+}
+
+void OpenglWidget::switchBloom()
+{
+  bloom_ = !bloom_;
+  qDebug() << "bloom" << bloom_;
+  updateParametrs();
+}
+
+void OpenglWidget::switchDebugDraw()
+{
+  debugMode_ = DebugMode((debugMode_ + 1) % DebugModeCount);
+  if ( debugMode_ == DebugBvh ) {
+    std::shared_ptr<CpuScene> scene = captureCpuScene();
+    debugBvh_.build(scene->positions());
+    qDebug() << QString("debug draw: BVH %1 nodes, %2 triangles").arg(debugBvh_.nodeCount()).arg(debugBvh_.triangleCount());
+  }
+  else {
+    debugBvh_.clear();
+  }
+  if ( debugMode_ < DebugNormals ) {
+    debugVertexes_.clear();
+  }
+  qDebug() << "debug draw" << int(debugMode_);
+  updateParametrs();
+}
+
+void OpenglWidget::switchSoftwareRenderer()
+{
+  if ( software_ ) {
+    software_.reset();
+  }
+  else {
+    std::shared_ptr<CpuScene> scene = captureCpuScene();
+    if ( paintCubeMap_ ) {
+      scene->setEnvironment(loadSkyBoxFaces());
+    }
+    software_.reset(new SoftwareRasterizer);
+    software_->setScene(scene);
+    qDebug() << QString("software renderer: %1 triangles, %2, %3 threads").arg(int(scene->triangles().size()))
+                .arg(SoftwareRasterizer::backend()).arg(JobSystem::instance().threadCount() + 1);
+  }
+  qDebug() << "software renderer" << bool(software_);
+  updateParametrs();
+}
+
+std::shared_ptr<CpuScene> OpenglWidget::captureCpuScene()
+{
+  auto scene = std::make_shared<CpuScene>();
+  makeCurrent();
+  if ( paintCustomObject_ ) {
+    for ( int i = 0; i < models_.size(); i++ ) {
+      scene->addObject(*models_.at(i), scene_.world(modelEntities_.at(i)));
+    }
+  }
+  const ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+  for ( int i = 0; i < renderers.size() && paintCubes_; i++ ) {
+    const MeshRendererComponent& renderer = renderers.at(i);
+    const MaterialComponent* material = scene_.materials().find(renderers.entity(i));
+    if ( renderer.primitive == MeshRendererComponent::Model || !material ) {
+      continue;
+    }
+    QOpenGLBuffer& vbo = primitiveBuffer(renderer.primitive);
+    QVector<Vertex> vertexes(vbo.size() / int(sizeof(Vertex)));
+    vbo.bind();
+    bool ok = vbo.read(0, vertexes.data(), vertexes.size() * int(sizeof(Vertex)));
+    vbo.release();
+    if ( !ok ) {
+      continue;
+    }
+    QVector<GLuint> indexes(vertexes.size());
+    for ( int k = 0; k < indexes.size(); k++ ) {
+      indexes[k] = GLuint(k);
+    }
+    // текстуры встроенной геометрии грузятся так же, как в loadTexture()
+    CpuScene::Surface surface;
+    surface.roughness = kPrimitiveRoughness;
+    if ( material->albedo == tWoodContainer_ ) {
+      surface.albedoMap = QImage(kWoodContainer).mirrored();
+    }
+    else if ( material->albedo == tFloor_ ) {
+      surface.albedoMap = QImage(kWoodFloor).mirrored();
+    }
+    scene->addMesh(vertexes, indexes, scene_.world(renderers.entity(i)), surface);
+  }
+  doneCurrent();
+
+  // источники как в setLightShader(); фонарь камеры не учитывается
+  scene->setDirectionalLight(kLightDirection, QVector3D{0.4f, 0.4f, 0.4f});
+  const ComponentArray<PointLightComponent>& lights = scene_.pointLights();
+  for ( int i = 0; i < qMin(lights.size(), kPosLightCount); i++ ) {
+    const PointLightComponent& light = lights.at(i);
+    CpuScene::PointLight pointLight;
+    pointLight.position = scene_.world(lights.entity(i)).column(3).toVector3D();
+    pointLight.color = light.diffuse;
+    pointLight.constant = light.constant;
+    pointLight.linear = light.linear;
+    pointLight.quadratic = light.quadratic;
+    scene->addPointLight(pointLight);
+  }
+  return scene;
+}
+
 void OpenglWidget::setRotate(bool flag)
 {
   rotateFlag_ = flag;
+  shadowMap_.invalidateStatic();
 }
 
 void OpenglWidget::setPaintCubeMap(bool flag)
@@ -122,28 +422,33 @@ void OpenglWidget::setPaintCubeMap(bool flag)
 void OpenglWidget::setPaintCubes(bool flag)
 {
   paintCubes_ = flag;
+  shadowMap_.invalidateStatic();
 }
 
 void OpenglWidget::setPaintCustomObject(bool flag)
 {
   paintCustomObject_ = flag;
+  shadowMap_.invalidateStatic();
 }
 
 void OpenglWidget::setLightColor(int i, QVector3D color)
 {
 //  color *= 300.0f;
-  if ( i >= 0 && i < kPosLightCount) {
-    pointLights_[i].ambient = color*0.05f;
-    pointLights_[i].diffuse = color*1.0f;
-    pointLights_[i].specular = color*0.01f;
+  if ( i >= 0 && i < lightEntities_.size() ) {
+    PointLightComponent* light = scene_.pointLights().find(lightEntities_.at(i));
+    light->ambient = color*0.05f;
+    light->diffuse = color*1.0f;
+    light->specular = color*0.01f;
   }
   updateParametrs();
 }
 
 void OpenglWidget::setLightPosition(int i, QVector3D position)
 {
-  if ( i > 0 && i < kPosLightCount) {
-    pointLights_[i].position = position;
+  if ( i > 0 && i < lightEntities_.size() ) {
+    QMatrix4x4 local;
+    local.translate(position);
+    scene_.setLocal(lightEntities_.at(i), local);
   }
   updateParametrs();
 }
@@ -157,6 +462,10 @@ void OpenglWidget::initializeGL()
 
   initScene();
   initShaders();
+  shadowMap_.create(kShadowMapResolution);
+  shadowMap_.setLightDirection(kLightDirection);
+  ringBuffer_.create(kRingBufferSize);
+  fullscreenVao_.create();
 }
 
 void OpenglWidget::initScene()
@@ -168,6 +477,19 @@ void OpenglWidget::initScene()
   initFloor(kFloorWidth);
   initCubeMap();
   initTest();
+  initSceneEntities();
+  // эти ресурсы не выгружаются, только учитываются
+  GpuMemory& memory = GpuMemory::instance();
+  for ( const QOpenGLBuffer* buffer : { &cubeVBO_, &floorVBO_, &cubeMapVBO_, &testVBO_ } ) {
+    sceneMemory_.append(memory.add(GpuMemory::VertexBuffer, QString("scene"), buffer->size()));
+  }
+  sceneMemory_.append(memory.add(GpuMemory::IndexBuffer, QString("scene"), testEBO_.size()));
+  for ( const QOpenGLTexture* texture : { tWoodContainer_, tFloor_ } ) {
+    sceneMemory_.append(memory.add(GpuMemory::Texture, QString("scene"),
+                                   GpuMemory::textureBytes(texture->width(), texture->height(), 1, 4, true)));
+  }
+  sceneMemory_.append(memory.add(GpuMemory::Texture, QString("scene"),
+                                 GpuMemory::textureBytes(tCubeMap_->width(), tCubeMap_->height(), 6, 4, false)));
 //  auto path = QString("/home/mikhail/build_dir/opengl/backpack/backpack.obj");
 //  initCustomObject(path);
 }
@@ -181,11 +503,138 @@ void OpenglWidget::resizeGL(int w, int h)
   projection_.perspective(fow_, aspect, nearPlane_, farPlane_);
 }
 
+void OpenglWidget::initSceneEntities()
+{
+  struct Placement {
+    MeshRendererComponent::Primitive primitive;
+    QVector3D position;
+    QOpenGLTexture* texture;
+  };
+  for ( const Placement& placement : { Placement{MeshRendererComponent::Cube, kContainerPos1, tWoodContainer_},
+                                       Placement{MeshRendererComponent::Cube, kContainerPos2, tWoodContainer_},
+                                       Placement{MeshRendererComponent::Floor, QVector3D{0.0f, float(-kCubeWidth/2), 0.0f}, tFloor_} } ) {
+    QMatrix4x4 local;
+    local.translate(placement.position);
+    int entity = scene_.createEntity(local);
+    MeshRendererComponent renderer;
+    renderer.primitive = placement.primitive;
+    scene_.meshRenderers().add(entity, renderer);
+    scene_.materials().add(entity, MaterialComponent{placement.texture});
+  }
+}
+
 void OpenglWidget::paintGL()
 {
 //  qDebug() << "paint";
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  paintScene();
+  QElapsedTimer frameTimer;
+  frameTimer.start();
+  frameStats_.reset();
+  frameArena_.beginFrame();
+  viewProjection_ = projection_ * camera_.getView();
+  QElapsedTimer transformTimer;
+  transformTimer.start();
+  frameStats_.transformsUpdated = scene_.update();
+  frameStats_.transformNodes = scene_.hierarchy().count();
+  frameStats_.transformMs = float(transformTimer.nsecsElapsed()) / 1.0e6f;
+  frameStats_.sceneEntities = scene_.entityCount();
+  processHotReload();
+  if ( frameStats_.transformsUpdated > 0 ) {
+    // положения источников берутся из уже пересчитанных мировых матриц
+    setLightShader(objectShader_);
+    setLightShader(PBRShader_);
+  }
+  JobSystem::instance().processMainThreadJobs();
+  qint64 heapAllocations = FrameArena::heapAllocations();
+  frameStats_.tonemap = Tonemap::name(tonemap_);
+  frameStats_.exposure = exposure_;
+  if ( software_ ) {
+    paintSoftware();
+  }
+  else {
+    prepareOcclusion();
+    collectDebugDraw();
+    frameStats_.debugVertices = debugDraw_.vertexCount();
+    frameStats_.debugDropped = debugDraw_.droppedVertices();
+    buildFrameGraph();
+    frameGraph_.compile();
+    frameGraph_.execute();
+    frameStats_.graphPasses = frameGraph_.passCount();
+    frameStats_.graphCulledPasses = frameGraph_.culledPasses();
+    frameStats_.graphTextures = frameGraph_.transientCount();
+    frameStats_.graphPhysicalTextures = frameGraph_.physicalCount();
+    frameStats_.graphTransientBytes = frameGraph_.transientBytes();
+    frameStats_.graphAliasedBytes = frameGraph_.aliasedBytes();
+    frameStats_.graphLivePeakBytes = frameGraph_.livePeakBytes();
+    frameStats_.graphPassCount = qMin(frameGraph_.executedCount(), int(FrameStats::kMaxGraphPasses));
+    for ( int i = 0; i < frameStats_.graphPassCount; i++ ) {
+      frameStats_.graphPassNames[i] = frameGraph_.executedName(i);
+      frameStats_.graphPassCpuMs[i] = frameGraph_.executedCpuMs(i);
+      frameStats_.graphPassGpuMs[i] = frameGraph_.executedGpuMs(i);
+    }
+    // время GPU всех проходов - по последним пришедшим меткам времени
+    float gpuMs = 0.0f;
+    for ( int i = 0; i < frameGraph_.executedCount(); i++ ) {
+      gpuMs += frameGraph_.executedGpuMs(i);
+    }
+    resolutionScaler_.update(gpuMs);
+    frameStats_.gpuFrameMs = gpuMs;
+    frameStats_.resolutionScale = resolutionScaler_.scale();
+    frameStats_.dynamicResolution = resolutionScaler_.isEnabled();
+    frameStats_.frameTargetMs = resolutionScaler_.targetMs();
+  }
+  // мипы, запрошенные при обходе сцены, появятся в следующем кадре
+  TextureStreamer& streamer = TextureStreamer::instance();
+  streamer.update();
+  frameStats_.textureCount = streamer.textureCount();
+  frameStats_.textureResidentBytes = streamer.residentBytes();
+  frameStats_.textureRequestedBytes = streamer.requestedBytes();
+  frameStats_.textureBudget = streamer.budget();
+  frameStats_.textureUploads = streamer.uploads();
+  frameStats_.textureEvictions = streamer.evictions();
+  GpuMemory& gpuMemory = GpuMemory::instance();
+  gpuMemory.endFrame();
+  frameStats_.gpuBytes = gpuMemory.totalBytes();
+  frameStats_.gpuBudget = gpuMemory.budget();
+  frameStats_.gpuResources = gpuMemory.resourceCount();
+  frameStats_.gpuEvictions = gpuMemory.evictions();
+  frameStats_.gpuEvictedBytes = gpuMemory.evictedBytes();
+  for ( int type = 0; type < GpuMemory::TypeCount; type++ ) {
+    frameStats_.gpuTypeBytes[type] = gpuMemory.bytes(GpuMemory::Type(type));
+  }
+  if ( occlusionCulling_ ) {
+    frameStats_.occlusionTested = occlusionCuller_.tested();
+    frameStats_.occlusionCulled = occlusionCuller_.culled();
+    frameStats_.occlusionOutside = occlusionCuller_.outside();
+  }
+  frameStats_.arenaAllocations = frameArena_.allocations();
+  frameStats_.arenaBytes = int(frameArena_.bytesUsed());
+  frameStats_.arenaBlockAllocations = frameArena_.blockAllocations();
+  frameStats_.heapAllocations = heapAllocations < 0 ? -1 : int(FrameArena::heapAllocations() - heapAllocations);
+  ringBuffer_.endFrame();
+  frameStats_.ringBytes = int(ringBuffer_.frameBytes());
+  frameStats_.ringOccupancy = ringBuffer_.occupancy();
+  frameStats_.ringFenceWaits = ringBuffer_.fenceWaits();
+  frameStats_.ringOrphans = ringBuffer_.orphans();
+  frameStats_.ringPersistent = ringBuffer_.isPersistent();
+  ringBuffer_.resetCounters();
+  frameStats_.frameMs = float(frameTimer.nsecsElapsed()) / 1.0e6f;
+  frame_++;
+}
+
+void OpenglWidget::paintSoftware()
+{
+  // снимок сцены не следит за анимацией, меняется только камера
+  if ( software_->image().width() != width() || software_->image().height() != height() ) {
+    software_->resize(width(), height());
+  }
+  software_->setView(camera_.getView(), projection_);
+  software_->setTonemap(tonemap_, exposure_);
+  software_->render();
+  frameStats_.softwareMs = software_->frameMs();
+  frameStats_.softwareTriangles = software_->trianglesBinned();
+  frameStats_.softwarePixels = software_->pixelsShaded();
+  QPainter painter(this);
+  painter.drawImage(rect(), software_->image());
 }
 
 void OpenglWidget::timerEvent(QTimerEvent* event)
@@ -198,21 +647,24 @@ void OpenglWidget::initShaders()
 {
   initObjectShader();
   initLightShader();
-  initNormalShader();
+  initDebugShader();
   initSkyBoxShader();
   initCustomObjectShader();
   initPBRShader();
+  initShadowShader();
+  initTonemapShader();
+  initBloomShaders();
 }
 
 void OpenglWidget::initObjectShader()
 {
   if ( objectShader_.isLinked() ) { return;}
   qDebug() << "init object shader";
-  if (!objectShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vObjectShader.vert")) {
+  if (!addShader(objectShader_, QOpenGLShader::Vertex, ":/shaders/vObjectShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!objectShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fObjectShader.frag")) {
+  if (!addShader(objectShader_, QOpenGLShader::Fragment, ":/shaders/fObjectShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
@@ -226,11 +678,11 @@ void OpenglWidget::initLightShader()
 {
   if ( lightShader_.isLinked() ) { return;}
   qDebug() << "init light shader";
-  if (!lightShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vLightShader.vert")) {
+  if (!addShader(lightShader_, QOpenGLShader::Vertex, ":/shaders/vLightShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!lightShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fLightShader.frag")) {
+  if (!addShader(lightShader_, QOpenGLShader::Fragment, ":/shaders/fLightShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
@@ -245,11 +697,11 @@ void OpenglWidget::initSkyBoxShader()
 {
   if ( skyBoxShader_.isLinked() ) { return;}
   qDebug() << "init skyBox shader";
-  if (!skyBoxShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vSkyBoxShader.vert")) {
+  if (!addShader(skyBoxShader_, QOpenGLShader::Vertex, ":/shaders/vSkyBoxShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!skyBoxShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fSkyBoxShader.frag")) {
+  if (!addShader(skyBoxShader_, QOpenGLShader::Fragment, ":/shaders/fSkyBoxShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
@@ -260,23 +712,19 @@ void OpenglWidget::initSkyBoxShader()
 
 }
 
-void OpenglWidget::initNormalShader()
+void OpenglWidget::initDebugShader()
 {
-  if ( normalShader_.isLinked() ) { return;}
-  qDebug() << "init normal shader";
-  if (!normalShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vNormalObjectShader.vert")) {
-    qDebug() << "Error vertex shader";
-    close();
-  }
-  if (!normalShader_.addShaderFromSourceFile(QOpenGLShader::Geometry, ":/shaders/gNormalObjectShader.geom")) {
+  if ( debugShader_.isLinked() ) { return;}
+  qDebug() << "init debug shader";
+  if (!addShader(debugShader_, QOpenGLShader::Vertex, ":/shaders/vDebugShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!normalShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fNormalObjectShader.frag")) {
+  if (!addShader(debugShader_, QOpenGLShader::Fragment, ":/shaders/fDebugShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
-  if (!normalShader_.link()) {
+  if (!debugShader_.link()) {
     qDebug() << "Error link shader program";
     close();
   }
@@ -286,11 +734,11 @@ void OpenglWidget::initCustomObjectShader()
 {
   if ( customObjectShader_.isLinked() ) { return;}
   qDebug() << "init customObject shader";
-  if (!customObjectShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vCustomObjectShader.vert")) {
+  if (!addShader(customObjectShader_, QOpenGLShader::Vertex, ":/shaders/vCustomObjectShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!customObjectShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fCustomObjectShader.frag")) {
+  if (!addShader(customObjectShader_, QOpenGLShader::Fragment, ":/shaders/fCustomObjectShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
@@ -304,11 +752,11 @@ void OpenglWidget::initPBRShader()
 {
   if ( PBRShader_.isLinked() ) { return;}
   qDebug() << "init PBR shader";
-  if (!PBRShader_.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shaders/vPBRShader.vert")) {
+  if (!addShader(PBRShader_, QOpenGLShader::Vertex, ":/shaders/vPBRShader.vert")) {
     qDebug() << "Error vertex shader";
     close();
   }
-  if (!PBRShader_.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shaders/fPBRShader.frag")) {
+  if (!addShader(PBRShader_, QOpenGLShader::Fragment, ":/shaders/fPBRShader.frag")) {
     qDebug() << "Error fragment shader";
     close();
   }
@@ -318,6 +766,65 @@ void OpenglWidget::initPBRShader()
   }
 }
 
+void OpenglWidget::initShadowShader()
+{
+  if ( shadowShader_.isLinked() ) { return;}
+  qDebug() << "init shadow shader";
+  if (!addShader(shadowShader_, QOpenGLShader::Vertex, ":/shaders/vShadowShader.vert")) {
+    qDebug() << "Error vertex shader";
+    close();
+  }
+  if (!addShader(shadowShader_, QOpenGLShader::Fragment, ":/shaders/fShadowShader.frag")) {
+    qDebug() << "Error fragment shader";
+    close();
+  }
+  if (!shadowShader_.link()) {
+    qDebug() << "Error link shader program";
+    close();
+  }
+}
+
+void OpenglWidget::initTonemapShader()
+{
+  if ( tonemapShader_.isLinked() ) { return;}
+  qDebug() << "init tonemap shader";
+  if (!addShader(tonemapShader_, QOpenGLShader::Vertex, ":/shaders/vFullscreenShader.vert")) {
+    qDebug() << "Error vertex shader";
+    close();
+  }
+  if (!addShader(tonemapShader_, QOpenGLShader::Fragment, ":/shaders/fTonemapShader.frag")) {
+    qDebug() << "Error fragment shader";
+    close();
+  }
+  if (!tonemapShader_.link()) {
+    qDebug() << "Error link shader program";
+    close();
+  }
+}
+
+void OpenglWidget::initBloomShaders()
+{
+  qDebug() << "init bloom shaders";
+  for ( auto shader : { std::make_pair(&bloomDownShader_, ":/shaders/fBloomDownShader.frag"),
+                        std::make_pair(&bloomUpShader_, ":/shaders/fBloomUpShader.frag") } ) {
+    if ( shader.first->isLinked() ) {
+      continue;
+    }
+    if (!addShader(*shader.first, QOpenGLShader::Vertex, ":/shaders/vFullscreenShader.vert")) {
+      qDebug() << "Error vertex shader";
+      close();
+    }
+    if (!addShader(*shader.first, QOpenGLShader::Fragment, shader.second)) {
+      qDebug() << "Error fragment shader";
+      close();
+    }
+    if (!shader.first->link()) {
+      qDebug() << "Error link shader program";
+      close();
+    }
+  }
+}
+
 void OpenglWidget::initCube(float width)
 {
   qDebug() << "init Cube";
@@ -372,6 +879,8 @@ void OpenglWidget::initCube(float width)
   vertexes.append(Vertex(QVector3D( -halfWidth, -halfWidth, -halfWidth), QVector2D(0.0f, 0.0f), QVector3D(0.0f,-1.0f,0.0f)));
   vertexes.append(Vertex(QVector3D(  halfWidth, -halfWidth, -halfWidth), QVector2D(1.0f, 0.0f), QVector3D(0.0f,-1.0f,0.0f)));
 
+  copyPositions(vertexes, cubePositions_, cubeIndexes_);
+
   cubeVBO_.create();
   cubeVBO_.bind();
   cubeVBO_.allocate(vertexes.constData(), vertexes.size() *  sizeof(Vertex));
@@ -392,6 +901,8 @@ void OpenglWidget::initFloor(float width)
   vertexes.append(Vertex(QVector3D( -halfWidth, 0.0f, -halfWidth), QVector2D(1.0f, 0.0f), QVector3D(0.0f,1.0f,0.0f)));
   vertexes.append(Vertex(QVector3D( -halfWidth, 0.0f,  halfWidth), QVector2D(0.0f, 0.0f), QVector3D(0.0f,1.0f,0.0f)));
 
+  copyPositions(vertexes, floorPositions_, floorIndexes_);
+
   floorVBO_.create();
   floorVBO_.bind();
   floorVBO_.allocate(vertexes.constData(), vertexes.size() *  sizeof(Vertex));
@@ -500,19 +1011,75 @@ void OpenglWidget::initTest()
 
 void OpenglWidget::initCustomObject(QString& path)
 {
-  if ( customObject_ ) {
-    delete customObject_;
-    customObject_ = nullptr;
+  // новая модель встаёт рядом с уже загруженными, а не заменяет их
+  OGLObject* object = new OGLObject{path};
+  SpinComponent spin;
+  spin.position = QVector3D{float(models_.size()) * kModelSpacing, 0.0f, 0.0f};
+  spin.axis = kModelSpinAxis;
+  spin.scale = 0.5f;
+  QMatrix4x4 local;
+  local.translate(spin.position);
+  local.scale(spin.scale);
+  int entity = scene_.createEntity(local);
+  scene_.spins().add(entity, spin);
+  MeshRendererComponent renderer;
+  renderer.object = object;
+  scene_.meshRenderers().add(entity, renderer);
+  scene_.setBounds(entity, object->bounds());
+  models_.append(object);
+  modelEntities_.append(entity);
+  hotReload_.watchModel(object);
+  qDebug().noquote() << GpuMemory::instance().report();
+  initInstanceGrid();
+  shadowMap_.invalidateStatic();
+  updateParametrs();
+}
+
+void OpenglWidget::removeCustomObject(int index)
+{
+  if ( index < 0 || index >= models_.size() ) {
+    return;
   }
-//  customObject_ = new OGLObject{QString("/home/mikhail/build_dir/opengl/backpack/backpack.obj")};
-//  customObject_ = new OGLObject{QString("/home/mikhail/build_dir/opengl/sphere/misha.obj")};
-  customObject_ = new OGLObject{path};
+  OGLObject* object = models_.takeAt(index);
+  int entity = modelEntities_.takeAt(index);
+  // сетка копий ссылается на модель и висит на первой из них - собирается заново до удаления
+  initInstanceGrid();
+  scene_.destroyEntity(entity);
+  hotReload_.unwatchModel(object);
+  debugVertexes_.remove(object);
+  makeCurrent();
+  delete object;
+  doneCurrent();
+  qDebug().noquote() << GpuMemory::instance().report();
+  shadowMap_.invalidateStatic();
   updateParametrs();
 }
 
+bool OpenglWidget::addShader(QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const QString& path)
+{
+  if ( !kShaderSourceDir.isEmpty() && path.startsWith(":/") ) {
+    QString sourcePath = kShaderSourceDir + path.mid(1);
+    if ( QFileInfo::exists(sourcePath) ) {
+      hotReload_.watchShader(program, type, sourcePath);
+      return program.addShaderFromSourceFile(type, sourcePath);
+    }
+  }
+  QByteArray source = AssetArchive::instance().text(path);
+  if ( !source.isNull() ) {
+    return program.addShaderFromSourceCode(type, source);
+  }
+  return program.addShaderFromSourceFile(type, path);
+}
+
 QOpenGLTexture* OpenglWidget::loadTexture(const QString& path)
 {
-  QOpenGLTexture* texture = new QOpenGLTexture(QImage(path).mirrored());
+  // сжатая текстура с мипами из архива грузится без декодирования
+  AssetArchive& archive = AssetArchive::instance();
+  const AssetArchive::Entry* entry = archive.find(path, AssetArchive::Texture);
+  QOpenGLTexture* texture = entry ? archive.createTexture(*entry, true) : nullptr;
+  if ( !texture ) {
+    texture = new QOpenGLTexture(QImage(path).mirrored());
+  }
   texture->setMinificationFilter(QOpenGLTexture::Nearest);
   texture->setMagnificationFilter(QOpenGLTexture::Linear);
   texture->setWrapMode(QOpenGLTexture::Repeat);
@@ -521,20 +1088,33 @@ QOpenGLTexture* OpenglWidget::loadTexture(const QString& path)
 
 QOpenGLTexture* OpenglWidget::loadCubeMap(const QVector<QString> &paths)
 {
+  AssetArchive& archive = AssetArchive::instance();
+  QVector<const AssetArchive::Entry*> faces;
+  for ( const auto& path : paths ) {
+    faces.append(archive.find(path, AssetArchive::Texture));
+  }
+  if ( QOpenGLTexture* texture = archive.createCubeMap(faces) ) {
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    return texture;
+  }
+  // грани декодируются параллельно, в GPU уходят отсюда
+  QVector<QImage> images(paths.size());
+  JobSystem::instance().parallelFor(paths.size(), 1, [&paths, &images]( int begin, int end ) {
+    for ( int i = begin; i < end; i++ ) {
+      images[i] = QImage(paths.at(i)).convertToFormat(QImage::Format_RGBA8888);
+    }
+  });
   QOpenGLTexture* texture = new QOpenGLTexture( QOpenGLTexture::TargetCubeMap );
   texture->create();
-  const QImage posx = QImage(paths.first()).convertToFormat(QImage::Format_RGBA8888);
+  const QImage& posx = images.first();
   texture->setSize(posx.width(), posx.height(), posx.depth());
   texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
   texture->allocateStorage();
-  texture->setData(0, 0, QOpenGLTexture::CubeMapPositiveX,
-                   QOpenGLTexture::RGBA, QOpenGLTexture::UInt8,
-                   posx.constBits(), Q_NULLPTR);
-  auto it = paths.begin() + 1;
-  for ( int i = 1; it < paths.end() ; it++, i++  ) {
-    const QImage image = QImage(*it).convertToFormat(QImage::Format_RGBA8888);
+  for ( int i = 0; i < images.size(); i++ ) {
     QOpenGLTexture::CubeMapFace face = QOpenGLTexture::CubeMapFace(QOpenGLTexture::CubeMapPositiveX+i);
-    texture->setData(0, 0, face,  QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, image.constBits(), Q_NULLPTR);
+    texture->setData(0, 0, face,  QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, images.at(i).constBits(), Q_NULLPTR);
   }
 
   texture->setWrapMode(QOpenGLTexture::ClampToEdge);
@@ -543,126 +1123,465 @@ QOpenGLTexture* OpenglWidget::loadCubeMap(const QVector<QString> &paths)
   return texture;
 }
 
+void OpenglWidget::buildFrameGraph()
+{
+  qreal ratio = devicePixelRatioF();
+  FrameSetup::Settings settings;
+  settings.targetWidth = qMax(1, int(width() * ratio));
+  settings.targetHeight = qMax(1, int(height() * ratio));
+  settings.backbuffer = defaultFramebufferObject();
+  float scale = resolutionScaler_.scale();
+  settings.sceneWidth = qMax(1, int(settings.targetWidth * scale + 0.5f));
+  settings.sceneHeight = qMax(1, int(settings.targetHeight * scale + 0.5f));
+  settings.shadowMap = shadowMap_.isCreated();
+  if ( settings.shadowMap ) {
+    settings.shadowTexture = shadowMap_.texture();
+    settings.shadowResolution = shadowMap_.resolution();
+  }
+  settings.debugDraw = !debugDraw_.isEmpty();
+  settings.bloom = bloom_;
+  frameStats_.sceneWidth = settings.sceneWidth;
+  frameStats_.sceneHeight = settings.sceneHeight;
+  FrameSetup::declare(frameGraph_, settings, this);
+}
+
+void OpenglWidget::paintShadowPass()
+{
+  paintShadows();
+}
+
+void OpenglWidget::paintScenePass()
+{
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  paintScene();
+}
+
+void OpenglWidget::paintDebugPass()
+{
+  debugDraw_.flush(debugShader_, ringBuffer_, viewProjection_);
+}
+
+void OpenglWidget::collectDebugDraw()
+{
+  debugDraw_.begin(camera_.getView());
+  if ( debugMode_ == DebugOff ) {
+    return;
+  }
+  // источники: сфера, где затухание 1 / (constant + linear * d + quadratic * d^2) падает
+  // до kDebugLightFalloff, и подпись поверх сцены
+  const ComponentArray<PointLightComponent>& lights = scene_.pointLights();
+  for ( int i = 0; i < lights.size(); i++ ) {
+    const PointLightComponent& light = lights.at(i);
+    QVector3D position = scene_.world(lights.entity(i)).column(3).toVector3D();
+    float c = light.constant - 1.0f / kDebugLightFalloff;
+    float radius = 0.0f;
+    if ( light.quadratic > 0.0f ) {
+      radius = (std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c) - light.linear) / (2.0f * light.quadratic);
+    }
+    else if ( light.linear > 0.0f ) {
+      radius = -c / light.linear;
+    }
+    if ( radius > 0.0f ) {
+      debugDraw_.sphere(position, radius, light.diffuse);
+    }
+    char label[16];
+    std::snprintf(label, sizeof(label), "LIGHT %d", i);
+    debugDraw_.setOverlay(true);
+    debugDraw_.cross(position, kDebugLabelHeight, light.diffuse);
+    debugDraw_.text(position + QVector3D{0.0f, kDebugLabelHeight, 0.0f}, label, kDebugLabelHeight, light.diffuse);
+    debugDraw_.setOverlay(false);
+  }
+  QVector3D sun = camera_.position() + camera_.front() * 2.0f;
+  debugDraw_.arrow(sun - kLightDirection.normalized() * 0.5f, sun, kDebugSunColor);
+
+  // границы видимых сущностей
+  Frustum frustum(viewProjection_);
+  const ComponentArray<BoundsComponent>& bounds = scene_.bounds();
+  for ( int i = 0; i < bounds.size(); i++ ) {
+    const BoundsComponent& entityBounds = bounds.at(i);
+    if ( frustum.intersects(entityBounds.center, entityBounds.radius) ) {
+      debugDraw_.box(scene_.world(bounds.entity(i)), entityBounds.local, kDebugBoundsColor);
+    }
+  }
+  if ( shadowMap_.isCreated() ) {
+    for ( int i = 0; i < ShadowMap::kCascadeCount; i++ ) {
+      debugDraw_.frustum(shadowMap_.lightSpace(i), kDebugCascadeColors[i % 4]);
+    }
+  }
+
+  if ( debugMode_ >= DebugNormals ) {
+    const ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+    for ( int i = 0; i < renderers.size(); i++ ) {
+      const MeshRendererComponent& renderer = renderers.at(i);
+      bool model = renderer.primitive == MeshRendererComponent::Model;
+      if ( (model && (!paintCustomObject_ || !renderer.object)) || (!model && !paintCubes_) ) {
+        continue;
+      }
+      int entity = renderers.entity(i);
+      const BoundsComponent* entityBounds = bounds.find(entity);
+      if ( entityBounds && !frustum.intersects(entityBounds->center, entityBounds->radius) ) {
+        continue;
+      }
+      debugDraw_.normals(debugVertexes(renderer), scene_.world(entity), kDebugNormalLength, kDebugNormalColor);
+    }
+  }
+  if ( debugMode_ == DebugBvh ) {
+    debugDraw_.bvh(debugBvh_, kDebugBvhDepth, kDebugBvhRootColor, kDebugBvhLeafColor);
+  }
+}
+
+const QVector<Vertex>& OpenglWidget::debugVertexes(const MeshRendererComponent& renderer)
+{
+  bool model = renderer.primitive == MeshRendererComponent::Model;
+  QOpenGLBuffer* vbo = model ? nullptr : &primitiveBuffer(renderer.primitive);
+  const void* key = model ? static_cast<const void*>(renderer.object) : static_cast<const void*>(vbo);
+  auto cached = debugVertexes_.find(key);
+  if ( cached != debugVertexes_.end() ) {
+    return cached.value();
+  }
+  QVector<Vertex>& vertexes = debugVertexes_[key];
+  if ( model ) {
+    QVector<Vertex> meshVertexes;
+    QVector<GLuint> meshIndexes;
+    for ( const std::shared_ptr<Mesh>& mesh : renderer.object->meshes() ) {
+      if ( mesh->readGeometry(meshVertexes, meshIndexes) ) {
+        vertexes += meshVertexes;
+      }
+    }
+  }
+  else {
+    vertexes.resize(vbo->size() / int(sizeof(Vertex)));
+    vbo->bind();
+    if ( !vbo->read(0, vertexes.data(), vertexes.size() * int(sizeof(Vertex))) ) {
+      vertexes.clear();
+    }
+    vbo->release();
+  }
+  return vertexes;
+}
+
 void OpenglWidget::paintScene()
 {
   if ( paintCubeMap_ ) {
     paintCubeMap();
   }
   if ( paintLights_ ) {
-    for ( auto& light : pointLights_  ) {
-      paintLight(light.position, light.diffuse, 0.25f);
-    }
+    paintLights(0.25f);
   }
   if ( paintCubes_ ) {
-    QVector3D containerPos1{1.0, 0.0, -3.0};
-    paintWoodContainer(containerPos1, 1.0f );
-    QVector3D containerPos2{2.0, 0.0, -2.0};
-    paintWoodContainer(containerPos2, 1.0f );
-  //      paintNormalWoodContainer(containerPos1);
-  //      paintNormalWoodContainer(containerPos2);
-    paintFloor();
+    paintPrimitives();
   }
   if ( paintCustomObject_ ) {
-    paintCustomObject();
+    paintModels();
   }
 //  paintTest(PBRShader_);
 }
 
-void OpenglWidget::paintWoodContainer( const QVector3D& position, float scale)
+void OpenglWidget::paintShadows()
 {
-  QMatrix4x4 model;
-  model.setToIdentity();
-  model.translate(position);
-  model.scale(scale);
+  if ( !shadowMap_.isCreated() || !shadowShader_.isLinked() ) {
+    return;
+  }
+  float aspect = width() / float(qMax(height(), 1));
+  shadowMap_.updateCascades(camera_.getView(), fow_, aspect, nearPlane_, farPlane_);
+
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  for ( int i = 0; i < ShadowMap::kCascadeCount; i++ ) {
+    if ( !shadowMap_.needsUpdate(i, frame_) ) {
+      continue;
+    }
+    shadowMap_.beginCascade(i);
+    if ( shadowMap_.isStaticDirty(i) ) {
+      shadowMap_.bindStaticLayer(i);
+      paintShadowCasters(shadowMap_.lightSpace(i), false);
+      frameStats_.shadowStaticRedraws++;
+    }
+    shadowMap_.bindDynamicLayer(i);
+    paintShadowCasters(shadowMap_.lightSpace(i), true);
+    shadowMap_.endCascade(i);
+    frameStats_.shadowCascadesUpdated++;
+  }
+  glDisable(GL_POLYGON_OFFSET_FILL);
 
-  objectShader_.bind();
-  auto view = camera_.getView();
+  frameStats_.shadowCascadeCount = ShadowMap::kCascadeCount;
+  for ( int i = 0; i < ShadowMap::kCascadeCount; i++ ) {
+    frameStats_.shadowCascadeMs[i] = shadowMap_.cascadeTimeMs(i);
+  }
+  shadowMap_.bindTexture(kShadowTextureUnit);
+  shadowMap_.setUniforms(objectShader_);
+  shadowMap_.setUniforms(PBRShader_);
+}
 
-  objectShader_.setUniformValue("model", model);
-  objectShader_.setUniformValue("view", view);
-  objectShader_.setUniformValue("projection", projection_);
-  objectShader_.setUniformValue("viewPos", camera_.position());
-  tWoodContainer_->bind(0);
-  objectShader_.setUniformValue("texture0", 0);
+void OpenglWidget::paintBloomDown(const FrameGraph& graph, int source, bool firstLevel)
+{
+  const FrameGraph::TextureDesc& desc = graph.desc(source);
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, graph.texture(source));
+  bloomDownShader_.bind();
+  bloomDownShader_.setUniformValue("source", 0);
+  bloomDownShader_.setUniformValue("sourceTexel", QVector2D{1.0f / float(desc.width), 1.0f / float(desc.height)});
+  bloomDownShader_.setUniformValue("firstLevel", firstLevel);
+  paintFullscreen();
+}
 
-  cubeVBO_.bind();
+void OpenglWidget::paintBloomUp(const FrameGraph& graph, int source, int base)
+{
+  const FrameGraph::TextureDesc& desc = graph.desc(source);
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, graph.texture(base));
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, graph.texture(source));
+  bloomUpShader_.bind();
+  bloomUpShader_.setUniformValue("source", 0);
+  bloomUpShader_.setUniformValue("base", 1);
+  bloomUpShader_.setUniformValue("sourceTexel", QVector2D{1.0f / float(desc.width), 1.0f / float(desc.height)});
+  paintFullscreen();
+}
 
-  int offset = 0;
+void OpenglWidget::paintTonemap(const FrameGraph& graph, int hdr, int bloom)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glActiveTexture(GL_TEXTURE1);
+  f->glBindTexture(GL_TEXTURE_2D, bloom >= 0 ? graph.texture(bloom) : 0);
+  f->glActiveTexture(GL_TEXTURE0);
+  f->glBindTexture(GL_TEXTURE_2D, graph.texture(hdr));
+  tonemapShader_.bind();
+  tonemapShader_.setUniformValue("hdr", 0);
+  tonemapShader_.setUniformValue("bloom", 1);
+  tonemapShader_.setUniformValue("useBloom", bloom >= 0);
+  tonemapShader_.setUniformValue("bloomStrength", kBloomStrength);
+  tonemapShader_.setUniformValue("exposure", exposure_);
+  tonemapShader_.setUniformValue("tonemapOperator", int(tonemap_));
+  const FrameGraph::TextureDesc& source = graph.desc(hdr);
+  bool upscaled = resolutionScaler_.scale() < ResolutionScaler::kMaxScale;
+  tonemapShader_.setUniformValue("sharpness", sharpen_ && upscaled ? kUpscaleSharpness : 0.0f);
+  tonemapShader_.setUniformValue("hdrTexel", QVector2D{1.0f / float(source.width), 1.0f / float(source.height)});
+  paintFullscreen();
+}
 
-  auto vertLoc = objectShader_.attributeLocation("inPos");
-  objectShader_.enableAttributeArray(vertLoc);
-  objectShader_.setAttributeBuffer(vertLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
+void OpenglWidget::paintFullscreen()
+{
+  glDisable(GL_DEPTH_TEST);
+  fullscreenVao_.bind();
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  fullscreenVao_.release();
+  glEnable(GL_DEPTH_TEST);
+}
 
-  offset += sizeof (QVector3D);
+void OpenglWidget::prepareOcclusion()
+{
+  if ( !occlusionCulling_ ) {
+    return;
+  }
+  QElapsedTimer timer;
+  timer.start();
+  occlusionCuller_.beginFrame(viewProjection_);
+  const ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+  for ( int i = 0; i < renderers.size(); i++ ) {
+    const MeshRendererComponent& renderer = renderers.at(i);
+    if ( !renderer.occluder ) {
+      continue;
+    }
+    QMatrix4x4 model = scene_.world(renderers.entity(i));
+    switch ( renderer.primitive ) {
+      case ( MeshRendererComponent::Model ): {
+        if ( paintCustomObject_ ) {
+          renderer.object->addOccluders(occlusionCuller_, model);
+        }
+        break;
+      }
+      case ( MeshRendererComponent::Cube ): {
+        if ( paintCubes_ ) {
+          occlusionCuller_.addOccluder(cubePositions_, cubeIndexes_, model);
+        }
+        break;
+      }
+      case ( MeshRendererComponent::Floor ): {
+        if ( paintCubes_ ) {
+          occlusionCuller_.addOccluder(floorPositions_, floorIndexes_, model);
+        }
+        break;
+      }
+    }
+  }
+  occlusionCuller_.rasterize();
+  frameStats_.occluderTriangles = occlusionCuller_.occluderTriangles();
+  frameStats_.occlusionMs = float(timer.nsecsElapsed()) / 1.0e6f;
+}
 
-  auto texLoc = objectShader_.attributeLocation("inTexCoord");
-  objectShader_.enableAttributeArray(texLoc);
-  objectShader_.setAttributeBuffer(texLoc, GL_FLOAT, offset, 2, sizeof(Vertex));
+void OpenglWidget::paintShadowCasters(const QMatrix4x4& lightSpace, bool dynamic)
+{
+  shadowShader_.bind();
+  shadowShader_.setUniformValue("lightSpace", lightSpace);
+  // динамические источники тени - вращающиеся модели, остальное рисуется в статический слой
+  const ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+  for ( int i = 0; i < renderers.size(); i++ ) {
+    const MeshRendererComponent& renderer = renderers.at(i);
+    if ( !renderer.castsShadow ) {
+      continue;
+    }
+    int entity = renderers.entity(i);
+    if ( renderer.primitive == MeshRendererComponent::Model ) {
+      bool spinning = rotateFlag_ && scene_.spins().contains(entity);
+      if ( paintCustomObject_ && dynamic == spinning ) {
+        shadowShader_.setUniformValue("model", scene_.world(entity));
+        renderer.object->drawDepth(shadowShader_);
+      }
+    }
+    else if ( !dynamic && paintCubes_ ) {
+      paintDepthArrays(primitiveBuffer(renderer.primitive), scene_.world(entity));
+    }
+  }
+}
 
-  offset += sizeof (QVector2D);
+void OpenglWidget::paintDepthArrays(QOpenGLBuffer& vbo, const QMatrix4x4& model)
+{
+  shadowShader_.setUniformValue("model", model);
+  vbo.bind();
+  auto vertLoc = shadowShader_.attributeLocation("inPos");
+  shadowShader_.enableAttributeArray(vertLoc);
+  shadowShader_.setAttributeBuffer(vertLoc, GL_FLOAT, 0, 3, sizeof(Vertex));
+  glDrawArrays(GL_TRIANGLES, 0, vbo.size() / int(sizeof(Vertex)));
+  vbo.release();
+}
 
-  auto normalLoc = objectShader_.attributeLocation("inNormal");
-  objectShader_.enableAttributeArray(normalLoc);
-  objectShader_.setAttributeBuffer(normalLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
+void OpenglWidget::initInstanceGrid()
+{
+  gridEntities_.append(gridEntity_);
+  scene_.destroyEntities(gridEntities_);
+  gridEntities_.clear();
+  gridEntity_ = Scene::kNone;
+  // границы подгружаемой кусками модели известны только после импорта
+  float size = 0.0f;
+  for ( int i = 0; i < models_.size(); i++ ) {
+    BoundingBox bounds = models_.at(i)->bounds();
+    scene_.setBounds(modelEntities_.at(i), bounds);
+    if ( !bounds.isEmpty() ) {
+      size = qMax(size, qMax(bounds.size().x(), bounds.size().z()));
+    }
+  }
+  if ( !instanceGrid_ || size <= 0.0f ) {
+    return;
+  }
+  // копии - дети первой модели: её поворот доходит до них при пересчёте иерархии.
+  // Модели в сетке чередуются, копии не отбрасывают тень и не закрывают других
+  gridEntity_ = scene_.createEntity(QMatrix4x4(), modelEntities_.first());
+  float step = size * kInstanceGridSpacing;
+  int half = kInstanceGridSize / 2;
+  int count = kInstanceGridSize * kInstanceGridSize;
+  scene_.reserve(scene_.entityCount() + count);
+  scene_.meshRenderers().reserve(scene_.meshRenderers().size() + count);
+  scene_.bounds().reserve(scene_.bounds().size() + count);
+  gridEntities_.reserve(count);
+  MeshRendererComponent renderer;
+  renderer.castsShadow = false;
+  renderer.occluder = false;
+  for ( int z = -half; z < kInstanceGridSize - half; z++ ) {
+    for ( int x = -half; x < kInstanceGridSize - half; x++ ) {
+      if ( x == 0 && z == 0 ) {
+        continue;
+      }
+      QMatrix4x4 local;
+      local.translate(float(x) * step, 0.0f, float(z) * step);
+      int entity = scene_.createEntity(local, gridEntity_);
+      renderer.object = models_.at(gridEntities_.size() % models_.size());
+      scene_.meshRenderers().add(entity, renderer);
+      scene_.setBounds(entity, renderer.object->bounds());
+      gridEntities_.append(entity);
+    }
+  }
+  // сетку могут пересоздать посреди кадра - мировые матрицы и границы нужны сразу
+  scene_.update();
+}
 
-  glDrawArrays(GL_TRIANGLES, 0, cubeVBO_.size());
-  tWoodContainer_->release();
+void OpenglWidget::setTransformUniforms(QOpenGLShaderProgram& shader, const QMatrix4x4& model)
+{
+  Mat4 matrix = SimdMath::fromQt(model);
+  ObjectTransform transform;
+  SimdMath::objectTransforms(SimdMath::fromQt(viewProjection_), &matrix, &transform, 1);
+  QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+  f->glUniformMatrix4fv(shader.uniformLocation("model"), 1, GL_FALSE, matrix.m);
+  f->glUniformMatrix4fv(shader.uniformLocation("mvp"), 1, GL_FALSE, transform.mvp);
+  f->glUniformMatrix3fv(shader.uniformLocation("normalMatrix"), 1, GL_FALSE, transform.normal);
 }
 
-void OpenglWidget::paintNormalCube( const QVector3D& position, float scale)
+QOpenGLBuffer& OpenglWidget::primitiveBuffer(MeshRendererComponent::Primitive primitive)
 {
-  QMatrix4x4 model;
-  model.setToIdentity();
-  model.translate(position);
-  model.scale(scale);
+  return primitive == MeshRendererComponent::Floor ? floorVBO_ : cubeVBO_;
+}
 
-  normalShader_.bind();
-  auto view = camera_.getView();
+void OpenglWidget::paintPrimitives()
+{
+  // рендереры без модели - встроенная геометрия, текстура берётся из материала
+  const ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+  for ( int i = 0; i < renderers.size(); i++ ) {
+    const MeshRendererComponent& renderer = renderers.at(i);
+    if ( renderer.primitive == MeshRendererComponent::Model ) {
+      continue;
+    }
+    int entity = renderers.entity(i);
+    const MaterialComponent* material = scene_.materials().find(entity);
+    paintPrimitive(primitiveBuffer(renderer.primitive), material ? material->albedo : nullptr, scene_.world(entity));
+  }
+}
 
-  normalShader_.setUniformValue("model", model);
-  normalShader_.setUniformValue("view", view);
-  normalShader_.setUniformValue("projection", projection_);
+void OpenglWidget::paintPrimitive(QOpenGLBuffer& vbo, QOpenGLTexture* texture, const QMatrix4x4& model)
+{
+  if ( !texture ) {
+    return;
+  }
+  objectShader_.bind();
+  setTransformUniforms(objectShader_, model);
+  objectShader_.setUniformValue("viewPos", camera_.position());
+  texture->bind(0);
+  objectShader_.setUniformValue("texture0", 0);
 
-  cubeVBO_.bind();
+  vbo.bind();
 
   int offset = 0;
 
-  auto vertLoc = normalShader_.attributeLocation("inPos");
-  normalShader_.enableAttributeArray(vertLoc);
-  normalShader_.setAttributeBuffer(vertLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
+  auto vertLoc = objectShader_.attributeLocation("inPos");
+  objectShader_.enableAttributeArray(vertLoc);
+  objectShader_.setAttributeBuffer(vertLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
 
   offset += sizeof (QVector3D);
 
-  auto texLoc = normalShader_.attributeLocation("inTexCoord");
-  normalShader_.enableAttributeArray(texLoc);
-  normalShader_.setAttributeBuffer(texLoc, GL_FLOAT, offset, 2, sizeof(Vertex));
+  auto texLoc = objectShader_.attributeLocation("inTexCoord");
+  objectShader_.enableAttributeArray(texLoc);
+  objectShader_.setAttributeBuffer(texLoc, GL_FLOAT, offset, 2, sizeof(Vertex));
 
   offset += sizeof (QVector2D);
 
-  auto normalLoc = normalShader_.attributeLocation("inNormal");
-  normalShader_.enableAttributeArray(normalLoc);
-  normalShader_.setAttributeBuffer(normalLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
+  auto normalLoc = objectShader_.attributeLocation("inNormal");
+  objectShader_.enableAttributeArray(normalLoc);
+  objectShader_.setAttributeBuffer(normalLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
 
-  glDrawArrays(GL_TRIANGLES, 0, cubeVBO_.size());
+  glDrawArrays(GL_TRIANGLES, 0, vbo.size() / int(sizeof(Vertex)));
+  texture->release();
 }
 
 void OpenglWidget::setLightShader(QOpenGLShaderProgram& shader)
 {
   if (!shader.isLinked()) {return;}
   shader.bind();
-  shader.setUniformValue("lightDir.direction", 0.55f, -1.0f, 1.0f);
+  shader.setUniformValue("lightDir.direction", kLightDirection);
   shader.setUniformValue("lightDir.ambient", 0.05f, 0.05f, 0.05f);
   shader.setUniformValue("lightDir.diffuse", 0.4f, 0.4f, 0.4f);
   shader.setUniformValue("lightDir.specular", 0.5f, 0.5f, 0.5f);
-  for ( int i = 0; i < kPosLightCount; i++) {
-    QString name = QString("pointLights[%1].%2").arg(i);
-    shader.setUniformValue( QString(name).arg("position") .toStdString().c_str(), pointLights_[i].position);
-    shader.setUniformValue( QString(name).arg("ambient")  .toStdString().c_str(), pointLights_[i].ambient);
-    shader.setUniformValue( QString(name).arg("diffuse")  .toStdString().c_str(), pointLights_[i].diffuse);
-    shader.setUniformValue( QString(name).arg("specular") .toStdString().c_str(), pointLights_[i].specular);
-    shader.setUniformValue( QString(name).arg("constant") .toStdString().c_str(), pointLights_[i].constant);
-    shader.setUniformValue( QString(name).arg("linear")   .toStdString().c_str(), pointLights_[i].linear);
-    shader.setUniformValue( QString(name).arg("quadratic").toStdString().c_str(), pointLights_[i].quadratic);
+  const ComponentArray<PointLightComponent>& lights = scene_.pointLights();
+  for ( int i = 0; i < qMin(lights.size(), kPosLightCount); i++) {
+    const PointLightUniforms& names = pointLightUniforms().at(i);
+    const PointLightComponent& light = lights.at(i);
+    shader.setUniformValue( names.position.constData(), scene_.world(lights.entity(i)).column(3).toVector3D());
+    shader.setUniformValue( names.ambient.constData(), light.ambient);
+    shader.setUniformValue( names.diffuse.constData(), light.diffuse);
+    shader.setUniformValue( names.specular.constData(), light.specular);
+    shader.setUniformValue( names.constant.constData(), light.constant);
+    shader.setUniformValue( names.linear.constData(), light.linear);
+    shader.setUniformValue( names.quadratic.constData(), light.quadratic);
 
   }
   // lamp
@@ -682,70 +1601,62 @@ void OpenglWidget::setLightShader(QOpenGLShaderProgram& shader)
   shader.setUniformValue("lamp.quadratic", 0.032f);
   shader.setUniformValue("lamp.cutOff", float(cos( qDegreesToRadians( 12.5 ) )));
   shader.setUniformValue("lamp.outerCutOff", float(cos( qDegreesToRadians( 15.0 ) )));
+  shader.setUniformValue("shadowMap", kShadowTextureUnit);
 }
 
-void OpenglWidget::paintLight(const QVector3D& position, const QVector3D& color, float scale)
+void OpenglWidget::paintLights(float scale)
 {
-  QMatrix4x4 model;
-  model.setToIdentity();
-  model.translate(position);
-  model.scale(scale);
+  // матрицы и цвета всех источников уходят одним instanced draw через кольцевой буфер
+  struct LightInstance {
+    float model[16];
+    float color[3];
+    float padding;
+  };
+  LightInstance instances[kPosLightCount];
+  int count = 0;
+  const ComponentArray<PointLightComponent>& lights = scene_.pointLights();
+  for ( int i = 0; i < qMin(lights.size(), kPosLightCount); i++ ) {
+    const PointLightComponent& light = lights.at(i);
+    QMatrix4x4 model = scene_.world(lights.entity(i));
+    model.scale(scale);
+    LightInstance& instance = instances[count++];
+    std::memcpy(instance.model, model.constData(), sizeof(instance.model));
+    instance.color[0] = light.diffuse.x();
+    instance.color[1] = light.diffuse.y();
+    instance.color[2] = light.diffuse.z();
+    instance.padding = 0.0f;
+  }
+  GLintptr offset = ringBuffer_.write(instances, GLsizeiptr(count * sizeof(LightInstance)));
+  if ( offset < 0 ) { return; }
 
   lightShader_.bind();
-  auto view = camera_.getView();
-  QMatrix4x4 modelViewProjectionMatrix{projection_ * view * model};
-  //qDebug() << modelViewProjectionMatrix;
-  lightShader_.setUniformValue("qt_ModelViewProjectionMatrix", modelViewProjectionMatrix);
-  lightShader_.setUniformValue("color", color);
+  lightShader_.setUniformValue("viewProjection", viewProjection_);
 
   cubeVBO_.bind();
-
-  int offset = 0;
-
   auto vertLoc = lightShader_.attributeLocation("inPos");
   lightShader_.enableAttributeArray(vertLoc);
-  lightShader_.setAttributeBuffer(vertLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
-
-  glDrawArrays(GL_TRIANGLES, 0, cubeVBO_.size());
-}
-
-void OpenglWidget::paintFloor()
-{
-  QMatrix4x4 model;
-  model.setToIdentity();
-  model.translate(QVector3D{0.0f, float(-kCubeWidth/2), 0.0f});
-  objectShader_.bind();
-  auto view = camera_.getView();
-
-  objectShader_.setUniformValue("model", model);
-  objectShader_.setUniformValue("view", view);
-  objectShader_.setUniformValue("projection", projection_);
-  objectShader_.setUniformValue("viewPos", camera_.position());
-  tFloor_->bind(1);
-  objectShader_.setUniformValue("texture0", 1);
-
-  floorVBO_.bind();
-
-  int offset = 0;
-
-  auto vertLoc = objectShader_.attributeLocation("inPos");
-  objectShader_.enableAttributeArray(vertLoc);
-  objectShader_.setAttributeBuffer(vertLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
-
-  offset += sizeof (QVector3D);
-
-  auto texLoc = objectShader_.attributeLocation("inTexCoord");
-  objectShader_.enableAttributeArray(texLoc);
-  objectShader_.setAttributeBuffer(texLoc, GL_FLOAT, offset, 2, sizeof(Vertex));
+  lightShader_.setAttributeBuffer(vertLoc, GL_FLOAT, 0, 3, sizeof(Vertex));
+
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glBindBuffer(GL_ARRAY_BUFFER, ringBuffer_.buffer());
+  for ( int i = 0; i < 4; ++i ) {
+    lightShader_.enableAttributeArray(kLightModelLocation + i);
+    lightShader_.setAttributeBuffer(kLightModelLocation + i, GL_FLOAT, int(offset + i * 4 * sizeof(float)), 4, sizeof(LightInstance));
+    f->glVertexAttribDivisor(kLightModelLocation + i, 1);
+  }
+  lightShader_.enableAttributeArray(kLightColorLocation);
+  lightShader_.setAttributeBuffer(kLightColorLocation, GL_FLOAT, int(offset + offsetof(LightInstance, color)), 3, sizeof(LightInstance));
+  f->glVertexAttribDivisor(kLightColorLocation, 1);
 
-  offset += sizeof (QVector2D);
+  f->glDrawArraysInstanced(GL_TRIANGLES, 0, cubeVBO_.size() / int(sizeof(Vertex)), count);
 
-  auto normalLoc = objectShader_.attributeLocation("inNormal");
-  objectShader_.enableAttributeArray(normalLoc);
-  objectShader_.setAttributeBuffer(normalLoc, GL_FLOAT, offset, 3, sizeof(Vertex));
-
-  glDrawArrays(GL_TRIANGLES, 0, floorVBO_.size());
-  tFloor_->release();
+  for ( int i = 0; i < 4; ++i ) {
+    f->glVertexAttribDivisor(kLightModelLocation + i, 0);
+    lightShader_.disableAttributeArray(kLightModelLocation + i);
+  }
+  f->glVertexAttribDivisor(kLightColorLocation, 0);
+  lightShader_.disableAttributeArray(kLightColorLocation);
+  f->glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void OpenglWidget::paintCubeMap()
@@ -771,23 +1682,56 @@ void OpenglWidget::paintCubeMap()
   tCubeMap_->release();
 }
 
-void OpenglWidget::paintCustomObject()
+void OpenglWidget::paintModels()
 {
-  QMatrix4x4 model;
-  model.setToIdentity();
-  model.rotate(rotate_);
-  model.scale(0.5);
+  if ( models_.isEmpty() ) {
+    return;
+  }
   PBRShader_.bind();
-  auto view = camera_.getView();
-
-  PBRShader_.setUniformValue("model", model);
-  PBRShader_.setUniformValue("view", view);
   PBRShader_.setUniformValue("viewPos", camera_.position());
-  PBRShader_.setUniformValue("projection", projection_);
-  if( customObject_ ) {
-    customObject_->draw(PBRShader_);
+  DrawView drawView;
+  drawView.position = camera_.position();
+  drawView.viewProjection = viewProjection_;
+  drawView.pixelScale = lod_ ? projection_(1, 1) * height() * 0.5f : 0.0f;
+  drawView.textureScale = projection_(1, 1) * height() * 0.5f;
+  drawView.meshletCulling = meshletCulling_;
+  drawView.arena = &frameArena_;
+  for ( int i = 0; i < models_.size(); i++ ) {
+    OGLObject* object = models_.at(i);
+    if ( !object->isStreaming() ) {
+      continue;
+    }
+    bool wasReady = object->outOfCore()->isReady();
+    if ( object->updateStreaming(scene_.world(modelEntities_.at(i)), drawView) ) {
+      // сменился набор кусков - кэш статических теней и вершины для нормалей устарели
+      shadowMap_.invalidateStatic();
+      debugVertexes_.remove(object);
+      if ( !wasReady ) {
+        initInstanceGrid();
+      }
+    }
+    const OutOfCoreModel* outOfCore = object->outOfCore();
+    frameStats_.streamChunks = outOfCore->chunkCount();
+    frameStats_.streamResidentChunks = outOfCore->residentChunks();
+    frameStats_.streamLoadingChunks = outOfCore->loadingChunks();
+    frameStats_.streamResidentBytes = outOfCore->residentBytes();
+    frameStats_.streamBudget = outOfCore->residentBudget();
+    frameStats_.streamImportProgress = outOfCore->importProgress();
   }
-
+  // обход и отсечение в рабочих потоках, отправка - здесь, в потоке контекста
+  drawListBuilder_.build(scene_, occlusionCulling_ ? &occlusionCuller_ : nullptr, drawView);
+  drawListBuilder_.submit(PBRShader_);
+  frameStats_.lodTrianglesDrawn = drawListBuilder_.trianglesDrawn();
+  frameStats_.lodTrianglesSaved = drawListBuilder_.trianglesSaved();
+  frameStats_.meshletTriangles = drawListBuilder_.meshletTriangles();
+  frameStats_.meshletTrianglesVisible = drawListBuilder_.meshletTrianglesVisible();
+  frameStats_.sceneInstances = drawListBuilder_.instances();
+  frameStats_.sceneInstancesCulled = drawListBuilder_.instancesCulled();
+  frameStats_.drawItems = drawListBuilder_.drawItems();
+  frameStats_.drawMeshBinds = drawListBuilder_.meshBinds();
+  frameStats_.drawTasks = drawListBuilder_.tasks();
+  frameStats_.drawBuildMs = drawListBuilder_.buildMs();
+  frameStats_.drawSubmitMs = drawListBuilder_.submitMs();
 }
 
 void OpenglWidget::paintTest(QOpenGLShaderProgram& shader)
@@ -800,12 +1744,8 @@ void OpenglWidget::paintTest(QOpenGLShaderProgram& shader)
   model.setToIdentity();
 //  model.rotate(rotate_);
   PBRShader_.bind();
-  auto view = camera_.getView();
-
-  shader.setUniformValue("model", model);
-  shader.setUniformValue("view", view);
+  setTransformUniforms(shader, model);
   shader.setUniformValue("viewPos", camera_.position());
-  shader.setUniformValue("projection", projection_);
   if ( false ) {
 //    material_->textureAlbedo()->bind(0);
     shader.setUniformValue("albedo0",0);
@@ -899,6 +1839,31 @@ void OpenglWidget::paintTest(QOpenGLShaderProgram& shader)
   shader.release();
 }
 
+void OpenglWidget::processHotReload()
+{
+  HotReload::Result result = hotReload_.process();
+  if ( !result.models.isEmpty() ) {
+    // у новых мешей свои LOD, а границы моделей и шаг сетки копий считаются заново
+    ComponentArray<MeshRendererComponent>& renderers = scene_.meshRenderers();
+    for ( int i = 0; i < renderers.size(); i++ ) {
+      if ( result.models.contains(renderers.at(i).object) ) {
+        renderers.at(i).lods.clear();
+      }
+    }
+    // копии вершин для нормалей снимаются заново с новых мешей
+    for ( const OGLObject* object : result.models ) {
+      debugVertexes_.remove(object);
+    }
+    initInstanceGrid();
+    shadowMap_.invalidateStatic();
+  }
+  if ( !result.programs.isEmpty() ) {
+    // после сборки заново значения uniform-переменных потеряны
+    setLightShader(objectShader_);
+    setLightShader(PBRShader_);
+  }
+}
+
 void OpenglWidget::updateParametrs()
 {
   auto rect = geometry();
@@ -911,12 +1876,11 @@ void OpenglWidget::updateParametrs()
 void OpenglWidget::changeLightPosSlot()
 {
   double velocity = 0.0001;
-  pointLights_[0].position = QVector3D{3.0f * float(sin(QDateTime::currentMSecsSinceEpoch()*velocity * M_PI)), 2.0f, float(cos(QDateTime::currentMSecsSinceEpoch()*velocity  * M_PI)) * 3.0f};
-  QString name = QString("pointLights[%1].%2").arg(0);
-  objectShader_.setUniformValue( QString(name).arg("position") .toStdString().c_str(), pointLights_[0].position);
+  QMatrix4x4 local;
+  local.translate(3.0f * float(sin(QDateTime::currentMSecsSinceEpoch()*velocity * M_PI)), 2.0f, float(cos(QDateTime::currentMSecsSinceEpoch()*velocity  * M_PI)) * 3.0f);
+  scene_.setLocal(lightEntities_.first(), local);
   if ( rotateFlag_ ) {
-    angle_++;
-    rotate_ = QQuaternion::fromAxisAndAngle(QVector3D{1.0,1.0,0.0}, angle_);
+    scene_.animate();
   }
   updateParametrs();
 }
@@ -924,7 +1888,10 @@ void OpenglWidget::changeLightPosSlot()
 void OpenglWidget::defaultPointsLights()
 {
   for ( int i = 0; i < kPosLightCount; i++) {
-    LightPos light{pointLightPositions[i]};
-    pointLights_.append(light);
+    QMatrix4x4 local;
+    local.translate(pointLightPositions[i]);
+    int entity = scene_.createEntity(local);
+    scene_.pointLights().add(entity);
+    lightEntities_.append(entity);
   }
 }
@@ -6,18 +6,35 @@
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
 #include <QTimer>
 
 #include "camera.h"
 #include "structs.h"
 #include "oglobject.h"
+#include "shadowmap.h"
+#include "framestats.h"
+#include "occlusionculler.h"
+#include "framearena.h"
+#include "gpuringbuffer.h"
+#include "drawlist.h"
+#include "simdmath.h"
+#include "scene.h"
+#include "hotreload.h"
+#include "pathtracer.h"
+#include "rasterizer.h"
+#include "framegraph.h"
+#include "framesetup.h"
+#include "tonemap.h"
+#include "debugdraw.h"
+#include "resolutionscaler.h"
 
 
 namespace Ui {
 class OpenglWidget;
 }
 
-class OpenglWidget : public QOpenGLWidget
+class OpenglWidget : public QOpenGLWidget, private FramePainter
 {
   Q_OBJECT
 
@@ -28,6 +45,16 @@ public:
   void setFow(float fow);
   void setNearPlane(float nearPlane);
   void setFarPlane(float farPlane);
+  // бюджет видеопамяти под мипы потоковых текстур
+  void setTextureBudget(qint64 bytes);
+  // общий бюджет видеопамяти, сверх него выгружаются давно не рисовавшиеся меши и мипы
+  void setGpuMemoryBudget(qint64 bytes);
+  // сцена рисуется в уменьшенную цель, масштаб подбирается под бюджет времени кадра на GPU
+  void setDynamicResolution(bool flag);
+  void setFrameTimeTarget(float ms);
+  // при растяжении на экран - повышение резкости по соседним пикселям
+  void setSharpenUpscale(bool flag);
+  const ResolutionScaler& resolutionScaler() const { return resolutionScaler_; }
 
   void goForward();
   void goBack();
@@ -35,6 +62,22 @@ public:
   void goRight();
   void rotateCamera(const QPoint& diff );
   void switchLamp();
+  void switchOcclusionCulling();
+  void switchLod();
+  void switchMeshletCulling();
+  void switchInstanceGrid();
+  // эталонный кадр трассировкой путей на CPU в фоне: рядом с программой пишутся
+  // opengl.png (текущий кадр GL) и reference.png, который уточняется по мере накопления
+  void renderReference();
+  // кадр рисует SoftwareRasterizer вместо GL (для сравнения с llvmpipe на машинах без GPU);
+  // сцена снимается один раз при включении, камера остаётся живой
+  void switchSoftwareRenderer();
+  // сцена рисуется в HDR, на экран - одним проходом тонмаппинга (Reinhard / ACES по кругу)
+  void switchTonemap();
+  void switchBloom();
+  // отладочный вывод по кругу: выключен, источники, границы и каскады теней, + нормали,
+  // + BVH сцены (строится при включении по снимку сцены, как у эталонного кадра)
+  void switchDebugDraw();
   void setRotate( bool flag );
   void setPaintCubeMap( bool flag );
   void setPaintCubes( bool flag );
@@ -42,6 +85,10 @@ public:
   void setLightColor(int i, QVector3D color);
   void setLightPosition(int i, QVector3D position);
   void initCustomObject( QString& path );
+  // модель убирается со сцены вместе с копиями в сетке, буферами и слежением за файлами
+  void removeCustomObject( int index );
+  int customObjectCount() const { return models_.size(); }
+  const FrameStats& frameStats() const { return frameStats_; }
 
 protected:
   void initializeGL() override;
@@ -54,25 +101,61 @@ private:
   void initObjectShader();
   void initLightShader();
   void initSkyBoxShader();
-  void initNormalShader();
+  void initDebugShader();
   void initCustomObjectShader();
   void initPBRShader();
+  void initShadowShader();
+  void initTonemapShader();
+  void initBloomShaders();
   void initScene();
+  // контейнеры и пол - сущности со встроенной геометрией
+  void initSceneEntities();
   void initCube(float width);
   void initFloor(float width);
   void initCubeMap();
   void initTest();
+  // шейдеры и текстуры берутся из архива ресурсов, если он открыт, иначе из sources.qrc;
+  // в отладочной сборке шейдеры читаются из исходников и перезагружаются при сохранении
+  bool addShader( QOpenGLShaderProgram& program, QOpenGLShader::ShaderType type, const QString& path );
   QOpenGLTexture* loadTexture( const QString& path );
   QOpenGLTexture* loadCubeMap( const QVector<QString>& paths );
+  // проходы GL-кадра и цели рендера между ними (FrameSetup), заново каждый кадр
+  void buildFrameGraph();
   void paintScene();
-  void paintWoodContainer(const QVector3D& translate = QVector3D{0,0,0}, float scale = 1.0f);
-  void paintNormalCube( const QVector3D& translate = QVector3D{0,0,0}, float scale = 1.0f);
+  void paintShadows();
+  // FramePainter: проходы графа кадра
+  void paintShadowPass() override;
+  void paintScenePass() override;
+  void paintDebugPass() override;
+  void paintBloomDown(const FrameGraph& graph, int source, bool firstLevel) override;
+  void paintBloomUp(const FrameGraph& graph, int source, int base) override;
+  // растягивает hdr на экран, если сцена рисовалась в уменьшенном разрешении
+  void paintTonemap(const FrameGraph& graph, int hdr, int bloom) override;
+  void paintFullscreen();
+  void prepareOcclusion();
+  // отладочная геометрия кадра в debugDraw_, рисует её проход "debug draw" графа кадра
+  void collectDebugDraw();
+  // вершины меша сущности в пространстве модели для вывода нормалей, читаются из буферов один раз
+  const QVector<Vertex>& debugVertexes(const MeshRendererComponent& renderer);
+  void paintShadowCasters(const QMatrix4x4& lightSpace, bool dynamic);
+  void paintDepthArrays(QOpenGLBuffer& vbo, const QMatrix4x4& model);
+  // "model", "mvp" и "normalMatrix" одиночного объекта, матрицы считает SimdMath
+  void setTransformUniforms(QOpenGLShaderProgram& shader, const QMatrix4x4& model);
+  // сетка копий загруженных моделей, пересоздаётся целиком
+  void initInstanceGrid();
+  QOpenGLBuffer& primitiveBuffer(MeshRendererComponent::Primitive primitive);
+  void paintPrimitives();
+  void paintPrimitive(QOpenGLBuffer& vbo, QOpenGLTexture* texture, const QMatrix4x4& model);
   void setLightShader( QOpenGLShaderProgram& shader );
-  void paintLight( const QVector3D& translate = QVector3D{0,0,0}, const QVector3D& color = QVector3D{1.0f,1.0f,1.0f}, float scale = 1.0f );
-  void paintFloor();
+  void paintLights(float scale);
   void paintCubeMap();
-  void paintCustomObject();
+  void paintModels();
   void paintTest(QOpenGLShaderProgram& shader);
+  // подмена изменившихся на диске моделей и шейдеров, в начале кадра
+  void processHotReload();
+  // снимок сцены для рендеров на CPU, в потоке контекста; небо не загружается
+  std::shared_ptr<CpuScene> captureCpuScene();
+  void paintSoftware();
   void updateParametrs();
   void defaultPointsLights();
 
@@ -81,18 +164,69 @@ private slots:
 
 
 private:
+  enum DebugMode { DebugOff, DebugGizmos, DebugNormals, DebugBvh, DebugModeCount };
+
   Ui::OpenglWidget *ui_ = nullptr;
   QMatrix4x4 projection_;
+  // projection_ * view камеры, один раз за кадр
+  QMatrix4x4 viewProjection_;
   QOpenGLShaderProgram objectShader_;
   QOpenGLShaderProgram lightShader_;
-  QOpenGLShaderProgram normalShader_;
+  QOpenGLShaderProgram debugShader_;
   QOpenGLShaderProgram skyBoxShader_;
   QOpenGLShaderProgram customObjectShader_;
   QOpenGLShaderProgram PBRShader_;
+  QOpenGLShaderProgram shadowShader_;
+  QOpenGLShaderProgram tonemapShader_;
+  QOpenGLShaderProgram bloomDownShader_;
+  QOpenGLShaderProgram bloomUpShader_;
+  // пустой: вершины полноэкранного треугольника считаются в шейдере
+  QOpenGLVertexArrayObject fullscreenVao_;
+  Tonemap::Operator tonemap_ = Tonemap::Aces;
+  float exposure_ = 1.0f;
+  bool bloom_ = true;
+  ResolutionScaler resolutionScaler_;
+  bool sharpen_ = true;
+  DebugDraw debugDraw_;
+  DebugMode debugMode_ = DebugOff;
+  // по модели или буферу встроенной геометрии; запись модели удаляется при замене её мешей
+  QHash<const void*, QVector<Vertex>> debugVertexes_;
+  Bvh debugBvh_;
+  ShadowMap shadowMap_;
+  FrameStats frameStats_;
+  FrameArena frameArena_;
+  GpuRingBuffer ringBuffer_;
+  FrameGraph frameGraph_;
+  // записи GpuMemory для буферов и текстур сцены, которые живут вместе с виджетом
+  QVector<int> sceneMemory_;
+  quint64 frame_ = 0;
+  OcclusionCuller occlusionCuller_;
+  bool occlusionCulling_ = true;
+  bool lod_ = true;
+  bool meshletCulling_ = true;
+  bool instanceGrid_ = false;
+  Scene scene_;
+  // загруженные модели и их сущности, модели живут до закрытия виджета
+  QVector<OGLObject*> models_;
+  QVector<int> modelEntities_;
+  // корень сетки копий (ребёнок первой модели) и сами копии
+  int gridEntity_ = Scene::kNone;
+  QVector<int> gridEntities_;
+  // точечные источники в порядке pointLights[i] в шейдерах
+  QVector<int> lightEntities_;
+  DrawListBuilder drawListBuilder_;
+  HotReload hotReload_;
+  // занят, пока его держит фоновая задача
+  std::shared_ptr<PathTracer> reference_;
+  // включён программный рендер
+  std::unique_ptr<SoftwareRasterizer> software_;
+  QVector<QVector3D> cubePositions_;
+  QVector<GLuint> cubeIndexes_;
+  QVector<QVector3D> floorPositions_;
+  QVector<GLuint> floorIndexes_;
   QOpenGLTexture* tWoodContainer_ = nullptr;
   QOpenGLTexture* tFloor_ = nullptr;
   QOpenGLTexture* tCubeMap_ = nullptr;
-  OGLObject* customObject_ = nullptr;
   QOpenGLBuffer cubeVBO_;
   QOpenGLBuffer floorVBO_;
   QOpenGLBuffer cubeMapVBO_;
@@ -108,9 +242,6 @@ private:
   bool paintCustomObject_ = false;
   bool paintCubeMap_ = true;
   Camera camera_;
-  QVector<LightPos> pointLights_;
-  QQuaternion rotate_;
-  float angle_ = 0;
 };
 
 #endif // OPENGLWIDGET_H
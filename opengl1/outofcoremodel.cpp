@@ -0,0 +1,830 @@
+#include "outofcoremodel.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include "jobsystem.h"
+
+static const quint32 kIndexMagic = 0x4f4f4331; // "OOC1"
+static const qint32 kIndexVersion = 2;
+// файл читается блоками, промежуточные файлы пишутся через буфер такого размера
+static const int kReadBlock = 4 * 1024 * 1024;
+static const int kWriteBlock = 4 * 1024 * 1024;
+// треугольники, ждущие записи в файлы кусков: это и есть лимит памяти раскладки
+static const qint64 kImportBufferBytes = 64ll * 1024 * 1024;
+static const int kFaceBlock = 64 * 1024;
+// сетка подсчёта треугольников; куски - листья kd-разбиения этой сетки,
+// лист из одной плотной ячейки при записи режется на куски по kTrianglesPerChunk
+static const int kCountGrid = 64;
+static const qint64 kTrianglesPerChunk = 64 * 1024;
+static const int kMaxPolygonCorners = 64;
+static const int kMaxLoadsInFlight = 4;
+
+namespace {
+
+// грань после раскладки строк: индексы с 1, 0 - нет данных; material - индекс имени или -1.
+// Индексы 64-битные: в файлах в десятки гигабайт вершин бывает больше 2^31
+struct FaceRecord
+{
+  qint64 position[3];
+  qint64 texCoord[3];
+  qint64 normal[3];
+  qint32 material;
+};
+
+// вершина в файле куска
+struct PackedVertex
+{
+  float position[3];
+  float texCoord[2];
+  float normal[3];
+};
+
+struct Bucket
+{
+  QByteArray data;
+  BoundingBox bounds;
+  qint64 triangles = 0;
+  int material = -1;
+};
+
+// кусок, в который сейчас пишутся треугольники области с материалом
+struct OpenBucket
+{
+  qint64 key = 0;
+  qint64 triangles = 0;
+};
+
+struct CellRange
+{
+  int lo[3];
+  int hi[3];
+};
+
+class LineReader
+{
+public:
+  explicit LineReader(QFile& file) : file_(file) {}
+
+  bool next(const char*& begin, const char*& end)
+  {
+    for ( ;; ) {
+      int newline = buffer_.indexOf('\n', position_);
+      if ( newline >= 0 ) {
+        begin = buffer_.constData() + position_;
+        end = buffer_.constData() + newline;
+        position_ = newline + 1;
+        return true;
+      }
+      if ( file_.atEnd() ) {
+        if ( position_ >= buffer_.size() ) {
+          return false;
+        }
+        begin = buffer_.constData() + position_;
+        end = buffer_.constData() + buffer_.size();
+        position_ = buffer_.size();
+        return true;
+      }
+      QByteArray block = file_.read(kReadBlock);
+      read_ += block.size();
+      buffer_ = buffer_.mid(position_) + block;
+      position_ = 0;
+    }
+  }
+
+  qint64 bytesRead() const { return read_; }
+
+private:
+  QFile& file_;
+  QByteArray buffer_;
+  int position_ = 0;
+  qint64 read_ = 0;
+};
+
+class BufferedWriter
+{
+public:
+  explicit BufferedWriter(const QString& path) : file_(path) {}
+  ~BufferedWriter() { close(); }
+
+  bool open() { return file_.open(QFile::WriteOnly | QFile::Truncate); }
+  void write(const void* data, int size)
+  {
+    buffer_.append(static_cast<const char*>(data), size);
+    if ( buffer_.size() >= kWriteBlock ) {
+      flush();
+    }
+  }
+  void flush()
+  {
+    file_.write(buffer_);
+    buffer_.clear();
+  }
+  void close()
+  {
+    if ( file_.isOpen() ) {
+      flush();
+      file_.close();
+    }
+  }
+
+private:
+  QFile file_;
+  QByteArray buffer_;
+};
+
+const char* skipSpaces(const char* p, const char* end)
+{
+  while ( p < end && (*p == ' ' || *p == '\t') ) {
+    p++;
+  }
+  return p;
+}
+
+bool hasKeyword(const char* p, const char* end, const char* keyword)
+{
+  while ( *keyword ) {
+    if ( p >= end || *p != *keyword ) {
+      return false;
+    }
+    p++;
+    keyword++;
+  }
+  return p < end && (*p == ' ' || *p == '\t');
+}
+
+// строка после ключевого слова без пробелов по краям
+QString restOfLine(const char* p, const char* end)
+{
+  return QString::fromUtf8(p, int(end - p)).trimmed();
+}
+
+int parseFloats(const char* p, const char* end, float* values, int count)
+{
+  // буфер строк всегда заканчивается '\n' или '\0', strtof не выйдет за него
+  int parsed = 0;
+  while ( parsed < count ) {
+    p = skipSpaces(p, end);
+    char* next = nullptr;
+    float value = std::strtof(p, &next);
+    if ( next == p || p >= end ) {
+      break;
+    }
+    values[parsed++] = value;
+    p = next;
+  }
+  return parsed;
+}
+
+// отрицательные индексы в obj отсчитываются от последнего прочитанного элемента
+qint64 resolveIndex(qint64 index, qint64 count)
+{
+  if ( index < 0 ) {
+    index = count + index + 1;
+  }
+  return index > 0 && index <= count ? index : 0;
+}
+
+int countCell(const QVector3D& point, const BoundingBox& bounds, int axis)
+{
+  float extent = bounds.max[axis] - bounds.min[axis];
+  if ( extent <= 0.0f ) {
+    return 0;
+  }
+  return qBound(0, int((point[axis] - bounds.min[axis]) / extent * kCountGrid), kCountGrid - 1);
+}
+
+int cellIndex(int x, int y, int z)
+{
+  return (z * kCountGrid + y) * kCountGrid + x;
+}
+
+// kd-разбиение сетки счётчиков: делим по медиане вдоль самой длинной стороны,
+// пока в части больше kTrianglesPerChunk треугольников
+void partition(const QVector<qint64>& counts, const CellRange& range, QVector<int>& cellChunk, int& chunkCount)
+{
+  int axis = 0;
+  for ( int i = 1; i < 3; i++ ) {
+    if ( range.hi[i] - range.lo[i] > range.hi[axis] - range.lo[axis] ) {
+      axis = i;
+    }
+  }
+  QVector<qint64> slices(range.hi[axis] - range.lo[axis], 0);
+  qint64 total = 0;
+  for ( int z = range.lo[2]; z < range.hi[2]; z++ ) {
+    for ( int y = range.lo[1]; y < range.hi[1]; y++ ) {
+      for ( int x = range.lo[0]; x < range.hi[0]; x++ ) {
+        qint64 count = counts.at(cellIndex(x, y, z));
+        int position[3] = {x, y, z};
+        slices[position[axis] - range.lo[axis]] += count;
+        total += count;
+      }
+    }
+  }
+  if ( total == 0 ) {
+    return;
+  }
+  if ( total <= kTrianglesPerChunk || slices.size() < 2 ) {
+    for ( int z = range.lo[2]; z < range.hi[2]; z++ ) {
+      for ( int y = range.lo[1]; y < range.hi[1]; y++ ) {
+        for ( int x = range.lo[0]; x < range.hi[0]; x++ ) {
+          cellChunk[cellIndex(x, y, z)] = chunkCount;
+        }
+      }
+    }
+    chunkCount++;
+    return;
+  }
+  int split = 1;
+  qint64 accumulated = slices.first();
+  while ( split < slices.size() - 1 && accumulated < total / 2 ) {
+    accumulated += slices.at(split);
+    split++;
+  }
+  CellRange left = range;
+  CellRange right = range;
+  left.hi[axis] = range.lo[axis] + split;
+  right.lo[axis] = range.lo[axis] + split;
+  partition(counts, left, cellChunk, chunkCount);
+  partition(counts, right, cellChunk, chunkCount);
+}
+
+bool readChunk(const QString& path, QVector<Vertex>& vertexes, QVector<GLuint>& indexes)
+{
+  QFile file{path};
+  if ( !file.open(QFile::ReadOnly) ) {
+    return false;
+  }
+  QByteArray data = file.readAll();
+  int count = data.size() / int(sizeof(PackedVertex));
+  const PackedVertex* packed = reinterpret_cast<const PackedVertex*>(data.constData());
+  vertexes.reserve(count);
+  indexes.reserve(count);
+  for ( int i = 0; i < count; i++ ) {
+    const PackedVertex& vertex = packed[i];
+    vertexes.append(Vertex{QVector3D{vertex.position[0], vertex.position[1], vertex.position[2]},
+                           QVector2D{vertex.texCoord[0], vertex.texCoord[1]},
+                           QVector3D{vertex.normal[0], vertex.normal[1], vertex.normal[2]}});
+    indexes.append(GLuint(i));
+  }
+  return count > 0;
+}
+
+}
+
+OutOfCoreModel::OutOfCoreModel(const QString& path) :
+  path_(path),
+  cacheDir_(path + ".chunks"),
+  defaultMaterial_(std::make_shared<Material>(QString("default")))
+{
+  if ( isIndexCurrent() ) {
+    importProgress_.store(1.0f);
+    importDone_.store(true);
+    return;
+  }
+  // раскладка - это минуты чтения диска, поэтому отдельный поток, а не задача планировщика
+  importer_ = std::thread([this] {
+    if ( !import() ) {
+      QFile::remove(indexPath());
+    }
+    importDone_.store(true, std::memory_order_release);
+  });
+}
+
+OutOfCoreModel::~OutOfCoreModel()
+{
+  cancel_.store(true);
+  if ( importer_.joinable() ) {
+    importer_.join();
+  }
+  // загрузки в работе завершаются через очередь главного потока
+  JobSystem& jobs = JobSystem::instance();
+  while ( loading_.load() > 0 ) {
+    jobs.processMainThreadJobs();
+    std::this_thread::yield();
+  }
+}
+
+void OutOfCoreModel::setMaterials(const QVector< std::shared_ptr<Material> >& materials)
+{
+  materials_ = materials;
+}
+
+QString OutOfCoreModel::chunkPath(qint64 key) const
+{
+  return cacheDir_ + QDir::separator() + QString("chunk_%1.bin").arg(key);
+}
+
+QString OutOfCoreModel::indexPath() const
+{
+  return cacheDir_ + QDir::separator() + QString("index.bin");
+}
+
+bool OutOfCoreModel::isIndexCurrent() const
+{
+  QFile file{indexPath()};
+  if ( !file.open(QFile::ReadOnly) ) {
+    return false;
+  }
+  QDataStream stream{&file};
+  quint32 magic = 0;
+  qint32 version = 0;
+  qint64 sourceSize = 0;
+  qint64 sourceModified = 0;
+  stream >> magic >> version >> sourceSize >> sourceModified;
+  QFileInfo source{path_};
+  return magic == kIndexMagic && version == kIndexVersion && sourceSize == source.size()
+      && sourceModified == source.lastModified().toMSecsSinceEpoch();
+}
+
+bool OutOfCoreModel::readIndex()
+{
+  QFile file{indexPath()};
+  if ( !file.open(QFile::ReadOnly) ) {
+    qDebug() << QString("out of core: no chunk index for %1").arg(path_);
+    return false;
+  }
+  QDataStream stream{&file};
+  quint32 magic = 0;
+  qint32 version = 0;
+  qint64 sourceSize = 0;
+  qint64 sourceModified = 0;
+  qint32 chunkCount = 0;
+  stream >> magic >> version >> sourceSize >> sourceModified;
+  if ( magic != kIndexMagic || version != kIndexVersion ) {
+    return false;
+  }
+  stream >> bounds_.min >> bounds_.max >> mtlLibraries_ >> materialNames_ >> chunkCount;
+  chunks_.clear();
+  chunks_.reserve(chunkCount);
+  for ( int i = 0; i < chunkCount; i++ ) {
+    Chunk chunk;
+    qint32 material = -1;
+    stream >> chunk.key >> material >> chunk.bounds.min >> chunk.bounds.max >> chunk.triangles;
+    chunk.material = material;
+    chunks_.append(chunk);
+  }
+  if ( stream.status() != QDataStream::Ok ) {
+    chunks_.clear();
+    return false;
+  }
+  qint64 triangles = 0;
+  for ( const auto& chunk : chunks_ ) {
+    triangles += chunk.triangles;
+  }
+  qDebug() << QString("out of core %1: %2 chunks, %3 triangles").arg(path_).arg(chunks_.size()).arg(triangles);
+  return true;
+}
+
+bool OutOfCoreModel::import()
+{
+  QFile source{path_};
+  if ( !source.open(QFile::ReadOnly) ) {
+    qDebug() << QString(" file %1 not open ").arg(path_);
+    return false;
+  }
+  QDir cache{cacheDir_};
+  cache.removeRecursively();
+  if ( !QDir().mkpath(cacheDir_) ) {
+    qDebug() << QString("out of core: can't create %1").arg(cacheDir_);
+    return false;
+  }
+  qint64 sourceSize = source.size();
+  QString positionsPath = cacheDir_ + QDir::separator() + QString("positions.tmp");
+  QString texCoordsPath = cacheDir_ + QDir::separator() + QString("texcoords.tmp");
+  QString normalsPath = cacheDir_ + QDir::separator() + QString("normals.tmp");
+  QString facesPath = cacheDir_ + QDir::separator() + QString("faces.tmp");
+
+  // проход 1: строки файла в массивы фиксированной длины на диске, границы модели
+  BoundingBox bounds;
+  QStringList mtlLibraries;
+  QStringList materialNames;
+  QHash<QString, int> materialIndex;
+  qint64 positionCount = 0;
+  qint64 texCoordCount = 0;
+  qint64 normalCount = 0;
+  qint64 faceCount = 0;
+  {
+    BufferedWriter positions{positionsPath};
+    BufferedWriter texCoords{texCoordsPath};
+    BufferedWriter normals{normalsPath};
+    BufferedWriter faces{facesPath};
+    if ( !positions.open() || !texCoords.open() || !normals.open() || !faces.open() ) {
+      return false;
+    }
+    LineReader reader{source};
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    qint32 material = -1;
+    qint64 lines = 0;
+    while ( reader.next(begin, end) ) {
+      if ( (++lines & 0xffff) == 0 ) {
+        if ( cancel_.load(std::memory_order_relaxed) ) {
+          return false;
+        }
+        importProgress_.store(0.7f * float(reader.bytesRead()) / float(qMax<qint64>(1, sourceSize)), std::memory_order_relaxed);
+      }
+      const char* p = skipSpaces(begin, end);
+      float values[3] = {0.0f, 0.0f, 0.0f};
+      if ( hasKeyword(p, end, "v") ) {
+        parseFloats(p + 1, end, values, 3);
+        positions.write(values, sizeof(values));
+        bounds.extend(QVector3D{values[0], values[1], values[2]});
+        positionCount++;
+      }
+      else if ( hasKeyword(p, end, "vt") ) {
+        parseFloats(p + 2, end, values, 2);
+        texCoords.write(values, 2 * sizeof(float));
+        texCoordCount++;
+      }
+      else if ( hasKeyword(p, end, "vn") ) {
+        parseFloats(p + 2, end, values, 3);
+        normals.write(values, sizeof(values));
+        normalCount++;
+      }
+      else if ( hasKeyword(p, end, "f") ) {
+        qint64 corners[kMaxPolygonCorners][3];
+        int cornerCount = 0;
+        p += 1;
+        while ( cornerCount < kMaxPolygonCorners ) {
+          p = skipSpaces(p, end);
+          char* next = nullptr;
+          qint64 position = std::strtoll(p, &next, 10);
+          if ( p >= end || next == p ) {
+            break;
+          }
+          p = next;
+          qint64 texCoord = 0;
+          qint64 normal = 0;
+          if ( *p == '/' ) {
+            p++;
+            if ( *p != '/' ) {
+              texCoord = std::strtoll(p, &next, 10);
+              p = next;
+            }
+            if ( *p == '/' ) {
+              p++;
+              normal = std::strtoll(p, &next, 10);
+              p = next;
+            }
+          }
+          corners[cornerCount][0] = resolveIndex(position, positionCount);
+          corners[cornerCount][1] = resolveIndex(texCoord, texCoordCount);
+          corners[cornerCount][2] = resolveIndex(normal, normalCount);
+          cornerCount++;
+        }
+        // многоугольники - веером
+        for ( int i = 1; i + 1 < cornerCount; i++ ) {
+          FaceRecord face{};
+          const int triangle[3] = {0, i, i + 1};
+          for ( int k = 0; k < 3; k++ ) {
+            face.position[k] = corners[triangle[k]][0];
+            face.texCoord[k] = corners[triangle[k]][1];
+            face.normal[k] = corners[triangle[k]][2];
+          }
+          face.material = material;
+          if ( face.position[0] > 0 && face.position[1] > 0 && face.position[2] > 0 ) {
+            faces.write(&face, sizeof(face));
+            faceCount++;
+          }
+        }
+      }
+      else if ( hasKeyword(p, end, "usemtl") ) {
+        QString name = restOfLine(p + 6, end);
+        if ( !materialIndex.contains(name) ) {
+          materialIndex.insert(name, materialNames.size());
+          materialNames.append(name);
+        }
+        material = materialIndex.value(name);
+      }
+      else if ( hasKeyword(p, end, "mtllib") ) {
+        mtlLibraries.append(restOfLine(p + 6, end));
+      }
+    }
+  }
+  source.close();
+  qDebug() << QString("out of core %1: %2 positions, %3 triangles").arg(path_).arg(positionCount).arg(faceCount);
+
+  // позиции, текстурные координаты и нормали читаются через отображение файлов:
+  // страницы подкачивает система, в памяти процесса они не копятся
+  QFile positionsFile{positionsPath};
+  QFile texCoordsFile{texCoordsPath};
+  QFile normalsFile{normalsPath};
+  QFile facesFile{facesPath};
+  if ( !positionsFile.open(QFile::ReadOnly) || !texCoordsFile.open(QFile::ReadOnly)
+       || !normalsFile.open(QFile::ReadOnly) || !facesFile.open(QFile::ReadOnly) ) {
+    return false;
+  }
+  auto mapFloats = []( QFile& file ) -> const float* {
+    return file.size() > 0 ? reinterpret_cast<const float*>(file.map(0, file.size())) : nullptr;
+  };
+  const float* positionData = mapFloats(positionsFile);
+  const float* texCoordData = mapFloats(texCoordsFile);
+  const float* normalData = mapFloats(normalsFile);
+  if ( !positionData ) {
+    return false;
+  }
+  auto position = [positionData]( qint64 index ) {
+    const float* value = positionData + (index - 1) * 3;
+    return QVector3D{value[0], value[1], value[2]};
+  };
+  auto centroid = [&position]( const FaceRecord& face ) {
+    return (position(face.position[0]) + position(face.position[1]) + position(face.position[2])) / 3.0f;
+  };
+  auto forEachFace = [this, &facesFile, faceCount]( float progressBegin, float progressEnd, const std::function<void(const FaceRecord&)>& body ) {
+    facesFile.seek(0);
+    qint64 done = 0;
+    while ( !facesFile.atEnd() ) {
+      if ( cancel_.load(std::memory_order_relaxed) ) {
+        return false;
+      }
+      QByteArray block = facesFile.read(qint64(kFaceBlock) * qint64(sizeof(FaceRecord)));
+      const FaceRecord* records = reinterpret_cast<const FaceRecord*>(block.constData());
+      int count = block.size() / int(sizeof(FaceRecord));
+      for ( int i = 0; i < count; i++ ) {
+        body(records[i]);
+      }
+      done += count;
+      importProgress_.store(progressBegin + (progressEnd - progressBegin) * float(done) / float(qMax<qint64>(1, faceCount)),
+                            std::memory_order_relaxed);
+    }
+    return true;
+  };
+
+  // проход 2: плотность треугольников по сетке и kd-разбиение на куски примерно равного размера
+  QVector<qint64> counts(kCountGrid * kCountGrid * kCountGrid, 0);
+  auto cellOf = [&bounds]( const QVector3D& point ) {
+    return cellIndex(countCell(point, bounds, 0), countCell(point, bounds, 1), countCell(point, bounds, 2));
+  };
+  bool completed = forEachFace(0.7f, 0.8f, [&counts, &centroid, &cellOf]( const FaceRecord& face ) {
+    counts[cellOf(centroid(face))]++;
+  });
+  if ( !completed ) {
+    return false;
+  }
+  QVector<int> cellChunk(counts.size(), -1);
+  int regionCount = 0;
+  partition(counts, CellRange{{0, 0, 0}, {kCountGrid, kCountGrid, kCountGrid}}, cellChunk, regionCount);
+  counts = QVector<qint64>{};
+
+  // проход 3: треугольники в файлы кусков (область x материал); буфер сбрасывается на диск по лимиту.
+  // Область, в которой одна плотная ячейка дала больше kTrianglesPerChunk треугольников,
+  // продолжается в новом куске с ключом после ключей областей
+  qint64 materialSlots = materialNames.size() + 1;
+  qint64 nextKey = qint64(regionCount) * materialSlots + 1;
+  QHash<qint64, OpenBucket> openBuckets;
+  QHash<qint64, Bucket> buckets;
+  qint64 buffered = 0;
+  auto flush = [this, &buckets, &buffered] {
+    for ( qint64 key : buckets.keys() ) {
+      Bucket& bucket = buckets[key];
+      if ( bucket.data.isEmpty() ) {
+        continue;
+      }
+      QFile file{chunkPath(key)};
+      if ( file.open(QFile::WriteOnly | QFile::Append) ) {
+        file.write(bucket.data);
+      }
+      bucket.data.clear();
+    }
+    buffered = 0;
+  };
+  completed = forEachFace(0.8f, 1.0f, [&]( const FaceRecord& face ) {
+    qint64 region = qint64(cellChunk.at(cellOf(centroid(face)))) * materialSlots + face.material + 1;
+    if ( !openBuckets.contains(region) ) {
+      openBuckets.insert(region, OpenBucket{region, 0});
+    }
+    OpenBucket& open = openBuckets[region];
+    if ( open.triangles >= kTrianglesPerChunk ) {
+      open = OpenBucket{nextKey++, 0};
+    }
+    open.triangles++;
+    Bucket& bucket = buckets[open.key];
+    bucket.material = face.material;
+    PackedVertex vertexes[3];
+    QVector3D points[3];
+    bool hasNormals = true;
+    for ( int k = 0; k < 3; k++ ) {
+      points[k] = position(face.position[k]);
+      bucket.bounds.extend(points[k]);
+      PackedVertex& vertex = vertexes[k];
+      vertex.position[0] = points[k].x();
+      vertex.position[1] = points[k].y();
+      vertex.position[2] = points[k].z();
+      vertex.texCoord[0] = 0.0f;
+      vertex.texCoord[1] = 0.0f;
+      if ( texCoordData && face.texCoord[k] > 0 && face.texCoord[k] <= texCoordCount ) {
+        vertex.texCoord[0] = texCoordData[(face.texCoord[k] - 1) * 2];
+        vertex.texCoord[1] = texCoordData[(face.texCoord[k] - 1) * 2 + 1];
+      }
+      if ( normalData && face.normal[k] > 0 && face.normal[k] <= normalCount ) {
+        const float* normal = normalData + (face.normal[k] - 1) * 3;
+        vertex.normal[0] = normal[0];
+        vertex.normal[1] = normal[1];
+        vertex.normal[2] = normal[2];
+      }
+      else {
+        hasNormals = false;
+      }
+    }
+    if ( !hasNormals ) {
+      // у сканов нормалей часто нет: берём нормаль грани
+      QVector3D normal = QVector3D::crossProduct(points[1] - points[0], points[2] - points[0]).normalized();
+      for ( auto& vertex : vertexes ) {
+        vertex.normal[0] = normal.x();
+        vertex.normal[1] = normal.y();
+        vertex.normal[2] = normal.z();
+      }
+    }
+    bucket.data.append(reinterpret_cast<const char*>(vertexes), int(sizeof(vertexes)));
+    bucket.triangles++;
+    buffered += qint64(sizeof(vertexes));
+    if ( buffered >= kImportBufferBytes ) {
+      flush();
+    }
+  });
+  if ( !completed ) {
+    return false;
+  }
+  flush();
+  positionsFile.close();
+  texCoordsFile.close();
+  normalsFile.close();
+  facesFile.close();
+  for ( const auto& path : { positionsPath, texCoordsPath, normalsPath, facesPath } ) {
+    QFile::remove(path);
+  }
+
+  // индекс пишется последним: по его наличию видно, что раскладка завершена
+  QFile indexFile{indexPath()};
+  if ( !indexFile.open(QFile::WriteOnly | QFile::Truncate) ) {
+    return false;
+  }
+  QFileInfo sourceInfo{path_};
+  QDataStream stream{&indexFile};
+  stream << kIndexMagic << kIndexVersion << sourceInfo.size() << sourceInfo.lastModified().toMSecsSinceEpoch();
+  stream << bounds.min << bounds.max << mtlLibraries << materialNames << qint32(buckets.size());
+  for ( qint64 key : buckets.keys() ) {
+    const Bucket& bucket = buckets[key];
+    stream << key << qint32(bucket.material) << bucket.bounds.min << bucket.bounds.max << bucket.triangles;
+  }
+  importProgress_.store(1.0f);
+  qDebug() << QString("out of core %1: %2 chunks in %3").arg(path_).arg(buckets.size()).arg(cacheDir_);
+  return stream.status() == QDataStream::Ok;
+}
+
+bool OutOfCoreModel::update(const QMatrix4x4& model, const DrawView& view)
+{
+  if ( failed_ ) {
+    return false;
+  }
+  if ( !ready_ ) {
+    if ( !importDone_.load(std::memory_order_acquire) ) {
+      return false;
+    }
+    if ( importer_.joinable() ) {
+      importer_.join();
+    }
+    ready_ = readIndex();
+    failed_ = !ready_;
+    return ready_;
+  }
+
+  // сначала видимые куски по расстоянию до камеры, за ними невидимые - впрок, если хватит лимита
+  Frustum frustum{view.viewProjection * model};
+  QVector3D camera = model.inverted().map(view.position);
+  float invisiblePenalty = bounds_.size().length();
+  order_.resize(chunks_.size());
+  priority_.resize(chunks_.size());
+  wanted_.fill(0, chunks_.size());
+  for ( int i = 0; i < chunks_.size(); i++ ) {
+    const BoundingBox& box = chunks_.at(i).bounds;
+    float radius = box.size().length() * 0.5f;
+    float distance = qMax(0.0f, (box.center() - camera).length() - radius);
+    priority_[i] = frustum.intersects(box.center(), radius) ? distance : distance + invisiblePenalty;
+    order_[i] = i;
+  }
+  std::sort(order_.begin(), order_.end(), [this]( int a, int b ) {
+    return priority_.at(a) < priority_.at(b);
+  });
+  qint64 planned = 0;
+  for ( int index : order_ ) {
+    const Chunk& chunk = chunks_.at(index);
+    if ( chunk.state == ChunkState::Failed ) {
+      continue;
+    }
+    qint64 bytes = estimatedBytes(chunk);
+    if ( planned + bytes > residentBudget_ ) {
+      break;
+    }
+    planned += bytes;
+    wanted_[index] = 1;
+  }
+
+  for ( int i = 0; i < chunks_.size(); i++ ) {
+    Chunk& chunk = chunks_[i];
+    if ( wanted_.at(i) ) {
+      continue;
+    }
+    if ( chunk.state == ChunkState::Resident ) {
+      chunk.mesh.reset();
+      chunk.state = ChunkState::Unloaded;
+      residentBytes_ -= estimatedBytes(chunk);
+      residentChunks_--;
+      meshesDirty_ = true;
+    }
+    else if ( chunk.state == ChunkState::Loading ) {
+      // результат загрузки будет отброшен
+      chunk.generation++;
+      chunk.state = ChunkState::Unloaded;
+    }
+  }
+  for ( int index : order_ ) {
+    if ( loading_.load() >= kMaxLoadsInFlight ) {
+      break;
+    }
+    if ( wanted_.at(index) && chunks_.at(index).state == ChunkState::Unloaded ) {
+      startLoad(index);
+    }
+  }
+
+  if ( !meshesDirty_ ) {
+    return false;
+  }
+  meshes_.clear();
+  for ( const auto& chunk : chunks_ ) {
+    if ( chunk.state == ChunkState::Resident ) {
+      meshes_.append(chunk.mesh);
+    }
+  }
+  meshesDirty_ = false;
+  return true;
+}
+
+void OutOfCoreModel::startLoad(int index)
+{
+  Chunk& chunk = chunks_[index];
+  chunk.state = ChunkState::Loading;
+  loading_++;
+  int generation = chunk.generation;
+  QString path = chunkPath(chunk.key);
+  std::shared_ptr<Material> material = defaultMaterial_;
+  if ( chunk.material >= 0 && chunk.material < materials_.size() && materials_.at(chunk.material) ) {
+    material = materials_.at(chunk.material);
+  }
+  OutOfCoreModel* self = this;
+  // чтение и подготовка меша - фоновая задача, главный поток её не подхватит посреди кадра
+  JobSystem& jobs = JobSystem::instance();
+  jobs.runBackground(jobs.create([self, index, generation, path, material] {
+    std::shared_ptr<Mesh> mesh;
+    QVector<Vertex> vertexes;
+    QVector<GLuint> indexes;
+    if ( !self->cancel_.load() && readChunk(path, vertexes, indexes) ) {
+      mesh = std::make_shared<Mesh>();
+      mesh->setMaterial(material);
+      mesh->setOwner(QFileInfo(self->path_).fileName());
+      mesh->build(vertexes, indexes);
+      mesh->setOccluder(false);
+    }
+    JobSystem::instance().runOnMainThread([self, index, generation, mesh] {
+      self->finishLoad(index, generation, mesh);
+    });
+  }));
+}
+
+void OutOfCoreModel::finishLoad(int index, int generation, const std::shared_ptr<Mesh>& mesh)
+{
+  loading_--;
+  if ( cancel_.load() ) {
+    return;
+  }
+  Chunk& chunk = chunks_[index];
+  if ( chunk.generation != generation || chunk.state != ChunkState::Loading ) {
+    return;
+  }
+  if ( !mesh ) {
+    qDebug() << QString("out of core: can't read %1").arg(chunkPath(chunk.key));
+    chunk.state = ChunkState::Failed;
+    return;
+  }
+  mesh->upload();
+  chunk.mesh = mesh;
+  chunk.state = ChunkState::Resident;
+  residentBytes_ += estimatedBytes(chunk);
+  residentChunks_++;
+  meshesDirty_ = true;
+}
+
+qint64 OutOfCoreModel::estimatedBytes(const Chunk& chunk)
+{
+  // вершины до склейки плюс индексы всех уровней LOD (в сумме не больше двух полных)
+  return chunk.triangles * 3 * qint64(sizeof(Vertex) + 2 * sizeof(GLuint));
+}
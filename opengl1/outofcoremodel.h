@@ -0,0 +1,109 @@
+#ifndef OUTOFCOREMODEL_H
+#define OUTOFCOREMODEL_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include <QMatrix4x4>
+#include <QStringList>
+#include <QVector>
+
+#include "structs.h"
+#include "material.h"
+#include "mesh.h"
+
+// Модель из obj-файла, который не помещается в память. При первом открытии файл
+// в отдельном потоке раскладывается по пространственным кускам на диске (каталог
+// <файл>.chunks рядом с ним), потом куски подгружаются в видеопамять - сначала
+// видимые и ближние к камере - и выгружаются, если не помещаются в лимит.
+// Память при раскладке и при показе ограничена константами и не зависит от размера файла.
+class OutOfCoreModel
+{
+public:
+  // файлы больше этого размера OGLObject открывает через OutOfCoreModel
+  static const qint64 kFileSizeThreshold = 1024ll * 1024 * 1024;
+  static const qint64 kDefaultResidentBudget = 512ll * 1024 * 1024;
+
+  explicit OutOfCoreModel(const QString& path);
+  OutOfCoreModel(const OutOfCoreModel&) = delete;
+  ~OutOfCoreModel();
+
+  OutOfCoreModel& operator=(const OutOfCoreModel&) = delete;
+
+  // раскладка закончена и индекс кусков прочитан
+  bool isReady() const { return ready_; }
+  bool hasFailed() const { return failed_; }
+  // доля прочитанного при раскладке, 1 - готово
+  float importProgress() const { return importProgress_.load(std::memory_order_relaxed); }
+
+  // библиотеки материалов и имена материалов файла; материалы (в порядке имён)
+  // задаются до подгрузки кусков, куски без материала получают материал по умолчанию
+  const QStringList& mtlLibraries() const { return mtlLibraries_; }
+  const QStringList& materialNames() const { return materialNames_; }
+  void setMaterials(const QVector< std::shared_ptr<Material> >& materials);
+
+  // в потоке контекста раз в кадр: выбор кусков по камере, запуск загрузок и выгрузка;
+  // true - изменился набор мешей или границы модели
+  bool update(const QMatrix4x4& model, const DrawView& view);
+  const QVector< std::shared_ptr<Mesh> >& meshes() const { return meshes_; }
+  const BoundingBox& bounds() const { return bounds_; }
+
+  void setResidentBudget(qint64 bytes) { residentBudget_ = bytes; }
+  qint64 residentBudget() const { return residentBudget_; }
+  int chunkCount() const { return chunks_.size(); }
+  int residentChunks() const { return residentChunks_; }
+  int loadingChunks() const { return loading_; }
+  // оценка по числу треугольников кусков в видеопамяти
+  qint64 residentBytes() const { return residentBytes_; }
+
+private:
+  enum class ChunkState { Unloaded, Loading, Resident, Failed };
+
+  struct Chunk {
+    qint64 key = 0;
+    int material = -1;
+    BoundingBox bounds;
+    qint64 triangles = 0;
+    ChunkState state = ChunkState::Unloaded;
+    int generation = 0;
+    std::shared_ptr<Mesh> mesh;
+  };
+
+  QString chunkPath(qint64 key) const;
+  QString indexPath() const;
+  bool isIndexCurrent() const;
+  bool readIndex();
+  bool import();
+  void startLoad(int index);
+  void finishLoad(int index, int generation, const std::shared_ptr<Mesh>& mesh);
+  static qint64 estimatedBytes(const Chunk& chunk);
+
+private:
+  QString path_;
+  QString cacheDir_;
+  std::thread importer_;
+  std::atomic<bool> cancel_{false};
+  std::atomic<bool> importDone_{false};
+  std::atomic<float> importProgress_{0.0f};
+  bool ready_ = false;
+  bool failed_ = false;
+
+  BoundingBox bounds_;
+  QStringList mtlLibraries_;
+  QStringList materialNames_;
+  QVector< std::shared_ptr<Material> > materials_;
+  std::shared_ptr<Material> defaultMaterial_;
+  QVector<Chunk> chunks_;
+  QVector<int> order_;
+  QVector<float> priority_;
+  QVector<char> wanted_;
+  QVector< std::shared_ptr<Mesh> > meshes_;
+  bool meshesDirty_ = false;
+  qint64 residentBudget_ = kDefaultResidentBudget;
+  qint64 residentBytes_ = 0;
+  int residentChunks_ = 0;
+  std::atomic<int> loading_{0};
+};
+
+#endif // OUTOFCOREMODEL_H
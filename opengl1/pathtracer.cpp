@@ -0,0 +1,411 @@
+#include "pathtracer.h"
+#include "jobsystem.h"
+#include "tonemap.h"
+
+#include <QElapsedTimer>
+#include <QtMath>
+
+#include <atomic>
+#include <cmath>
+
+const float PathTracer::kMinRoughness = 0.05f;
+
+// F0 диэлектрика; в fPBRShader.frag стоит normalize(vec3(0.04)), то есть 0.577
+static const float kDielectricF0 = 0.04f;
+// как max(..., 0.001) в знаменателе зеркальной части шейдера
+static const float kMinSpecularDenominator = 0.001f;
+// доля зеркальной выборки в смеси ограничена, чтобы обе стратегии оставались в игре
+static const float kMinSpecularProbability = 0.1f;
+static const float kMaxSpecularProbability = 0.9f;
+static const float kMaxRouletteSurvival = 0.95f;
+static const float kRayOffset = 1.0e-4f;
+
+static QVector3D mix(const QVector3D& a, const QVector3D& b, float t)
+{
+  return a * (1.0f - t) + b * t;
+}
+
+static float average(const QVector3D& v)
+{
+  return (v.x() + v.y() + v.z()) / 3.0f;
+}
+
+static QVector3D fresnelSchlick(float cosTheta, const QVector3D& F0)
+{
+  float p = std::pow(1.0f - qMin(cosTheta, 1.0f), 5.0f);
+  return F0 + (QVector3D{1.0f, 1.0f, 1.0f} - F0) * p;
+}
+
+// GGX без ограничения знаменателя: иначе выборка и её плотность расходятся
+static float distributionGGX(float NdotH, float roughness)
+{
+  float a = roughness * roughness;
+  float a2 = a * a;
+  float denominator = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+  return a2 / (float(M_PI) * denominator * denominator);
+}
+
+static float geometrySchlickGGX(float NdotV, float roughness)
+{
+  float r = roughness + 1.0f;
+  float k = r * r / 8.0f;
+  return NdotV / (NdotV * (1.0f - k) + k);
+}
+
+// начало вторичного луча чуть над поверхностью, с запасом на величину координат
+static QVector3D offsetPoint(const QVector3D& position, const QVector3D& normal)
+{
+  float scale = 1.0f + qMax(qMax(std::fabs(position.x()), std::fabs(position.y())), std::fabs(position.z()));
+  return position + normal * (kRayOffset * scale);
+}
+
+PathTracer::Random::Random(quint64 seed)
+{
+  // splitmix64, чтобы соседние пиксели и проходы не давали похожих последовательностей
+  seed += 0x9E3779B97F4A7C15ull;
+  seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ull;
+  seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBull;
+  state = seed ^ (seed >> 31);
+}
+
+float PathTracer::Random::next()
+{
+  // PCG32 (XSH RR)
+  quint64 old = state;
+  state = old * 6364136223846793005ull + 1442695040888963407ull;
+  quint32 shifted = quint32(((old >> 18u) ^ old) >> 27u);
+  quint32 rotation = quint32(old >> 59u);
+  quint32 r = (shifted >> rotation) | (shifted << ((32u - rotation) & 31u));
+  return float(r >> 8) * (1.0f / 16777216.0f);
+}
+
+void PathTracer::setScene(std::shared_ptr<const CpuScene> scene)
+{
+  scene_ = std::move(scene);
+  bvh_.clear();
+  reset();
+}
+
+void PathTracer::build()
+{
+  if ( scene_ ) {
+    bvh_.build(scene_->positions());
+  }
+  reset();
+}
+
+void PathTracer::setTonemap(Tonemap::Operator op, float exposure)
+{
+  tonemap_ = op;
+  exposure_ = exposure;
+}
+
+void PathTracer::setView(const QMatrix4x4& view, const QMatrix4x4& projection)
+{
+  QMatrix4x4 inverse = (projection * view).inverted();
+  eye_ = view.inverted().column(3).toVector3D();
+  corner_ = inverse.map(QVector3D{-1.0f, 1.0f, 1.0f});
+  right_ = inverse.map(QVector3D{1.0f, 1.0f, 1.0f}) - corner_;
+  down_ = inverse.map(QVector3D{-1.0f, -1.0f, 1.0f}) - corner_;
+  reset();
+}
+
+void PathTracer::resize(int width, int height)
+{
+  width_ = qMax(0, width);
+  height_ = qMax(0, height);
+  reset();
+}
+
+void PathTracer::reset()
+{
+  accumulated_.assign(size_t(width_) * size_t(height_), QVector3D{0.0f, 0.0f, 0.0f});
+  passes_ = 0;
+  rays_ = 0;
+  elapsedNs_ = 0;
+}
+
+void PathTracer::renderPass()
+{
+  if ( width_ == 0 || height_ == 0 || !scene_ ) {
+    return;
+  }
+  QElapsedTimer timer;
+  timer.start();
+  int tilesX = (width_ + kTileSize - 1) / kTileSize;
+  int tilesY = (height_ + kTileSize - 1) / kTileSize;
+  std::atomic<qint64> rays{0};
+  // у каждого тайла свои пиксели, накопление пишется без синхронизации
+  JobSystem::instance().parallelFor(tilesX * tilesY, 1, [&]( int begin, int end ) {
+    qint64 local = 0;
+    for ( int tile = begin; tile < end; tile++ ) {
+      renderTile(tile % tilesX, tile / tilesX, local);
+    }
+    rays.fetch_add(local, std::memory_order_relaxed);
+  });
+  passes_++;
+  rays_ += rays.load();
+  elapsedNs_ += timer.nsecsElapsed();
+}
+
+void PathTracer::renderTile(int tileX, int tileY, qint64& rays)
+{
+  int x0 = tileX * kTileSize;
+  int y0 = tileY * kTileSize;
+  int x1 = qMin(x0 + kTileSize, width_);
+  int y1 = qMin(y0 + kTileSize, height_);
+  for ( int y = y0; y < y1; y += 2 ) {
+    for ( int x = x0; x < x1; x += 2 ) {
+      // квадрат 2x2 пикселей - один пакет первичных лучей
+      BvhRayPacket packet;
+      BvhHit hits[4];
+      Random randoms[4];
+      int pixels[4];
+      for ( int lane = 0; lane < 4; lane++ ) {
+        int px = x + (lane & 1);
+        int py = y + (lane >> 1);
+        packet.originX[lane] = eye_.x();
+        packet.originY[lane] = eye_.y();
+        packet.originZ[lane] = eye_.z();
+        packet.tMin[lane] = 0.0f;
+        if ( px >= x1 || py >= y1 ) {
+          pixels[lane] = -1;
+          packet.directionX[lane] = 0.0f;
+          packet.directionY[lane] = 0.0f;
+          packet.directionZ[lane] = 1.0f;
+          packet.tMax[lane] = -1.0f;
+          continue;
+        }
+        pixels[lane] = py * width_ + px;
+        randoms[lane] = Random((quint64(pixels[lane]) << 32) | quint64(passes_));
+        float sx = (float(px) + randoms[lane].next()) / float(width_);
+        float sy = (float(py) + randoms[lane].next()) / float(height_);
+        QVector3D direction = (corner_ + right_ * sx + down_ * sy - eye_).normalized();
+        packet.directionX[lane] = direction.x();
+        packet.directionY[lane] = direction.y();
+        packet.directionZ[lane] = direction.z();
+        packet.tMax[lane] = std::numeric_limits<float>::max();
+        rays++;
+      }
+      bvh_.intersect(packet, hits);
+      for ( int lane = 0; lane < 4; lane++ ) {
+        if ( pixels[lane] < 0 ) {
+          continue;
+        }
+        BvhRay ray;
+        ray.origin = eye_;
+        ray.direction = QVector3D{packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]};
+        accumulated_[size_t(pixels[lane])] += radiance(ray, hits[lane], randoms[lane], rays);
+      }
+    }
+  }
+}
+
+QVector3D PathTracer::radiance(BvhRay ray, BvhHit hit, Random& random, qint64& rays) const
+{
+  QVector3D result{0.0f, 0.0f, 0.0f};
+  QVector3D throughput{1.0f, 1.0f, 1.0f};
+  for ( int bounce = 0; ; bounce++ ) {
+    if ( hit.triangle < 0 ) {
+      result += throughput * scene_->environment(ray.direction);
+      break;
+    }
+    Shading shading = shade(ray, hit);
+    QVector3D view = -ray.direction;
+    result += throughput * directLight(shading, view, rays);
+    if ( bounce == kMaxBounces ) {
+      break;
+    }
+
+    // одна выборка из смеси: половинный вектор по GGX или косинус по полусфере,
+    // плотность - взвешенная сумма обеих
+    const QVector3D& normal = shading.normal;
+    float NdotV = qMax(QVector3D::dotProduct(normal, view), 1.0e-4f);
+    QVector3D F0 = mix(QVector3D{kDielectricF0, kDielectricF0, kDielectricF0}, shading.albedo, shading.metallic);
+    float specular = qBound(kMinSpecularProbability, qMax(shading.metallic, average(fresnelSchlick(NdotV, F0))),
+                            kMaxSpecularProbability);
+    QVector3D tangent, bitangent;
+    CpuScene::basis(normal, tangent, bitangent);
+    float u1 = random.next();
+    float u2 = random.next();
+    float phi = 2.0f * float(M_PI) * u2;
+    QVector3D light;
+    if ( random.next() < specular ) {
+      float a = shading.roughness * shading.roughness;
+      float cosTheta = std::sqrt((1.0f - u1) / (1.0f + (a * a - 1.0f) * u1));
+      float sinTheta = std::sqrt(qMax(0.0f, 1.0f - cosTheta * cosTheta));
+      QVector3D half = tangent * (sinTheta * std::cos(phi)) + bitangent * (sinTheta * std::sin(phi)) + normal * cosTheta;
+      light = half * (2.0f * QVector3D::dotProduct(view, half)) - view;
+    }
+    else {
+      float r = std::sqrt(u1);
+      light = tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(1.0f - u1);
+    }
+    float NdotL = QVector3D::dotProduct(normal, light);
+    if ( NdotL <= 0.0f || QVector3D::dotProduct(shading.geometric, light) <= 0.0f ) {
+      break;
+    }
+    QVector3D half = (view + light).normalized();
+    float NdotH = qMax(QVector3D::dotProduct(normal, half), 0.0f);
+    float VdotH = qMax(QVector3D::dotProduct(view, half), 1.0e-4f);
+    float pdf = specular * distributionGGX(NdotH, shading.roughness) * NdotH / (4.0f * VdotH)
+              + (1.0f - specular) * NdotL / float(M_PI);
+    if ( pdf <= 0.0f ) {
+      break;
+    }
+    throughput *= brdf(shading, view, light) * (NdotL / pdf);
+
+    if ( bounce >= kRouletteBounce ) {
+      float survival = qMin(qMax(throughput.x(), qMax(throughput.y(), throughput.z())), kMaxRouletteSurvival);
+      if ( random.next() >= survival ) {
+        break;
+      }
+      throughput /= survival;
+    }
+
+    ray = BvhRay{};
+    ray.origin = offsetPoint(shading.position, shading.geometric);
+    ray.direction = light;
+    hit = BvhHit{};
+    rays++;
+    bvh_.intersect(ray, hit);
+  }
+  return result;
+}
+
+PathTracer::Shading PathTracer::shade(const BvhRay& ray, const BvhHit& hit) const
+{
+  const CpuScene::Triangle& triangle = scene_->triangles()[size_t(hit.triangle)];
+  const CpuScene::Surface& surface = scene_->surfaces().at(triangle.surface);
+  float w = 1.0f - hit.u - hit.v;
+  Shading shading;
+  shading.position = ray.origin + ray.direction * hit.t;
+  shading.geometric = triangle.geometric;
+  QVector3D normal = triangle.normals[0] * w + triangle.normals[1] * hit.u + triangle.normals[2] * hit.v;
+  normal = normal.lengthSquared() > 1.0e-12f ? normal.normalized() : triangle.geometric;
+  QVector2D uv = triangle.uvs[0] * w + triangle.uvs[1] * hit.u + triangle.uvs[2] * hit.v;
+
+  // альбедо из sRGB в линейный цвет, остальные карты как есть, как в шейдере
+  shading.albedo = surface.albedoMap.isNull()
+                 ? surface.albedo : Tonemap::toLinear(CpuScene::sample(surface.albedoMap, uv).toVector3D());
+  shading.metallic = surface.metallicMap.isNull() ? surface.metallic : CpuScene::sample(surface.metallicMap, uv).x();
+  shading.roughness = surface.roughnessMap.isNull() ? surface.roughness : CpuScene::sample(surface.roughnessMap, uv).x();
+  shading.roughness = qBound(kMinRoughness, shading.roughness, 1.0f);
+  if ( !surface.normalMap.isNull() ) {
+    QVector3D mapped = CpuScene::sample(surface.normalMap, uv).toVector3D() * 2.0f - QVector3D{1.0f, 1.0f, 1.0f};
+    QVector3D tangent = triangle.tangent - normal * QVector3D::dotProduct(normal, triangle.tangent);
+    if ( tangent.lengthSquared() > 1.0e-12f ) {
+      tangent.normalize();
+      QVector3D bitangent = QVector3D::crossProduct(normal, tangent);
+      if ( QVector3D::dotProduct(bitangent, triangle.bitangent) < 0.0f ) {
+        bitangent = -bitangent;
+      }
+      QVector3D perturbed = tangent * mapped.x() + bitangent * mapped.y() + normal * mapped.z();
+      if ( perturbed.lengthSquared() > 1.0e-12f ) {
+        normal = perturbed.normalized();
+      }
+    }
+  }
+
+  // поверхности двусторонние: нормали разворачиваются к приходящему лучу
+  if ( QVector3D::dotProduct(shading.geometric, ray.direction) > 0.0f ) {
+    shading.geometric = -shading.geometric;
+  }
+  if ( QVector3D::dotProduct(normal, shading.geometric) < 0.0f ) {
+    normal = -normal;
+  }
+  shading.normal = normal;
+  return shading;
+}
+
+QVector3D PathTracer::directLight(const Shading& shading, const QVector3D& view, qint64& rays) const
+{
+  QVector3D result{0.0f, 0.0f, 0.0f};
+  QVector3D origin = offsetPoint(shading.position, shading.geometric);
+  if ( !scene_->lightColor().isNull() ) {
+    QVector3D light = -scene_->lightDirection();
+    float NdotL = QVector3D::dotProduct(shading.normal, light);
+    if ( NdotL > 0.0f && QVector3D::dotProduct(shading.geometric, light) > 0.0f ) {
+      BvhRay shadow;
+      shadow.origin = origin;
+      shadow.direction = light;
+      rays++;
+      if ( !bvh_.occluded(shadow) ) {
+        result += brdf(shading, view, light) * scene_->lightColor() * NdotL;
+      }
+    }
+  }
+  for ( const auto& pointLight : scene_->pointLights() ) {
+    QVector3D toLight = pointLight.position - shading.position;
+    float distance = toLight.length();
+    if ( distance <= 0.0f ) {
+      continue;
+    }
+    QVector3D light = toLight / distance;
+    float NdotL = QVector3D::dotProduct(shading.normal, light);
+    if ( NdotL <= 0.0f || QVector3D::dotProduct(shading.geometric, light) <= 0.0f ) {
+      continue;
+    }
+    BvhRay shadow;
+    shadow.origin = origin;
+    shadow.direction = light;
+    shadow.tMax = (pointLight.position - origin).length();
+    rays++;
+    if ( bvh_.occluded(shadow) ) {
+      continue;
+    }
+    float attenuation = 1.0f / (pointLight.constant + pointLight.linear * distance + pointLight.quadratic * distance * distance);
+    result += brdf(shading, view, light) * pointLight.color * (attenuation * NdotL);
+  }
+  return result;
+}
+
+QVector3D PathTracer::brdf(const Shading& shading, const QVector3D& view, const QVector3D& light)
+{
+  // то же, что в fPBRShader.frag, кроме F0 и ограничения знаменателя GGX
+  const QVector3D& normal = shading.normal;
+  QVector3D half = (view + light).normalized();
+  float NdotV = qMax(QVector3D::dotProduct(normal, view), 0.0f);
+  float NdotL = qMax(QVector3D::dotProduct(normal, light), 0.0f);
+  float NdotH = qMax(QVector3D::dotProduct(normal, half), 0.0f);
+  float HdotV = qBound(0.0f, QVector3D::dotProduct(half, view), 1.0f);
+  QVector3D F0 = mix(QVector3D{kDielectricF0, kDielectricF0, kDielectricF0}, shading.albedo, shading.metallic);
+  QVector3D F = fresnelSchlick(HdotV, F0);
+  float NDF = distributionGGX(NdotH, shading.roughness);
+  float G = geometrySchlickGGX(NdotV, shading.roughness) * geometrySchlickGGX(NdotL, shading.roughness);
+  QVector3D specular = F * (NDF * G / qMax(4.0f * NdotV * NdotL, kMinSpecularDenominator));
+  QVector3D kD = (QVector3D{1.0f, 1.0f, 1.0f} - F) * (1.0f - shading.metallic);
+  return kD * shading.albedo / float(M_PI) + specular;
+}
+
+QImage PathTracer::image() const
+{
+  QImage image(qMax(1, width_), qMax(1, height_), QImage::Format_RGB32);
+  image.fill(Qt::black);
+  if ( passes_ == 0 ) {
+    return image;
+  }
+  float scale = 1.0f / float(passes_);
+  for ( int y = 0; y < height_; y++ ) {
+    QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+    for ( int x = 0; x < width_; x++ ) {
+      QVector3D c = Tonemap::apply(accumulated_[size_t(y) * size_t(width_) + size_t(x)] * scale, tonemap_, exposure_);
+      int rgb[3];
+      for ( int i = 0; i < 3; i++ ) {
+        rgb[i] = qBound(0, int(c[i] * 255.0f + 0.5f), 255);
+      }
+      line[x] = qRgb(rgb[0], rgb[1], rgb[2]);
+    }
+  }
+  return image;
+}
+
+double PathTracer::samplesPerSecond() const
+{
+  return elapsedNs_ > 0 ? double(passes_) * width_ * height_ * 1.0e9 / double(elapsedNs_) : 0.0;
+}
+
+double PathTracer::raysPerSecond() const
+{
+  return elapsedNs_ > 0 ? double(rays_) * 1.0e9 / double(elapsedNs_) : 0.0;
+}
@@ -0,0 +1,100 @@
+#ifndef PATHTRACER_H
+#define PATHTRACER_H
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <memory>
+#include <vector>
+
+#include "bvh.h"
+#include "cpuscene.h"
+#include "tonemap.h"
+
+// Эталонный рендер сцены трассировкой путей на CPU: те же меши и параметры PBR-материалов
+// (цвет, metallic, roughness, карты), что у fPBRShader.frag, и та же модель BRDF -
+// GGX, Smith-Schlick, Френель по Шлику, - только интеграл считается честно: прямой свет
+// от источников с теневыми лучами, переотражения по выборке GGX и косинусной выборке,
+// окружение - кубическая карта неба. Каждый renderPass() добавляет по сэмплу на пиксель
+// (накопление), кадр делится на тайлы kTileSize, тайлы считаются в JobSystem, первичные лучи
+// идут пакетами 2x2 через Bvh. Без GL: сцену (CpuScene) нужно собрать в потоке контекста,
+// дальше всё можно считать в рабочих потоках.
+class PathTracer
+{
+public:
+  static const int kTileSize = 16;
+  static const int kMaxBounces = 6;
+  // с этого отскока пути обрываются русской рулеткой
+  static const int kRouletteBounce = 2;
+  // зеркальный GGX не интегрируется выборкой, шероховатость ограничена снизу
+  static const float kMinRoughness;
+
+  PathTracer() = default;
+  PathTracer(const PathTracer&) = delete;
+
+  PathTracer& operator=(const PathTracer&) = delete;
+
+  // сцена не меняется, пока трассировщик ей пользуется; build() строит по ней Bvh
+  void setScene(std::shared_ptr<const CpuScene> scene);
+  void build();
+
+  void setView(const QMatrix4x4& view, const QMatrix4x4& projection);
+  // как у кадра GL, только без bloom
+  void setTonemap(Tonemap::Operator op, float exposure);
+  // сбрасывает накопление
+  void resize(int width, int height);
+  void reset();
+  // один сэмпл на пиксель по всему кадру
+  void renderPass();
+  // среднее накопленных проходов после тонмаппинга
+  QImage image() const;
+
+  int passes() const { return passes_; }
+  int triangleCount() const { return bvh_.triangleCount(); }
+  double samplesPerSecond() const;
+  double raysPerSecond() const;
+
+private:
+  // точка пути: нормали смотрят навстречу лучу
+  struct Shading {
+    QVector3D position;
+    QVector3D normal;
+    QVector3D geometric;
+    QVector3D albedo;
+    float metallic;
+    float roughness;
+  };
+
+  struct Random {
+    explicit Random(quint64 seed = 0);
+    float next();
+
+    quint64 state;
+  };
+
+  void renderTile(int tileX, int tileY, qint64& rays);
+  QVector3D radiance(BvhRay ray, BvhHit hit, Random& random, qint64& rays) const;
+  Shading shade(const BvhRay& ray, const BvhHit& hit) const;
+  QVector3D directLight(const Shading& shading, const QVector3D& view, qint64& rays) const;
+  static QVector3D brdf(const Shading& shading, const QVector3D& view, const QVector3D& light);
+
+private:
+  std::shared_ptr<const CpuScene> scene_;
+  Bvh bvh_;
+  // камера: лучи из eye_ в точку дальней плоскости corner_ + right_ * x + down_ * y, x, y в [0, 1]
+  QVector3D eye_;
+  QVector3D corner_;
+  QVector3D right_;
+  QVector3D down_;
+  int width_ = 0;
+  int height_ = 0;
+  Tonemap::Operator tonemap_ = Tonemap::Reinhard;
+  float exposure_ = 1.0f;
+  std::vector<QVector3D> accumulated_;
+  int passes_ = 0;
+  qint64 rays_ = 0;
+  qint64 elapsedNs_ = 0;
+};
+
+#endif // PATHTRACER_H
@@ -0,0 +1,436 @@
+#include "rasterizer.h"
+#include "jobsystem.h"
+#include "simd4.h"
+#include "tonemap.h"
+
+#include <QElapsedTimer>
+#include <QtMath>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+const float SoftwareRasterizer::kClearColor = 0.2f;
+
+// номера треугольников в буфере видимости: из треугольника сцены получается не больше двух
+static const int kChunkStride = 2 * SoftwareRasterizer::kChunkTriangles;
+static const float kLaneOffsets[4] = { 0.5f, 1.5f, 2.5f, 3.5f };
+// постоянные fPBRShader.frag
+static const float kPi = 3.14159265359f;
+static const float kDirectionalAmbient = 0.1f;
+static const float kPointAmbient = 0.03f;
+static const float kMinDenominator = 0.001f;
+
+namespace {
+
+QVector3D mix(const QVector3D& a, const QVector3D& b, float t)
+{
+  return a * (1.0f - t) + b * t;
+}
+
+float distributionGGX(const QVector3D& N, const QVector3D& H, float roughness)
+{
+  float a = roughness * roughness;
+  float a2 = a * a;
+  float NdotH = qMax(QVector3D::dotProduct(N, H), 0.0f);
+  float denominator = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+  denominator = kPi * denominator * denominator;
+  return a2 / qMax(denominator, kMinDenominator);
+}
+
+float geometrySchlickGGX(float NdotV, float roughness)
+{
+  float r = roughness + 1.0f;
+  float k = r * r / 8.0f;
+  return NdotV / qMax(NdotV * (1.0f - k) + k, kMinDenominator);
+}
+
+QVector3D fresnelSchlick(float cosTheta, const QVector3D& F0)
+{
+  float p = std::pow(1.0f - qMin(cosTheta, 1.0f), 5.0f);
+  return F0 + (QVector3D{1.0f, 1.0f, 1.0f} - F0) * p;
+}
+
+// слагаемое Lo одного источника, как в addDirLightPBR / addPosLightPBR
+QVector3D lightPBR(const QVector3D& N, const QVector3D& V, const QVector3D& L, const QVector3D& albedo,
+                   float metallic, float roughness, const QVector3D& F0, const QVector3D& radiance)
+{
+  QVector3D H = (V + L).normalized();
+  float NdotV = qMax(QVector3D::dotProduct(N, V), 0.0f);
+  float NdotL = qMax(QVector3D::dotProduct(N, L), 0.0f);
+  float NDF = distributionGGX(N, H, roughness);
+  float G = geometrySchlickGGX(NdotV, roughness) * geometrySchlickGGX(NdotL, roughness);
+  QVector3D F = fresnelSchlick(qBound(0.0f, QVector3D::dotProduct(H, V), 1.0f), F0);
+  QVector3D kD = (QVector3D{1.0f, 1.0f, 1.0f} - F) * (1.0f - metallic);
+  QVector3D specular = F * (NDF * G / qMax(4.0f * NdotV * NdotL, kMinDenominator));
+  return (kD * albedo / kPi + specular) * radiance * NdotL;
+}
+
+QRgb toRgb(const QVector3D& color)
+{
+  int rgb[3];
+  for ( int i = 0; i < 3; i++ ) {
+    rgb[i] = qBound(0, int(color[i] * 255.0f + 0.5f), 255);
+  }
+  return qRgb(rgb[0], rgb[1], rgb[2]);
+}
+
+}
+
+void SoftwareRasterizer::setScene(std::shared_ptr<const CpuScene> scene)
+{
+  scene_ = std::move(scene);
+}
+
+void SoftwareRasterizer::setTonemap(Tonemap::Operator op, float exposure)
+{
+  tonemap_ = op;
+  exposure_ = exposure;
+}
+
+void SoftwareRasterizer::setView(const QMatrix4x4& view, const QMatrix4x4& projection)
+{
+  QMatrix4x4 viewProjection = projection * view;
+  std::copy(viewProjection.constData(), viewProjection.constData() + 16, viewProjection_);
+  QMatrix4x4 inverse = viewProjection.inverted();
+  eye_ = view.inverted().column(3).toVector3D();
+  corner_ = inverse.map(QVector3D{-1.0f, 1.0f, 1.0f});
+  right_ = inverse.map(QVector3D{1.0f, 1.0f, 1.0f}) - corner_;
+  down_ = inverse.map(QVector3D{-1.0f, -1.0f, 1.0f}) - corner_;
+}
+
+void SoftwareRasterizer::resize(int width, int height)
+{
+  width_ = qMax(0, width);
+  height_ = qMax(0, height);
+  tilesX_ = (width_ + kTileSize - 1) / kTileSize;
+  tilesY_ = (height_ + kTileSize - 1) / kTileSize;
+  stride_ = tilesX_ * kTileSize;
+  depth_.assign(size_t(stride_) * size_t(height_), 1.0f);
+  visibility_.assign(size_t(stride_) * size_t(height_), -1);
+  image_ = QImage(qMax(1, width_), qMax(1, height_), QImage::Format_RGB32);
+  image_.fill(Qt::black);
+}
+
+void SoftwareRasterizer::render()
+{
+  if ( width_ == 0 || height_ == 0 || !scene_ ) {
+    return;
+  }
+  QElapsedTimer timer;
+  timer.start();
+  int triangles = int(scene_->triangles().size());
+  chunkCount_ = (triangles + kChunkTriangles - 1) / kChunkTriangles;
+  if ( int(chunks_.size()) < chunkCount_ ) {
+    chunks_.resize(size_t(chunkCount_));
+  }
+  JobSystem& jobs = JobSystem::instance();
+  jobs.parallelFor(chunkCount_, 1, [this]( int begin, int end ) {
+    for ( int chunk = begin; chunk < end; chunk++ ) {
+      setupChunk(chunk);
+    }
+  });
+  trianglesBinned_ = 0;
+  for ( int chunk = 0; chunk < chunkCount_; chunk++ ) {
+    trianglesBinned_ += int(chunks_[size_t(chunk)].triangles.size());
+  }
+
+  // bits() отцепляет изображение от копий, отданных наружу, - до раздачи тайлов потокам
+  bits_ = image_.bits();
+  bytesPerLine_ = image_.bytesPerLine();
+  std::atomic<int> shaded{0};
+  jobs.parallelFor(tilesX_ * tilesY_, 1, [this, &shaded]( int begin, int end ) {
+    int local = 0;
+    for ( int tile = begin; tile < end; tile++ ) {
+      rasterizeTile(tile, local);
+    }
+    shaded.fetch_add(local, std::memory_order_relaxed);
+  });
+  pixelsShaded_ = shaded.load();
+  frameMs_ = float(timer.nsecsElapsed()) / 1.0e6f;
+}
+
+const char* SoftwareRasterizer::backend()
+{
+  return Simd4::backend();
+}
+
+void SoftwareRasterizer::setupChunk(int index)
+{
+  Chunk& chunk = chunks_[size_t(index)];
+  chunk.triangles.clear();
+  chunk.bins.resize(size_t(tilesX_ * tilesY_));
+  for ( auto& bin : chunk.bins ) {
+    bin.clear();
+  }
+  const std::vector<CpuScene::Triangle>& triangles = scene_->triangles();
+  int begin = index * kChunkTriangles;
+  int end = qMin(begin + kChunkTriangles, int(triangles.size()));
+  const float* m = viewProjection_;
+  for ( int i = begin; i < end; i++ ) {
+    const CpuScene::Triangle& triangle = triangles[size_t(i)];
+    ClipVertex vertexes[3];
+    // коды выхода за плоскости отсечения: треугольник целиком снаружи одной из них не рисуется
+    int outside = 0x3F;
+    for ( int k = 0; k < 3; k++ ) {
+      const QVector3D& p = triangle.positions[k];
+      float* clip = vertexes[k].position;
+      for ( int row = 0; row < 4; row++ ) {
+        clip[row] = m[row] * p.x() + m[4 + row] * p.y() + m[8 + row] * p.z() + m[12 + row];
+      }
+      vertexes[k].u = k == 1 ? 1.0f : 0.0f;
+      vertexes[k].v = k == 2 ? 1.0f : 0.0f;
+      float w = clip[3];
+      int code = (clip[0] < -w ? 1 : 0) | (clip[0] > w ? 2 : 0) | (clip[1] < -w ? 4 : 0) | (clip[1] > w ? 8 : 0)
+               | (clip[2] < -w ? 16 : 0) | (clip[2] > w ? 32 : 0);
+      outside &= code;
+    }
+    if ( outside != 0 ) {
+      continue;
+    }
+    float distances[3];
+    bool clipped = false;
+    for ( int k = 0; k < 3; k++ ) {
+      distances[k] = vertexes[k].position[2] + vertexes[k].position[3];
+      clipped = clipped || distances[k] < 0.0f;
+    }
+    if ( !clipped ) {
+      addTriangle(chunk, vertexes, i);
+      continue;
+    }
+    // отсечение по ближней плоскости z = -w: из треугольника получается не больше четырёхугольника
+    ClipVertex polygon[4];
+    int count = 0;
+    for ( int k = 0; k < 3; k++ ) {
+      int next = (k + 1) % 3;
+      if ( distances[k] >= 0.0f ) {
+        polygon[count++] = vertexes[k];
+      }
+      if ( (distances[k] >= 0.0f) != (distances[next] >= 0.0f) ) {
+        float t = distances[k] / (distances[k] - distances[next]);
+        ClipVertex& vertex = polygon[count++];
+        for ( int c = 0; c < 4; c++ ) {
+          vertex.position[c] = vertexes[k].position[c] + (vertexes[next].position[c] - vertexes[k].position[c]) * t;
+        }
+        vertex.u = vertexes[k].u + (vertexes[next].u - vertexes[k].u) * t;
+        vertex.v = vertexes[k].v + (vertexes[next].v - vertexes[k].v) * t;
+      }
+    }
+    for ( int k = 1; k + 1 < count; k++ ) {
+      ClipVertex fan[3] = { polygon[0], polygon[k], polygon[k + 1] };
+      addTriangle(chunk, fan, i);
+    }
+  }
+}
+
+void SoftwareRasterizer::addTriangle(Chunk& chunk, const ClipVertex* vertexes, int triangle)
+{
+  ScreenTriangle screen;
+  double x[3], y[3];
+  double minX = std::numeric_limits<double>::max();
+  double minY = std::numeric_limits<double>::max();
+  double maxX = -std::numeric_limits<double>::max();
+  double maxY = -std::numeric_limits<double>::max();
+  for ( int k = 0; k < 3; k++ ) {
+    const float* clip = vertexes[k].position;
+    if ( clip[3] <= 0.0f ) {
+      return;
+    }
+    double invW = 1.0 / double(clip[3]);
+    x[k] = (double(clip[0]) * invW * 0.5 + 0.5) * width_;
+    y[k] = (0.5 - double(clip[1]) * invW * 0.5) * height_;
+    screen.depth[k] = double(clip[2]) * invW * 0.5 + 0.5;
+    screen.invW[k] = float(invW);
+    screen.u[k] = vertexes[k].u;
+    screen.v[k] = vertexes[k].v;
+    minX = qMin(minX, x[k]);
+    minY = qMin(minY, y[k]);
+    maxX = qMax(maxX, x[k]);
+    maxY = qMax(maxY, y[k]);
+  }
+  double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+  if ( area == 0.0 || !std::isfinite(area) ) {
+    return;
+  }
+  // нормировка на площадь со знаком: внутри треугольника все три координаты неотрицательны
+  // при любом обходе, грани не отбрасываются
+  for ( int k = 0; k < 3; k++ ) {
+    int k1 = (k + 1) % 3;
+    int k2 = (k + 2) % 3;
+    screen.a[k] = (y[k1] - y[k2]) / area;
+    screen.b[k] = (x[k2] - x[k1]) / area;
+    screen.c[k] = (x[k1] * y[k2] - x[k2] * y[k1]) / area;
+  }
+  // пиксель покрыт, если покрыт его центр (x + 0.5, y + 0.5)
+  screen.minX = qMax(0, int(std::floor(qMax(minX - 0.5, -1.0))));
+  screen.minY = qMax(0, int(std::floor(qMax(minY - 0.5, -1.0))));
+  screen.maxX = qMin(width_ - 1, int(std::ceil(qMin(maxX - 0.5, double(width_)))));
+  screen.maxY = qMin(height_ - 1, int(std::ceil(qMin(maxY - 0.5, double(height_)))));
+  if ( screen.minX > screen.maxX || screen.minY > screen.maxY ) {
+    return;
+  }
+  screen.triangle = triangle;
+  int index = int(chunk.triangles.size());
+  chunk.triangles.push_back(screen);
+  for ( int tileY = screen.minY / kTileSize; tileY <= screen.maxY / kTileSize; tileY++ ) {
+    for ( int tileX = screen.minX / kTileSize; tileX <= screen.maxX / kTileSize; tileX++ ) {
+      chunk.bins[size_t(tileY * tilesX_ + tileX)].push_back(index);
+    }
+  }
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile, int& shaded)
+{
+  typedef Simd4::V V;
+  int x0 = (tile % tilesX_) * kTileSize;
+  int y0 = (tile / tilesX_) * kTileSize;
+  int x1 = qMin(x0 + kTileSize, width_);
+  int y1 = qMin(y0 + kTileSize, height_);
+  for ( int y = y0; y < y1; y++ ) {
+    size_t row = size_t(y) * size_t(stride_) + size_t(x0);
+    std::fill(depth_.begin() + row, depth_.begin() + row + kTileSize, 1.0f);
+    std::fill(visibility_.begin() + row, visibility_.begin() + row + kTileSize, -1);
+  }
+
+  const V zero = Simd4::set(0.0f);
+  const V offsets = Simd4::load(kLaneOffsets);
+  for ( int chunkIndex = 0; chunkIndex < chunkCount_; chunkIndex++ ) {
+    const Chunk& chunk = chunks_[size_t(chunkIndex)];
+    for ( int index : chunk.bins[size_t(tile)] ) {
+      const ScreenTriangle& screen = chunk.triangles[size_t(index)];
+      // плоскости относительно угла тайла, дальше хватает float
+      float a[3], b[3], c[3];
+      double depthA = 0.0, depthB = 0.0, depthC = 0.0;
+      for ( int k = 0; k < 3; k++ ) {
+        a[k] = float(screen.a[k]);
+        b[k] = float(screen.b[k]);
+        c[k] = float(screen.c[k] + screen.a[k] * x0 + screen.b[k] * y0);
+        depthA += screen.a[k] * screen.depth[k];
+        depthB += screen.b[k] * screen.depth[k];
+        depthC += screen.c[k] * screen.depth[k];
+      }
+      float za = float(depthA);
+      float zb = float(depthB);
+      float zc = float(depthC + depthA * x0 + depthB * y0);
+      V a0 = Simd4::set(a[0]), a1 = Simd4::set(a[1]), a2 = Simd4::set(a[2]), vza = Simd4::set(za);
+      int bx0 = (qMax(screen.minX, x0) - x0) & ~3;
+      int bx1 = qMin(screen.maxX, x1 - 1) - x0;
+      int by0 = qMax(screen.minY, y0) - y0;
+      int by1 = qMin(screen.maxY, y1 - 1) - y0;
+      int id = chunkIndex * kChunkStride + index;
+      for ( int by = by0; by <= by1; by++ ) {
+        float py = float(by) + 0.5f;
+        V r0 = Simd4::set(b[0] * py + c[0]);
+        V r1 = Simd4::set(b[1] * py + c[1]);
+        V r2 = Simd4::set(b[2] * py + c[2]);
+        V rz = Simd4::set(zb * py + zc);
+        size_t row = size_t(y0 + by) * size_t(stride_) + size_t(x0);
+        float* depth = depth_.data() + row;
+        int* visibility = visibility_.data() + row;
+        for ( int bx = bx0; bx <= bx1; bx += 4 ) {
+          V px = Simd4::add(Simd4::set(float(bx)), offsets);
+          V l0 = Simd4::add(Simd4::mul(a0, px), r0);
+          V l1 = Simd4::add(Simd4::mul(a1, px), r1);
+          V l2 = Simd4::add(Simd4::mul(a2, px), r2);
+          V z = Simd4::add(Simd4::mul(vza, px), rz);
+          V stored = Simd4::load(depth + bx);
+          V inside = Simd4::both(Simd4::both(Simd4::lessEqual(zero, l0), Simd4::lessEqual(zero, l1)),
+                                 Simd4::both(Simd4::lessEqual(zero, l2), Simd4::less(z, stored)));
+          int mask = Simd4::mask(inside);
+          if ( mask == 0 ) {
+            continue;
+          }
+          Simd4::store(depth + bx, Simd4::select(inside, z, stored));
+          for ( int lane = 0; lane < 4; lane++ ) {
+            if ( mask & (1 << lane) ) {
+              visibility[bx + lane] = id;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // отложенное затенение: каждый пиксель - один раз, после теста глубины всех треугольников
+  for ( int y = y0; y < y1; y++ ) {
+    const int* visibility = visibility_.data() + size_t(y) * size_t(stride_);
+    QRgb* line = reinterpret_cast<QRgb*>(bits_ + size_t(y) * size_t(bytesPerLine_));
+    for ( int x = x0; x < x1; x++ ) {
+      int id = visibility[x];
+      if ( id < 0 ) {
+        line[x] = toRgb(Tonemap::apply(background(float(x) + 0.5f, float(y) + 0.5f), tonemap_, exposure_));
+        continue;
+      }
+      const ScreenTriangle& screen = chunks_[size_t(id / kChunkStride)].triangles[size_t(id % kChunkStride)];
+      line[x] = toRgb(Tonemap::apply(shade(screen, float(x) + 0.5f, float(y) + 0.5f), tonemap_, exposure_));
+      shaded++;
+    }
+  }
+}
+
+QVector3D SoftwareRasterizer::shade(const ScreenTriangle& screen, float x, float y) const
+{
+  // экранные барицентрические координаты, делённые на w вершин, - перспективно-корректные
+  float weights[3];
+  float sum = 0.0f;
+  for ( int k = 0; k < 3; k++ ) {
+    float l = float(screen.a[k] * x + screen.b[k] * y + screen.c[k]);
+    weights[k] = qMax(l, 0.0f) * screen.invW[k];
+    sum += weights[k];
+  }
+  float u = 0.0f;
+  float v = 0.0f;
+  if ( sum > 0.0f ) {
+    for ( int k = 0; k < 3; k++ ) {
+      u += weights[k] * screen.u[k];
+      v += weights[k] * screen.v[k];
+    }
+    u /= sum;
+    v /= sum;
+  }
+  float w = 1.0f - u - v;
+
+  const CpuScene::Triangle& triangle = scene_->triangles()[size_t(screen.triangle)];
+  const CpuScene::Surface& surface = scene_->surfaces().at(triangle.surface);
+  QVector3D fragPos = triangle.positions[0] * w + triangle.positions[1] * u + triangle.positions[2] * v;
+  QVector2D texCoord = triangle.uvs[0] * w + triangle.uvs[1] * u + triangle.uvs[2] * v;
+  QVector3D N = (triangle.normals[0] * w + triangle.normals[1] * u + triangle.normals[2] * v).normalized();
+  if ( !surface.normalMap.isNull() ) {
+    QVector3D mapped = CpuScene::sample(surface.normalMap, texCoord).toVector3D() * 2.0f - QVector3D{1.0f, 1.0f, 1.0f};
+    N = (triangle.tangent.normalized() * mapped.x() + triangle.bitangent.normalized() * mapped.y() + N * mapped.z())
+        .normalized();
+  }
+  QVector3D V = (eye_ - fragPos).normalized();
+  QVector3D albedo = surface.albedoMap.isNull()
+                   ? surface.albedo : Tonemap::toLinear(CpuScene::sample(surface.albedoMap, texCoord).toVector3D());
+  float metallic = surface.metallicMap.isNull() ? surface.metallic : CpuScene::sample(surface.metallicMap, texCoord).x();
+  float roughness = surface.roughnessMap.isNull() ? surface.roughness
+                                                  : CpuScene::sample(surface.roughnessMap, texCoord).x();
+  float ao = surface.aoMap.isNull() ? surface.ao : CpuScene::sample(surface.aoMap, texCoord).x();
+  // F0 = normalize(vec3(0.04)) в шейдере
+  float f0 = 1.0f / std::sqrt(3.0f);
+  QVector3D F0 = mix(QVector3D{f0, f0, f0}, albedo, metallic);
+
+  // как в шейдере, освещение копится линейно; тонмаппинг - при записи пикселя
+  QVector3D L = -scene_->lightDirection();
+  QVector3D color = albedo * (kDirectionalAmbient * ao)
+                  + lightPBR(N, V, L, albedo, metallic, roughness, F0, scene_->lightColor());
+  color += albedo * (kPointAmbient * ao);
+  for ( const auto& light : scene_->pointLights() ) {
+    QVector3D toLight = light.position - fragPos;
+    float distance = toLight.length();
+    float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    color += lightPBR(N, V, toLight.normalized(), albedo, metallic, roughness, F0, light.color * attenuation);
+  }
+  return color;
+}
+
+QVector3D SoftwareRasterizer::background(float x, float y) const
+{
+  if ( !scene_->hasEnvironment() ) {
+    return QVector3D{kClearColor, kClearColor, kClearColor};
+  }
+  QVector3D direction = corner_ + right_ * (x / float(width_)) + down_ * (y / float(height_)) - eye_;
+  return scene_->environment(direction);
+}
@@ -0,0 +1,118 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <QImage>
+#include <QMatrix4x4>
+#include <QVector3D>
+
+#include <memory>
+#include <vector>
+
+#include "cpuscene.h"
+#include "tonemap.h"
+
+// Программный растеризатор для машин без GPU (рендер-ферма, сборка): рисует CpuScene с тем же
+// освещением, что fPBRShader.frag, перенесённым в C++. Кадр делится на тайлы kTileSize.
+// Треугольники переводятся в экранные координаты (с отсечением по ближней плоскости)
+// и раскладываются по тайлам порциями kChunkTriangles, порядок внутри тайла сохраняется.
+// Каждый тайл - задание JobSystem: растеризация по 4 пикселя (Simd4) с тестом глубины в буфер
+// видимости, затем каждый видимый пиксель затеняется один раз с перспективно-корректной
+// интерполяцией и сразу тонмаппится. Тени, фонарь камеры, bloom и Phong-освещение примитивов
+// не повторяются.
+class SoftwareRasterizer
+{
+public:
+  static const int kTileSize = 64;
+  static const int kChunkTriangles = 4096;
+  // фон без неба - glClearColor в OpenglWidget
+  static const float kClearColor;
+
+  SoftwareRasterizer() = default;
+  SoftwareRasterizer(const SoftwareRasterizer&) = delete;
+
+  SoftwareRasterizer& operator=(const SoftwareRasterizer&) = delete;
+
+  // сцена не меняется, пока растеризатор ей пользуется
+  void setScene(std::shared_ptr<const CpuScene> scene);
+  void setView(const QMatrix4x4& view, const QMatrix4x4& projection);
+  void setTonemap(Tonemap::Operator op, float exposure);
+  void resize(int width, int height);
+  void render();
+  // RGB32, как grabFramebuffer()
+  const QImage& image() const { return image_; }
+
+  static const char* backend();
+  float frameMs() const { return frameMs_; }
+  // треугольники после отсечения, попавшие хотя бы в один тайл
+  int trianglesBinned() const { return trianglesBinned_; }
+  int pixelsShaded() const { return pixelsShaded_; }
+
+private:
+  // треугольник на экране: барицентрические координаты и глубина - плоскости a * x + b * y + c
+  // в пикселях (0, 0 - левый верхний угол), считаются в double, чтобы большие координаты
+  // не съедали точность
+  struct ScreenTriangle {
+    double a[3];
+    double b[3];
+    double c[3];
+    double depth[3];
+    float invW[3];
+    // вершины в барицентрических координатах исходного треугольника (веса вершин 1 и 2)
+    float u[3];
+    float v[3];
+    int triangle;
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+  };
+
+  struct ClipVertex {
+    float position[4];
+    float u;
+    float v;
+  };
+
+  struct Chunk {
+    std::vector<ScreenTriangle> triangles;
+    // номера треугольников порции по тайлам
+    std::vector<std::vector<int>> bins;
+  };
+
+  void setupChunk(int index);
+  void addTriangle(Chunk& chunk, const ClipVertex* vertexes, int triangle);
+  void rasterizeTile(int tile, int& shaded);
+  QVector3D shade(const ScreenTriangle& screen, float x, float y) const;
+  QVector3D background(float x, float y) const;
+
+private:
+  std::shared_ptr<const CpuScene> scene_;
+  // проекция * вид по столбцам, как QMatrix4x4::constData()
+  float viewProjection_[16]{};
+  QVector3D eye_;
+  // направление на пиксель: corner_ + right_ * x + down_ * y - eye_, x, y в [0, 1]
+  QVector3D corner_;
+  QVector3D right_;
+  QVector3D down_;
+  int width_ = 0;
+  int height_ = 0;
+  int tilesX_ = 0;
+  int tilesY_ = 0;
+  // строки буферов выровнены по тайлам, блоки по 4 пикселя не выходят за строку
+  int stride_ = 0;
+  std::vector<Chunk> chunks_;
+  int chunkCount_ = 0;
+  std::vector<float> depth_;
+  // порция * 2 * kChunkTriangles + номер в порции, -1 - фон
+  std::vector<int> visibility_;
+  Tonemap::Operator tonemap_ = Tonemap::Reinhard;
+  float exposure_ = 1.0f;
+  QImage image_;
+  uchar* bits_ = nullptr;
+  int bytesPerLine_ = 0;
+  float frameMs_ = 0.0f;
+  int trianglesBinned_ = 0;
+  int pixelsShaded_ = 0;
+};
+
+#endif // RASTERIZER_H
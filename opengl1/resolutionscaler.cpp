@@ -0,0 +1,66 @@
+#include "resolutionscaler.h"
+
+#include <QtGlobal>
+
+#include <cmath>
+
+const float ResolutionScaler::kMinScale = 0.5f;
+const float ResolutionScaler::kMaxScale = 1.0f;
+const float ResolutionScaler::kQuantum = 0.05f;
+const float ResolutionScaler::kMaxStep = 0.1f;
+const float ResolutionScaler::kLowerBand = 0.8f;
+const float ResolutionScaler::kSmoothing = 0.1f;
+
+void ResolutionScaler::setEnabled(bool enabled)
+{
+  if ( enabled_ != enabled ) {
+    enabled_ = enabled;
+    reset();
+  }
+}
+
+void ResolutionScaler::setTargetMs(float ms)
+{
+  if ( ms <= 0.0f ) { return; }
+  targetMs_ = ms;
+  settle_ = 0;
+}
+
+void ResolutionScaler::reset()
+{
+  scale_ = kMaxScale;
+  smoothedMs_ = 0.0f;
+  settle_ = kSettleFrames;
+}
+
+void ResolutionScaler::update(float gpuMs)
+{
+  if ( !enabled_ || gpuMs <= 0.0f ) {
+    return;
+  }
+  smoothedMs_ = smoothedMs_ > 0.0f ? smoothedMs_ + (gpuMs - smoothedMs_) * kSmoothing : gpuMs;
+  if ( settle_ > 0 ) {
+    settle_--;
+    return;
+  }
+  // внутри полосы масштаб не трогаем, иначе он колебался бы вокруг бюджета
+  if ( smoothedMs_ <= targetMs_ && smoothedMs_ >= targetMs_ * kLowerBand ) {
+    return;
+  }
+  // время ~ числу пикселей ~ scale^2; вверх целимся в середину полосы
+  float goal = smoothedMs_ > targetMs_ ? targetMs_ : targetMs_ * (1.0f + kLowerBand) * 0.5f;
+  float wanted = scale_ * std::sqrt(goal / smoothedMs_);
+  wanted = qBound(scale_ - kMaxStep, wanted, scale_ + kMaxStep);
+  // квантуем к масштабу в сторону изменения, чтобы шаг не пропадал при округлении
+  float steps = wanted / kQuantum;
+  wanted = (wanted < scale_ ? std::floor(steps + 1.0e-3f) : std::ceil(steps - 1.0e-3f)) * kQuantum;
+  wanted = qBound(kMinScale, wanted, kMaxScale);
+  if ( std::fabs(wanted - scale_) < kQuantum * 0.5f ) {
+    return;
+  }
+  scale_ = wanted;
+  // старые времена относятся к прежнему размеру
+  smoothedMs_ = 0.0f;
+  settle_ = kSettleFrames;
+  changes_++;
+}
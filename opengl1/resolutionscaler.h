@@ -0,0 +1,43 @@
+#ifndef RESOLUTIONSCALER_H
+#define RESOLUTIONSCALER_H
+
+// Динамическое разрешение: по времени кадра на GPU выбирает масштаб, с которым сцена рисуется
+// во внеэкранную цель (на экран её растягивает проход тонмаппинга). Время сглаживается,
+// масштаб меняется только если оно вышло из полосы [kLowerBand, 1] * бюджета, шаг считается
+// из того, что время пропорционально числу пикселей, и ограничен kMaxStep. Масштаб
+// квантуется шагом kQuantum, чтобы пул графа кадра не заводил цели под каждый размер,
+// а после смены kSettleFrames кадров ждёт, пока придут метки времени нового размера.
+class ResolutionScaler
+{
+public:
+  static const float kMinScale;
+  static const float kMaxScale;
+  static const float kQuantum;
+  static const float kMaxStep;
+  static const float kLowerBand;
+  static const float kSmoothing;
+  static const int kSettleFrames = 8;
+
+  void setEnabled(bool enabled);
+  bool isEnabled() const { return enabled_; }
+  void setTargetMs(float ms);
+  float targetMs() const { return targetMs_; }
+  // раз в кадр; gpuMs <= 0 - время ещё не измерено
+  void update(float gpuMs);
+  void reset();
+
+  // доля стороны экрана, kMaxScale без динамического разрешения
+  float scale() const { return enabled_ ? scale_ : kMaxScale; }
+  float smoothedMs() const { return smoothedMs_; }
+  int changes() const { return changes_; }
+
+private:
+  bool enabled_ = false;
+  float targetMs_ = 16.6f;
+  float scale_ = 1.0f;
+  float smoothedMs_ = 0.0f;
+  int settle_ = 0;
+  int changes_ = 0;
+};
+
+#endif // RESOLUTIONSCALER_H
@@ -0,0 +1,139 @@
+#include "scene.h"
+
+#include <cmath>
+
+const int Scene::kNone;
+
+void Scene::reserve(int count)
+{
+  alive_.reserve(count);
+  nodeEntities_.reserve(count);
+  hierarchy_.reserve(count);
+  transforms_.reserve(count);
+}
+
+int Scene::createEntity()
+{
+  int entity;
+  if ( !freeEntities_.isEmpty() ) {
+    entity = freeEntities_.takeLast();
+    alive_[entity] = 1;
+  }
+  else {
+    entity = alive_.size();
+    alive_.append(1);
+  }
+  entityCount_++;
+  return entity;
+}
+
+int Scene::createEntity(const QMatrix4x4& local, int parent)
+{
+  int entity = createEntity();
+  int node = hierarchy_.create(parent == kNone ? TransformHierarchy::kNone : this->node(parent));
+  hierarchy_.setLocal(node, local);
+  transforms_.add(entity, TransformComponent{node});
+  if ( node >= nodeEntities_.size() ) {
+    nodeEntities_.resize(node + 1);
+  }
+  nodeEntities_[node] = entity;
+  return entity;
+}
+
+void Scene::destroyEntities(const QVector<int>& entities)
+{
+  QVector<int> nodes;
+  nodes.reserve(entities.size());
+  for ( int entity : entities ) {
+    if ( !isValid(entity) ) {
+      continue;
+    }
+    if ( const TransformComponent* transform = transforms_.find(entity) ) {
+      nodes.append(transform->node);
+    }
+    transforms_.remove(entity);
+    meshRenderers_.remove(entity);
+    materials_.remove(entity);
+    pointLights_.remove(entity);
+    bounds_.remove(entity);
+    spins_.remove(entity);
+    alive_[entity] = 0;
+    freeEntities_.append(entity);
+    entityCount_--;
+  }
+  // поддеревья уходят одним проходом по массивам иерархии
+  hierarchy_.destroy(nodes);
+}
+
+int Scene::node(int entity) const
+{
+  const TransformComponent* transform = transforms_.find(entity);
+  return transform ? transform->node : TransformHierarchy::kNone;
+}
+
+void Scene::setLocal(int entity, const QMatrix4x4& local)
+{
+  hierarchy_.setLocal(node(entity), local);
+}
+
+QMatrix4x4 Scene::world(int entity) const
+{
+  return hierarchy_.worldMatrix(node(entity));
+}
+
+Mat4 Scene::worldMat4(int entity) const
+{
+  return hierarchy_.world(node(entity));
+}
+
+void Scene::setBounds(int entity, const BoundingBox& bounds)
+{
+  BoundsComponent& component = bounds_.add(entity, BoundsComponent{bounds, QVector3D{}, 0.0f});
+  updateWorldBounds(component, worldMat4(entity));
+}
+
+void Scene::animate()
+{
+  SpinComponent* spins = spins_.data();
+  for ( int i = 0; i < spins_.size(); i++ ) {
+    SpinComponent& spin = spins[i];
+    spin.angle = std::fmod(spin.angle + spin.step, 360.0f);
+    QMatrix4x4 local;
+    local.translate(spin.position);
+    local.rotate(spin.angle, spin.axis);
+    local.scale(spin.scale);
+    hierarchy_.setLocal(node(spins_.entity(i)), local);
+  }
+}
+
+int Scene::update()
+{
+  int updated = hierarchy_.update();
+  // мировые границы - только у сдвинувшихся узлов
+  for ( int node : hierarchy_.changed() ) {
+    if ( BoundsComponent* bounds = bounds_.find(nodeEntities_.at(node)) ) {
+      updateWorldBounds(*bounds, hierarchy_.world(node));
+    }
+  }
+  return updated;
+}
+
+void Scene::updateWorldBounds(BoundsComponent& bounds, const Mat4& world)
+{
+  if ( bounds.local.isEmpty() ) {
+    bounds.radius = 0.0f;
+    return;
+  }
+  const float* m = world.m;
+  QVector3D c = bounds.local.center();
+  bounds.center = QVector3D{m[0] * c.x() + m[4] * c.y() + m[8] * c.z() + m[12],
+                            m[1] * c.x() + m[5] * c.y() + m[9] * c.z() + m[13],
+                            m[2] * c.x() + m[6] * c.y() + m[10] * c.z() + m[14]};
+  // радиус растягивается наибольшим масштабом по осям
+  float scale = 0.0f;
+  for ( int column = 0; column < 3; column++ ) {
+    const float* axis = m + column * 4;
+    scale = qMax(scale, axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  }
+  bounds.radius = bounds.local.size().length() * 0.5f * std::sqrt(scale);
+}
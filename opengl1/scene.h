@@ -0,0 +1,208 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <algorithm>
+
+#include <QVector>
+#include <QVector3D>
+#include <QMatrix4x4>
+
+#include "structs.h"
+#include "transformhierarchy.h"
+
+class OGLObject;
+class QOpenGLTexture;
+
+// Плотный массив компонентов одного типа: компоненты и их сущности лежат подряд без дыр,
+// индекс по сущности даёт позицию. При удалении на освободившееся место переезжает последний,
+// поэтому системы идут по массиву линейно, а поиск по сущности - одно обращение по индексу.
+template<class T>
+class ComponentArray
+{
+public:
+  int size() const { return components_.size(); }
+  bool contains(int entity) const { return entity >= 0 && entity < indexes_.size() && indexes_.at(entity) >= 0; }
+  void reserve(int count)
+  {
+    components_.reserve(count);
+    entities_.reserve(count);
+  }
+
+  T& add(int entity, const T& component = T())
+  {
+    if ( entity >= indexes_.size() ) {
+      int old = indexes_.size();
+      indexes_.resize(entity + 1);
+      std::fill(indexes_.begin() + old, indexes_.end(), -1);
+    }
+    int& index = indexes_[entity];
+    if ( index < 0 ) {
+      index = components_.size();
+      components_.append(component);
+      entities_.append(entity);
+    }
+    else {
+      components_[index] = component;
+    }
+    return components_[index];
+  }
+  void remove(int entity)
+  {
+    if ( !contains(entity) ) {
+      return;
+    }
+    int index = indexes_.at(entity);
+    int last = components_.size() - 1;
+    if ( index != last ) {
+      components_[index] = components_.at(last);
+      entities_[index] = entities_.at(last);
+      indexes_[entities_.at(index)] = index;
+    }
+    components_.removeLast();
+    entities_.removeLast();
+    indexes_[entity] = -1;
+  }
+  void clear()
+  {
+    components_.clear();
+    entities_.clear();
+    indexes_.clear();
+  }
+
+  T* find(int entity) { return contains(entity) ? &components_[indexes_.at(entity)] : nullptr; }
+  const T* find(int entity) const { return contains(entity) ? &components_.at(indexes_.at(entity)) : nullptr; }
+  // по позиции в массиве
+  T& at(int index) { return components_[index]; }
+  const T& at(int index) const { return components_.at(index); }
+  int entity(int index) const { return entities_.at(index); }
+  // для обхода в рабочих потоках: data() отделяет общий буфер заранее
+  T* data() { return components_.data(); }
+  const T* constData() const { return components_.constData(); }
+
+private:
+  QVector<T> components_;
+  QVector<int> entities_;
+  // по сущности, -1 - компонента нет
+  QVector<int> indexes_;
+};
+
+struct TransformComponent {
+  int node = TransformHierarchy::kNone;
+};
+
+struct MeshRendererComponent {
+  enum Primitive { Model, Cube, Floor };
+
+  Primitive primitive = Model;
+  // модель для Model, у встроенной геометрии nullptr
+  OGLObject* object = nullptr;
+  // LOD мешей модели с прошлого кадра
+  QVector<int> lods;
+  bool castsShadow = true;
+  bool occluder = true;
+};
+
+// материал встроенной геометрии; у моделей материалы свои в каждом меше
+struct MaterialComponent {
+  QOpenGLTexture* albedo = nullptr;
+};
+
+// положение источника - из его трансформации
+struct PointLightComponent {
+  QVector3D ambient{0.05f, 0.05f, 0.05f};
+  QVector3D diffuse{1.0f, 1.0f, 1.0f};
+  QVector3D specular{0.1f, 0.1f, 0.1f};
+  float constant = 1.0f;
+  float linear = 0.09f;
+  float quadratic = 0.032f;
+};
+
+// границы в пространстве модели и описанная сфера в мире - её пересчитывает Scene::update
+// только у сдвинувшихся сущностей
+struct BoundsComponent {
+  BoundingBox local;
+  QVector3D center{0.0f, 0.0f, 0.0f};
+  float radius = 0.0f;
+};
+
+// анимация: поворот вокруг оси на шаг за тик, local = translate(position) * rotate * scale
+struct SpinComponent {
+  QVector3D position{0.0f, 0.0f, 0.0f};
+  QVector3D axis{0.0f, 1.0f, 0.0f};
+  float angle = 0.0f;
+  float step = 1.0f;
+  float scale = 1.0f;
+};
+
+// Сцена из сущностей: сущность - только номер, данные лежат в плотных массивах компонентов,
+// трансформации - узлы TransformHierarchy. Системы (анимация, пересчёт границ, отсечение
+// и отправка в DrawListBuilder) идут по массивам линейно.
+class Scene
+{
+public:
+  static const int kNone = -1;
+
+  Scene() = default;
+  Scene(const Scene&) = delete;
+
+  Scene& operator=(const Scene&) = delete;
+
+  void reserve(int count);
+  // сущность без компонентов
+  int createEntity();
+  // сущность с трансформацией; parent - сущность с трансформацией или kNone
+  int createEntity(const QMatrix4x4& local, int parent = kNone);
+  // сущности удаляются со всеми компонентами; сущности, чьи узлы лежат в поддеревьях
+  // удаляемых, нужно удалять в том же вызове
+  void destroyEntities(const QVector<int>& entities);
+  void destroyEntity(int entity) { destroyEntities(QVector<int>{entity}); }
+  bool isValid(int entity) const { return entity >= 0 && entity < alive_.size() && alive_.at(entity); }
+  int entityCount() const { return entityCount_; }
+
+  int node(int entity) const;
+  void setLocal(int entity, const QMatrix4x4& local);
+  // мировая матрица на момент последнего update()
+  QMatrix4x4 world(int entity) const;
+  Mat4 worldMat4(int entity) const;
+  // границы в пространстве модели, мировая сфера считается сразу
+  void setBounds(int entity, const BoundingBox& bounds);
+
+  const TransformHierarchy& hierarchy() const { return hierarchy_; }
+  ComponentArray<TransformComponent>& transforms() { return transforms_; }
+  const ComponentArray<TransformComponent>& transforms() const { return transforms_; }
+  ComponentArray<MeshRendererComponent>& meshRenderers() { return meshRenderers_; }
+  const ComponentArray<MeshRendererComponent>& meshRenderers() const { return meshRenderers_; }
+  ComponentArray<MaterialComponent>& materials() { return materials_; }
+  const ComponentArray<MaterialComponent>& materials() const { return materials_; }
+  ComponentArray<PointLightComponent>& pointLights() { return pointLights_; }
+  const ComponentArray<PointLightComponent>& pointLights() const { return pointLights_; }
+  ComponentArray<BoundsComponent>& bounds() { return bounds_; }
+  const ComponentArray<BoundsComponent>& bounds() const { return bounds_; }
+  ComponentArray<SpinComponent>& spins() { return spins_; }
+  const ComponentArray<SpinComponent>& spins() const { return spins_; }
+
+  // система анимации: все SpinComponent на шаг вперёд
+  void animate();
+  // мировые матрицы помеченных узлов и мировые границы их сущностей;
+  // возвращает число пересчитанных узлов
+  int update();
+
+private:
+  static void updateWorldBounds(BoundsComponent& bounds, const Mat4& world);
+
+private:
+  TransformHierarchy hierarchy_;
+  ComponentArray<TransformComponent> transforms_;
+  ComponentArray<MeshRendererComponent> meshRenderers_;
+  ComponentArray<MaterialComponent> materials_;
+  ComponentArray<PointLightComponent> pointLights_;
+  ComponentArray<BoundsComponent> bounds_;
+  ComponentArray<SpinComponent> spins_;
+  QVector<char> alive_;
+  QVector<int> freeEntities_;
+  int entityCount_ = 0;
+  // по id узла иерархии
+  QVector<int> nodeEntities_;
+};
+
+#endif // SCENE_H
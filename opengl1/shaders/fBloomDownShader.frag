@@ -0,0 +1,58 @@
+#version 330 core
+uniform sampler2D source;
+uniform vec2 sourceTexel;
+// первый уровень: среднее с весами по яркости (Karis), чтобы одиночные яркие пиксели не мерцали
+uniform bool firstLevel;
+
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+float karisWeight(vec3 color)
+{
+  float luma = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  return 1.0 / (1.0 + luma);
+}
+
+vec3 sampleSource(vec2 offset)
+{
+  return texture(source, texCoord + offset * sourceTexel).rgb;
+}
+
+// 13 выборок с перекрытием, как в Jimenez 2014 (Call of Duty: Advanced Warfare)
+void main(void)
+{
+  vec3 a = sampleSource(vec2(-2.0,  2.0));
+  vec3 b = sampleSource(vec2( 0.0,  2.0));
+  vec3 c = sampleSource(vec2( 2.0,  2.0));
+  vec3 d = sampleSource(vec2(-2.0,  0.0));
+  vec3 e = sampleSource(vec2( 0.0,  0.0));
+  vec3 f = sampleSource(vec2( 2.0,  0.0));
+  vec3 g = sampleSource(vec2(-2.0, -2.0));
+  vec3 h = sampleSource(vec2( 0.0, -2.0));
+  vec3 i = sampleSource(vec2( 2.0, -2.0));
+  vec3 j = sampleSource(vec2(-1.0,  1.0));
+  vec3 k = sampleSource(vec2( 1.0,  1.0));
+  vec3 l = sampleSource(vec2(-1.0, -1.0));
+  vec3 m = sampleSource(vec2( 1.0, -1.0));
+
+  vec3 groups[5];
+  groups[0] = (j + k + l + m) * 0.25;
+  groups[1] = (a + b + d + e) * 0.25;
+  groups[2] = (b + c + e + f) * 0.25;
+  groups[3] = (d + e + g + h) * 0.25;
+  groups[4] = (e + f + h + i) * 0.25;
+  float weights[5] = float[](0.5, 0.125, 0.125, 0.125, 0.125);
+
+  vec3 color = vec3(0.0);
+  float total = 0.0;
+  for ( int n = 0; n < 5; ++n ) {
+    float weight = weights[n];
+    if ( firstLevel ) {
+      weight *= karisWeight(groups[n]);
+    }
+    color += groups[n] * weight;
+    total += weight;
+  }
+  FragColor = vec4(max(color / total, vec3(0.0001)), 1.0);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+uniform sampler2D source;
+uniform sampler2D base;
+uniform vec2 sourceTexel;
+
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+// фильтр-палатка 3x3 по уровню вдвое мельче, сумма с уровнем base того же размера, что и цель
+void main(void)
+{
+  vec3 color = texture(source, texCoord + vec2(-1.0,  1.0) * sourceTexel).rgb
+             + texture(source, texCoord + vec2( 0.0,  1.0) * sourceTexel).rgb * 2.0
+             + texture(source, texCoord + vec2( 1.0,  1.0) * sourceTexel).rgb
+             + texture(source, texCoord + vec2(-1.0,  0.0) * sourceTexel).rgb * 2.0
+             + texture(source, texCoord).rgb * 4.0
+             + texture(source, texCoord + vec2( 1.0,  0.0) * sourceTexel).rgb * 2.0
+             + texture(source, texCoord + vec2(-1.0, -1.0) * sourceTexel).rgb
+             + texture(source, texCoord + vec2( 0.0, -1.0) * sourceTexel).rgb * 2.0
+             + texture(source, texCoord + vec2( 1.0, -1.0) * sourceTexel).rgb;
+  FragColor = vec4(texture(base, texCoord).rgb + color / 16.0, 1.0);
+}
@@ -89,7 +89,7 @@ vec3 addDirLight(LightDirect light, vec3 normal, vec3 viewDir)
   vec3 reflectDir = reflect(-lightDir, normal);
 
   float spec = pow(max(dot(normal, halfwayDir), 0.0), material.specularExponent);
-  vec3 objectColor = texture2D(albedo0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(albedo0, texCoord.st).rgb, vec3(2.2));
 //  vec3 objectColor = vec3(1.0f, 0.5f, 0.2f);
   vec3 ambient  = light.ambient  * material.ambientColor * objectColor;
   vec3 diffuse  = light.diffuse  * material.diffuseColor * diff * objectColor;
@@ -106,7 +106,7 @@ vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir)
   vec3 reflectDir = reflect(-lightDir, normal);
 
   float spec = pow(max(dot(normal, halfwayDir), 0.0), material.specularExponent);
-  vec3 objectColor = texture2D(albedo0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(albedo0, texCoord.st).rgb, vec3(2.2));
 //  vec3 objectColor = vec3(1.0f, 0.5f, 0.2f);
   // Затухание
   float distance    = length(light.position - fragPos);
@@ -125,7 +125,7 @@ vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir)
 
 vec3 addLamp( Lamp light, vec3 normal)
 {
-  vec3 objectColor = texture2D(albedo0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(albedo0, texCoord.st).rgb, vec3(2.2));
 //  vec3 objectColor = vec3(1.0f, 0.5f, 0.2f);
   vec3 ambient = light.ambient * material.ambientColor * objectColor;
 
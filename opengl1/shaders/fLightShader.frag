@@ -1,5 +1,5 @@
 #version 330 core
-uniform vec3 color;
+in vec3 color;
 out vec4 FragColor;
 
 void main(void)
@@ -47,11 +47,19 @@ uniform LightPos pointLights[NR_POINT_LIGHTS];
 
 uniform Lamp lamp;
 
+#define NR_CASCADES 3
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 lightSpaceMatrices[NR_CASCADES];
+uniform float cascadeSplits[NR_CASCADES];
+uniform bool useShadows;
+uniform mat4 view;
+
 out vec4 FragColor;
 
 vec3 addDirLight(LightDirect light, vec3 normal, vec3 viewDir);
 vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir);
 vec3 addLamp(Lamp light, vec3 normal);
+float shadowFactor(vec3 N, vec3 L);
 
 void main(void)
 {
@@ -76,11 +84,12 @@ vec3 addDirLight(LightDirect light, vec3 normal, vec3 viewDir)
   vec3 reflectDir = reflect(-lightDir, normal);
 
   float spec = pow(max(dot(normal, halfwayDir), 0.0), 64);
-  vec3 objectColor = texture2D(texture0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(texture0, texCoord.st).rgb, vec3(2.2));
   vec3 ambient  = light.ambient  * objectColor;
   vec3 diffuse  = light.diffuse  * diff * objectColor;
   vec3 specular = light.specular * spec * objectColor;
-  return (ambient + diffuse + specular);
+  float shadow = shadowFactor(normal, lightDir);
+  return (ambient + (diffuse + specular) * shadow);
 }
 
 vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir)
@@ -92,7 +101,7 @@ vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir)
   vec3 reflectDir = reflect(-lightDir, normal);
 
   float spec = pow(max(dot(normal, halfwayDir), 0.0), 64);
-  vec3 objectColor = texture2D(texture0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(texture0, texCoord.st).rgb, vec3(2.2));
 
   // Затухание
   float distance    = length(light.position - fragPos);
@@ -111,7 +120,7 @@ vec3 addPosLight(LightPos light, vec3 normal, vec3 viewDir)
 
 vec3 addLamp( Lamp light, vec3 normal)
 {
-  vec3 objectColor = texture2D(texture0, texCoord.st).rgb;
+  vec3 objectColor = pow(texture2D(texture0, texCoord.st).rgb, vec3(2.2));
   vec3 ambient = light.ambient * objectColor;
 
   vec3 lightDir = normalize(light.position - fragPos);
@@ -138,3 +147,35 @@ vec3 addLamp( Lamp light, vec3 normal)
 
   return (ambient + diffuse + specular);
 }
+
+float shadowFactor(vec3 N, vec3 L)
+{
+  if ( !useShadows ) {
+    return 1.0;
+  }
+  float depth = -(view * vec4(fragPos, 1.0)).z;
+  int cascade = -1;
+  for ( int i = 0; i < NR_CASCADES; ++i ) {
+    if ( depth < cascadeSplits[i] ) {
+      cascade = i;
+      break;
+    }
+  }
+  if ( cascade < 0 ) {
+    return 1.0;
+  }
+  vec4 lightPos = lightSpaceMatrices[cascade] * vec4(fragPos, 1.0);
+  vec3 proj = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+  if ( proj.z > 1.0 ) {
+    return 1.0;
+  }
+  float bias = max(0.002 * (1.0 - dot(N, L)), 0.0005);
+  vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+  float lit = 0.0;
+  for ( int x = -1; x <= 1; ++x ) {
+    for ( int y = -1; y <= 1; ++y ) {
+      lit += texture(shadowMap, vec4(proj.xy + vec2(x, y) * texel, float(cascade), proj.z - bias));
+    }
+  }
+  return lit / 9.0;
+}
@@ -68,6 +68,13 @@ uniform LightPos pointLights[NR_POINT_LIGHTS];
 uniform Lamp lamp;
 uniform Material material;
 
+#define NR_CASCADES 3
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 lightSpaceMatrices[NR_CASCADES];
+uniform float cascadeSplits[NR_CASCADES];
+uniform bool useShadows;
+uniform mat4 view;
+
 out vec4 FragColor;
 
 const float PI = 3.14159265359;
@@ -76,6 +83,7 @@ float distributionGGX(vec3 N, vec3 H, float roughness);
 float geometrySchlickGGX(float NdotV, float roughness);
 float geometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
+float shadowFactor(vec3 N, vec3 L);
 
 vec3 addDirLightPBR(LightDirect light, vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, float ao);
 vec3 addPosLightPBR(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, float ao);
@@ -96,8 +104,7 @@ void main(void)
 
   vec3 albedo;
   if (useAlbedoMap) {
-//      albedo = pow(texture2D(albedo0, texCoord).rgb, vec3(2.2));
-    albedo = texture2D(albedo0, texCoord).rgb;
+    albedo = pow(texture2D(albedo0, texCoord).rgb, vec3(2.2));
   }
   else {
     albedo = material.ambientColor;
@@ -136,6 +143,7 @@ void main(void)
 
   //Lamp
   result += addLampPBR(lamp, norm,viewDir, albedo, metallic, roughness, ao);
+  // освещение копится линейно в HDR, тонмаппинг и гамма - в fTonemapShader.frag
   FragColor = vec4(result, 1.0f);
 }
 
@@ -164,14 +172,11 @@ vec3 addDirLightPBR(LightDirect light, vec3 N, vec3 V,vec3 albedo, float metalli
 
   float NdotL = max( dot( N ,L), 0.0);
   Lo += (kD * albedo/PI + specular) * radiance * NdotL;
+  Lo *= shadowFactor(N, L);
 
 
   vec3 ambient = vec3(0.1) * albedo * ao;
-  vec3 color = ambient +  Lo;
-
-  color = color/(color + vec3(1.0));
-  color = pow(color, vec3(1.0/2.2));
-  return color;
+  return ambient + Lo;
 }
 
 vec3 addPosLightPBR(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness, float ao )
@@ -207,11 +212,7 @@ vec3 addPosLightPBR(vec3 N, vec3 V, vec3 albedo, float metallic, float roughness
 
 
   vec3 ambient = vec3(0.03) * albedo * ao;
-  vec3 color = ambient +  Lo;
-
-  color = color/(color + vec3(1.0));
-//  color = pow(color, vec3(1.0/2.2));
-  return color;
+  return ambient + Lo;
 }
 
 vec3 addLampPBR( Lamp light, vec3 V, vec3 N, vec3 albedo, float metallic, float roughness, float ao)
@@ -249,11 +250,7 @@ vec3 addLampPBR( Lamp light, vec3 V, vec3 N, vec3 albedo, float metallic, float
   Lo  *= intensity;
 
   vec3 ambient = albedo * ao * radiance * intensity;
-  vec3 color = ambient +  Lo;
-
-  color = color/(color + vec3(1.0));
-//  color = pow(color, vec3(1.0/2.2));
-  return color;
+  return ambient + Lo;
 }
 
 float distributionGGX(vec3 N, vec3 H, float roughness)
@@ -296,3 +293,35 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
   float p=pow(1.0 - cosTheta, 5.0);
   return F0 + (1.0 - F0) * p;
 }
+
+float shadowFactor(vec3 N, vec3 L)
+{
+  if ( !useShadows ) {
+    return 1.0;
+  }
+  float depth = -(view * vec4(fragPos, 1.0)).z;
+  int cascade = -1;
+  for ( int i = 0; i < NR_CASCADES; ++i ) {
+    if ( depth < cascadeSplits[i] ) {
+      cascade = i;
+      break;
+    }
+  }
+  if ( cascade < 0 ) {
+    return 1.0;
+  }
+  vec4 lightPos = lightSpaceMatrices[cascade] * vec4(fragPos, 1.0);
+  vec3 proj = lightPos.xyz / lightPos.w * 0.5 + 0.5;
+  if ( proj.z > 1.0 ) {
+    return 1.0;
+  }
+  float bias = max(0.002 * (1.0 - dot(N, L)), 0.0005);
+  vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+  float lit = 0.0;
+  for ( int x = -1; x <= 1; ++x ) {
+    for ( int y = -1; y <= 1; ++y ) {
+      lit += texture(shadowMap, vec4(proj.xy + vec2(x, y) * texel, float(cascade), proj.z - bias));
+    }
+  }
+  return lit / 9.0;
+}
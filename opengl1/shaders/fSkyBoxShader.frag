@@ -6,5 +6,5 @@ out vec4 FragColor;
 
 void main(void)
 {
-    FragColor = texture(skybox, texCoords);
+    FragColor = vec4(pow(texture(skybox, texCoords).rgb, vec3(2.2)), 1.0);
 }
@@ -0,0 +1,47 @@
+#version 330 core
+uniform sampler2D hdr;
+uniform sampler2D bloom;
+uniform bool useBloom;
+uniform float bloomStrength;
+uniform float exposure;
+// 0 - Reinhard, 1 - ACES, как Tonemap::Operator
+uniform int tonemapOperator;
+// сцена в уменьшенном разрешении растягивается билинейно; sharpness > 0 - повышение резкости
+// по четырём соседям, ограниченное их минимумом и максимумом, чтобы не было ореолов
+uniform float sharpness;
+uniform vec2 hdrTexel;
+
+in vec2 texCoord;
+
+out vec4 FragColor;
+
+// аппроксимация ACES Нарковича (2015)
+vec3 aces(vec3 x)
+{
+  return clamp(x * (2.51 * x + 0.03) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main(void)
+{
+  vec3 color = texture(hdr, texCoord).rgb;
+  if ( sharpness > 0.0 ) {
+    vec3 left = texture(hdr, texCoord - vec2(hdrTexel.x, 0.0)).rgb;
+    vec3 right = texture(hdr, texCoord + vec2(hdrTexel.x, 0.0)).rgb;
+    vec3 down = texture(hdr, texCoord - vec2(0.0, hdrTexel.y)).rgb;
+    vec3 up = texture(hdr, texCoord + vec2(0.0, hdrTexel.y)).rgb;
+    vec3 low = min(min(min(left, right), min(down, up)), color);
+    vec3 high = max(max(max(left, right), max(down, up)), color);
+    color = clamp(color + (4.0 * color - left - right - down - up) * sharpness, low, high);
+  }
+  if ( useBloom ) {
+    color = mix(color, texture(bloom, texCoord).rgb, bloomStrength);
+  }
+  color = max(color, vec3(0.0)) * exposure;
+  if ( tonemapOperator == 1 ) {
+    color = aces(color);
+  }
+  else {
+    color = color / (color + vec3(1.0));
+  }
+  FragColor = vec4(pow(color, vec3(1.0 / 2.2)), 1.0);
+}
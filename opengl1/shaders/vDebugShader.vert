@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec3 inPos;
+// цвет задаётся в sRGB, а рисуется в HDR до тонмаппинга
+layout (location = 1) in vec4 inColor;
+uniform mat4 viewProjection;
+out vec3 color;
+
+void main(void)
+{
+    color = pow(inColor.rgb, vec3(2.2));
+    gl_Position = viewProjection * vec4(inPos,1.f);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+out vec2 texCoord;
+
+void main(void)
+{
+  // один треугольник на весь экран без буфера вершин
+  vec2 position = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+  texCoord = position;
+  gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
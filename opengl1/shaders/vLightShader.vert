@@ -1,10 +1,14 @@
 #version 330 core
 // important for VM export MESA_GL_VERSION_OVERRIDE=3.3
 layout (location = 0) in vec3 inPos;
-uniform mat4 qt_ModelViewProjectionMatrix;
+// данные экземпляра из кольцевого буфера
+layout (location = 5) in mat4 inModel;
+layout (location = 9) in vec3 inColor;
+uniform mat4 viewProjection;
+out vec3 color;
 
 void main(void)
 {
-    gl_Position = qt_ModelViewProjectionMatrix * vec4(inPos,1.f);
+    color = inColor;
+    gl_Position = viewProjection * inModel * vec4(inPos,1.f);
 }
-
@@ -1,17 +0,0 @@
-#version 330 core
-layout (location = 0) in vec3 inPos;
-layout (location = 1) in vec3 inNormal;
-
-out VS_OUT {
-    vec3 normal;
-} vs_out;
-
-uniform mat4 view;
-uniform mat4 model;
-
-void main()
-{
-    gl_Position = view * model * vec4(inPos, 1.0);
-    mat3 normalMatrix = mat3(transpose(inverse(view * model)));
-    vs_out.normal = normalize(vec3(vec4(normalMatrix * inNormal, 0.0)));
-}
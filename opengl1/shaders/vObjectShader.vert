@@ -3,9 +3,10 @@
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 inTexCoord;
 layout (location = 2) in vec3 inNormal;
-uniform mat4 projection;
-uniform mat4 view;
+// mvp и матрица нормалей считаются на CPU (SimdMath)
+uniform mat4 mvp;
 uniform mat4 model;
+uniform mat3 normalMatrix;
 
 out vec2 texCoord;
 out vec3 normal;
@@ -13,8 +14,8 @@ out vec3 fragPos;
 
 void main(void)
 {
-    gl_Position = projection * view * model * vec4(inPos,1.f);
+    gl_Position = mvp * vec4(inPos,1.f);
     fragPos = vec3(model * vec4(inPos, 1.0f));
     texCoord = inTexCoord;
-    normal = mat3( transpose( inverse(model) ) ) * inNormal;
+    normal = normalMatrix * inNormal;
 }
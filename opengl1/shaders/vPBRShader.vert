@@ -5,9 +5,10 @@ layout (location = 1) in vec2 inTexCoord;
 layout (location = 2) in vec3 inNormal;
 layout (location = 3) in vec3 inTangent;
 layout (location = 4) in vec3 inBitangent;
-uniform mat4 projection;
-uniform mat4 view;
+// mvp и матрица нормалей считаются на CPU (SimdMath)
+uniform mat4 mvp;
 uniform mat4 model;
+uniform mat3 normalMatrix;
 
 out vec2 texCoord;
 out vec3 fragPos;
@@ -16,10 +17,10 @@ out mat3 TBN;
 
 void main(void)
 {
-    gl_Position = projection * view * model * vec4(inPos,1.f);
+    gl_Position = mvp * vec4(inPos,1.f);
     fragPos = vec3(model * vec4(inPos, 1.0f));
     texCoord = inTexCoord;
-    vec3 normal = mat3( transpose( inverse(model) ) ) * inNormal;
+    vec3 normal = normalMatrix * inNormal;
     nNormal = normal;
     vec3 T = normalize(vec3(model * vec4(inTangent, 0.0f)));
     vec3 B = normalize(vec3(model * vec4(inBitangent, 0.0f)));
@@ -0,0 +1,10 @@
+#version 330 core
+// important for VM export MESA_GL_VERSION_OVERRIDE=3.3
+layout (location = 0) in vec3 inPos;
+uniform mat4 lightSpace;
+uniform mat4 model;
+
+void main(void)
+{
+    gl_Position = lightSpace * model * vec4(inPos,1.f);
+}
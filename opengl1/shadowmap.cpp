@@ -0,0 +1,235 @@
+#include "shadowmap.h"
+
+#include <QDebug>
+#include <QtMath>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+static const float kSplitLambda = 0.75f;
+static const float kMaxShadowDistance = 50.0f;
+static const float kDepthMargin = 20.0f;
+// Центр каскада привязывается к сетке из kCacheSnapTexels текселей:
+// пока камера не вышла из ячейки, матрица каскада (и кэш статики) не меняется,
+// а при смене ячейки сдвиг кратен текселю, поэтому тени не "дрожат".
+static const int kCacheSnapTexels = 64;
+
+ShadowMap::~ShadowMap()
+{
+  destroy();
+}
+
+void ShadowMap::create(int resolution)
+{
+  destroy();
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  resolution_ = resolution;
+
+  f->glGenTextures(1, &texture_);
+  f->glBindTexture(GL_TEXTURE_2D_ARRAY, texture_);
+  f->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution_, resolution_, kCascadeCount * 2,
+                  0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  f->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  memory_.allocate(GpuMemory::RenderTarget, QString("shadow map"),
+                   GpuMemory::textureBytes(resolution_, resolution_, kCascadeCount * 2, 4, false));
+
+  GLenum none = GL_NONE;
+  f->glGenFramebuffers(1, &staticFbo_);
+  f->glGenFramebuffers(1, &dynamicFbo_);
+  for ( GLuint fbo : {staticFbo_, dynamicFbo_} ) {
+    attachLayer(fbo, 0);
+    f->glDrawBuffers(1, &none);
+    f->glReadBuffer(GL_NONE);
+    if ( f->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE ) {
+      qDebug() << "Error shadow framebuffer";
+    }
+  }
+
+  for ( auto& cascade : cascades_ ) {
+    cascade.timer.create();
+    cascade.rendered = false;
+    cascade.staticDirty = true;
+  }
+}
+
+void ShadowMap::destroy()
+{
+  if ( texture_ == 0 ) { return; }
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glDeleteFramebuffers(1, &staticFbo_);
+  f->glDeleteFramebuffers(1, &dynamicFbo_);
+  f->glDeleteTextures(1, &texture_);
+  memory_.release();
+  for ( auto& cascade : cascades_ ) {
+    cascade.timer.destroy();
+    cascade.timerRunning = false;
+    cascade.timerPending = false;
+  }
+  texture_ = 0;
+  staticFbo_ = 0;
+  dynamicFbo_ = 0;
+}
+
+void ShadowMap::setLightDirection(const QVector3D& direction)
+{
+  QVector3D up{0.0f, 1.0f, 0.0f};
+  if ( qAbs(QVector3D::dotProduct(direction.normalized(), up)) > 0.99f ) {
+    up = QVector3D{1.0f, 0.0f, 0.0f};
+  }
+  QMatrix4x4 lightView;
+  lightView.lookAt(QVector3D{0.0f, 0.0f, 0.0f}, direction, up);
+  if ( lightView != lightView_ ) {
+    lightView_ = lightView;
+    invalidateStatic();
+  }
+}
+
+void ShadowMap::updateCascades(const QMatrix4x4& view, float fow, float aspect, float nearPlane, float farPlane)
+{
+  if ( !isCreated() ) { return; }
+  float shadowFar = qMin(farPlane, kMaxShadowDistance);
+  QMatrix4x4 invView = view.inverted();
+  float tanHalfV = float(tan(qDegreesToRadians(double(fow) / 2.0)));
+  float tanHalfH = tanHalfV * aspect;
+  float k2 = tanHalfH * tanHalfH + tanHalfV * tanHalfV;
+
+  float splitNear = nearPlane;
+  for ( int i = 0; i < kCascadeCount; i++ ) {
+    Cascade& cascade = cascades_[i];
+    float p = float(i + 1) / kCascadeCount;
+    float logSplit = nearPlane * float(pow(double(shadowFar / nearPlane), double(p)));
+    float uniformSplit = nearPlane + (shadowFar - nearPlane) * p;
+    float splitFar = kSplitLambda * logSplit + (1.0f - kSplitLambda) * uniformSplit;
+
+    // Сфера, описанная вокруг среза пирамиды видимости: её радиус не зависит
+    // от поворота камеры, поэтому размер каскада стабилен.
+    float centerDistance = (splitFar + splitNear) * (1.0f + k2) / 2.0f;
+    float radius;
+    if ( centerDistance >= splitFar ) {
+      centerDistance = splitFar;
+      radius = splitFar * sqrt(k2);
+    }
+    else {
+      float dz = splitFar - centerDistance;
+      radius = sqrt(dz * dz + splitFar * splitFar * k2);
+    }
+    radius = ceil(radius * 16.0f) / 16.0f;
+
+    float extent = radius / (1.0f - 2.0f * kCacheSnapTexels / resolution_);
+    float snap = 2.0f * extent / resolution_ * kCacheSnapTexels;
+    QVector3D center = lightView_.map(invView.map(QVector3D{0.0f, 0.0f, -centerDistance}));
+    float x = floor(center.x() / snap) * snap + snap / 2.0f;
+    float y = floor(center.y() / snap) * snap + snap / 2.0f;
+    float z = floor(center.z() / snap) * snap;
+
+    QMatrix4x4 projection;
+    projection.ortho(x - extent, x + extent, y - extent, y + extent,
+                     -(z + snap + extent + kDepthMargin), -(z - extent));
+    cascade.lightSpace = projection * lightView_;
+    cascade.splitFar = splitFar;
+    if ( cascade.lightSpace != cascade.renderedLightSpace ) {
+      cascade.staticDirty = true;
+    }
+    splitNear = splitFar;
+  }
+}
+
+void ShadowMap::invalidateStatic()
+{
+  for ( auto& cascade : cascades_ ) {
+    cascade.staticDirty = true;
+  }
+}
+
+bool ShadowMap::needsUpdate(int cascade, quint64 frame) const
+{
+  const Cascade& c = cascades_[cascade];
+  if ( !isCreated() ) { return false; }
+  if ( !c.rendered || c.staticDirty || cascade == 0 ) { return true; }
+  // дальние каскады обновляются реже: 1 - каждый второй кадр, 2 - каждый четвёртый и т.д.,
+  // со сдвигом, чтобы в один кадр попадало как можно меньше каскадов
+  quint64 period = quint64(1) << cascade;
+  return frame % period == period / 2 - 1;
+}
+
+void ShadowMap::beginCascade(int cascade)
+{
+  Cascade& c = cascades_[cascade];
+  if ( !c.timer.isCreated() ) { return; }
+  if ( c.timerPending && c.timer.isResultAvailable() ) {
+    c.gpuMs = float(c.timer.waitForResult()) / 1.0e6f;
+    c.timerPending = false;
+  }
+  if ( !c.timerPending ) {
+    c.timer.begin();
+    c.timerRunning = true;
+  }
+}
+
+void ShadowMap::bindStaticLayer(int cascade)
+{
+  attachLayer(staticFbo_, kCascadeCount + cascade);
+  glViewport(0, 0, resolution_, resolution_);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowMap::bindDynamicLayer(int cascade)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  attachLayer(staticFbo_, kCascadeCount + cascade);
+  attachLayer(dynamicFbo_, cascade);
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFbo_);
+  f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, dynamicFbo_);
+  f->glBlitFramebuffer(0, 0, resolution_, resolution_, 0, 0, resolution_, resolution_,
+                       GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  f->glBindFramebuffer(GL_FRAMEBUFFER, dynamicFbo_);
+  glViewport(0, 0, resolution_, resolution_);
+}
+
+void ShadowMap::endCascade(int cascade)
+{
+  Cascade& c = cascades_[cascade];
+  c.staticDirty = false;
+  c.rendered = true;
+  c.renderedLightSpace = c.lightSpace;
+  if ( c.timerRunning ) {
+    c.timer.end();
+    c.timerRunning = false;
+    c.timerPending = true;
+  }
+}
+
+void ShadowMap::bindTexture(int unit)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glActiveTexture(GLenum(GL_TEXTURE0 + unit));
+  f->glBindTexture(GL_TEXTURE_2D_ARRAY, texture_);
+  f->glActiveTexture(GL_TEXTURE0);
+}
+
+void ShadowMap::setUniforms(QOpenGLShaderProgram& shader)
+{
+  if ( !shader.isLinked() ) { return; }
+  QMatrix4x4 matrices[kCascadeCount];
+  GLfloat splits[kCascadeCount];
+  for ( int i = 0; i < kCascadeCount; i++ ) {
+    matrices[i] = cascades_[i].renderedLightSpace;
+    splits[i] = cascades_[i].splitFar;
+  }
+  shader.bind();
+  shader.setUniformValue("useShadows", isCreated());
+  shader.setUniformValueArray("lightSpaceMatrices", matrices, kCascadeCount);
+  shader.setUniformValueArray("cascadeSplits", splits, kCascadeCount, 1);
+}
+
+void ShadowMap::attachLayer(GLuint fbo, int layer)
+{
+  auto f = QOpenGLContext::currentContext()->extraFunctions();
+  f->glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  f->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture_, 0, layer);
+}
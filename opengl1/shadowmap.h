@@ -0,0 +1,73 @@
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTimerQuery>
+
+#include "gpumemory.h"
+
+// Каскадные карты теней для направленного света.
+// Слои [0, kCascadeCount) - итоговые карты, которые читает шейдер,
+// слои [kCascadeCount, 2*kCascadeCount) - кэш статической геометрии.
+class ShadowMap
+{
+public:
+  static const int kCascadeCount = 3;
+
+  ShadowMap() = default;
+  ShadowMap(const ShadowMap&) = delete;
+  ~ShadowMap();
+
+  ShadowMap& operator=(const ShadowMap&) = delete;
+
+  void create(int resolution);
+  void destroy();
+  bool isCreated() const { return texture_ != 0; }
+  GLuint texture() const { return texture_; }
+  int resolution() const { return resolution_; }
+
+  void setLightDirection(const QVector3D& direction);
+  void updateCascades(const QMatrix4x4& view, float fow, float aspect, float nearPlane, float farPlane);
+  void invalidateStatic();
+
+  bool needsUpdate(int cascade, quint64 frame) const;
+  bool isStaticDirty(int cascade) const { return cascades_[cascade].staticDirty; }
+  QMatrix4x4 lightSpace(int cascade) const { return cascades_[cascade].lightSpace; }
+
+  void beginCascade(int cascade);
+  void bindStaticLayer(int cascade);
+  void bindDynamicLayer(int cascade);
+  void endCascade(int cascade);
+
+  void bindTexture(int unit);
+  void setUniforms(QOpenGLShaderProgram& shader);
+  float cascadeTimeMs(int cascade) const { return cascades_[cascade].gpuMs; }
+
+private:
+  struct Cascade {
+    QMatrix4x4 lightSpace;
+    QMatrix4x4 renderedLightSpace;
+    float splitFar = 0.0f;
+    bool staticDirty = true;
+    bool rendered = false;
+    QOpenGLTimerQuery timer;
+    bool timerRunning = false;
+    bool timerPending = false;
+    float gpuMs = 0.0f;
+  };
+
+  void attachLayer(GLuint fbo, int layer);
+
+private:
+  Cascade cascades_[kCascadeCount];
+  QMatrix4x4 lightView_;
+  int resolution_ = 0;
+  GLuint texture_ = 0;
+  GLuint staticFbo_ = 0;
+  GLuint dynamicFbo_ = 0;
+  GpuAllocation memory_;
+};
+
+#endif // SHADOWMAP_H
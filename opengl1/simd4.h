@@ -0,0 +1,134 @@
+#ifndef SIMD4_H
+#define SIMD4_H
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD4_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SIMD4_NEON
+#endif
+
+// Четыре дорожки float для Bvh и SoftwareRasterizer: SSE2 на x86-64, NEON на ARM64,
+// иначе скалярный вариант с тем же интерфейсом. Сравнения дают маску: все биты дорожки -
+// единицы или нули, mask() собирает знаковые биты в число (бит i - дорожка i),
+// select(mask, a, b) берёт a там, где маска установлена.
+#if defined(SIMD4_SSE)
+struct Simd4
+{
+  typedef __m128 V;
+
+  static const char* backend() { return "SSE2"; }
+  static V set(float x) { return _mm_set1_ps(x); }
+  static V load(const float* p) { return _mm_loadu_ps(p); }
+  static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V div(V a, V b) { return _mm_div_ps(a, b); }
+  static V min(V a, V b) { return _mm_min_ps(a, b); }
+  static V max(V a, V b) { return _mm_max_ps(a, b); }
+  static V abs(V a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  static V less(V a, V b) { return _mm_cmplt_ps(a, b); }
+  static V lessEqual(V a, V b) { return _mm_cmple_ps(a, b); }
+  static V both(V a, V b) { return _mm_and_ps(a, b); }
+  static V select(V mask, V a, V b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+  static int mask(V a) { return _mm_movemask_ps(a); }
+};
+#elif defined(SIMD4_NEON)
+struct Simd4
+{
+  typedef float32x4_t V;
+
+  static const char* backend() { return "NEON"; }
+  static V set(float x) { return vdupq_n_f32(x); }
+  static V load(const float* p) { return vld1q_f32(p); }
+  static void store(float* p, V a) { vst1q_f32(p, a); }
+  static V add(V a, V b) { return vaddq_f32(a, b); }
+  static V sub(V a, V b) { return vsubq_f32(a, b); }
+  static V mul(V a, V b) { return vmulq_f32(a, b); }
+  static V div(V a, V b) { return vdivq_f32(a, b); }
+  static V min(V a, V b) { return vminq_f32(a, b); }
+  static V max(V a, V b) { return vmaxq_f32(a, b); }
+  static V abs(V a) { return vabsq_f32(a); }
+  static V less(V a, V b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+  static V lessEqual(V a, V b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+  static V both(V a, V b)
+  {
+    return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+  }
+  static V select(V mask, V a, V b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+  static int mask(V a)
+  {
+    static const uint32_t kBits[4] = { 1, 2, 4, 8 };
+    return int(vaddvq_u32(vandq_u32(vreinterpretq_u32_f32(a), vld1q_u32(kBits))));
+  }
+};
+#else
+struct Simd4
+{
+  struct V {
+    float x[4];
+  };
+
+  static const char* backend() { return "scalar"; }
+
+  template<class F>
+  static V apply(V a, V b, F function)
+  {
+    V r;
+    for ( int i = 0; i < 4; i++ ) {
+      r.x[i] = function(a.x[i], b.x[i]);
+    }
+    return r;
+  }
+  static float bits(bool flag)
+  {
+    unsigned value = flag ? ~0u : 0u;
+    float r;
+    std::memcpy(&r, &value, sizeof(r));
+    return r;
+  }
+  static bool isSet(float x)
+  {
+    unsigned value;
+    std::memcpy(&value, &x, sizeof(value));
+    return (value >> 31) != 0;
+  }
+
+  static V set(float x) { return V{ { x, x, x, x } }; }
+  static V load(const float* p) { return V{ { p[0], p[1], p[2], p[3] } }; }
+  static void store(float* p, V a) { std::memcpy(p, a.x, sizeof(a.x)); }
+  static V add(V a, V b) { return apply(a, b, []( float x, float y ) { return x + y; }); }
+  static V sub(V a, V b) { return apply(a, b, []( float x, float y ) { return x - y; }); }
+  static V mul(V a, V b) { return apply(a, b, []( float x, float y ) { return x * y; }); }
+  static V div(V a, V b) { return apply(a, b, []( float x, float y ) { return x / y; }); }
+  static V min(V a, V b) { return apply(a, b, []( float x, float y ) { return x < y ? x : y; }); }
+  static V max(V a, V b) { return apply(a, b, []( float x, float y ) { return x > y ? x : y; }); }
+  static V abs(V a) { return apply(a, a, []( float x, float ) { return std::fabs(x); }); }
+  static V less(V a, V b) { return apply(a, b, []( float x, float y ) { return bits(x < y); }); }
+  static V lessEqual(V a, V b) { return apply(a, b, []( float x, float y ) { return bits(x <= y); }); }
+  static V both(V a, V b) { return apply(a, b, []( float x, float y ) { return bits(isSet(x) && isSet(y)); }); }
+  static V select(V mask, V a, V b)
+  {
+    V r;
+    for ( int i = 0; i < 4; i++ ) {
+      r.x[i] = isSet(mask.x[i]) ? a.x[i] : b.x[i];
+    }
+    return r;
+  }
+  static int mask(V a)
+  {
+    int r = 0;
+    for ( int i = 0; i < 4; i++ ) {
+      r |= isSet(a.x[i]) ? (1 << i) : 0;
+    }
+    return r;
+  }
+};
+#endif
+
+#endif // SIMD4_H
@@ -0,0 +1,408 @@
+#include "simdmath.h"
+
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMDMATH_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMDMATH_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SIMDMATH_NEON
+#endif
+
+static const int kMatrixStride = sizeof(Mat4) / sizeof(float);
+static const int kTransformStride = sizeof(ObjectTransform) / sizeof(float);
+
+namespace {
+
+// Каждый вариант даёт вектор из N дорожек и перестановку столбцов: loadColumn берёт
+// столбец (4 float) у N матриц, лежащих с шагом stride, и возвращает 4 вектора - по одному
+// на компоненту, в дорожке i компонента матрицы i; storeColumn делает обратное.
+struct ScalarLanes
+{
+  typedef float V;
+  static const int N = 1;
+
+  static V set(float x) { return x; }
+  static V add(V a, V b) { return a + b; }
+  static V sub(V a, V b) { return a - b; }
+  static V mul(V a, V b) { return a * b; }
+  static V madd(V a, V b, V c) { return a * b + c; }
+  static V reciprocal(V a) { return 1.0f / a; }
+  static V load(const float* p) { return *p; }
+  static void store(float* p, V a) { *p = a; }
+  static V gather(const float* base, const int* index) { return base[index[0]]; }
+  static void scatter(float* base, const int* index, V a) { base[index[0]] = a; }
+  static void loadColumn(const float* first, int, V out[4])
+  {
+    for ( int i = 0; i < 4; i++ ) {
+      out[i] = first[i];
+    }
+  }
+  static void storeColumn(const V in[4], float* first, int)
+  {
+    for ( int i = 0; i < 4; i++ ) {
+      first[i] = in[i];
+    }
+  }
+};
+
+#if defined(SIMDMATH_SSE) || defined(SIMDMATH_AVX)
+struct SseLanes
+{
+  typedef __m128 V;
+  static const int N = 4;
+
+  static V set(float x) { return _mm_set1_ps(x); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V madd(V a, V b, V c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static V reciprocal(V a) { return _mm_div_ps(_mm_set1_ps(1.0f), a); }
+  static V load(const float* p) { return _mm_loadu_ps(p); }
+  static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+  static V gather(const float* base, const int* index)
+  {
+    return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+  }
+  static void scatter(float* base, const int* index, V a)
+  {
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, a);
+    for ( int i = 0; i < 4; i++ ) {
+      base[index[i]] = lanes[i];
+    }
+  }
+  static void loadColumn(const float* first, int stride, V out[4])
+  {
+    V r0 = _mm_loadu_ps(first);
+    V r1 = _mm_loadu_ps(first + stride);
+    V r2 = _mm_loadu_ps(first + 2 * stride);
+    V r3 = _mm_loadu_ps(first + 3 * stride);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    out[0] = r0;
+    out[1] = r1;
+    out[2] = r2;
+    out[3] = r3;
+  }
+  static void storeColumn(const V in[4], float* first, int stride)
+  {
+    V r0 = in[0];
+    V r1 = in[1];
+    V r2 = in[2];
+    V r3 = in[3];
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(first, r0);
+    _mm_storeu_ps(first + stride, r1);
+    _mm_storeu_ps(first + 2 * stride, r2);
+    _mm_storeu_ps(first + 3 * stride, r3);
+  }
+};
+#endif
+
+#ifdef SIMDMATH_AVX
+// восемь матриц: половины регистров переставляются как две четвёрки SSE
+struct AvxLanes
+{
+  typedef __m256 V;
+  static const int N = 8;
+
+  static V set(float x) { return _mm256_set1_ps(x); }
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+#ifdef __FMA__
+  static V madd(V a, V b, V c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+  static V madd(V a, V b, V c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+  static V reciprocal(V a) { return _mm256_div_ps(_mm256_set1_ps(1.0f), a); }
+  static V load(const float* p) { return _mm256_loadu_ps(p); }
+  static void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+#ifdef __AVX2__
+  static V gather(const float* base, const int* index)
+  {
+    return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)), 4);
+  }
+#else
+  static V gather(const float* base, const int* index)
+  {
+    return _mm256_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]],
+                          base[index[4]], base[index[5]], base[index[6]], base[index[7]]);
+  }
+#endif
+  static void scatter(float* base, const int* index, V a)
+  {
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, a);
+    for ( int i = 0; i < 8; i++ ) {
+      base[index[i]] = lanes[i];
+    }
+  }
+  static void loadColumn(const float* first, int stride, V out[4])
+  {
+    __m128 low[4];
+    __m128 high[4];
+    SseLanes::loadColumn(first, stride, low);
+    SseLanes::loadColumn(first + 4 * stride, stride, high);
+    for ( int i = 0; i < 4; i++ ) {
+      out[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(low[i]), high[i], 1);
+    }
+  }
+  static void storeColumn(const V in[4], float* first, int stride)
+  {
+    __m128 low[4];
+    __m128 high[4];
+    for ( int i = 0; i < 4; i++ ) {
+      low[i] = _mm256_castps256_ps128(in[i]);
+      high[i] = _mm256_extractf128_ps(in[i], 1);
+    }
+    SseLanes::storeColumn(low, first, stride);
+    SseLanes::storeColumn(high, first + 4 * stride, stride);
+  }
+};
+typedef AvxLanes Lanes;
+#elif defined(SIMDMATH_SSE)
+typedef SseLanes Lanes;
+#endif
+
+#ifdef SIMDMATH_NEON
+struct NeonLanes
+{
+  typedef float32x4_t V;
+  static const int N = 4;
+
+  static V set(float x) { return vdupq_n_f32(x); }
+  static V add(V a, V b) { return vaddq_f32(a, b); }
+  static V sub(V a, V b) { return vsubq_f32(a, b); }
+  static V mul(V a, V b) { return vmulq_f32(a, b); }
+  static V madd(V a, V b, V c) { return vmlaq_f32(c, a, b); }
+  // оценка и два шага Ньютона: деления по дорожкам на ARMv7 нет
+  static V reciprocal(V a)
+  {
+    V r = vrecpeq_f32(a);
+    r = vmulq_f32(vrecpsq_f32(a, r), r);
+    return vmulq_f32(vrecpsq_f32(a, r), r);
+  }
+  static V load(const float* p) { return vld1q_f32(p); }
+  static void store(float* p, V a) { vst1q_f32(p, a); }
+  static V gather(const float* base, const int* index)
+  {
+    float lanes[4] = { base[index[0]], base[index[1]], base[index[2]], base[index[3]] };
+    return vld1q_f32(lanes);
+  }
+  static void scatter(float* base, const int* index, V a)
+  {
+    float lanes[4];
+    vst1q_f32(lanes, a);
+    for ( int i = 0; i < 4; i++ ) {
+      base[index[i]] = lanes[i];
+    }
+  }
+  static void transpose(V r[4])
+  {
+    float32x4x2_t t01 = vtrnq_f32(r[0], r[1]);
+    float32x4x2_t t23 = vtrnq_f32(r[2], r[3]);
+    r[0] = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r[1] = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r[2] = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r[3] = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+  }
+  static void loadColumn(const float* first, int stride, V out[4])
+  {
+    for ( int i = 0; i < 4; i++ ) {
+      out[i] = vld1q_f32(first + i * stride);
+    }
+    transpose(out);
+  }
+  static void storeColumn(const V in[4], float* first, int stride)
+  {
+    V r[4] = { in[0], in[1], in[2], in[3] };
+    transpose(r);
+    for ( int i = 0; i < 4; i++ ) {
+      vst1q_f32(first + i * stride, r[i]);
+    }
+  }
+};
+typedef NeonLanes Lanes;
+#endif
+
+#if !defined(SIMDMATH_AVX) && !defined(SIMDMATH_SSE) && !defined(SIMDMATH_NEON)
+typedef ScalarLanes Lanes;
+#endif
+
+// столбец c произведения a * b, b - столбец c правой матрицы (в каждой дорожке своя пара матриц)
+template<class L>
+void multiplyColumn(const typename L::V* a, const typename L::V* b, typename L::V* out)
+{
+  for ( int r = 0; r < 4; r++ ) {
+    typename L::V sum = L::mul(a[r], b[0]);
+    sum = L::madd(a[4 + r], b[1], sum);
+    sum = L::madd(a[8 + r], b[2], sum);
+    out[r] = L::madd(a[12 + r], b[3], sum);
+  }
+}
+
+template<class L>
+void loadMatrixes(const Mat4* matrixes, typename L::V* out)
+{
+  for ( int c = 0; c < 4; c++ ) {
+    L::loadColumn(matrixes->m + c * 4, kMatrixStride, out + c * 4);
+  }
+}
+
+template<class L>
+void cross(const typename L::V* a, const typename L::V* b, typename L::V* out)
+{
+  out[0] = L::sub(L::mul(a[1], b[2]), L::mul(a[2], b[1]));
+  out[1] = L::sub(L::mul(a[2], b[0]), L::mul(a[0], b[2]));
+  out[2] = L::sub(L::mul(a[0], b[1]), L::mul(a[1], b[0]));
+}
+
+template<class L>
+int multiplyBatch(const Mat4& a, const Mat4* b, Mat4* out, int count)
+{
+  typename L::V left[16];
+  for ( int i = 0; i < 16; i++ ) {
+    left[i] = L::set(a.m[i]);
+  }
+  int done = 0;
+  for ( ; done + L::N <= count; done += L::N ) {
+    typename L::V right[16];
+    loadMatrixes<L>(b + done, right);
+    for ( int c = 0; c < 4; c++ ) {
+      typename L::V column[4];
+      multiplyColumn<L>(left, right + c * 4, column);
+      L::storeColumn(column, out[done].m + c * 4, kMatrixStride);
+    }
+  }
+  return done;
+}
+
+template<class L>
+int transformBatch(const Mat4& viewProjection, const Mat4* models, ObjectTransform* out, int count)
+{
+  typename L::V vp[16];
+  for ( int i = 0; i < 16; i++ ) {
+    vp[i] = L::set(viewProjection.m[i]);
+  }
+  int done = 0;
+  for ( ; done + L::N <= count; done += L::N ) {
+    typename L::V model[16];
+    loadMatrixes<L>(models + done, model);
+    for ( int c = 0; c < 4; c++ ) {
+      typename L::V column[4];
+      multiplyColumn<L>(vp, model + c * 4, column);
+      L::storeColumn(column, out[done].mvp + c * 4, kTransformStride);
+    }
+    // для столбцов a, b, c верхнего 3x3: transpose(inverse(M)) = (b x c, c x a, a x b) / det.
+    // Столбцы пишутся по 4 float подряд, лишний четвёртый затирается следующим (последний - в padding)
+    typename L::V normal[3][4];
+    cross<L>(model + 4, model + 8, normal[0]);
+    cross<L>(model + 8, model, normal[1]);
+    cross<L>(model, model + 4, normal[2]);
+    typename L::V det = L::mul(model[0], normal[0][0]);
+    det = L::madd(model[1], normal[0][1], det);
+    det = L::madd(model[2], normal[0][2], det);
+    typename L::V inverse = L::reciprocal(det);
+    for ( int k = 0; k < 3; k++ ) {
+      for ( int i = 0; i < 3; i++ ) {
+        normal[k][i] = L::mul(normal[k][i], inverse);
+      }
+      normal[k][3] = L::set(0.0f);
+      L::storeColumn(normal[k], out[done].normal + k * 3, kTransformStride);
+    }
+  }
+  return done;
+}
+
+template<class L>
+int multiplyParentsBatch(const Mat4Streams& local, const Mat4Streams& world,
+                         const int* nodes, const int* parents, int count)
+{
+  int done = 0;
+  for ( ; done + L::N <= count; done += L::N ) {
+    const int* node = nodes + done;
+    const int* parent = parents + done;
+    // узлы возрастают, значит разница N - 1 бывает только у идущих подряд
+    bool contiguous = node[L::N - 1] - node[0] == L::N - 1;
+    bool shared = true;
+    for ( int i = 1; i < L::N; i++ ) {
+      shared = shared && parent[i] == parent[0];
+    }
+    typename L::V a[16];
+    typename L::V b[16];
+    for ( int e = 0; e < 16; e++ ) {
+      // у братьев один родитель - его элемент просто размножается по дорожкам
+      a[e] = shared ? L::set(world.m[e][parent[0]]) : L::gather(world.m[e], parent);
+      b[e] = contiguous ? L::load(local.m[e] + node[0]) : L::gather(local.m[e], node);
+    }
+    for ( int c = 0; c < 4; c++ ) {
+      typename L::V column[4];
+      multiplyColumn<L>(a, b + c * 4, column);
+      for ( int r = 0; r < 4; r++ ) {
+        if ( contiguous ) {
+          L::store(world.m[c * 4 + r] + node[0], column[r]);
+        }
+        else {
+          L::scatter(world.m[c * 4 + r], node, column[r]);
+        }
+      }
+    }
+  }
+  return done;
+}
+
+}
+
+const int SimdMath::kLanes = Lanes::N;
+
+const char* SimdMath::backend()
+{
+#if defined(SIMDMATH_AVX)
+  return "AVX";
+#elif defined(SIMDMATH_SSE)
+  return "SSE2";
+#elif defined(SIMDMATH_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+Mat4 SimdMath::fromQt(const QMatrix4x4& matrix)
+{
+  Mat4 result;
+  std::memcpy(result.m, matrix.constData(), sizeof(result.m));
+  return result;
+}
+
+QMatrix4x4 SimdMath::toQt(const Mat4& matrix)
+{
+  QMatrix4x4 result;
+  std::memcpy(result.data(), matrix.m, sizeof(matrix.m));
+  return result;
+}
+
+void SimdMath::multiply(const Mat4& a, const Mat4* b, Mat4* out, int count)
+{
+  // хвост пакета - тем же кодом по одной матрице
+  int done = multiplyBatch<Lanes>(a, b, out, count);
+  multiplyBatch<ScalarLanes>(a, b + done, out + done, count - done);
+}
+
+void SimdMath::objectTransforms(const Mat4& viewProjection, const Mat4* models, ObjectTransform* out, int count)
+{
+  int done = transformBatch<Lanes>(viewProjection, models, out, count);
+  transformBatch<ScalarLanes>(viewProjection, models + done, out + done, count - done);
+}
+
+void SimdMath::multiplyParents(const Mat4Streams& local, const Mat4Streams& world,
+                               const int* nodes, const int* parents, int count)
+{
+  int done = multiplyParentsBatch<Lanes>(local, world, nodes, parents, count);
+  multiplyParentsBatch<ScalarLanes>(local, world, nodes + done, parents + done, count - done);
+}
@@ -0,0 +1,51 @@
+#ifndef SIMDMATH_H
+#define SIMDMATH_H
+
+#include <QMatrix4x4>
+
+// Матрицы для пакетной обработки: 16 float по столбцам, как QMatrix4x4::constData()
+struct alignas(16) Mat4
+{
+  float m[16];
+};
+
+// Матрицы объекта для шейдера: MVP и матрица нормалей transpose(inverse(mat3(model)))
+// по столбцам (9 float, как ждёт glUniformMatrix3fv)
+struct alignas(16) ObjectTransform
+{
+  float mvp[16];
+  float normal[9];
+  float padding[3];
+};
+
+// Матрицы по элементам (SoA): m[e][i] - элемент e (по столбцам) матрицы i
+struct Mat4Streams
+{
+  float* m[16];
+};
+
+// Пакетная математика матриц на SSE/AVX/NEON. Матрицы хранятся как есть (AoS),
+// при загрузке пакет из kLanes матриц транспонируется в регистрах: в каждой SIMD-дорожке
+// своя матрица (SoA), поэтому умножение и обращение идут без горизонтальных операций.
+// AVX используется, если сборка включает его (-mavx / -march=native), иначе SSE2
+// (всегда есть на x86-64) или NEON на ARM; без них - скалярный вариант того же кода.
+class SimdMath
+{
+public:
+  static const int kLanes;
+
+  static const char* backend();
+  static Mat4 fromQt(const QMatrix4x4& matrix);
+  static QMatrix4x4 toQt(const Mat4& matrix);
+
+  // out[i] = a * b[i]
+  static void multiply(const Mat4& a, const Mat4* b, Mat4* out, int count);
+  // out[i].mvp = viewProjection * models[i], out[i].normal - матрица нормалей models[i]
+  static void objectTransforms(const Mat4& viewProjection, const Mat4* models, ObjectTransform* out, int count);
+  // world[nodes[k]] = world[parents[k]] * local[nodes[k]]: nodes возрастают, ни один родитель
+  // не входит в nodes. Узлы подряд читаются и пишутся векторами, остальные собираются по индексам
+  static void multiplyParents(const Mat4Streams& local, const Mat4Streams& world,
+                              const int* nodes, const int* parents, int count);
+};
+
+#endif // SIMDMATH_H
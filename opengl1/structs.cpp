@@ -1,5 +1,7 @@
 #include "structs.h"
 
+#include <QString>
+
 Vertex::Vertex(QVector3D pos, QVector2D textPos, QVector3D norm) :
   position(pos),
   texturePosition(textPos),
@@ -8,11 +10,49 @@ Vertex::Vertex(QVector3D pos, QVector2D textPos, QVector3D norm) :
 
 }
 
-LightPos::LightPos(  QVector3D pos, QVector3D a, QVector3D d, QVector3D s) :
-  position(pos),
-  ambient(a),
-  diffuse(d),
-  specular(s)
+PointLightUniforms PointLightUniforms::forLight(int index)
 {
+  QString name = QString("pointLights[%1].%2").arg(index);
+  return PointLightUniforms{ name.arg("position").toLatin1(), name.arg("ambient").toLatin1(),
+                             name.arg("diffuse").toLatin1(), name.arg("specular").toLatin1(),
+                             name.arg("constant").toLatin1(), name.arg("linear").toLatin1(),
+                             name.arg("quadratic").toLatin1() };
+}
 
+void BoundingBox::extend(const QVector3D& point)
+{
+  min = QVector3D{ qMin(min.x(), point.x()), qMin(min.y(), point.y()), qMin(min.z(), point.z()) };
+  max = QVector3D{ qMax(max.x(), point.x()), qMax(max.y(), point.y()), qMax(max.z(), point.z()) };
+}
+
+void BoundingBox::extend(const BoundingBox& box)
+{
+  if ( box.isEmpty() ) { return; }
+  extend(box.min);
+  extend(box.max);
+}
+
+Frustum::Frustum(const QMatrix4x4& matrix)
+{
+  // Gribb-Hartmann: левая, правая, нижняя, верхняя, ближняя, дальняя
+  for ( int i = 0; i < 3; i++ ) {
+    planes[i * 2] = matrix.row(3) + matrix.row(i);
+    planes[i * 2 + 1] = matrix.row(3) - matrix.row(i);
+  }
+  for ( auto& plane : planes ) {
+    float length = plane.toVector3D().length();
+    if ( length > 0.0f ) {
+      plane /= length;
+    }
+  }
+}
+
+bool Frustum::intersects(const QVector3D& center, float radius) const
+{
+  for ( const auto& plane : planes ) {
+    if ( QVector3D::dotProduct(plane.toVector3D(), center) + plane.w() < -radius ) {
+      return false;
+    }
+  }
+  return true;
 }
@@ -1,8 +1,13 @@
 #ifndef STRUCTS_H
 #define STRUCTS_H
 
+#include <limits>
+
+#include <QByteArray>
 #include <QVector2D>
 #include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
 
 struct Vertex
 {
@@ -17,17 +22,53 @@ struct Vertex
 };
 
 
-struct LightPos {
-  LightPos(  QVector3D position = QVector3D{0.0f, 0.0f, 0.0f}, QVector3D ambient = QVector3D{0.05f, 0.05f, 0.05f},
-             QVector3D diffuse = QVector3D{1.0f, 1.0f, 1.0f}, QVector3D specular = QVector3D{0.1f, 0.1f, 0.1f});
-  QVector3D position{0.0f, 0.0f, 0.0f};
-  QVector3D ambient{0.05f, 0.05f, 0.05f};
-  QVector3D diffuse{1.0f, 1.0f, 1.0f};
-  QVector3D specular{0.1f, 0.1f, 0.1f};
+// имена uniform-переменных точечного источника pointLights[index].* шейдеров освещения
+struct PointLightUniforms {
+  static PointLightUniforms forLight(int index);
+
+  QByteArray position;
+  QByteArray ambient;
+  QByteArray diffuse;
+  QByteArray specular;
+  QByteArray constant;
+  QByteArray linear;
+  QByteArray quadratic;
+};
+
+struct BoundingBox {
+  void extend( const QVector3D& point );
+  void extend( const BoundingBox& box );
+  bool isEmpty() const { return min.x() > max.x(); }
+  QVector3D center() const { return (min + max) * 0.5f; }
+  QVector3D size() const { return max - min; }
+
+  QVector3D min{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+  QVector3D max{ -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+};
 
-  float constant{1.0f};
-  float linear{0.09f};
-  float quadratic{0.032f};
+
+class FrameArena;
+
+struct Frustum {
+  Frustum(){}
+  // плоскости берутся из матрицы проекции*вида (или проекции*вида*модели - тогда в пространстве модели)
+  explicit Frustum( const QMatrix4x4& matrix );
+  bool intersects( const QVector3D& center, float radius ) const;
+
+  QVector4D planes[6];
+};
+
+
+struct DrawView {
+  QVector3D position{0.0f, 0.0f, 0.0f};
+  QMatrix4x4 viewProjection;
+  // пикселей экрана на единицу длины на расстоянии 1 от камеры, 0 - всегда полная детализация
+  float pixelScale = 0.0f;
+  // то же для выбора уровней мипов при подгрузке текстур, 0 - текстуры не запрашиваются
+  float textureScale = 0.0f;
+  bool meshletCulling = false;
+  // временные данные кадра (диапазоны видимых кластеров и т.п.), без него кластеры не отсекаются
+  FrameArena* arena = nullptr;
 };
 
 
@@ -0,0 +1,245 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QDebug>
+
+// уровни не больше этого размера загружаются сразу и не выгружаются
+static const int kInitialMipSize = 64;
+
+StreamedTexture::StreamedTexture(const QVector<QImage>& mips, const QString& owner) :
+  mips_(mips),
+  owner_(owner)
+{
+  minimumMip_ = qMax(0, mips_.size() - 1);
+  for ( int i = 0; i < mips_.size(); i++ ) {
+    if ( qMax(mips_.at(i).width(), mips_.at(i).height()) <= kInitialMipSize ) {
+      minimumMip_ = i;
+      break;
+    }
+  }
+  wantedMip_ = minimumMip_;
+  if ( !mips_.isEmpty() ) {
+    setResidentMip(minimumMip_);
+  }
+}
+
+StreamedTexture::~StreamedTexture()
+{
+  delete texture_;
+}
+
+QVector<QImage> StreamedTexture::buildMipChain(const QImage& image)
+{
+  QVector<QImage> mips;
+  if ( image.isNull() ) {
+    return mips;
+  }
+  mips.append(image.convertToFormat(QImage::Format_RGBA8888));
+  while ( mips.last().width() > 1 || mips.last().height() > 1 ) {
+    const QImage& previous = mips.last();
+    mips.append(previous.scaled(qMax(1, previous.width() / 2), qMax(1, previous.height() / 2),
+                                Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+  }
+  return mips;
+}
+
+void StreamedTexture::bind(uint unit)
+{
+  if ( texture_ ) {
+    texture_->bind(unit);
+    memory_.touch();
+  }
+}
+
+void StreamedTexture::release()
+{
+  if ( texture_ ) {
+    texture_->release();
+  }
+}
+
+void StreamedTexture::request(float uvPerPixel)
+{
+  if ( mips_.isEmpty() ) {
+    return;
+  }
+  // уровень, на котором один тексель приходится примерно на один пиксель
+  float texelsPerPixel = float(qMax(mips_.first().width(), mips_.first().height())) * uvPerPixel;
+  int mip = texelsPerPixel > 1.0f ? int(std::floor(std::log2(texelsPerPixel))) : 0;
+  mip = qBound(0, mip, minimumMip_);
+  int current = requestedMip_.load(std::memory_order_relaxed);
+  while ( mip < current && !requestedMip_.compare_exchange_weak(current, mip, std::memory_order_relaxed) ) {
+  }
+}
+
+qint64 StreamedTexture::bytesFrom(int mip) const
+{
+  qint64 bytes = 0;
+  for ( int i = qMax(0, mip); i < mips_.size(); i++ ) {
+    bytes += qint64(mips_.at(i).width()) * mips_.at(i).height() * 4;
+  }
+  return bytes;
+}
+
+void StreamedTexture::setResidentMip(int mip)
+{
+  // хранилище текстуры неизменяемого размера: меняем уровень - пересоздаём
+  delete texture_;
+  residentMip_ = mip;
+  const QImage& top = mips_.at(mip);
+  texture_ = new QOpenGLTexture(QOpenGLTexture::Target2D);
+  texture_->create();
+  texture_->setSize(top.width(), top.height());
+  texture_->setFormat(QOpenGLTexture::RGBA8_UNorm);
+  texture_->setMipLevels(mips_.size() - mip);
+  texture_->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+  for ( int i = mip; i < mips_.size(); i++ ) {
+    texture_->setData(i - mip, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, mips_.at(i).constBits());
+  }
+  texture_->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+  texture_->setMagnificationFilter(QOpenGLTexture::Linear);
+  texture_->setWrapMode(QOpenGLTexture::Repeat);
+  if ( memory_.isAllocated() ) {
+    memory_.resize(residentBytes());
+    return;
+  }
+  // при нехватке видеопамяти оставляем только неснимаемые мелкие уровни
+  memory_.allocate(GpuMemory::Texture, owner_, residentBytes(), [this] {
+    if ( residentMip_ >= minimumMip_ ) {
+      return false;
+    }
+    setResidentMip(minimumMip_);
+    return true;
+  });
+}
+
+TextureStreamer& TextureStreamer::instance()
+{
+  static TextureStreamer streamer;
+  return streamer;
+}
+
+std::shared_ptr<StreamedTexture> TextureStreamer::create(const QVector<QImage>& mips, const QString& owner)
+{
+  auto texture = std::make_shared<StreamedTexture>(mips, owner);
+  textures_.append(texture);
+  return texture;
+}
+
+void TextureStreamer::update()
+{
+  frame_++;
+  uploads_ = 0;
+  evictions_ = 0;
+  residentBytes_ = 0;
+  requestedBytes_ = 0;
+  // удалённые вместе с материалами текстуры выбрасываем из списка
+  live_.clear();
+  for ( int i = 0; i < textures_.size(); ) {
+    auto texture = textures_.at(i).lock();
+    if ( !texture ) {
+      textures_.remove(i);
+      continue;
+    }
+    live_.append(texture.get());
+    i++;
+  }
+  textureCount_ = live_.size();
+
+  candidates_.clear();
+  for ( auto texture : live_ ) {
+    int requested = texture->requestedMip_.exchange(StreamedTexture::kNoRequest, std::memory_order_relaxed);
+    if ( requested != StreamedTexture::kNoRequest ) {
+      texture->wantedMip_ = requested;
+      texture->lastUsedFrame_ = frame_;
+    }
+    residentBytes_ += texture->residentBytes();
+    requestedBytes_ += texture->bytesFrom(texture->wantedMip_);
+    // подгружаем только то, что видно в этом кадре
+    if ( texture->lastUsedFrame_ == frame_ && texture->wantedMip_ < texture->residentMip_ ) {
+      candidates_.append(texture);
+    }
+  }
+
+  // бюджет уменьшили - сначала возвращаемся в его пределы
+  while ( residentBytes_ > budget_ ) {
+    StreamedTexture* victim = findVictim(nullptr);
+    if ( !victim ) {
+      break;
+    }
+    qint64 before = victim->residentBytes();
+    victim->setResidentMip(victim->residentMip_ + 1);
+    residentBytes_ -= before - victim->residentBytes();
+    evictions_++;
+  }
+
+  // сильнее всего отстающие от запроса - первыми, при равенстве - недавно использованные
+  std::sort(candidates_.begin(), candidates_.end(), []( const StreamedTexture* a, const StreamedTexture* b ) {
+    int lagA = a->residentMip_ - a->wantedMip_;
+    int lagB = b->residentMip_ - b->wantedMip_;
+    if ( lagA != lagB ) {
+      return lagA > lagB;
+    }
+    return a->lastUsedFrame_ > b->lastUsedFrame_;
+  });
+  qint64 uploadBytes = 0;
+  for ( auto texture : candidates_ ) {
+    // по одному уровню за кадр: загрузка размазывается и не даёт рывков
+    int next = texture->residentMip_ - 1;
+    qint64 bytes = texture->bytesFrom(next);
+    if ( uploadBytes > 0 && uploadBytes + bytes > kMaxUploadBytesPerFrame ) {
+      break;
+    }
+    qint64 extra = bytes - texture->residentBytes();
+    while ( residentBytes_ + extra > budget_ ) {
+      StreamedTexture* victim = findVictim(texture);
+      if ( !victim ) {
+        break;
+      }
+      qint64 before = victim->residentBytes();
+      victim->setResidentMip(victim->residentMip_ + 1);
+      residentBytes_ -= before - victim->residentBytes();
+      evictions_++;
+    }
+    if ( residentBytes_ + extra > budget_ ) {
+      continue;
+    }
+    texture->setResidentMip(next);
+    residentBytes_ += extra;
+    uploadBytes += bytes;
+    uploads_++;
+  }
+}
+
+StreamedTexture* TextureStreamer::findVictim(const StreamedTexture* keep) const
+{
+  // сначала текстуры с уровнями сверх запроса, затем давно не использованные;
+  // у использованных не раньше keep уровни не отбираем, иначе они будут меняться каждый кадр
+  StreamedTexture* victim = nullptr;
+  auto better = []( const StreamedTexture* a, const StreamedTexture* b ) {
+    bool excessA = a->residentMip_ < a->wantedMip_;
+    bool excessB = b->residentMip_ < b->wantedMip_;
+    if ( excessA != excessB ) {
+      return excessA;
+    }
+    if ( a->lastUsedFrame_ != b->lastUsedFrame_ ) {
+      return a->lastUsedFrame_ < b->lastUsedFrame_;
+    }
+    return a->residentMip_ < b->residentMip_;
+  };
+  for ( auto texture : live_ ) {
+    if ( texture == keep || texture->residentMip_ >= texture->minimumMip_ ) {
+      continue;
+    }
+    bool excess = texture->residentMip_ < texture->wantedMip_;
+    if ( keep && !excess && texture->lastUsedFrame_ >= keep->lastUsedFrame_ ) {
+      continue;
+    }
+    if ( !victim || better(texture, victim) ) {
+      victim = texture;
+    }
+  }
+  return victim;
+}
@@ -0,0 +1,105 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include <atomic>
+#include <limits>
+#include <memory>
+
+#include <QImage>
+#include <QVector>
+#include <QOpenGLTexture>
+
+#include "gpumemory.h"
+
+// Текстура, у которой в видеопамяти лежит только часть цепочки мипов: от residentMip()
+// до самого мелкого. Полная цепочка хранится в памяти CPU, так что подгрузка и
+// выгрузка верхних уровней - это пересоздание текстуры нужного размера без чтения с диска.
+class StreamedTexture
+{
+public:
+  static const int kNoRequest = std::numeric_limits<int>::max();
+
+  explicit StreamedTexture(const QVector<QImage>& mips, const QString& owner = QString());
+  StreamedTexture(const StreamedTexture&) = delete;
+  ~StreamedTexture();
+
+  StreamedTexture& operator=(const StreamedTexture&) = delete;
+
+  // цепочка RGBA8 от полного размера до 1x1; можно вызывать из рабочих потоков
+  static QVector<QImage> buildMipChain(const QImage& image);
+
+  void bind(uint unit);
+  void release();
+  bool isResident() const { return texture_ != nullptr; }
+
+  // сколько единиц UV приходится на пиксель экрана; вызывается из потоков обхода сцены
+  void request(float uvPerPixel);
+
+  int mipCount() const { return mips_.size(); }
+  // уровень в памяти CPU, 0 - полный размер
+  const QImage& image(int mip = 0) const { return mips_.at(mip); }
+  int residentMip() const { return residentMip_; }
+  // самый детальный уровень, который никогда не выгружается
+  int minimumMip() const { return minimumMip_; }
+  qint64 bytesFrom(int mip) const;
+  qint64 residentBytes() const { return bytesFrom(residentMip_); }
+
+private:
+  friend class TextureStreamer;
+
+  void setResidentMip(int mip);
+
+private:
+  QVector<QImage> mips_;
+  QOpenGLTexture* texture_ = nullptr;
+  QString owner_;
+  GpuAllocation memory_;
+  int residentMip_ = 0;
+  int minimumMip_ = 0;
+  std::atomic<int> requestedMip_{kNoRequest};
+  int wantedMip_ = 0;
+  quint64 lastUsedFrame_ = 0;
+};
+
+// Подгрузка мипов по запросам кадра в пределах бюджета видеопамяти. Новые текстуры
+// сразу получают только мелкие уровни, дальше в каждом кадре (update() в потоке GL)
+// самые отстающие от запроса текстуры получают следующий уровень; если бюджет
+// исчерпан, верхние уровни снимаются с давно не использованных текстур (LRU).
+class TextureStreamer
+{
+public:
+  static const qint64 kDefaultBudget = 512ll * 1024 * 1024;
+  static const qint64 kMaxUploadBytesPerFrame = 16ll * 1024 * 1024;
+
+  static TextureStreamer& instance();
+
+  std::shared_ptr<StreamedTexture> create(const QVector<QImage>& mips, const QString& owner = QString());
+  void update();
+
+  void setBudget(qint64 bytes) { budget_ = bytes; }
+  qint64 budget() const { return budget_; }
+  qint64 residentBytes() const { return residentBytes_; }
+  qint64 requestedBytes() const { return requestedBytes_; }
+  int textureCount() const { return textureCount_; }
+  int uploads() const { return uploads_; }
+  int evictions() const { return evictions_; }
+
+private:
+  TextureStreamer() = default;
+
+  StreamedTexture* findVictim(const StreamedTexture* keep) const;
+
+private:
+  QVector< std::weak_ptr<StreamedTexture> > textures_;
+  QVector<StreamedTexture*> live_;
+  QVector<StreamedTexture*> candidates_;
+  quint64 frame_ = 0;
+  qint64 budget_ = kDefaultBudget;
+  qint64 residentBytes_ = 0;
+  qint64 requestedBytes_ = 0;
+  int textureCount_ = 0;
+  int uploads_ = 0;
+  int evictions_ = 0;
+};
+
+#endif // TEXTURESTREAMER_H
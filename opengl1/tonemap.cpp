@@ -0,0 +1,45 @@
+#include "tonemap.h"
+
+#include <cmath>
+
+#include <QtGlobal>
+
+const float Tonemap::kGamma = 2.2f;
+
+const char* Tonemap::name(Operator op)
+{
+  switch ( op ) {
+    case ( Reinhard ): {
+      return "reinhard";
+    }
+    case ( Aces ): {
+      return "aces";
+    }
+    default: {
+      return "unknown";
+    }
+  }
+}
+
+QVector3D Tonemap::apply(const QVector3D& color, Operator op, float exposure)
+{
+  QVector3D mapped;
+  for ( int i = 0; i < 3; i++ ) {
+    float x = qMax(color[i], 0.0f) * exposure;
+    if ( op == Aces ) {
+      // аппроксимация ACES Нарковича (2015)
+      x = qBound(0.0f, x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f), 1.0f);
+    }
+    else {
+      x = x / (x + 1.0f);
+    }
+    mapped[i] = std::pow(x, 1.0f / kGamma);
+  }
+  return mapped;
+}
+
+QVector3D Tonemap::toLinear(const QVector3D& color)
+{
+  return QVector3D{std::pow(qMax(color.x(), 0.0f), kGamma), std::pow(qMax(color.y(), 0.0f), kGamma),
+                   std::pow(qMax(color.z(), 0.0f), kGamma)};
+}
@@ -0,0 +1,21 @@
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include <QVector3D>
+
+// Перевод линейного HDR-цвета в цвет экрана: экспозиция, тонмаппинг и гамма - то же,
+// что делает fTonemapShader.frag, для рендеров на CPU. Цвета текстур (альбедо, небо) хранятся
+// в sRGB и перед освещением переводятся в линейные.
+class Tonemap
+{
+public:
+  enum Operator { Reinhard, Aces, OperatorCount };
+
+  static const float kGamma;
+
+  static const char* name(Operator op);
+  static QVector3D apply(const QVector3D& color, Operator op, float exposure = 1.0f);
+  static QVector3D toLinear(const QVector3D& color);
+};
+
+#endif // TONEMAP_H
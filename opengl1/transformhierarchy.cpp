@@ -0,0 +1,256 @@
+#include "transformhierarchy.h"
+
+#include <algorithm>
+
+static const float kIdentity[16] = { 1.0f, 0.0f, 0.0f, 0.0f,
+                                     0.0f, 1.0f, 0.0f, 0.0f,
+                                     0.0f, 0.0f, 1.0f, 0.0f,
+                                     0.0f, 0.0f, 0.0f, 1.0f };
+
+static const int kPageFloats = 4096 / sizeof(float);
+static const int kLineFloats = 64 / sizeof(float);
+
+const int TransformHierarchy::kNone;
+
+void TransformHierarchy::reserve(int count)
+{
+  parent_.reserve(count);
+  depth_.reserve(count);
+  dirty_.reserve(count);
+  ids_.reserve(count);
+  indexes_.reserve(count);
+  if ( count > capacity_ ) {
+    grow(count);
+  }
+}
+
+void TransformHierarchy::grow(int capacity)
+{
+  int stride = (capacity + kPageFloats - 1) / kPageFloats * kPageFloats + kLineFloats;
+  QVector<float> elements(32 * stride);
+  for ( int e = 0; e < 32; e++ ) {
+    std::copy(elements_.constBegin() + e * stride_, elements_.constBegin() + e * stride_ + count(),
+              elements.begin() + e * stride);
+  }
+  elements_.swap(elements);
+  stride_ = stride;
+  capacity_ = capacity;
+}
+
+int TransformHierarchy::create(int parent)
+{
+  int parentIndex = kNone;
+  int depth = 0;
+  if ( parent != kNone ) {
+    Q_ASSERT(isValid(parent));
+    parentIndex = indexes_.at(parent);
+    depth = depth_.at(parentIndex) + 1;
+  }
+  int id;
+  if ( !freeIds_.isEmpty() ) {
+    id = freeIds_.takeLast();
+  }
+  else {
+    id = indexes_.size();
+    indexes_.append(kNone);
+  }
+  // новый узел в конце массивов - после своего родителя
+  int index = count();
+  if ( index == capacity_ ) {
+    grow(qMax(capacity_ * 2, kPageFloats));
+  }
+  indexes_[id] = index;
+  ids_.append(id);
+  parent_.append(parentIndex);
+  depth_.append(depth);
+  dirty_.append(1);
+  for ( int e = 0; e < 16; e++ ) {
+    localElements(e)[index] = kIdentity[e];
+    worldElements(e)[index] = kIdentity[e];
+  }
+  maxDepth_ = qMax(maxDepth_, depth);
+  firstDirty_ = qMin(firstDirty_, index);
+  return id;
+}
+
+void TransformHierarchy::destroy(int node)
+{
+  destroy(QVector<int>{node});
+}
+
+void TransformHierarchy::destroy(const QVector<int>& nodes)
+{
+  static const int kRemoved = -2;
+  int total = count();
+  int first = total;
+  for ( int node : nodes ) {
+    if ( isValid(node) ) {
+      first = qMin(first, indexes_.at(node));
+    }
+  }
+  if ( first == total ) {
+    return;
+  }
+  bool hadDirty = firstDirty_ < total;
+  // удаляются перечисленные узлы и узлы, чей родитель удаляется; остальные сдвигаются
+  // к началу без смены порядка. Новые индексы узлов от first пишутся в levelNodes_
+  // как во временный массив, поэтому узлы в одном вызове - один проход по массивам
+  levelNodes_.fill(kNone, total - first);
+  for ( int node : nodes ) {
+    if ( isValid(node) ) {
+      levelNodes_[indexes_.at(node) - first] = kRemoved;
+    }
+  }
+  int write = first;
+  maxDepth_ = 0;
+  for ( int i = first; i < total; i++ ) {
+    int parent = parent_.at(i);
+    if ( levelNodes_.at(i - first) == kRemoved || (parent >= first && levelNodes_.at(parent - first) < 0) ) {
+      levelNodes_[i - first] = kRemoved;
+      indexes_[ids_.at(i)] = kNone;
+      freeIds_.append(ids_.at(i));
+      continue;
+    }
+    levelNodes_[i - first] = write;
+    parent_[write] = parent >= first ? levelNodes_.at(parent - first) : parent;
+    depth_[write] = depth_.at(i);
+    dirty_[write] = dirty_.at(i);
+    ids_[write] = ids_.at(i);
+    indexes_[ids_.at(i)] = write;
+    for ( int e = 0; e < 32; e++ ) {
+      elements_[e * stride_ + write] = elements_.at(e * stride_ + i);
+    }
+    write++;
+  }
+  parent_.resize(write);
+  depth_.resize(write);
+  dirty_.resize(write);
+  ids_.resize(write);
+  for ( int depth : depth_ ) {
+    maxDepth_ = qMax(maxDepth_, depth);
+  }
+  firstDirty_ = hadDirty ? qMin(firstDirty_, first) : write;
+}
+
+void TransformHierarchy::clear()
+{
+  parent_.clear();
+  depth_.clear();
+  dirty_.clear();
+  ids_.clear();
+  indexes_.clear();
+  freeIds_.clear();
+  firstDirty_ = 0;
+  maxDepth_ = 0;
+  changed_.clear();
+}
+
+int TransformHierarchy::parent(int node) const
+{
+  int parent = parent_.at(indexes_.at(node));
+  return parent == kNone ? kNone : ids_.at(parent);
+}
+
+void TransformHierarchy::setLocal(int node, const Mat4& local)
+{
+  int index = indexes_.at(node);
+  for ( int e = 0; e < 16; e++ ) {
+    localElements(e)[index] = local.m[e];
+  }
+  dirty_[index] = 1;
+  firstDirty_ = qMin(firstDirty_, index);
+}
+
+Mat4 TransformHierarchy::local(int node) const
+{
+  int index = indexes_.at(node);
+  Mat4 result;
+  for ( int e = 0; e < 16; e++ ) {
+    result.m[e] = localElements(e)[index];
+  }
+  return result;
+}
+
+Mat4 TransformHierarchy::world(int node) const
+{
+  int index = indexes_.at(node);
+  Mat4 result;
+  for ( int e = 0; e < 16; e++ ) {
+    result.m[e] = worldElements(e)[index];
+  }
+  return result;
+}
+
+int TransformHierarchy::update()
+{
+  changed_.clear();
+  int total = count();
+  if ( firstDirty_ >= total ) {
+    firstDirty_ = total;
+    return 0;
+  }
+  // родитель раньше детей, поэтому пометка доходит до всего поддерева за один проход
+  char* dirty = dirty_.data();
+  const int* parent = parent_.constData();
+  const int* depth = depth_.constData();
+  int levels = maxDepth_ + 1;
+  levelStart_.fill(0, levels + 1);
+  int* levelCount = levelStart_.data() + 1;
+  // QVector::operator[] проверяет общий буфер на каждом обращении, в циклах - голые указатели
+  changed_.resize(total - firstDirty_);
+  int* changed = changed_.data();
+  int changedCount = 0;
+  for ( int i = firstDirty_; i < total; i++ ) {
+    if ( !dirty[i] && parent[i] != kNone && dirty[parent[i]] ) {
+      dirty[i] = 1;
+    }
+    if ( dirty[i] ) {
+      changed[changedCount++] = i;
+      levelCount[depth[i]]++;
+    }
+  }
+  changed_.resize(changedCount);
+
+  // устойчивая сортировка подсчётом по глубине: внутри уровня индексы по-прежнему возрастают
+  for ( int d = 0; d < levels; d++ ) {
+    levelStart_[d + 1] += levelStart_.at(d);
+  }
+  levelNodes_.resize(changedCount);
+  levelParents_.resize(changedCount);
+  levelFill_.resize(levels + 1);
+  std::copy(levelStart_.constBegin(), levelStart_.constEnd(), levelFill_.begin());
+  int* fill = levelFill_.data();
+  int* nodes = levelNodes_.data();
+  int* parents = levelParents_.data();
+  for ( int k = 0; k < changedCount; k++ ) {
+    int index = changed[k];
+    int position = fill[depth[index]]++;
+    nodes[position] = index;
+    parents[position] = parent[index];
+  }
+
+  Mat4Streams local;
+  Mat4Streams world;
+  for ( int e = 0; e < 16; e++ ) {
+    local.m[e] = localElements(e);
+    world.m[e] = worldElements(e);
+  }
+  for ( int k = 0; k < levelStart_.at(1); k++ ) {
+    int index = nodes[k];
+    for ( int e = 0; e < 16; e++ ) {
+      world.m[e][index] = local.m[e][index];
+    }
+  }
+  for ( int d = 1; d < levels; d++ ) {
+    int begin = levelStart_.at(d);
+    SimdMath::multiplyParents(local, world, nodes + begin, parents + begin, levelStart_.at(d + 1) - begin);
+  }
+
+  const int* ids = ids_.constData();
+  for ( int k = 0; k < changedCount; k++ ) {
+    dirty[changed[k]] = 0;
+    changed[k] = ids[changed[k]];
+  }
+  firstDirty_ = total;
+  return changedCount;
+}
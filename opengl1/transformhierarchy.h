@@ -0,0 +1,81 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <QVector>
+#include <QMatrix4x4>
+
+#include "simdmath.h"
+
+// Иерархия трансформаций. Узлы лежат в плотных массивах, родитель всегда раньше детей;
+// локальные и мировые матрицы хранятся по элементам (SoA, 16 массивов float).
+// setLocal только помечает узел, update() одним линейным проходом распространяет пометку
+// на поддеревья и пересчитывает помеченные узлы по уровням глубины пакетами SimdMath -
+// родители уровня уже посчитаны на предыдущем шаге. Снаружи узлы адресуются постоянными id,
+// плотный индекс меняется при удалении.
+class TransformHierarchy
+{
+public:
+  static const int kNone = -1;
+
+  TransformHierarchy() = default;
+  TransformHierarchy(const TransformHierarchy&) = delete;
+
+  TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+  void reserve(int count);
+  // узел с единичной локальной матрицей; parent - id или kNone
+  int create(int parent = kNone);
+  // удаляет узел вместе с поддеревом
+  void destroy(int node);
+  // то же для многих узлов сразу - за один проход по массивам
+  void destroy(const QVector<int>& nodes);
+  void clear();
+  bool isValid(int node) const { return node >= 0 && node < indexes_.size() && indexes_.at(node) != kNone; }
+  int count() const { return parent_.size(); }
+  int parent(int node) const;
+
+  void setLocal(int node, const Mat4& local);
+  void setLocal(int node, const QMatrix4x4& local) { setLocal(node, SimdMath::fromQt(local)); }
+  Mat4 local(int node) const;
+  // мировая матрица на момент последнего update()
+  Mat4 world(int node) const;
+  QMatrix4x4 worldMatrix(int node) const { return SimdMath::toQt(world(node)); }
+
+  // пересчитывает помеченные поддеревья, возвращает число пересчитанных узлов
+  int update();
+  // id узлов, пересчитанных последним update(): заново отправлять нужно только их матрицы
+  const QVector<int>& changed() const { return changed_; }
+
+private:
+  void grow(int capacity);
+  float* localElements(int e) { return elements_.data() + e * stride_; }
+  float* worldElements(int e) { return elements_.data() + (16 + e) * stride_; }
+  const float* localElements(int e) const { return elements_.constData() + e * stride_; }
+  const float* worldElements(int e) const { return elements_.constData() + (16 + e) * stride_; }
+
+private:
+  // по плотному индексу
+  QVector<int> parent_;
+  QVector<int> depth_;
+  QVector<char> dirty_;
+  QVector<int> ids_;
+  // 32 массива по stride_ float: 16 элементов локальных матриц, затем 16 мировых.
+  // Шаг кратен 4 КБ плюс строка кэша, иначе начала массивов попадают в один набор кэша
+  QVector<float> elements_;
+  int stride_ = 0;
+  int capacity_ = 0;
+  // по id, kNone - свободный id
+  QVector<int> indexes_;
+  QVector<int> freeIds_;
+  // раньше этого индекса помеченных узлов нет
+  int firstDirty_ = 0;
+  int maxDepth_ = 0;
+  QVector<int> changed_;
+  // помеченные узлы, разложенные по уровням
+  QVector<int> levelStart_;
+  QVector<int> levelFill_;
+  QVector<int> levelNodes_;
+  QVector<int> levelParents_;
+};
+
+#endif // TRANSFORMHIERARCHY_H
@@ -0,0 +1,185 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include <cmath>
+
+#include "oglobject.h"
+#include "pathtracer.h"
+#include "rasterizer.h"
+#include "jobsystem.h"
+
+// Кадр без GPU, для сборочных машин без GL:
+//   reference [--raster] [--aces] <модель.obj> <выход.png> [проходов] [ширина] [высота] [каталог неба]
+// Модель разбирается тем же кодом, что в opengl1 (obj и mtl, параметры и карты материалов),
+// камера смотрит на неё спереди сверху, свет - направленный, как в OpenglWidget. В каталоге
+// неба ищутся right/left/top/bottom/front/back.jpg, как в textures/cubes/skybox.
+// По умолчанию - эталон трассировкой путей; с --raster кадр рисует SoftwareRasterizer
+// (как fPBRShader.frag), проходы - повторы кадра для замера времени. Тонмаппинг - Рейнхард,
+// с --aces - ACES, как в fTonemapShader.frag.
+static const int kDefaultPasses = 256;
+static const int kDefaultWidth = 800;
+static const int kDefaultHeight = 600;
+static const int kSaveEvery = 32;
+static const int kDefaultRasterFrames = 16;
+static const float kFieldOfView = 45.0f;
+static const QVector3D kLightDirection{0.55f, -1.0f, 1.0f};
+static const QVector3D kLightColor{0.4f, 0.4f, 0.4f};
+static const QStringList kSkyBoxFaces{ "right.jpg", "left.jpg", "top.jpg", "bottom.jpg", "front.jpg", "back.jpg" };
+
+namespace {
+
+int argument(const QStringList& arguments, int index, int fallback)
+{
+  return arguments.size() > index ? qMax(1, arguments.at(index).toInt()) : fallback;
+}
+
+// материалы всех mtl-библиотек модели по имени, как их собирает OGLObject::loadMtl
+QHash<QString, CpuScene::Surface> loadSurfaces(const QString& path, const QStringList& libraries)
+{
+  QHash<QString, CpuScene::Surface> surfaces;
+  QString directory = QFileInfo(path).absolutePath();
+  for ( const auto& library : libraries ) {
+    QString libraryPath = directory + QDir::separator() + library;
+    QFile file{libraryPath};
+    if ( !file.open(QFile::ReadOnly) ) {
+      qDebug() << QString("mtl %1 not open").arg(libraryPath);
+      continue;
+    }
+    for ( const auto& material : OGLObject::parseMtl(file.readAll(), QFileInfo(libraryPath).absolutePath()) ) {
+      CpuScene::Surface surface;
+      surface.albedo = material.ambientColor;
+      // Material не задаёт metallic и roughness из mtl, у шейдера без карт они нулевые
+      surface.metallic = 0.0f;
+      surface.roughness = 0.0f;
+      for ( const auto& map : material.maps ) {
+        // как у StreamedTexture: изображение без отражения по вертикали
+        QImage image{map.path};
+        switch ( map.type ) {
+          case ( Material::Albedo ): {
+            surface.albedoMap = image;
+            break;
+          }
+          case ( Material::Normal ): {
+            surface.normalMap = image;
+            break;
+          }
+          case ( Material::Metallic ): {
+            surface.metallicMap = image;
+            break;
+          }
+          case ( Material::Roughness ): {
+            surface.roughnessMap = image;
+            break;
+          }
+          default: {
+            break;
+          }
+        }
+      }
+      surfaces.insert(material.name, surface);
+    }
+  }
+  return surfaces;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication application(argc, argv);
+  QStringList arguments = application.arguments();
+  bool raster = arguments.removeAll(QString("--raster")) > 0;
+  Tonemap::Operator tonemap = arguments.removeAll(QString("--aces")) > 0 ? Tonemap::Aces : Tonemap::Reinhard;
+  if ( arguments.size() < 3 ) {
+    qDebug() << "usage: reference [--raster] [--aces] <model.obj> <output.png> [passes] [width] [height] [skybox directory]";
+    return 1;
+  }
+  QString modelPath = arguments.at(1);
+  QString outputPath = arguments.at(2);
+  int passes = argument(arguments, 3, raster ? kDefaultRasterFrames : kDefaultPasses);
+  int width = argument(arguments, 4, kDefaultWidth);
+  int height = argument(arguments, 5, kDefaultHeight);
+
+  QStringList libraries;
+  QVector<OGLObject::ObjMesh> meshes;
+  if ( !OGLObject::parse(modelPath, libraries, meshes) || meshes.isEmpty() ) {
+    qDebug() << QString("model %1 not loaded").arg(modelPath);
+    return 1;
+  }
+  QHash<QString, CpuScene::Surface> surfaces = loadSurfaces(modelPath, libraries);
+
+  auto scene = std::make_shared<CpuScene>();
+  BoundingBox bounds;
+  for ( const auto& mesh : meshes ) {
+    for ( const auto& vertex : mesh.vertexes ) {
+      bounds.extend(vertex.position);
+    }
+    scene->addMesh(mesh.vertexes, mesh.indexes, QMatrix4x4(), surfaces.value(mesh.material));
+  }
+  scene->setDirectionalLight(kLightDirection, kLightColor);
+  if ( arguments.size() > 6 ) {
+    QVector<QImage> faces;
+    for ( const auto& face : kSkyBoxFaces ) {
+      faces.append(QImage(arguments.at(6) + QDir::separator() + face));
+    }
+    scene->setEnvironment(faces);
+  }
+
+  // вся модель в кадре: отходим на радиус описанной сферы с запасом по углу обзора
+  QVector3D center = bounds.center();
+  float radius = qMax(bounds.size().length() * 0.5f, 1.0e-3f);
+  float distance = radius / std::sin(qDegreesToRadians(kFieldOfView * 0.5f));
+  QVector3D eye = center + QVector3D{0.0f, 0.5f, 1.0f}.normalized() * distance;
+  QMatrix4x4 view;
+  view.lookAt(eye, center, QVector3D{0.0f, 1.0f, 0.0f});
+  QMatrix4x4 projection;
+  projection.perspective(kFieldOfView, float(width) / float(height), distance * 0.01f, distance + radius * 2.0f);
+
+  if ( raster ) {
+    SoftwareRasterizer rasterizer;
+    rasterizer.setScene(scene);
+    rasterizer.setView(view, projection);
+    rasterizer.setTonemap(tonemap, 1.0f);
+    rasterizer.resize(width, height);
+    qDebug() << QString("%1: %2 triangles, %3, %4 threads").arg(modelPath).arg(int(scene->triangles().size()))
+                .arg(SoftwareRasterizer::backend()).arg(JobSystem::instance().threadCount() + 1);
+    float totalMs = 0.0f;
+    for ( int frame = 0; frame < passes; frame++ ) {
+      rasterizer.render();
+      totalMs += rasterizer.frameMs();
+    }
+    if ( !rasterizer.image().save(outputPath) ) {
+      qDebug() << QString("image %1 not written").arg(outputPath);
+      return 1;
+    }
+    qDebug() << QString("%1 frames, %2 ms/frame, %3 tris binned, %4 pixels shaded").arg(passes)
+                .arg(double(totalMs) / passes, 0, 'f', 2).arg(rasterizer.trianglesBinned()).arg(rasterizer.pixelsShaded());
+    return 0;
+  }
+
+  PathTracer tracer;
+  tracer.setScene(scene);
+  tracer.build();
+  tracer.setView(view, projection);
+  tracer.setTonemap(tonemap, 1.0f);
+  tracer.resize(width, height);
+  qDebug() << QString("%1: %2 triangles, BVH %3, %4 threads").arg(modelPath).arg(tracer.triangleCount())
+              .arg(Bvh::backend()).arg(JobSystem::instance().threadCount() + 1);
+
+  for ( int pass = 1; pass <= passes; pass++ ) {
+    tracer.renderPass();
+    if ( pass % kSaveEvery == 0 || pass == passes ) {
+      if ( !tracer.image().save(outputPath) ) {
+        qDebug() << QString("image %1 not written").arg(outputPath);
+        return 1;
+      }
+      qDebug() << QString("%1 spp, %2 Msamples/s, %3 Mrays/s").arg(tracer.passes())
+                  .arg(tracer.samplesPerSecond() / 1.0e6, 0, 'f', 2).arg(tracer.raysPerSecond() / 1.0e6, 0, 'f', 2);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,60 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = reference
+TEMPLATE = app
+DESTDIR = ~/build_dir/opengl
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# разбор моделей, трассировщик и растеризатор - код движка, контекст GL не создаётся
+INCLUDEPATH += ../opengl1
+
+SOURCES += \
+        main.cpp \
+    ../opengl1/cpuscene.cpp \
+    ../opengl1/tonemap.cpp \
+    ../opengl1/pathtracer.cpp \
+    ../opengl1/rasterizer.cpp \
+    ../opengl1/bvh.cpp \
+    ../opengl1/assetarchive.cpp \
+    ../opengl1/oglobject.cpp \
+    ../opengl1/outofcoremodel.cpp \
+    ../opengl1/occlusionculler.cpp \
+    ../opengl1/mesh.cpp \
+    ../opengl1/material.cpp \
+    ../opengl1/texturestreamer.cpp \
+    ../opengl1/gpumemory.cpp \
+    ../opengl1/meshsimplifier.cpp \
+    ../opengl1/meshlet.cpp \
+    ../opengl1/indexoptimizer.cpp \
+    ../opengl1/framearena.cpp \
+    ../opengl1/structs.cpp \
+    ../opengl1/jobsystem.cpp \
+    ../opengl1/geometrycodec.cpp
+
+HEADERS += \
+    ../opengl1/cpuscene.h \
+    ../opengl1/tonemap.h \
+    ../opengl1/pathtracer.h \
+    ../opengl1/rasterizer.h \
+    ../opengl1/bvh.h \
+    ../opengl1/simd4.h \
+    ../opengl1/assetarchive.h \
+    ../opengl1/oglobject.h \
+    ../opengl1/outofcoremodel.h \
+    ../opengl1/occlusionculler.h \
+    ../opengl1/mesh.h \
+    ../opengl1/material.h \
+    ../opengl1/texturestreamer.h \
+    ../opengl1/gpumemory.h \
+    ../opengl1/meshsimplifier.h \
+    ../opengl1/meshlet.h \
+    ../opengl1/indexoptimizer.h \
+    ../opengl1/framearena.h \
+    ../opengl1/structs.h \
+    ../opengl1/jobsystem.h \
+    ../opengl1/geometrycodec.h
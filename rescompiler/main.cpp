@@ -0,0 +1,176 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
+#include <QTextStream>
+
+#include "assetarchive.h"
+#include "oglobject.h"
+#include "texturestreamer.h"
+#include "texturecompressor.h"
+
+static const QStringList kShaderSuffixes{ "vert", "frag", "geom", "glsl" };
+static const QStringList kImageSuffixes{ "png", "jpg", "jpeg", "bmp", "tga" };
+
+// Сборка архива ресурсов для opengl1:
+//   rescompiler [--deflate] <архив> <каталог>...
+// Имена ресурсов - пути относительно переданного каталога (для ../opengl1 - "shaders/...",
+// "textures/...", "models/..."), как в sources.qrc. Модели собираются заранее (склейка вершин,
+// порядок под кэш, кластеры, LOD), текстуры материалов кладутся цепочкой мипов RGBA8 для
+// стриминга, остальные изображения - цепочкой мипов BC1/BC3, шейдеры и mtl - текстом.
+// Геометрия моделей сжимается GeometryCodec, с --deflate поверх ещё и zlib: архив меньше,
+// но распаковка при загрузке медленнее - имеет смысл для медленных дисков и сети.
+// Архив кладётся рядом с программой под именем assets.pak. Файл, открытый с диска, берётся
+// из архива, только если его путь относительно каталога архива совпадает с именем ресурса.
+
+namespace {
+
+struct Counters
+{
+  int shaders = 0;
+  int models = 0;
+  int textures = 0;
+  int compressed = 0;
+  int skipped = 0;
+  GeometryCodec::Compression compression = GeometryCodec::NoCompression;
+  GeometryCodec::Stats geometry;
+};
+
+// текстуры, на которые ссылаются mtl-файлы: их стримит TextureStreamer, которому нужен RGBA8
+QSet<QString> materialTextures(const QStringList& files)
+{
+  QSet<QString> textures;
+  for ( const auto& path : files ) {
+    if ( QFileInfo(path).suffix().toLower() != QString("mtl") ) {
+      continue;
+    }
+    QFile file{path};
+    if ( !file.open(QFile::ReadOnly) ) {
+      continue;
+    }
+    QTextStream stream{&file};
+    QString directory = QFileInfo(path).absolutePath();
+    while ( !stream.atEnd() ) {
+      QStringList tokenList{stream.readLine().split(" ")};
+      if ( tokenList.size() > 1 && tokenList.first().startsWith(QString("map_")) ) {
+        tokenList.removeFirst();
+        textures.insert(QDir::cleanPath(directory + QDir::separator() + tokenList.join(" ")));
+      }
+    }
+  }
+  return textures;
+}
+
+bool addImage(AssetArchiveWriter& writer, const QString& name, const QString& path, bool material, Counters& counters)
+{
+  QImage image{path};
+  if ( image.isNull() ) {
+    qDebug() << QString("image %1 not loaded").arg(path);
+    return false;
+  }
+  QVector<QImage> mips = StreamedTexture::buildMipChain(image);
+  QVector<QByteArray> data;
+  AssetArchive::Format format = AssetArchive::RGBA8;
+  if ( material ) {
+    for ( const auto& mip : mips ) {
+      data.append(QByteArray(reinterpret_cast<const char*>(mip.constBits()), mip.bytesPerLine() * mip.height()));
+    }
+  }
+  else {
+    format = TextureCompressor::hasAlpha(image) ? AssetArchive::BC3 : AssetArchive::BC1;
+    for ( const auto& mip : mips ) {
+      data.append(TextureCompressor::compress(mip, format));
+    }
+    counters.compressed++;
+  }
+  counters.textures++;
+  return writer.addTexture(name, format, image.width(), image.height(), data);
+}
+
+bool addDirectory(AssetArchiveWriter& writer, const QString& root, Counters& counters)
+{
+  QDir rootDir{root};
+  QStringList files;
+  QDirIterator iterator{root, QDir::Files, QDirIterator::Subdirectories};
+  while ( iterator.hasNext() ) {
+    files.append(QDir::cleanPath(QFileInfo(iterator.next()).absoluteFilePath()));
+  }
+  files.sort();
+  QSet<QString> textures = materialTextures(files);
+
+  for ( const auto& path : files ) {
+    QFileInfo info{path};
+    QString name = rootDir.relativeFilePath(path);
+    QString suffix = info.suffix().toLower();
+    bool ok = true;
+    if ( kShaderSuffixes.contains(suffix) || suffix == QString("mtl") ) {
+      QFile file{path};
+      ok = file.open(QFile::ReadOnly) && writer.addText(name, file.readAll());
+      counters.shaders += kShaderSuffixes.contains(suffix) ? 1 : 0;
+    }
+    else if ( suffix == QString("obj") ) {
+      if ( info.size() > OutOfCoreModel::kFileSizeThreshold ) {
+        // такие файлы раскладывает по кускам OutOfCoreModel
+        qDebug() << QString("model %1 is too large, skipped").arg(name);
+        counters.skipped++;
+        continue;
+      }
+      QByteArray model = OGLObject::bake(path, counters.compression, &counters.geometry);
+      ok = !model.isEmpty() && writer.addModel(name, model);
+      counters.models++;
+    }
+    else if ( kImageSuffixes.contains(suffix) ) {
+      ok = addImage(writer, name, path, textures.contains(path), counters);
+    }
+    else {
+      continue;
+    }
+    if ( !ok ) {
+      qDebug() << QString("resource %1 not added").arg(path);
+      return false;
+    }
+    qDebug() << QString("added %1").arg(name);
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication application(argc, argv);
+  QStringList arguments = application.arguments();
+  Counters counters;
+  if ( arguments.removeAll(QString("--deflate")) > 0 ) {
+    counters.compression = GeometryCodec::Deflate;
+  }
+  if ( arguments.size() < 3 ) {
+    qDebug() << "usage: rescompiler [--deflate] <archive> <directory>...";
+    return 1;
+  }
+  AssetArchiveWriter writer;
+  if ( !writer.open(arguments.at(1)) ) {
+    return 1;
+  }
+  for ( int i = 2; i < arguments.size(); i++ ) {
+    if ( !addDirectory(writer, arguments.at(i), counters) ) {
+      return 1;
+    }
+  }
+  if ( !writer.finish() ) {
+    qDebug() << QString("archive %1 not written").arg(arguments.at(1));
+    return 1;
+  }
+  qDebug() << QString("%1: %2 shaders, %3 models, %4 textures (%5 compressed), %6 skipped, %7 MB")
+              .arg(arguments.at(1)).arg(counters.shaders).arg(counters.models).arg(counters.textures)
+              .arg(counters.compressed).arg(counters.skipped).arg(double(QFileInfo(arguments.at(1)).size()) / (1024 * 1024), 0, 'f', 1);
+  if ( counters.geometry.rawBytes > 0 ) {
+    qDebug() << QString("geometry (%1): %2 KB -> %3 KB, x%4")
+                .arg(counters.compression == GeometryCodec::Deflate ? "codec + deflate" : "codec")
+                .arg(counters.geometry.rawBytes / 1024).arg(counters.geometry.encodedBytes / 1024)
+                .arg(counters.geometry.ratio(), 0, 'f', 2);
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+QT       += core gui
+QT       -= widgets
+
+TARGET = rescompiler
+TEMPLATE = app
+DESTDIR = ~/build_dir/opengl
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# модели собираются кодом движка, формат архива общий с программой
+INCLUDEPATH += ../opengl1
+
+SOURCES += \
+        main.cpp \
+    texturecompressor.cpp \
+    ../opengl1/assetarchive.cpp \
+    ../opengl1/oglobject.cpp \
+    ../opengl1/outofcoremodel.cpp \
+    ../opengl1/occlusionculler.cpp \
+    ../opengl1/mesh.cpp \
+    ../opengl1/material.cpp \
+    ../opengl1/texturestreamer.cpp \
+    ../opengl1/gpumemory.cpp \
+    ../opengl1/meshsimplifier.cpp \
+    ../opengl1/meshlet.cpp \
+    ../opengl1/indexoptimizer.cpp \
+    ../opengl1/framearena.cpp \
+    ../opengl1/structs.cpp \
+    ../opengl1/jobsystem.cpp \
+    ../opengl1/geometrycodec.cpp
+
+HEADERS += \
+    texturecompressor.h \
+    ../opengl1/assetarchive.h \
+    ../opengl1/oglobject.h \
+    ../opengl1/outofcoremodel.h \
+    ../opengl1/occlusionculler.h \
+    ../opengl1/mesh.h \
+    ../opengl1/material.h \
+    ../opengl1/texturestreamer.h \
+    ../opengl1/gpumemory.h \
+    ../opengl1/meshsimplifier.h \
+    ../opengl1/meshlet.h \
+    ../opengl1/indexoptimizer.h \
+    ../opengl1/framearena.h \
+    ../opengl1/structs.h \
+    ../opengl1/jobsystem.h \
+    ../opengl1/geometrycodec.h
@@ -0,0 +1,207 @@
+#include "texturecompressor.h"
+#include "jobsystem.h"
+
+#include <cstring>
+#include <utility>
+
+static const int kBlockPixels = 16;
+// итераций степенного метода для главной оси цветов блока
+static const int kAxisIterations = 4;
+
+namespace {
+
+quint16 packColor(const float* color)
+{
+  int r = qBound(0, int(color[0] * 31.0f / 255.0f + 0.5f), 31);
+  int g = qBound(0, int(color[1] * 63.0f / 255.0f + 0.5f), 63);
+  int b = qBound(0, int(color[2] * 31.0f / 255.0f + 0.5f), 31);
+  return quint16((r << 11) | (g << 5) | b);
+}
+
+void unpackColor(quint16 packed, int* color)
+{
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+}
+
+bool TextureCompressor::hasAlpha(const QImage& image)
+{
+  if ( !image.hasAlphaChannel() ) {
+    return false;
+  }
+  QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+  for ( int y = 0; y < rgba.height(); y++ ) {
+    const uchar* line = rgba.constScanLine(y);
+    for ( int x = 0; x < rgba.width(); x++ ) {
+      if ( line[x * 4 + 3] != 255 ) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+QByteArray TextureCompressor::compress(const QImage& image, AssetArchive::Format format)
+{
+  int width = image.width();
+  int height = image.height();
+  int blockBytes = format == AssetArchive::BC1 ? 8 : 16;
+  int blocksX = (width + 3) / 4;
+  int blocksY = (height + 3) / 4;
+  QByteArray result(int(AssetArchive::mipBytes(format, width, height)), Qt::Uninitialized);
+  uchar* target = reinterpret_cast<uchar*>(result.data());
+  // строки блоков независимы
+  JobSystem::instance().parallelFor(blocksY, 1, [&]( int begin, int end ) {
+    uchar pixels[kBlockPixels * 4];
+    for ( int by = begin; by < end; by++ ) {
+      for ( int bx = 0; bx < blocksX; bx++ ) {
+        for ( int i = 0; i < kBlockPixels; i++ ) {
+          int x = qMin(bx * 4 + i % 4, width - 1);
+          int y = qMin(by * 4 + i / 4, height - 1);
+          std::memcpy(pixels + i * 4, image.constScanLine(y) + x * 4, 4);
+        }
+        uchar* block = target + (by * blocksX + bx) * blockBytes;
+        if ( format == AssetArchive::BC3 ) {
+          encodeAlphaBlock(pixels, block);
+          block += 8;
+        }
+        encodeColorBlock(pixels, block);
+      }
+    }
+  });
+  return result;
+}
+
+void TextureCompressor::encodeColorBlock(const uchar* pixels, uchar* block)
+{
+  float mean[3] = { 0.0f, 0.0f, 0.0f };
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    for ( int c = 0; c < 3; c++ ) {
+      mean[c] += pixels[i * 4 + c] / float(kBlockPixels);
+    }
+  }
+  float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    float r = pixels[i * 4] - mean[0];
+    float g = pixels[i * 4 + 1] - mean[1];
+    float b = pixels[i * 4 + 2] - mean[2];
+    covariance[0] += r * r;
+    covariance[1] += r * g;
+    covariance[2] += r * b;
+    covariance[3] += g * g;
+    covariance[4] += g * b;
+    covariance[5] += b * b;
+  }
+  float axis[3] = { 1.0f, 1.0f, 1.0f };
+  for ( int iteration = 0; iteration < kAxisIterations; iteration++ ) {
+    float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+    float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+    float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+    float length = qMax(qMax(qAbs(x), qAbs(y)), qAbs(z));
+    if ( length <= 0.0f ) {
+      break;
+    }
+    axis[0] = x / length;
+    axis[1] = y / length;
+    axis[2] = z / length;
+  }
+
+  int minIndex = 0;
+  int maxIndex = 0;
+  float minProjection = 0.0f;
+  float maxProjection = 0.0f;
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    float projection = pixels[i * 4] * axis[0] + pixels[i * 4 + 1] * axis[1] + pixels[i * 4 + 2] * axis[2];
+    if ( i == 0 || projection < minProjection ) {
+      minProjection = projection;
+      minIndex = i;
+    }
+    if ( i == 0 || projection > maxProjection ) {
+      maxProjection = projection;
+      maxIndex = i;
+    }
+  }
+  float maxColor[3] = { float(pixels[maxIndex * 4]), float(pixels[maxIndex * 4 + 1]), float(pixels[maxIndex * 4 + 2]) };
+  float minColor[3] = { float(pixels[minIndex * 4]), float(pixels[minIndex * 4 + 1]), float(pixels[minIndex * 4 + 2]) };
+  quint16 color0 = packColor(maxColor);
+  quint16 color1 = packColor(minColor);
+  // режим четырёх цветов требует color0 > color1
+  if ( color0 < color1 ) {
+    std::swap(color0, color1);
+  }
+  block[0] = uchar(color0 & 0xff);
+  block[1] = uchar(color0 >> 8);
+  block[2] = uchar(color1 & 0xff);
+  block[3] = uchar(color1 >> 8);
+  std::memset(block + 4, 0, 4);
+  if ( color0 == color1 ) {
+    return;
+  }
+
+  int palette[4][3];
+  unpackColor(color0, palette[0]);
+  unpackColor(color1, palette[1]);
+  for ( int c = 0; c < 3; c++ ) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    int best = 0;
+    int bestDistance = 0;
+    for ( int p = 0; p < 4; p++ ) {
+      int distance = 0;
+      for ( int c = 0; c < 3; c++ ) {
+        int delta = pixels[i * 4 + c] - palette[p][c];
+        distance += delta * delta;
+      }
+      if ( p == 0 || distance < bestDistance ) {
+        best = p;
+        bestDistance = distance;
+      }
+    }
+    block[4 + i / 4] |= uchar(best << (2 * (i % 4)));
+  }
+}
+
+void TextureCompressor::encodeAlphaBlock(const uchar* pixels, uchar* block)
+{
+  int alpha0 = 0;
+  int alpha1 = 255;
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    alpha0 = qMax(alpha0, int(pixels[i * 4 + 3]));
+    alpha1 = qMin(alpha1, int(pixels[i * 4 + 3]));
+  }
+  block[0] = uchar(alpha0);
+  block[1] = uchar(alpha1);
+  std::memset(block + 2, 0, 6);
+  if ( alpha0 == alpha1 ) {
+    return;
+  }
+
+  // при alpha0 > alpha1 восемь значений: два конца и шесть промежуточных
+  int palette[8];
+  palette[0] = alpha0;
+  palette[1] = alpha1;
+  for ( int i = 1; i < 7; i++ ) {
+    palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+  }
+  quint64 bits = 0;
+  for ( int i = 0; i < kBlockPixels; i++ ) {
+    int best = 0;
+    for ( int p = 1; p < 8; p++ ) {
+      if ( qAbs(pixels[i * 4 + 3] - palette[p]) < qAbs(pixels[i * 4 + 3] - palette[best]) ) {
+        best = p;
+      }
+    }
+    bits |= quint64(best) << (3 * i);
+  }
+  for ( int i = 0; i < 6; i++ ) {
+    block[2 + i] = uchar(bits >> (8 * i));
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include <QByteArray>
+#include <QImage>
+
+#include "assetarchive.h"
+
+// Сжатие RGBA8 в блоки S3TC: BC1 для непрозрачных изображений, BC3 - с альфой.
+// Концы отрезка цвета - крайние пиксели блока по главной оси их разброса.
+class TextureCompressor
+{
+public:
+  static bool hasAlpha(const QImage& image);
+  // image - в формате RGBA8888; края изображений не кратных 4 дополняются повтором пикселей
+  static QByteArray compress(const QImage& image, AssetArchive::Format format);
+
+private:
+  static void encodeColorBlock(const uchar* pixels, uchar* block);
+  static void encodeAlphaBlock(const uchar* pixels, uchar* block);
+};
+
+#endif // TEXTURECOMPRESSOR_H